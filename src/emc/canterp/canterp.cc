@@ -84,6 +84,7 @@ public:
     int read(const char *line);
     int close();
     int reset();
+    int restore(int start_line);
     int line();
     int call_level();
     char *command(char *buf, size_t buflen);
@@ -687,6 +688,7 @@ int Canterp::close() {
 int Canterp::exit() { return 0; }
 int Canterp::synch() { return 0; }
 int Canterp::reset() { return 0; }
+int Canterp::restore(int start_line) { return 0; }
 int Canterp::line() { return 0; }
 int Canterp::call_level() { return 0; }
 
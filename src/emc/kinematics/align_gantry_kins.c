@@ -26,6 +26,9 @@
 // FILE *dptrace = fopen("dptrace.log","w");
 static FILE *dptrace;
 #endif
+#include "dptrace_ring.h"
+static dpt_ring_t *trace;	/* kinematicsForward/Inverse trace ring */
+static int trace_shmem_id = -1;
 
 typedef struct {
     // hal_float_t *theta; // unit: rad
@@ -64,9 +67,8 @@ int kinematicsForward(const double *joints,
     // pos->b = joints[5];
     // pos->c = joints[6];
 
-    DP("kFWD: x(%f), y(%f), j0(%f), j1(%f), j2(%f), yy_offset(%f),POLARITY(%f)\n",
-        pos->tran.x, pos->tran.y, joints[0], joints[1], joints[2], YY_OFFSET, GANTRY_POLARITY);
-    DP("kFWD: s(%f), j5(%f)\n", pos->s, joints[5]);
+    DPT(trace, DPT_KINS_FWD, 0, pos->tran.x, pos->tran.y, pos->tran.z,
+        joints[2]);
 
     return 0;
 }
@@ -87,9 +89,8 @@ int kinematicsInverse(const EmcPose * pos,
     // joints[6] = pos->u;
     // joints[7] = pos->v;
     // joints[8] = pos->w;
-    DP("kINV: x(%f), y(%f), j0(%f), j1(%f), j2(%f), yy_offset(%f)\n",
-       pos->tran.x, pos->tran.y, joints[0], joints[1], joints[2], YY_OFFSET);
-    DP("kINV: s(%f), j5(%f)\n", pos->s, joints[5]);
+    DPT(trace, DPT_KINS_INV, 0, pos->tran.x, pos->tran.y, pos->tran.z,
+        joints[2]);
 
     return 0;
 }
@@ -147,6 +148,7 @@ int rtapi_app_main(void)
     }
     GANTRY_POLARITY = 1.0;
 
+    trace_shmem_id = dpt_open(&trace, DPT_RING_KINS, comp_id);
     hal_ready(comp_id);
     DP ("success\n");
     return 0;
@@ -160,4 +162,10 @@ error:
     return res;
 }
 
-void rtapi_app_exit(void) { hal_exit(comp_id); }
+void rtapi_app_exit(void)
+{
+    if (trace_shmem_id >= 0) {
+        rtapi_shmem_delete(trace_shmem_id, comp_id);
+    }
+    hal_exit(comp_id);
+}
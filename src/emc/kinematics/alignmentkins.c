@@ -26,6 +26,9 @@
 // FILE *dptrace = fopen("dptrace.log","w");
 static FILE *dptrace;
 #endif
+#include "dptrace_ring.h"
+static dpt_ring_t *trace;	/* kinematicsForward/Inverse trace ring */
+static int trace_shmem_id = -1;
 
 typedef struct {
     hal_float_t *theta; // unit: rad
@@ -101,8 +104,8 @@ int kinematicsForward(const double *joints,
     // pos->v = joints[7];
     // pos->w = joints[8];
 
-    DP("kFWD: theta(%f), j0(%f), j1(%f), x(%f), y(%f)\n",
-       THETA, joints[0], joints[1], pos->tran.x, pos->tran.y);
+    DPT(trace, DPT_KINS_FWD, 0, pos->tran.x, pos->tran.y, pos->tran.z,
+        THETA);
 
     return 0;
 }
@@ -127,8 +130,8 @@ int kinematicsInverse(const EmcPose * pos,
     // joints[7] = pos->v;
     // joints[8] = pos->w;
 
-    DP("kINV: theta(%f), j0(%f), j1(%f), x(%f), y(%f)\n",
-       THETA, joints[0], joints[1], pos->tran.x, pos->tran.y);
+    DPT(trace, DPT_KINS_INV, 0, pos->tran.x, pos->tran.y, pos->tran.z,
+        THETA);
 
     return 0;
 }
@@ -187,6 +190,7 @@ int rtapi_app_main(void)
     // align_pins->theta = 0;
     // align_pins->theta = 0.78539815;   // 45 degree
 
+    trace_shmem_id = dpt_open(&trace, DPT_RING_KINS, comp_id);
     hal_ready(comp_id);
     DP ("success\n");
     return 0;
@@ -199,4 +203,10 @@ error:
     return res;
 }
 
-void rtapi_app_exit(void) { hal_exit(comp_id); }
+void rtapi_app_exit(void)
+{
+    if (trace_shmem_id >= 0) {
+        rtapi_shmem_delete(trace_shmem_id, comp_id);
+    }
+    hal_exit(comp_id);
+}
@@ -28,6 +28,9 @@
 // FILE *dptrace = fopen("dptrace.log","w");
 static FILE *dptrace;
 #endif
+#include "dptrace_ring.h"
+static dpt_ring_t *trace;	/* kinematicsForward/Inverse trace ring */
+static int trace_shmem_id = -1;
 
 const char *machine_type = "";
 RTAPI_MP_STRING(machine_type, "Tapping Machine Type");
@@ -50,9 +53,8 @@ int kinematicsForward(const double *joints,
     pos->w = joints[4];
     pos->s = joints[5];
 
-    DP("kFWD: x(%f), y(%f), j0(%f), j1(%f), j2(%f)\n",
-        pos->tran.x, pos->tran.y, joints[0], joints[1], joints[2]);
-    DP("kFWD: s(%f), j5(%f)\n", pos->s, joints[5]);
+    DPT(trace, DPT_KINS_FWD, 0, pos->tran.x, pos->tran.y, pos->tran.z,
+        pos->s);
 
     return 0;
 }
@@ -69,9 +71,8 @@ int kinematicsInverse(const EmcPose * pos,
     joints[4] = pos->w;
     joints[5] = pos->s;
     // fprintf(stderr,"kI j0(%f) j1(%f)\n",joints[0], joints[1]);
-    DP("kINV: x(%f), y(%f), j0(%f), j1(%f), j2(%f)\n",
-       pos->tran.x, pos->tran.y, joints[0], joints[1], joints[2]);
-    DP("kINV: s(%f), j5(%f)\n", pos->s, joints[5]);
+    DPT(trace, DPT_KINS_INV, 0, pos->tran.x, pos->tran.y, pos->tran.z,
+        pos->s);
 
     return 0;
 }
@@ -110,9 +111,16 @@ int rtapi_app_main(void)
     }
     
     /* export param for scaled velocity (frequency in Hz) */
+    trace_shmem_id = dpt_open(&trace, DPT_RING_KINS, comp_id);
     hal_ready(comp_id);
     DP ("success\n");
     return 0;
 }
 
-void rtapi_app_exit(void) { hal_exit(comp_id); }
+void rtapi_app_exit(void)
+{
+    if (trace_shmem_id >= 0) {
+        rtapi_shmem_delete(trace_shmem_id, comp_id);
+    }
+    hal_exit(comp_id);
+}
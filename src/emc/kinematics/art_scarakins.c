@@ -32,6 +32,9 @@
 // FILE *dptrace = fopen("dptrace.log","w");
 static FILE *dptrace;
 #endif
+#include "dptrace_ring.h"
+static dpt_ring_t *trace;	/* kinematicsForward/Inverse trace ring */
+static int trace_shmem_id = -1;
 
 struct scara_data {
     hal_float_t *d1, *d2, *d3, *d4, *d5, *d6, *ppd, *sing;
@@ -124,8 +127,6 @@ int kinematicsForward(const double * joint,
     double a0, a1, a3;
     double x, y, z, a;
 
-    DP ("begin\n");
-
     /* convert joint angles to radians for sin() and cos() */
     a0 = joint[0] * ( PM_PI / 180 );
     a1 = joint[1] * ( PM_PI / 180 );
@@ -159,18 +160,7 @@ int kinematicsForward(const double * joint,
     // world->a = joint[4];
     // world->b = joint[5];
 
-#if (TRACE)
-    { 
-      int i;
-      for (i=0; i<4; i++) {
-        DPS("Joint[%d]=%f ", i, joint[i]);
-      }
-    }
-#endif
-    DPS("\n");
-    DPS("x=%f y=%f z=%f a=%f\n", 
-        x, y, z, world->a);
-    DP ("end\n");
+    DPT(trace, DPT_KINS_FWD, 0, x, y, z, world->a);
 
     return (0);
 }
@@ -185,10 +175,7 @@ int kinematicsInverse(const EmcPose *world,
     double xt, yt, rsq, cc;
     double x, y, z, a;
 
-    DP ("begin\n");
-    
     if (*iflags & SCARA_SINGULAR) {
-        DP ("quit when SCARA is at SINGULARITY configuration\n");
         return -1;
     }
 
@@ -214,8 +201,7 @@ int kinematicsInverse(const EmcPose *world,
     q1 = acos(cc);
     
     if (fabs(q1) < SINGU) {
-        DP ("quit when SCARA is about to move to SINGULAR position\n");
-        DP ("x(%f) y(%f) q1(%f) cur_j1(%f)\n", x, y, q1, joint[1]);
+        DPT(trace, DPT_KINS_SINGULAR, 0, x, y, q1, joint[1]);
         return -1;
     }
 
@@ -250,18 +236,7 @@ int kinematicsInverse(const EmcPose *world,
 
     *fflags = 0;
     
-    DPS("x=%f y=%f z=%f a=%f\n", 
-        x, y, z, world->a);
-#if (TRACE)
-    {
-      int i;
-      for (i=0; i<4; i++) {
-        DPS("Joint[%d]=%f ", i, joint[i]);
-      }
-    }
-#endif
-    DPS("\n");
-    DP ("end\n");
+    DPT(trace, DPT_KINS_INV, 0, x, y, z, world->a);
 
     return (0);
 }
@@ -324,6 +299,7 @@ int rtapi_app_main(void) {
     // D5 = DEFAULT_D5;
     // D6 = DEFAULT_D6;
 
+    trace_shmem_id = dpt_open(&trace, DPT_RING_KINS, comp_id);
     hal_ready(comp_id);
     DP ("success\n");
     return 0;
@@ -341,6 +317,9 @@ void rtapi_app_exit(void)
 #if (TRACE!=0)
     fclose(dptrace);
 #endif
+    if (trace_shmem_id >= 0) {
+        rtapi_shmem_delete(trace_shmem_id, comp_id);
+    }
     hal_exit(comp_id); 
 }
 #endif
@@ -0,0 +1,385 @@
+/********************************************************************
+* Description: dptrace.c
+*   User space side of the binary trace rings in dptrace_ring.h:
+*   switches a ring on, drains it and decodes the records to text or
+*   CSV, or saves them raw to be decoded later.
+*
+*   dptrace [-r ring] [-c | -b] [-n count] [-1] [-e] [filename]
+*   dptrace -i rawfile [-c] [filename]
+*
+*   -r ring   motion (the default), kins, wou, or a ring number
+*   -c        CSV instead of text
+*   -b        raw records, for a later dptrace -i
+*   -i file   decode raw records saved with -b instead of reading a ring
+*   -n count  stop after count records
+*   -1        print what the ring holds and exit, instead of following it
+*   -e        leave the ring switched on at exit, so that it keeps the
+*             last records for a later dptrace -1
+*
+* License: GPL Version 2
+* System: Linux
+*
+* Copyright (c) 2014 All rights reserved.
+*
+********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+
+#include "rtapi.h"		/* RTAPI realtime OS API */
+#include "hal.h"		/* HAL public API decls */
+#include "dptrace_ring.h"
+
+/* id 0 never comes out of a ring; dptrace uses it for the clock
+   calibration: clk is the clock at ring creation, arg[0] ns per clock */
+#define DPT_CALIB 0
+
+typedef struct {
+    const char *name;
+    const char *i;		/* what the int holds, 0 if nothing */
+    const char *arg[4];		/* what the doubles hold, 0 if nothing */
+} dpt_event_t;
+
+static const dpt_event_t events[DPT_EVENTS] = {
+    [DPT_TP_CYCLE] = {"tp.cycle", "state",
+	{"req_vel", "cur_vel", "cur_accel", "dist_to_go"}},
+    [DPT_TP_DECEL] = {"tp.decel", "state",
+	{"tc_target", "stop_dist", "cur_vel", "cur_accel"}},
+    [DPT_TP_REQVEL] = {"tp.reqvel", "state",
+	{"cur_vel", "cur_accel", "req_vel", 0}},
+    [DPT_TP_BLEND] = {"tp.blend", "mode",
+	{"k", "rv", "ca", "maxaccel"}},
+    [DPT_TP_RIGIDTAP] = {"tp.rigidtap", 0,
+	{"jerk", "req_vel", "req_acc", "target"}},
+    [DPT_TP_ORIENT] = {"tp.orient", "spindle_dir",
+	{"start_angle", "end_angle", "tc_dir", "target"}},
+    [DPT_TC_CURVE] = {"tc.curve", "id",
+	{"reqvel", "cur_vel", "curve_accel", "limited"}},
+    [DPT_TC_POS] = {"tc.pos", "id", {"x", "y", "z", "w"}},
+    [DPT_CTRL_CMD_SYNC] = {"ctrl.cmd_sync", "req", {0, 0, 0, 0}},
+    [DPT_CTRL_CSS] = {"ctrl.css", "spindle_dir",
+	{"css_req", "css_cur", "css_error", "denom"}},
+    [DPT_CTRL_COORD] = {"ctrl.coord", 0, {"x", "y", "z", "s"}},
+    [DPT_CTRL_JOINT] = {"ctrl.joint", "joint",
+	{"pos_cmd", "vel_cmd", "coarse_pos", 0}},
+    [DPT_CTRL_TELEOP] = {"ctrl.teleop", "axis",
+	{"pos_cmd", "cur_vel", "desired_vel", "desired_acc"}},
+    [DPT_KINS_FWD] = {"kins.fwd", 0, {"x", "y", "z", "aux"}},
+    [DPT_KINS_INV] = {"kins.inv", 0, {"x", "y", "z", "aux"}},
+    [DPT_KINS_SINGULAR] = {"kins.singular", 0, {"x", "y", "q1", "j1"}},
+    [DPT_WOU_JOINT] = {"wou.joint", "joint",
+	{"int_pcmd", "prev_pos_cmd", "pos_fb", "risc_pos_cmd"}},
+    [DPT_WOU_RCMD] = {"wou.rcmd", "state",
+	{"update_pos_req", "seq_num_req", 0, 0}},
+    [DPT_WOU_POS_ACK] = {"wou.pos_ack", "seq_num", {0, 0, 0, 0}},
+    [DPT_WOU_SYNC_IN] = {"wou.sync_in", "input", {"wait_type", 0, 0, 0}},
+    [DPT_WOU_SSYNC_SCALE] = {"wou.ssync_scale", "joint",
+	{"scale", "uu_per_rev", "spindle_joint", 0}},
+    [DPT_WOU_PROBE] = {"wou.probe", "joint", {"type", "pin", 0, 0}},
+    [DPT_WOU_POS_UPDATE] = {"wou.pos_update", "joint",
+	{"pos_cmd", "rawcount", 0, 0}},
+};
+
+static const char *ring_names[DPT_RINGS] = { "motion", "kins", "wou" };
+
+static int comp_id = -1;	/* -1 means hal_init() not called yet */
+static int shmem_id = -1;
+static volatile int done = 0;
+
+static int csv = 0;
+static long long int clk0;	/* from the last calibration record */
+static double ns_per_clk;
+
+static void quit(int sig)
+{
+    done = 1;
+}
+
+static void print_record(const dpt_record_t * r, int ring)
+{
+    const dpt_event_t *e = 0;
+    double t;
+    int n;
+
+    if (r->id == DPT_CALIB) {
+	clk0 = r->clk;
+	ns_per_clk = r->arg[0];
+	return;
+    }
+    if (r->id > 0 && r->id < DPT_EVENTS && events[r->id].name) {
+	e = &events[r->id];
+    }
+    /* seconds since the ring was created, or clocks until the ring
+       has been calibrated */
+    t = ns_per_clk > 0 ? (r->clk - clk0) * ns_per_clk * 1e-9 :
+	(double) (r->clk - clk0);
+    if (csv) {
+	printf("%.9f,%s,", t, ring_names[ring]);
+	if (e) {
+	    printf("%s", e->name);
+	} else {
+	    printf("%d", r->id);
+	}
+	printf(",%d,%.9g,%.9g,%.9g,%.9g\n", r->i, r->arg[0], r->arg[1],
+	       r->arg[2], r->arg[3]);
+	return;
+    }
+    printf("%14.9f %-6s ", t, ring_names[ring]);
+    if (e == 0) {
+	printf("event-%d i=%d %.9g %.9g %.9g %.9g\n", r->id, r->i,
+	       r->arg[0], r->arg[1], r->arg[2], r->arg[3]);
+	return;
+    }
+    printf("%-16s", e->name);
+    if (e->i) {
+	printf(" %s=%d", e->i, r->i);
+    }
+    for (n = 0; n < 4; n++) {
+	if (e->arg[n]) {
+	    printf(" %s=%.9g", e->arg[n], r->arg[n]);
+	}
+    }
+    printf("\n");
+}
+
+static void emit(const dpt_record_t * r, int ring, int raw)
+{
+    if (raw) {
+	fwrite(r, sizeof(*r), 1, stdout);
+    } else {
+	print_record(r, ring);
+    }
+}
+
+/* sends a calibration record when the ring's clock pair has moved */
+static void calibrate(dpt_ring_t * ring, int n, int raw)
+{
+    static long long int last_clk1 = -1;
+    dpt_record_t c;
+    long long int clk1, ns1;
+
+    do {
+	clk1 = ring->clk1;
+	ns1 = ring->ns1;
+    } while (clk1 != ring->clk1);
+    if (clk1 == last_clk1) {
+	return;
+    }
+    last_clk1 = clk1;
+    memset(&c, 0, sizeof(c));
+    c.id = DPT_CALIB;
+    c.clk = ring->clk0;
+    if (clk1 > ring->clk0) {
+	c.arg[0] = (double) (ns1 - ring->ns0) / (clk1 - ring->clk0);
+    }
+    emit(&c, n, raw);
+}
+
+/* decodes what dptrace -b saved; the ring number leads the records */
+static int decode_file(const char *name, long samples)
+{
+    dpt_record_t r;
+    FILE *f;
+    int ring;
+
+    f = fopen(name, "r");
+    if (f == NULL) {
+	perror(name);
+	return 1;
+    }
+    if (fread(&ring, sizeof(ring), 1, f) != 1 || ring < 0 ||
+	ring >= DPT_RINGS) {
+	fprintf(stderr, "ERROR: %s is not a dptrace -b file\n", name);
+	fclose(f);
+	return 1;
+    }
+    while (samples != 0 && fread(&r, sizeof(r), 1, f) == 1) {
+	print_record(&r, ring);
+	if (r.id != DPT_CALIB && samples > 0) {
+	    samples--;
+	}
+    }
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int n, ring, raw, once, keep, retval, exitval = 1;
+    long samples;
+    unsigned int head, tail;
+    char *cp, *cp2, *input = 0;
+    char comp_name[HAL_NAME_LEN + 1];
+    void *shmem_ptr;
+    dpt_ring_t *dpt;
+    dpt_record_t r;
+    struct timespec delay;
+
+    ring = DPT_RING_MOTION;
+    raw = once = keep = 0;
+    samples = -1;		/* -1 means run forever */
+    for (n = 1; n < argc; n++) {
+	cp = argv[n];
+	if (*cp != '-') {
+	    break;
+	}
+	switch (*(++cp)) {
+	case 'r':
+	    if ((*(++cp) == '\0') && (++n < argc)) {
+		cp = argv[n];
+	    }
+	    for (ring = 0; ring < DPT_RINGS; ring++) {
+		if (strcmp(cp, ring_names[ring]) == 0) {
+		    break;
+		}
+	    }
+	    if (ring == DPT_RINGS) {
+		ring = strtol(cp, &cp2, 10);
+		if ((*cp2) || (ring < 0) || (ring >= DPT_RINGS)) {
+		    fprintf(stderr, "ERROR: invalid ring '%s'\n", cp);
+		    exit(1);
+		}
+	    }
+	    break;
+	case 'i':
+	    if ((*(++cp) == '\0') && (++n < argc)) {
+		cp = argv[n];
+	    }
+	    input = cp;
+	    break;
+	case 'n':
+	    if ((*(++cp) == '\0') && (++n < argc)) {
+		cp = argv[n];
+	    }
+	    samples = strtol(cp, &cp2, 10);
+	    if ((*cp2) || (samples < 0)) {
+		fprintf(stderr, "ERROR: invalid record count '%s'\n", cp);
+		exit(1);
+	    }
+	    break;
+	case 'c':
+	    csv = 1;
+	    break;
+	case 'b':
+	    raw = 1;
+	    break;
+	case '1':
+	    once = 1;
+	    break;
+	case 'e':
+	    keep = 1;
+	    break;
+	default:
+	    fprintf(stderr, "ERROR: unknown option '%s'\n", cp);
+	    exit(1);
+	    break;
+	}
+    }
+    if (n < argc) {
+	int fd;
+	if (argc > n + 1) {
+	    fprintf(stderr, "ERROR: At most one filename may be specified\n");
+	    exit(1);
+	}
+	// make stdout be the named file
+	fd = open(argv[n], O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	close(1);
+	dup2(fd, 1);
+    }
+    if (csv) {
+	printf("time,ring,event,i,arg0,arg1,arg2,arg3\n");
+    }
+    if (input) {
+	return decode_file(input, samples);
+    }
+
+    signal(SIGINT, quit);
+    signal(SIGTERM, quit);
+    signal(SIGPIPE, quit);
+    /* create a unique module name, to allow for several dptraces */
+    snprintf(comp_name, sizeof(comp_name), "dptrace%d", getpid());
+    comp_id = hal_init(comp_name);
+    if (comp_id < 0) {
+	fprintf(stderr, "ERROR: hal_init() failed: %d\n", comp_id);
+	goto out;
+    }
+    hal_ready(comp_id);
+    shmem_id = rtapi_shmem_new(DPT_SHMEM_KEY + ring, comp_id,
+			       sizeof(dpt_ring_t));
+    if (shmem_id < 0) {
+	fprintf(stderr, "ERROR: couldn't allocate user/RT shared memory\n");
+	goto out;
+    }
+    retval = rtapi_shmem_getptr(shmem_id, &shmem_ptr);
+    if (retval < 0) {
+	fprintf(stderr, "ERROR: couldn't map user/RT shared memory\n");
+	goto out;
+    }
+    dpt = shmem_ptr;
+    if (dpt->magic != DPT_MAGIC || dpt->depth != DPT_DEPTH) {
+	fprintf(stderr, "ERROR: no %s trace ring, its module is not loaded\n",
+		ring_names[ring]);
+	goto out;
+    }
+    if (raw) {
+	fwrite(&ring, sizeof(ring), 1, stdout);
+    }
+
+    head = dpt->head;
+    if (once) {
+	tail = head > DPT_DEPTH ? head - DPT_DEPTH : 0;
+	done = 1;
+    } else {
+	tail = head;
+	dpt->enable = 1;
+    }
+    do {
+	if (!done) {
+	    /* nothing new, sleep for 10mS */
+	    delay.tv_sec = 0;
+	    delay.tv_nsec = 10000000;
+	    nanosleep(&delay, NULL);
+	}
+	head = dpt->head;
+	rtapi_smp_rmb();
+	calibrate(dpt, ring, raw);
+	if (head - tail > DPT_DEPTH) {
+	    fprintf(stderr, "dptrace: overrun, %u records lost\n",
+		    head - tail - DPT_DEPTH);
+	    tail = head - DPT_DEPTH;
+	}
+	for (; tail != head && samples != 0; tail++) {
+	    r = dpt->rec[tail & (DPT_DEPTH - 1)];
+	    rtapi_smp_rmb();
+	    if (dpt->head - tail >= DPT_DEPTH) {
+		/* overwritten while we were copying it */
+		continue;
+	    }
+	    emit(&r, ring, raw);
+	    if (samples > 0) {
+		samples--;
+	    }
+	}
+	fflush(stdout);
+    } while (!done && samples != 0);
+    if (keep) {
+	dpt->enable = 1;
+    } else if (!once) {
+	dpt->enable = 0;
+    }
+    exitval = 0;
+
+  out:
+    if (shmem_id >= 0) {
+	rtapi_shmem_delete(shmem_id, comp_id);
+    }
+    if (comp_id >= 0) {
+	hal_exit(comp_id);
+    }
+    return exitval;
+}
@@ -0,0 +1,150 @@
+/********************************************************************
+* Description: dptrace_ring.h
+*   Binary trace rings in RTAPI shared memory
+*
+*   DP() in dptrace.h formats text into a FILE from wherever it is
+*   called, so it only exists in SIM and even there it wrecks the servo
+*   timing.  DPT() stores a timestamp, an event id, an int and four
+*   doubles into a ring in shared memory instead, and the dptrace tool
+*   drains the rings and decodes them to text or CSV.
+*
+*   Each ring has a single writer, a module whose traced functions all
+*   run in one thread, so writing a record takes a handful of stores,
+*   a write barrier and an index bump, and no lock.  Until dptrace
+*   switches a ring on, DPT() is a load and a branch.
+*
+* License: GPL Version 2
+* System: Linux
+*
+* Copyright (c) 2014 All rights reserved.
+*
+********************************************************************/
+#ifndef _DPTRACE_RING_H_
+#define _DPTRACE_RING_H_
+
+#include "rtapi.h"
+#include "rtapi_atomic.h"
+
+#define DPT_SHMEM_KEY	0x44505430	/* "DPT0", plus the ring number */
+#define DPT_MAGIC	0x44505452
+#define DPT_DEPTH	4096		/* records per ring, a power of 2 */
+
+/* one ring per writing module */
+enum {
+    DPT_RING_MOTION = 0,	/* motmod: tp.c, tc.c, control.c */
+    DPT_RING_KINS,		/* the kinematics module */
+    DPT_RING_WOU,		/* wou_stepgen */
+    DPT_RINGS
+};
+
+/* events, and what i and arg[0..3] hold; dptrace.c has the names */
+enum {
+    DPT_TP_CYCLE = 1,		/* accel_state; req_vel cur_vel cur_accel dist_to_go */
+    DPT_TP_DECEL,		/* accel_state kept; tc_target stop_dist cur_vel cur_accel */
+    DPT_TP_REQVEL,		/* accel_state left; cur_vel cur_accel req_vel */
+    DPT_TP_BLEND,		/* seamless_blend_mode; k rv ca maxaccel */
+    DPT_TP_RIGIDTAP,		/* -; jerk req_vel req_acc target */
+    DPT_TP_ORIENT,		/* spindle direction; start_angle end_angle spindle_dir target */
+    DPT_TC_CURVE,		/* tc id; reqvel cur_vel curve_accel limited reqvel */
+    DPT_TC_POS,			/* tc id; x y z w */
+    DPT_CTRL_CMD_SYNC,		/* req_cmd_sync */
+    DPT_CTRL_CSS,		/* spindle direction; css_req css_cur css_error denom */
+    DPT_CTRL_COORD,		/* -; x y z s of carte_pos_cmd */
+    DPT_CTRL_JOINT,		/* joint; pos_cmd vel_cmd coarse_pos */
+    DPT_CTRL_TELEOP,		/* axis; pos_cmd cur_vel desired_vel desired_acc */
+    DPT_KINS_FWD,		/* -; x y z, and a kins specific fourth */
+    DPT_KINS_INV,		/* -; x y z, and a kins specific fourth */
+    DPT_KINS_SINGULAR,		/* -; x y q1 joint[1] */
+    DPT_WOU_JOINT,		/* joint; int_pcmd prev_pos_cmd pos_fb risc_pos_cmd */
+    DPT_WOU_RCMD,		/* rcmd_state; update_pos_req rcmd_seq_num_req */
+    DPT_WOU_POS_ACK,		/* rcmd_seq_num_ack */
+    DPT_WOU_SYNC_IN,		/* input; wait_type */
+    DPT_WOU_SSYNC_SCALE,	/* joint; scale (16.16) uu_per_rev spindle_joint_id */
+    DPT_WOU_PROBE,		/* joint; risc_probe_type risc_probe_pin */
+    DPT_WOU_POS_UPDATE,		/* joint; pos_cmd rawcount */
+    DPT_EVENTS
+};
+
+typedef struct {
+    long long int clk;		/* rtapi_get_clocks() */
+    int id;
+    int i;
+    double arg[4];
+} dpt_record_t;
+
+typedef struct {
+    unsigned int magic;
+    unsigned int depth;
+    volatile int enable;	/* set by dptrace */
+    volatile unsigned int head;	/* records written, ever */
+    /* clocks and ns read together at load time and every DPT_DEPTH
+       records, so dptrace can turn clocks into seconds */
+    long long int clk0, ns0;
+    volatile long long int clk1, ns1;
+    dpt_record_t rec[DPT_DEPTH];
+} dpt_ring_t;
+
+#ifdef RTAPI
+/* creates ring n for the module, returns its shmem id (for
+   rtapi_shmem_delete() at exit) or a negative error */
+static inline int dpt_open(dpt_ring_t ** ring, int n, int module_id)
+{
+    int shmem_id, retval;
+    void *p;
+
+    *ring = 0;
+    shmem_id = rtapi_shmem_new(DPT_SHMEM_KEY + n, module_id,
+			       sizeof(dpt_ring_t));
+    if (shmem_id < 0) {
+	return shmem_id;
+    }
+    retval = rtapi_shmem_getptr(shmem_id, &p);
+    if (retval < 0) {
+	rtapi_shmem_delete(shmem_id, module_id);
+	return retval;
+    }
+    *ring = p;
+    (*ring)->enable = 0;
+    (*ring)->head = 0;
+    (*ring)->depth = DPT_DEPTH;
+    (*ring)->clk0 = (*ring)->clk1 = rtapi_get_clocks();
+    (*ring)->ns0 = (*ring)->ns1 = rtapi_get_time();
+    rtapi_smp_wmb();
+    (*ring)->magic = DPT_MAGIC;
+    return shmem_id;
+}
+
+static inline void dpt_write(dpt_ring_t * ring, int id, int i,
+			     double a0, double a1, double a2, double a3)
+{
+    unsigned int head;
+    dpt_record_t *r;
+
+    if (ring == 0 || !ring->enable) {
+	return;
+    }
+    head = ring->head;
+    r = &ring->rec[head & (DPT_DEPTH - 1)];
+    r->clk = rtapi_get_clocks();
+    r->id = id;
+    r->i = i;
+    r->arg[0] = a0;
+    r->arg[1] = a1;
+    r->arg[2] = a2;
+    r->arg[3] = a3;
+    if ((head & (DPT_DEPTH - 1)) == 0) {
+	ring->clk1 = r->clk;
+	ring->ns1 = rtapi_get_time();
+    }
+    rtapi_smp_wmb();
+    ring->head = head + 1;
+}
+
+#define DPT(ring, id, i, a0, a1, a2, a3) \
+    dpt_write(ring, id, i, a0, a1, a2, a3)
+#else
+// planner code built into user space programs has no ring to write
+#define DPT(ring, id, i, a0, a1, a2, a3)    do {} while (0)
+#endif /* RTAPI */
+
+#endif /* _DPTRACE_RING_H_ */
@@ -27,6 +27,9 @@
 #if (TRACE!=0)
 static FILE *dptrace;
 #endif
+#include "dptrace_ring.h"
+static dpt_ring_t *trace;	/* kinematicsForward/Inverse trace ring */
+static int trace_shmem_id = -1;
 
 typedef struct {
     hal_float_t *gantry_polarity;
@@ -57,9 +60,8 @@ int kinematicsForward(const double *joints,
     pos->tran.z = joints[3];
     pos->c = joints[5];
 
-    DP("kFWD: x(%f), y(%f), j0(%f), j1(%f), j2(%f), yy_offset(%f),POLARITY(%f)\n",
-        pos->tran.x, pos->tran.y, joints[0], joints[1], joints[2], YY_OFFSET, GANTRY_POLARITY);
-    DP("kFWD: c(%f), j5(%f)\n", pos->c, joints[5]);
+    DPT(trace, DPT_KINS_FWD, 0, pos->tran.x, pos->tran.y, pos->tran.z,
+        joints[2]);
 
     return 0;
 }
@@ -74,9 +76,8 @@ int kinematicsInverse(const EmcPose * pos,
     joints[2] = pos->tran.y - (YY_OFFSET * GANTRY_POLARITY);  // YY
     joints[3] = pos->tran.z;
     joints[5] = pos->c;
-    DP("kINV: x(%f), y(%f), j0(%f), j1(%f), j2(%f), yy_offset(%f)\n",
-       pos->tran.x, pos->tran.y, joints[0], joints[1], joints[2], YY_OFFSET);
-    DP("kINV: c(%f), j5(%f)\n", pos->c, joints[5]);
+    DPT(trace, DPT_KINS_INV, 0, pos->tran.x, pos->tran.y, pos->tran.z,
+        joints[2]);
 
     return 0;
 }
@@ -128,6 +129,7 @@ int rtapi_app_main(void)
     }
     GANTRY_POLARITY = 1.0;
 
+    trace_shmem_id = dpt_open(&trace, DPT_RING_KINS, comp_id);
     hal_ready(comp_id);
     DP ("success\n");
     return 0;
@@ -141,4 +143,10 @@ error:
     return res;
 }
 
-void rtapi_app_exit(void) { hal_exit(comp_id); }
+void rtapi_app_exit(void)
+{
+    if (trace_shmem_id >= 0) {
+        rtapi_shmem_delete(trace_shmem_id, comp_id);
+    }
+    hal_exit(comp_id);
+}
@@ -27,6 +27,7 @@
 #endif
 
 #include "rtapi.h"		/* rtapi_print_msg */
+#include "rtapi_string.h"	/* memset */
 #include "posemath.h"
 #include "emcpos.h"
 #include "tc.h"
@@ -36,15 +37,10 @@
 //#include "../motion/mot_priv.h"
 //#include "motion_debug.h"
 
-#define TRACE 0
-#include "dptrace.h"
-
-#if (TRACE != 0)
-    static FILE *dptrace = NULL;
-    static uint32_t _dt = 0;
-#endif
+#include "dptrace_ring.h"
 
 extern emcmot_status_t *emcmotStatus;
+extern dpt_ring_t *emcmot_trace;
 
 
 static int
@@ -136,13 +132,41 @@ int nurbs_findspan (int n, int p, double u, double *U)
     return (span);
 }
 
+/*! nurbs_findspan_cached() function
+ *
+ * \brief nurbs_findspan() for a monotonically increasing u.
+ *
+ * Starts from the span found for the previous u and walks forward a few
+ * knots; only falls back to the binary search on a jump or a rewind.
+ */
+static int nurbs_findspan_cached(nurbs_block_t *nb, double u)
+{
+    int s, len, steps;
+    double *U = nb->knots_ptr;
+
+    len = nb->nr_of_ctrl_pts + nb->order - 2;	/* n+p as in nurbs_findspan() */
+    s = nb->span_idx;
+    if (s >= 0 && s <= len - 2 && U[s] <= u) {
+        for (steps = 0; steps < NURBS_MAX_ORDER && s <= len - 2; steps++) {
+            if (u < U[s + 1]) {
+                nb->span_idx = s;
+                return s;
+            }
+            s++;
+        }
+    }
+    s = nurbs_findspan(nb->nr_of_ctrl_pts - 1, nb->order - 1, u, U);
+    nb->span_idx = s;
+    return s;
+}
+
 // Basis Function.
 //
 // INPUT:
 //
 //   i - knot span  ( from FindSpan() )
 //   u - parametric point
-//   p - spline degree
+//   p - spline degree, at most NURBS_MAX_ORDER - 1
 //   U - knot sequence
 //
 // OUTPUT:
@@ -150,21 +174,16 @@ int nurbs_findspan (int n, int p, double u, double *U)
 //   N - Basis functions vector[p+1]  sizeof(double)*(p+1)
 //
 // Algorithm A2.2 from 'The NURBS BOOK' pg70.
-void nurbs_basisfun(int i, double u, int p,
+// Inlined by nurbs_basisfun() with a constant p for the common degrees,
+// so the compiler unrolls both loops.
+static inline void basisfun_p(int i, double u, const int p,
               double *U,
               double *N)
 {
   int j,r, id;
   double saved, temp, denom;
-
-#ifdef RTAPI_SIM
-  double *left = (double*)malloc(sizeof(double)*(p+1));
-  double *right = (double*)malloc(sizeof(double)*(p+1));
-#else
-  #warning "to implement rtai_kmalloc() or static memory chunk for left[] and right[]"
-  double left[4096];
-  double right[4096];
-#endif
+  double left[NURBS_MAX_ORDER + 1];
+  double right[NURBS_MAX_ORDER + 1];
 
   N[0] = 1.0;
   for (j = 1; j <= p; j++)
@@ -189,13 +208,206 @@ void nurbs_basisfun(int i, double u, int p,
       N[j] = saved;
 
     }
-#ifdef RTAPI_SIM
-  free(left);
-  free(right);
-#else
-  #warning "to implement rtai_kmalloc() or static memory chunk for left[] and right[]"
-#endif
+}
 
+void nurbs_basisfun(int i, double u, int p,
+              double *U,
+              double *N)
+{
+    switch (p) {
+    case 2:
+        basisfun_p(i, u, 2, U, N);
+        break;
+    case 3:
+        basisfun_p(i, u, 3, U, N);
+        break;
+    case 4:
+        basisfun_p(i, u, 4, U, N);
+        break;
+    default:
+        assert(p < NURBS_MAX_ORDER);
+        basisfun_p(i, u, p, U, N);
+        break;
+    }
+}
+
+/*! nurbs_evaluate() function
+ *
+ * \brief Evaluates the rational curve at parameter u (0 <= u < 1).
+ *
+ * Control points are stored in homogeneous form (already multiplied by
+ * their weight R), so the result is divided by the interpolated weight.
+ * cp->R returns the interpolated weight, cp->D the interpolated curvature
+ * radius. nb->N must hold at least nb->order doubles.
+ */
+void nurbs_evaluate(nurbs_block_t *nb, double u, CONTROL_POINT *cp)
+{
+    int s, first, i, k, id;
+    double *N = nb->N;
+    double sum[NURBS_CP_DIM];
+    const double *pt;
+
+    s = nurbs_findspan_cached(nb, u);
+    nurbs_basisfun(s, u, nb->order - 1, nb->knots_ptr, N);
+    first = s - nb->order + 1;
+
+    /* all coordinates of a CONTROL_POINT are doubles: accumulate them
+       in one loop the compiler can vectorize */
+    for (k = 0; k < NURBS_CP_DIM; k++) {
+        sum[k] = 0.0;
+    }
+    for (i = 0; i < nb->order; i++) {
+        id = first + i;
+        if (id < 0) id = 0;
+        else if (id >= nb->nr_of_ctrl_pts) id = nb->nr_of_ctrl_pts - 1;
+        pt = (const double *) &nb->ctrl_pts_ptr[id];
+        for (k = 0; k < NURBS_CP_DIM; k++) {
+            sum[k] += N[i] * pt[k];
+        }
+    }
+
+    cp->R = sum[NURBS_CP_R];
+    cp->X = sum[0] / cp->R;
+    cp->Y = sum[1] / cp->R;
+    cp->Z = sum[2] / cp->R;
+    cp->A = sum[3] / cp->R;
+    cp->B = sum[4] / cp->R;
+    cp->C = sum[5] / cp->R;
+    cp->U = sum[6] / cp->R;
+    cp->V = sum[7] / cp->R;
+    cp->W = sum[8] / cp->R;
+    cp->D = sum[NURBS_CP_R + 1] / cp->R;
+}
+
+/*! nurbs_alen_size() function
+ *
+ * \brief number of arc-length table entries for a curve with
+ * nr_of_ctrl_pts control points
+ */
+uint32_t nurbs_alen_size(uint32_t nr_of_ctrl_pts)
+{
+    uint32_t n;
+
+    n = nr_of_ctrl_pts * NURBS_ALEN_PER_CP;
+    if (n > NURBS_MAX_ALEN) {
+        n = NURBS_MAX_ALEN;
+    }
+    return n + 1;
+}
+
+/* last control point, de-homogenized: the curve position at u == 1 */
+static void nurbs_endpoint(nurbs_block_t *nb, CONTROL_POINT *cp)
+{
+    *cp = nb->ctrl_pts_ptr[nb->nr_of_ctrl_pts - 1];
+    cp->X /= cp->R; cp->Y /= cp->R; cp->Z /= cp->R;
+    cp->A /= cp->R; cp->B /= cp->R; cp->C /= cp->R;
+    cp->U /= cp->R; cp->V /= cp->R; cp->W /= cp->R;
+}
+
+static double nurbs_alen_fill(nurbs_block_t *nb, int all_axes)
+{
+    uint32_t k, n;
+    double len, d2, dx, dy, dz, da, db, dc, du, dv, dw;
+    CONTROL_POINT prev, cur;
+
+    n = nb->nr_of_alen - 1;
+    nb->alen_ptr[0] = 0.0;
+    nurbs_evaluate(nb, 0.0, &prev);
+    len = 0.0;
+    for (k = 1; k <= n; k++) {
+        if (k == n) {
+            nurbs_endpoint(nb, &cur);
+        } else {
+            nurbs_evaluate(nb, (double) k / n, &cur);
+        }
+        dx = cur.X - prev.X;
+        dy = cur.Y - prev.Y;
+        dz = cur.Z - prev.Z;
+        d2 = dx * dx + dy * dy + dz * dz;
+        if (all_axes) {
+            da = cur.A - prev.A;
+            db = cur.B - prev.B;
+            dc = cur.C - prev.C;
+            du = cur.U - prev.U;
+            dv = cur.V - prev.V;
+            dw = cur.W - prev.W;
+            d2 += da * da + db * db + dc * dc + du * du + dv * dv + dw * dw;
+        }
+        len += pmSqrt(d2);
+        nb->alen_ptr[k] = len;
+        prev = cur;
+    }
+    return len;
+}
+
+/*! nurbs_alen_init() function
+ *
+ * \brief Builds the arc-length table of a fully collected NURBS block.
+ *
+ * Samples the curve at nr_of_alen uniformly spaced parameters and stores
+ * the accumulated chord length. The length is measured along xyz like
+ * TC_LINEAR progress; curves without xyz motion are measured over all
+ * nine axes. nb->alen_ptr must hold nb->nr_of_alen doubles.
+ * Called once by tpAddNURBS(), never from tpRunCycle().
+ *
+ * @return	 double	   the measured curve length
+ */
+double nurbs_alen_init(nurbs_block_t *nb)
+{
+    double len;
+
+    nb->alen_idx = 0;
+    nb->span_idx = 0;
+    len = nurbs_alen_fill(nb, 0);
+    if (len < 1e-9) {
+        len = nurbs_alen_fill(nb, 1);
+    }
+    return len;
+}
+
+/*! nurbs_alen_to_u() function
+ *
+ * \brief Maps a fraction of the curve length (0..1) to the curve parameter u.
+ *
+ * The search starts at the interval found by the previous call, so a
+ * monotonically increasing progress costs O(1) per servo cycle.
+ * Falls back to u = ratio when no table has been built.
+ */
+double nurbs_alen_to_u(nurbs_block_t *nb, double ratio)
+{
+    uint32_t idx, n;
+    double l, l0, l1;
+
+    if (nb->alen_ptr == 0 || nb->nr_of_alen < 2) {
+        return ratio;
+    }
+    if (ratio <= 0.0) {
+        return 0.0;
+    }
+    if (ratio >= 1.0) {
+        return 1.0;
+    }
+
+    n = nb->nr_of_alen - 1;
+    l = ratio * nb->alen_ptr[n];
+    idx = nb->alen_idx;
+    if (idx >= n) {
+        idx = n - 1;
+    }
+    while (idx < n - 1 && nb->alen_ptr[idx + 1] < l) {
+        idx++;
+    }
+    while (idx > 0 && nb->alen_ptr[idx] > l) {
+        idx--;
+    }
+    nb->alen_idx = idx;
+
+    l0 = nb->alen_ptr[idx];
+    l1 = nb->alen_ptr[idx + 1];
+    if (l1 > l0) {
+        return (idx + (l - l0) / (l1 - l0)) / n;
+    }
+    return (double) idx / n;
 }
 
 #if 0
@@ -204,22 +416,22 @@ PmCartesian tcGetStartingUnitVector(TC_STRUCT *tc) {
     PmCartesian v;
 
     if(tc->motion_type == TC_LINEAR || tc->motion_type == TC_SPINDLE_SYNC_MOTION) {
-        pmCartCartSub(tc->coords.line.xyz.end.tran, tc->coords.line.xyz.start.tran, &v);
+        pmCartCartSub(tc->coords->line.xyz.end.tran, tc->coords->line.xyz.start.tran, &v);
     } else {
         PmPose startpoint;
         PmCartesian radius;
         PmCartesian tan, perp;
 
-        pmCirclePoint(&tc->coords.circle.xyz, 0.0, &startpoint);
-        pmCartCartSub(startpoint.tran, tc->coords.circle.xyz.center, &radius);
-        pmCartCartCross(tc->coords.circle.xyz.normal, radius, &tan);
+        pmCirclePoint(&tc->coords->circle.xyz, 0.0, &startpoint);
+        pmCartCartSub(startpoint.tran, tc->coords->circle.xyz.center, &radius);
+        pmCartCartCross(tc->coords->circle.xyz.normal, radius, &tan);
         pmCartUnit(tan, &tan);
 
-        pmCartCartSub(tc->coords.circle.xyz.center, startpoint.tran, &perp);
+        pmCartCartSub(tc->coords->circle.xyz.center, startpoint.tran, &perp);
         pmCartUnit(perp, &perp);
 
         pmCartScalMult(tan, tc->maxaccel, &tan);
-        pmCartScalMult(perp, pmSq(0.5 * tc->reqvel)/tc->coords.circle.xyz.radius, &perp);
+        pmCartScalMult(perp, pmSq(0.5 * tc->reqvel)/tc->coords->circle.xyz.radius, &perp);
         pmCartCartAdd(tan, perp, &v);
     }
     pmCartUnit(v, &v);
@@ -231,14 +443,14 @@ PmCartesian tcGetEndingUnitVector(TC_STRUCT *tc) {
     PmCartesian v;
 
     if(tc->motion_type == TC_LINEAR || tc->motion_type == TC_SPINDLE_SYNC_MOTION) {
-        pmCartCartSub(tc->coords.line.xyz.end.tran, tc->coords.line.xyz.start.tran, &v);
+        pmCartCartSub(tc->coords->line.xyz.end.tran, tc->coords->line.xyz.start.tran, &v);
     } else {
         PmPose endpoint;
         PmCartesian radius;
 
-        pmCirclePoint(&tc->coords.circle.xyz, tc->coords.circle.xyz.angle, &endpoint);
-        pmCartCartSub(endpoint.tran, tc->coords.circle.xyz.center, &radius);
-        pmCartCartCross(tc->coords.circle.xyz.normal, radius, &v);
+        pmCirclePoint(&tc->coords->circle.xyz, tc->coords->circle.xyz.angle, &endpoint);
+        pmCartCartSub(endpoint.tran, tc->coords->circle.xyz.center, &radius);
+        pmCartCartCross(tc->coords->circle.xyz.normal, radius, &v);
     }
     pmCartUnit(v, &v);
     return v;
@@ -278,144 +490,88 @@ EmcPose tcGetPosReal(TC_STRUCT * tc, int of_endpoint)
     double s;
     
     double progress = of_endpoint? tc->target: tc->progress;
-#if(TRACE != 0)
-    static double last_l, last_u,last_x = 0 , last_y = 0, last_z = 0, last_a = 0;
-#endif
 
     // update spindle position
     s = emcmotStatus->carte_pos_cmd.s;
     if (tc->motion_type == TC_SPINDLE_SYNC_MOTION) {
         // for RIGID_TAPPING(G33.1), CSS(G33 w/ G96), and THREADING(G33 w/ G97)
-        pmLinePoint(&tc->coords.spindle_sync.xyz, tc->coords.spindle_sync.xyz.tmag * (progress / tc->target) , &xyz);
+        pmLinePoint(&tc->coords->spindle_sync.xyz, tc->coords->spindle_sync.xyz.tmag * (progress / tc->target) , &xyz);
         // no rotary move allowed while tapping
-        abc.tran = tc->coords.spindle_sync.abc;
-        uvw.tran = tc->coords.spindle_sync.uvw;
+        abc.tran = tc->coords->spindle_sync.abc;
+        uvw.tran = tc->coords->spindle_sync.uvw;
         if (!of_endpoint)
         {
-            s = tc->coords.spindle_sync.spindle_start_pos + tc->coords.spindle_sync.spindle_dir * progress;
+            s = tc->coords->spindle_sync.spindle_start_pos + tc->coords->spindle_sync.spindle_dir * progress;
         }
     } else if (tc->motion_type == TC_LINEAR) {
 
-        if (tc->coords.line.xyz.tmag > 0.) {
+        if (tc->coords->line.xyz.tmag > 0.) {
             // progress is along xyz, so uvw and abc move proportionally in order
             // to end at the same time.
-            pmLinePoint(&tc->coords.line.xyz, progress, &xyz);
-            pmLinePoint(&tc->coords.line.uvw,
-                        progress * tc->coords.line.uvw.tmag / tc->target,
+            pmLinePoint(&tc->coords->line.xyz, progress, &xyz);
+            pmLinePoint(&tc->coords->line.uvw,
+                        progress * tc->coords->line.uvw.tmag / tc->target,
                         &uvw);
-            pmLinePoint(&tc->coords.line.abc,
-                        progress * tc->coords.line.abc.tmag / tc->target,
+            pmLinePoint(&tc->coords->line.abc,
+                        progress * tc->coords->line.abc.tmag / tc->target,
                         &abc);
-        } else if (tc->coords.line.uvw.tmag > 0.) {
+        } else if (tc->coords->line.uvw.tmag > 0.) {
             // xyz is not moving
-            pmLinePoint(&tc->coords.line.xyz, 0.0, &xyz);
-            pmLinePoint(&tc->coords.line.uvw, progress, &uvw);
+            pmLinePoint(&tc->coords->line.xyz, 0.0, &xyz);
+            pmLinePoint(&tc->coords->line.uvw, progress, &uvw);
             // abc moves proportionally in order to end at the same time
-            pmLinePoint(&tc->coords.line.abc,
-                        progress * tc->coords.line.abc.tmag / tc->target,
+            pmLinePoint(&tc->coords->line.abc,
+                        progress * tc->coords->line.abc.tmag / tc->target,
                         &abc);
         } else {
             // if all else fails, it's along abc only
-            pmLinePoint(&tc->coords.line.xyz, 0.0, &xyz);
-            pmLinePoint(&tc->coords.line.uvw, 0.0, &uvw);
-            pmLinePoint(&tc->coords.line.abc, progress, &abc);
+            pmLinePoint(&tc->coords->line.xyz, 0.0, &xyz);
+            pmLinePoint(&tc->coords->line.uvw, 0.0, &uvw);
+            pmLinePoint(&tc->coords->line.abc, progress, &abc);
         }
     } else if (tc->motion_type == TC_CIRCULAR) {//we have TC_CIRCULAR
         // progress is always along the xyz circle.  This simplification
         // is possible since zero-radius arcs are not allowed by the interp.
 
-        pmCirclePoint(&tc->coords.circle.xyz,
-                      progress * tc->coords.circle.xyz.angle / tc->target,
+        pmCirclePoint(&tc->coords->circle.xyz,
+                      progress * tc->coords->circle.xyz.angle / tc->target,
                       &xyz);
         // abc moves proportionally in order to end at the same time as the
         // circular xyz move.
-        pmLinePoint(&tc->coords.circle.abc,
-                    progress * tc->coords.circle.abc.tmag / tc->target,
+        pmLinePoint(&tc->coords->circle.abc,
+                    progress * tc->coords->circle.abc.tmag / tc->target,
                     &abc);
         // same for uvw
-        pmLinePoint(&tc->coords.circle.uvw,
-                    progress * tc->coords.circle.uvw.tmag / tc->target,
+        pmLinePoint(&tc->coords->circle.uvw,
+                    progress * tc->coords->circle.uvw.tmag / tc->target,
                     &uvw);
 
     } else {
-        int          s, tmp1, i, id;
-        double       u,*N,R, X, Y, Z, A, B, C, U, V, W, D;
+        double       u, D;
         double       curve_accel;
-#if(TRACE != 0)
-        double delta_l, delta_u, delta_d, delta_x, delta_y, delta_z, delta_a;
-#endif
-        N = tc->nurbs_block.N;
-//        NL = tc->nurbs_block.NL;
+        CONTROL_POINT cp;
         assert(tc->motion_type == TC_NURBS);
 
-        u = progress / tc->target;
+        // progress is arc length; map it through the table so the
+        // tool tip moves at the planned speed regardless of knot spacing
+        u = nurbs_alen_to_u(tc->nurbs_block, progress / tc->target);
         if (u < 1.0) {
-
-            s = nurbs_findspan(tc->nurbs_block.nr_of_ctrl_pts-1,  tc->nurbs_block.order - 1,
-                                u, tc->nurbs_block.knots_ptr);  //return span index of u_i
-            nurbs_basisfun(s, u, tc->nurbs_block.order - 1 , tc->nurbs_block.knots_ptr , N);    // input: s:knot span index u:u_0 d:B-Spline degree  k:Knots
-                           // output: N:basis functions
             // refer to bspeval.cc::line(70) of octave
             // refer to opennurbs_evaluate_nurbs.cpp::line(985) of openNurbs
-            // refer to ON_NurbsCurve::Evaluate() for ...
-            // refer to opennurbs_knot.cpp::ON_NurbsSpanIndex()
             // http://www.rhino3d.com/nurbs.htm (What is NURBS?)
-            //    Some modelers that use older algorithms for NURBS
-            //    evaluation require two extra knot values for a total of
-            //    degree+N+1 knots. When Rhino is exporting and importing
-            //    NURBS geometry, it automatically adds and removes these
-            //    two superfluous knots as the situation requires.
-            tmp1 = s - tc->nurbs_block.order + 1;
-
-            R = 0.0;
-            X = 0.0;
-            Y = 0.0;
-            Z = 0.0;
-            A = 0.0;
-            B = 0.0;
-            C = 0.0;
-            U = 0.0;
-            V = 0.0;
-            W = 0.0;
-            D = 0.0;
-            for (i = 0; i < tc->nurbs_block.order; i++) {
-                id = tmp1 + i;
-                if (id < 0) id = 0;
-                else if (id >= tc->nurbs_block.nr_of_ctrl_pts) id = tc->nurbs_block.nr_of_ctrl_pts - 1;
-                R += N[i]*tc->nurbs_block.ctrl_pts_ptr[id].R;
-                X += N[i]*tc->nurbs_block.ctrl_pts_ptr[id].X;
-                Y += N[i]*tc->nurbs_block.ctrl_pts_ptr[id].Y;
-                Z += N[i]*tc->nurbs_block.ctrl_pts_ptr[id].Z;
-                A += N[i]*tc->nurbs_block.ctrl_pts_ptr[id].A;
-                B += N[i]*tc->nurbs_block.ctrl_pts_ptr[id].B;
-                C += N[i]*tc->nurbs_block.ctrl_pts_ptr[id].C;
-                U += N[i]*tc->nurbs_block.ctrl_pts_ptr[id].U;
-                V += N[i]*tc->nurbs_block.ctrl_pts_ptr[id].V;
-                W += N[i]*tc->nurbs_block.ctrl_pts_ptr[id].W;
-                D += N[i]*tc->nurbs_block.ctrl_pts_ptr[id].D;
-            }
-
-            X = X/R;
-            xyz.tran.x = X;
-            Y = Y/R;
-            xyz.tran.y = Y;
-            Z = Z/R;
-            xyz.tran.z = Z;
-            A = A/R;
-            abc.tran.x = A;
-            B = B/R;
-            abc.tran.y = B;
-            C = C/R;
-            abc.tran.z = C;
-            U = U/R;
-            uvw.tran.x = U;
-            V = V/R;
-            uvw.tran.y = V;
-            W = W/R;
-            uvw.tran.z = W;
-
-            tc->reqvel = tc->nurbs_block.reqvel; // restore reqvel of this curve
-            D = D/R;
+            nurbs_evaluate(tc->nurbs_block, u, &cp);
+            xyz.tran.x = cp.X;
+            xyz.tran.y = cp.Y;
+            xyz.tran.z = cp.Z;
+            abc.tran.x = cp.A;
+            abc.tran.y = cp.B;
+            abc.tran.z = cp.C;
+            uvw.tran.x = cp.U;
+            uvw.tran.y = cp.V;
+            uvw.tran.z = cp.W;
+
+            tc->reqvel = tc->nurbs_block->reqvel; // restore reqvel of this curve
+            D = cp.D;
             // compute allowed feed
             if(!of_endpoint) {
                 curve_accel = (tc->cur_vel * tc->cur_vel)/D;
@@ -424,30 +580,25 @@ EmcPose tcGetPosReal(TC_STRUCT * tc, int of_endpoint)
                     // modify req_vel
                     // tc->reqvel: unit/s
                     // tc->maxaccel: unit/s * cycle_time * cycle_time
-                    DPS ("tc.c: reqvel(%f) cur_vel(%f) curve_accel(%f) maxaccel(%f)\n",
-                            tc->reqvel, tc->cur_vel, curve_accel, tc->maxaccel);
                     tc->reqvel = pmSqrt((tc->maxaccel * D)) / tc->cycle_time;
-                    DPS ("curvature limited reqvel(%f)\n", tc->reqvel);
+                    DPT(emcmot_trace, DPT_TC_CURVE, tc->id,
+                        tc->nurbs_block->reqvel, tc->cur_vel, curve_accel,
+                        tc->reqvel);
                 }
             }
         }else {
-            xyz.tran.x = tc->nurbs_block.ctrl_pts_ptr[tc->nurbs_block.nr_of_ctrl_pts-1].X;
-            xyz.tran.y = tc->nurbs_block.ctrl_pts_ptr[tc->nurbs_block.nr_of_ctrl_pts-1].Y;
-            xyz.tran.z = tc->nurbs_block.ctrl_pts_ptr[tc->nurbs_block.nr_of_ctrl_pts-1].Z;
-            uvw.tran.x = tc->nurbs_block.ctrl_pts_ptr[tc->nurbs_block.nr_of_ctrl_pts-1].U;
-            uvw.tran.y = tc->nurbs_block.ctrl_pts_ptr[tc->nurbs_block.nr_of_ctrl_pts-1].V;
-            uvw.tran.z = tc->nurbs_block.ctrl_pts_ptr[tc->nurbs_block.nr_of_ctrl_pts-1].W;
-            abc.tran.x = tc->nurbs_block.ctrl_pts_ptr[tc->nurbs_block.nr_of_ctrl_pts-1].A;
-            abc.tran.y = tc->nurbs_block.ctrl_pts_ptr[tc->nurbs_block.nr_of_ctrl_pts-1].B;
-            abc.tran.z = tc->nurbs_block.ctrl_pts_ptr[tc->nurbs_block.nr_of_ctrl_pts-1].C;
+            xyz.tran.x = tc->nurbs_block->ctrl_pts_ptr[tc->nurbs_block->nr_of_ctrl_pts-1].X;
+            xyz.tran.y = tc->nurbs_block->ctrl_pts_ptr[tc->nurbs_block->nr_of_ctrl_pts-1].Y;
+            xyz.tran.z = tc->nurbs_block->ctrl_pts_ptr[tc->nurbs_block->nr_of_ctrl_pts-1].Z;
+            uvw.tran.x = tc->nurbs_block->ctrl_pts_ptr[tc->nurbs_block->nr_of_ctrl_pts-1].U;
+            uvw.tran.y = tc->nurbs_block->ctrl_pts_ptr[tc->nurbs_block->nr_of_ctrl_pts-1].V;
+            uvw.tran.z = tc->nurbs_block->ctrl_pts_ptr[tc->nurbs_block->nr_of_ctrl_pts-1].W;
+            abc.tran.x = tc->nurbs_block->ctrl_pts_ptr[tc->nurbs_block->nr_of_ctrl_pts-1].A;
+            abc.tran.y = tc->nurbs_block->ctrl_pts_ptr[tc->nurbs_block->nr_of_ctrl_pts-1].B;
+            abc.tran.z = tc->nurbs_block->ctrl_pts_ptr[tc->nurbs_block->nr_of_ctrl_pts-1].C;
         }
     }
     //DP ("GetEndPoint?(%d) R(%.2f) X(%.2f) Y(%.2f) Z(%.2f) A(%.2f)\n",of_endpoint, R, X, Y, Z, A);
-#if (TRACE != 1)
-    if( of_endpoint != 1) {
-
-    }
-#endif
     pos.tran = xyz.tran;
     pos.a = abc.tran.x;
     pos.b = abc.tran.y;
@@ -456,9 +607,8 @@ EmcPose tcGetPosReal(TC_STRUCT * tc, int of_endpoint)
     pos.v = uvw.tran.y;
     pos.w = uvw.tran.z;
     pos.s = s;
-    DP ("of_endpoint(%d) tc->id(%d) MotionType(%d) X(%.2f) Y(%.2f) Z(%.2f) W(%.2f)\n",
-    		of_endpoint, tc->id, tc->motion_type, pos.tran.x,
-    		pos.tran.y, pos.tran.z, pos.w);
+    DPT(emcmot_trace, DPT_TC_POS, tc->id, pos.tran.x, pos.tran.y,
+        pos.tran.z, pos.w);
     return pos;
 }
 
@@ -482,21 +632,32 @@ EmcPose tcGetPosReal(TC_STRUCT * tc, int of_endpoint)
  * @param    tcq       pointer to the new TC_QUEUE_STRUCT
  * @param	 _size	   size of the new queue
  * @param	 tcSpace   holds the space allocated for the new queue, allocated in motion.c
+ * @param	 coordsSpace  geometry of the tcs, _size entries, allocated in motion.c
+ * @param	 syncdioSpace synched I/O of the tcs, allocated in motion.c
+ * @param	 _syncdioSize entries in syncdioSpace
  *
  * @return	 int	   returns success or failure
  */   
-int tcqCreate(TC_QUEUE_STRUCT * tcq, int _size, TC_STRUCT * tcSpace)
+int tcqCreate(TC_QUEUE_STRUCT * tcq, int _size, TC_STRUCT * tcSpace,
+	      TC_COORDS * coordsSpace, syncdio_t * syncdioSpace,
+	      int _syncdioSize)
 {
-    if (_size <= 0 || 0 == tcq) {
+    if (_size <= 0 || _syncdioSize <= 0 || 0 == tcq) {
 	return -1;
     } else {
 	tcq->queue = tcSpace;
+	tcq->coords = coordsSpace;
 	tcq->size = _size;
 	tcq->_len = 0;
 	tcq->start = tcq->end = 0;
 	tcq->allFull = 0;
+	tcq->nurbs_pool = 0;
+	tcq->syncdio = syncdioSpace;
+	tcq->syncdio_size = _syncdioSize;
+	tcq->syncdio_len = 0;
+	tcq->syncdio_start = tcq->syncdio_end = 0;
 
-	if (0 == tcq->queue) {
+	if (0 == tcq->queue || 0 == tcq->coords || 0 == tcq->syncdio) {
 	    return -1;
 	}
 	return 0;
@@ -540,13 +701,6 @@ int tcqDelete(TC_QUEUE_STRUCT * tcq)
  */
 int tcqInit(TC_QUEUE_STRUCT * tcq)
 {
-#if (TRACE != 0)
-    if(!dptrace){
-        dptrace = fopen("tc.log","w");
-        fprintf(stderr,"tc.c dptrace not NULL \n");
-    }
-#endif
-
     if (0 == tcq) {
 	return -1;
     }
@@ -554,7 +708,13 @@ int tcqInit(TC_QUEUE_STRUCT * tcq)
     tcq->_len = 0;
     tcq->start = tcq->end = 0;
     tcq->allFull = 0;
+    tcq->syncdio_len = 0;
+    tcq->syncdio_start = tcq->syncdio_end = 0;
 
+    /* nothing queued, so no NURBS block is in use either */
+    if (tcq->nurbs_pool) {
+        nurbsPoolInit(tcq->nurbs_pool);
+    }
 
     return 0;
 }
@@ -565,14 +725,20 @@ int tcqInit(TC_QUEUE_STRUCT * tcq)
  *
  * This function adds a tc element at the end of the queue. 
  * It gets called by tpAddLine() and tpAddCircle()
+ * The geometry tc->coords points at and the synched I/O tc->syncdio
+ * points at, if any, are copied to the queue's own tables, and the
+ * queued tc points there instead.
  * 
  * @param    tcq       pointer to the new TC_QUEUE_STRUCT
  * @param	 tc        the new TC element to be added
  *
  * @return	 int	   returns success or failure
  */   
-int tcqPut(TC_QUEUE_STRUCT * tcq, TC_STRUCT tc)
+int tcqPut(TC_QUEUE_STRUCT * tcq, TC_STRUCT * tc)
 {
+    TC_STRUCT *t;
+    TC_COORDS *coords;
+
     /* check for initialized */
     if (0 == tcq || 0 == tcq->queue) {
 	    return -1;
@@ -582,9 +748,26 @@ int tcqPut(TC_QUEUE_STRUCT * tcq, TC_STRUCT tc)
     if (tcq->allFull) {
 	    return -1;
     }
+    if (tc->syncdio && tcq->syncdio_len == tcq->syncdio_size) {
+	    return -1;
+    }
 
     /* add it */
-    tcq->queue[tcq->end] = tc;
+    t = &tcq->queue[tcq->end];
+    coords = &tcq->coords[tcq->end];
+    *t = *tc;
+    if (tc->coords) {
+        *coords = *tc->coords;
+    } else {
+        memset(coords, 0, sizeof(*coords));
+    }
+    t->coords = coords;
+    if (tc->syncdio) {
+        t->syncdio = &tcq->syncdio[tcq->syncdio_end];
+        *t->syncdio = *tc->syncdio;
+        tcq->syncdio_end = (tcq->syncdio_end + 1) % tcq->syncdio_size;
+        tcq->syncdio_len++;
+    }
     tcq->_len++;
 
     /* update end ptr, modulo size of queue */
@@ -626,18 +809,17 @@ int tcqRemove(TC_QUEUE_STRUCT * tcq, int n)
 	    return -1;
     }
 
-#ifdef RTAPI_SIM
-    /* for NURBS only */
-    for(i=tcq->start;i<(tcq->start+n);i++){
-        if(tcq->queue[i].motion_type == TC_NURBS) {
-            //fprintf(stderr,"Remove TCNURBS PARAM\n");
-            free(tcq->queue[i].nurbs_block.knots_ptr);
-            free(tcq->queue[i].nurbs_block.ctrl_pts_ptr);
-            free(tcq->queue[i].nurbs_block.N);
-
+    /* give back NURBS and synched I/O storage, oldest first */
+    for (i = 0; i < n; i++) {
+        TC_STRUCT *tc = &tcq->queue[(tcq->start + i) % tcq->size];
+        if (tc->motion_type == TC_NURBS && tcq->nurbs_pool) {
+            nurbsPoolFree(tcq->nurbs_pool, tc->nurbs_block);
+        }
+        if (tc->syncdio) {
+            tcq->syncdio_start = (tcq->syncdio_start + 1) % tcq->syncdio_size;
+            tcq->syncdio_len--;
         }
     }
-#endif
 
     /* update start ptr and reset allFull flag and len */
     tcq->start = (tcq->start + n) % tcq->size;
@@ -693,6 +875,12 @@ TC_STRUCT *tcqItem(TC_QUEUE_STRUCT * tcq, int n, long period)
  */
 #define TC_QUEUE_MARGIN 10
 
+/*! 
+ * \def NURBS_POOL_MARGIN
+ * the last 1/NURBS_POOL_MARGIN of the NURBS pool is kept as margin
+ */
+#define NURBS_POOL_MARGIN 4
+
 /*! tcqFull() function
  *
  * \brief get the full status of the queue 
@@ -724,7 +912,158 @@ int tcqFull(TC_QUEUE_STRUCT * tcq)
 	    return 1;
     }
 
+    /* and for synched I/O, which every tc may carry */
+    if (tcq->syncdio_size > TC_QUEUE_MARGIN &&
+        tcq->syncdio_len >= tcq->syncdio_size - TC_QUEUE_MARGIN) {
+	    return 1;
+    }
+
+    /* likewise for the NURBS storage: a whole curve must still fit */
+    if (tcq->nurbs_pool &&
+        tcq->nurbs_pool->used >= tcq->nurbs_pool->size - tcq->nurbs_pool->size / NURBS_POOL_MARGIN) {
+	    return 1;
+    }
+
     /* we're not into the margin */
     return 0;
 }
 
+/*!
+ * \subsection NURBS pool functions
+ * Storage for the control points, knots, basis function buffer and
+ * arc-length table of each queued TC_NURBS segment. tpAddNURBS() takes
+ * a block when a curve starts, tcqRemove() gives it back. Both happen in
+ * queue order, which keeps the allocator a constant-time ring.
+ */
+
+/* doubles taken by a nurbs_block_t at the head of a block */
+#define NURBS_POOL_HEAD ((int) ((sizeof(nurbs_block_t) + sizeof(double) - 1) / sizeof(double)))
+
+/* doubles needed for one NURBS segment */
+static int nurbs_pool_block_size(nurbs_block_t * nb)
+{
+    int cp_size = (sizeof(CONTROL_POINT) + sizeof(double) - 1) / sizeof(double);
+
+    return NURBS_POOL_HEAD				/* the nurbs_block_t */
+	+ nb->nr_of_ctrl_pts * cp_size		/* ctrl_pts_ptr */
+	+ nb->nr_of_knots + nb->order		/* knots_ptr, 'order' extra */
+	+ nb->order + 1				/* N */
+	+ nurbs_alen_size(nb->nr_of_ctrl_pts);	/* alen_ptr */
+}
+
+/*! nurbsPoolCreate() function
+ *
+ * \brief Creates a pool for NURBS segment storage.
+ *
+ * It gets called by init_comm_buffers() in motion.c
+ *
+ * @param    pool      pointer to the new NURBS_POOL_STRUCT
+ * @param	 _size	   size of the pool in doubles
+ * @param	 space     memory for the pool, allocated in motion.c
+ *
+ * @return	 int	   returns success or failure
+ */
+int nurbsPoolCreate(NURBS_POOL_STRUCT * pool, int _size, double *space)
+{
+    if (_size <= 0 || 0 == pool || 0 == space) {
+	return -1;
+    }
+    pool->space = space;
+    pool->size = _size;
+    return nurbsPoolInit(pool);
+}
+
+/*! nurbsPoolInit() function
+ *
+ * \brief Releases every block of the pool.
+ *
+ * It gets called by tcqInit() when the queue is cleared or aborted.
+ */
+int nurbsPoolInit(NURBS_POOL_STRUCT * pool)
+{
+    if (0 == pool) {
+	return -1;
+    }
+    pool->used = 0;
+    pool->start = pool->end = 0;
+    return 0;
+}
+
+/*! nurbsPoolAlloc() function
+ *
+ * \brief Hands out the storage for one NURBS segment.
+ *
+ * A block never wraps around the end of the pool; the unused tail is
+ * charged to the block and returned together with it.
+ * The block starts with a copy of nb, which the TC_NURBS tc points at,
+ * so the tc itself carries no curve data.
+ * It gets called by tpAddNURBS() with the first block of a curve.
+ *
+ * @return	 nurbs_block_t*  the curve in the block, 0 if the pool is exhausted
+ */
+nurbs_block_t *nurbsPoolAlloc(NURBS_POOL_STRUCT * pool, nurbs_block_t * shape)
+{
+    int n, off, waste;
+    double *p;
+    nurbs_block_t *nb;
+
+    if (0 == pool || 0 == pool->space) {
+	return 0;
+    }
+
+    n = nurbs_pool_block_size(shape);
+    if (pool->used == 0) {
+	/* empty: restart at the bottom to avoid needless wrapping */
+	pool->start = pool->end = 0;
+    }
+    if (pool->end + n <= pool->size) {
+	off = pool->end;
+	waste = 0;
+    } else {
+	off = 0;
+	waste = pool->size - pool->end;
+    }
+    if (pool->used + waste + n > pool->size) {
+	return 0;
+    }
+
+    p = pool->space + off;
+    nb = (nurbs_block_t *) p;
+    *nb = *shape;
+    p += NURBS_POOL_HEAD;
+    nb->ctrl_pts_ptr = (CONTROL_POINT *) p;
+    p += nb->nr_of_ctrl_pts *
+	((sizeof(CONTROL_POINT) + sizeof(double) - 1) / sizeof(double));
+    nb->knots_ptr = p;
+    p += nb->nr_of_knots + nb->order;
+    nb->N = p;
+    p += nb->order + 1;
+    nb->alen_ptr = p;
+    nb->nr_of_alen = nurbs_alen_size(nb->nr_of_ctrl_pts);
+
+    pool->used += waste + n;
+    pool->end = (off + n) % pool->size;
+    nb->pool_next = pool->end;
+    nb->pool_used = waste + n;
+    return nb;
+}
+
+/*! nurbsPoolFree() function
+ *
+ * \brief Gives back the storage of the oldest NURBS segment.
+ *
+ * It gets called by tcqRemove().
+ */
+int nurbsPoolFree(NURBS_POOL_STRUCT * pool, nurbs_block_t * nb)
+{
+    if (0 == pool || 0 == nb || pool->used < (int) nb->pool_used) {
+	return -1;
+    }
+    pool->used -= nb->pool_used;
+    pool->start = nb->pool_next;
+    nb->ctrl_pts_ptr = 0;
+    nb->knots_ptr = 0;
+    nb->N = 0;
+    nb->alen_ptr = 0;
+    return 0;
+}
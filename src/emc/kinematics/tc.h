@@ -88,6 +88,18 @@ enum smlblnd_type {
   SMLBLND_DISABLE   // 2
 };
 
+/* geometry of a queued segment; kept apart from TC_STRUCT, in a table
+   with one entry per queue slot, as only the one or two moving segments
+   need it each cycle */
+typedef union {
+    PmLine9 line;
+    PmCircle9 circle;
+    PmSpindleSyncMotion spindle_sync;
+} TC_COORDS;
+
+/* TC_STRUCT holds what the planner reads and updates every cycle and
+   what look-ahead walks over; geometry, synched I/O and NURBS data
+   live in side tables and are reached through pointers */
 typedef struct {
     double cycle_time;
     double progress;        // where are we in the segment?  0..target
@@ -111,19 +123,20 @@ typedef struct {
     double dist_comp;
     int    on_feed_change;
     int    prev_state;
-    nurbs_block_t nurbs_block; // nurbs command block
-    double *N;                  // nurbs basis function buffer
+    nurbs_block_t *nurbs_block; // TC_NURBS: curve, at the head of its
+                                // NURBS pool block
     enum state_type accel_state;
     enum smlblnd_type seamless_blend_mode;
-    double nexttc_target;
+    double nexttc_target;   // distance past target tcRunCycle may plan its
+                            // deceleration over (SMLBLND_ENABLE only)
+    double junction_vel;    // fastest this tc may leave into the next one:
+                            // corner and feed limits (vel * cycle_time)
+    double finalvel;        // planned velocity at the end of this tc, from
+                            // the look-ahead pass (vel * cycle_time)
     
     int id;                 // segment's serial number
 
-    union {                 // describes the segment's start and end positions
-        PmLine9 line;
-        PmCircle9 circle;
-        PmSpindleSyncMotion spindle_sync;
-    } coords;
+    TC_COORDS *coords;      // the segment's start and end positions
 
     char motion_type;       // TC_LINEAR (coords.line) or 
                             // TC_CIRCULAR (coords.circle) or
@@ -143,7 +156,8 @@ typedef struct {
     int sync_accel;         // we're accelerating up to sync with the spindle
     unsigned char enables;  // Feed scale, etc, enable bits for this move
     char atspeed;           // wait for the spindle to be at-speed before starting this move
-    syncdio_t syncdio;      // synched DIO's for this move. what to turn on/off
+    syncdio_t *syncdio;     // synched DIO's for this move. what to turn on/off,
+                            // NULL if none
     int indexrotary;        // which rotary axis to unlock to make this move, -1 for none
 
     PmCartesian utvIn;      // unit tangent vector inward
@@ -158,21 +172,60 @@ EmcPose tcGetPosReal(TC_STRUCT * tc, int of_endpoint);
 PmCartesian tcGetEndingUnitVector(TC_STRUCT *tc);
 PmCartesian tcGetStartingUnitVector(TC_STRUCT *tc);
 
+/* pool of doubles holding the control points, knots and tables of queued
+   NURBS segments. Blocks are handed out and given back in queue order, so
+   the pool is a ring: allocation at end, release at start. */
+
+typedef struct {
+    double *space;		/* ptr to the pool memory */
+    int size;			/* size of pool, in doubles */
+    int used;			/* doubles now allocated, including wrap waste */
+    int start, end;		/* offsets of oldest block, next free double */
+} NURBS_POOL_STRUCT;
+
 /* queue of TC_STRUCT elements*/
 
 typedef struct {
     TC_STRUCT *queue;		/* ptr to the tcs */
+    TC_COORDS *coords;		/* geometry, one per tc slot */
     int size;			/* size of queue */
     int _len;			/* number of tcs now in queue */
     int start, end;		/* indices to next to get, next to put */
     int allFull;		/* flag meaning it's actually full */
+    NURBS_POOL_STRUCT *nurbs_pool; /* storage for TC_NURBS segments */
+    /* synched I/O of the queued tcs that have any, taken and given
+       back in queue order like the NURBS pool */
+    syncdio_t *syncdio;
+    int syncdio_size;
+    int syncdio_len;
+    int syncdio_start, syncdio_end;
 } TC_QUEUE_STRUCT;
 
+/* NURBS_POOL_STRUCT functions */
+
+/* create pool of _size doubles */
+extern int nurbsPoolCreate(NURBS_POOL_STRUCT * pool, int _size,
+			   double *space);
+
+/* release all blocks */
+extern int nurbsPoolInit(NURBS_POOL_STRUCT * pool);
+
+/* take a new block for a curve shaped like nb (counts and order set);
+   returns the block's own copy of nb, at its head, with ctrl_pts/knots/
+   N/alen pointing into the block, or 0 if the pool is exhausted */
+extern nurbs_block_t *nurbsPoolAlloc(NURBS_POOL_STRUCT * pool,
+				     nurbs_block_t * nb);
+
+/* give back the block of nb; must be the oldest one */
+extern int nurbsPoolFree(NURBS_POOL_STRUCT * pool, nurbs_block_t * nb);
+
 /* TC_QUEUE_STRUCT functions */
 
-/* create queue of _size */
+/* create queue of _size, with _size coords and _syncdioSize synched
+   I/O entries */
 extern int tcqCreate(TC_QUEUE_STRUCT * tcq, int _size,
-		     TC_STRUCT * tcSpace);
+		     TC_STRUCT * tcSpace, TC_COORDS * coordsSpace,
+		     syncdio_t * syncdioSpace, int _syncdioSize);
 
 /* free up queue */
 extern int tcqDelete(TC_QUEUE_STRUCT * tcq);
@@ -180,8 +233,9 @@ extern int tcqDelete(TC_QUEUE_STRUCT * tcq);
 /* reset queue to empty */
 extern int tcqInit(TC_QUEUE_STRUCT * tcq);
 
-/* put tc on end */
-extern int tcqPut(TC_QUEUE_STRUCT * tcq, TC_STRUCT tc);
+/* put a copy of tc on end; *tc->coords and *tc->syncdio are copied
+   into the queue's tables */
+extern int tcqPut(TC_QUEUE_STRUCT * tcq, TC_STRUCT * tc);
 
 /* remove n tcs from front */
 extern int tcqRemove(TC_QUEUE_STRUCT * tcq, int n);
@@ -36,22 +36,12 @@
 // #undef SMLBLND       // turn off seamless blending
 #define SMLBLND         // to evaluate seamless blending
 
-// to disable DP(): #define TRACE 0
-#define TRACE 0
-#include "dptrace.h"
-#if (TRACE!=0)
-static FILE* dptrace = 0;
-static uint32_t _dt = 0;
-#endif
+#include "dptrace_ring.h"
 
 #define CSS_TRACE 0
 #if (CSS_TRACE!=0)
-#if (TRACE==0)
 static FILE* csstrace = 0;
 static uint32_t _dt = 0;
-#else
-#undef CSS_TRACE // disable CSS_TRACE when TRACE is enabled
-#endif
 #endif
 
 #define EPSTHON 1e-6
@@ -61,10 +51,16 @@ extern emcmot_debug_t *emcmotDebug;
 
 static const double tiny = 1e-7;
 
+/* the NURBS tpAddNURBS() is collecting, one knot per call */
+static uint32_t nurbs_knots_todo;
+static nurbs_block_t *nurbs_to_tc;  // the curve, in its pool block
+
 int output_chan = 0;
 syncdio_t syncdio; //record tpSetDout's here
 
-int tpCreate(TP_STRUCT * tp, int _queueSize, TC_STRUCT * tcSpace)
+int tpCreate(TP_STRUCT * tp, int _queueSize, TC_STRUCT * tcSpace,
+             TC_COORDS * coordsSpace, syncdio_t * syncdioSpace,
+             int _syncdioSize)
 {
     if (0 == tp) {
 	return -1;
@@ -77,19 +73,14 @@ int tpCreate(TP_STRUCT * tp, int _queueSize, TC_STRUCT * tcSpace)
     }
 
     /* create the queue */
-    if (-1 == tcqCreate(&tp->queue, tp->queueSize, tcSpace)) {
+    if (-1 == tcqCreate(&tp->queue, tp->queueSize, tcSpace, coordsSpace,
+                        syncdioSpace, _syncdioSize)) {
 	return -1;
     }
-
-#if (TRACE!=0)
-    if (!dptrace) {
-        dptrace = fopen("tp.log", "w");
-        /* prepare header for gnuplot */
-        DPS ("%11s%6s%15s%15s%15s%15s%15s%15s%15s\n",
-                "#dt", "state", "req_vel", "cur_accel", "cur_vel", "progress%", "target", "dist_to_go", "tc_target");
-        _dt = 0;
-    }
-#endif
+    tp->lookahead = 0;
+    tp->lookahead_steps = 0;
+    tp->lookahead_top = -1;
+    tp->lookahead_tail = -1;
 
 #if (CSS_TRACE!=0)
     if (!csstrace) {
@@ -136,6 +127,10 @@ int tpClearDIOs() {
 int tpClear(TP_STRUCT * tp)
 {
     tcqInit(&tp->queue);
+    tp->lookahead_top = -1;
+    tp->lookahead_tail = -1;
+    nurbs_knots_todo = 0;   // tcqInit() emptied the pool under a partial NURBS
+    nurbs_to_tc = 0;
     tp->queueSize = 0;
     tp->goalPos = tp->currentPos;
     tp->nextId = 0;
@@ -176,6 +171,37 @@ int tpInit(TP_STRUCT * tp)
     return tpClear(tp);
 }
 
+// storage for the control points and knots of queued NURBS segments
+int tpSetNurbsPool(TP_STRUCT * tp, NURBS_POOL_STRUCT * pool)
+{
+    if (0 == tp || 0 == pool) {
+	return -1;
+    }
+
+    tp->queue.nurbs_pool = pool;
+
+    return 0;
+}
+
+// how many queued segments tpLookahead() may walk back over
+int tpSetLookahead(TP_STRUCT * tp, int depth)
+{
+    if (0 == tp) {
+	return -1;
+    }
+
+    if (depth < 0) {
+        depth = 0;
+    }
+    if (depth >= tp->queue.size) {
+        depth = tp->queue.size - 1;
+    }
+    tp->lookahead = depth;
+    tp->lookahead_steps = depth;
+
+    return 0;
+}
+
 int tpSetCycleTime(TP_STRUCT * tp, double secs)
 {
     if (0 == tp || secs <= 0.0) {
@@ -311,6 +337,7 @@ int tpAddSpindleSyncMotion(TP_STRUCT *tp, EmcPose end, double vel,
                   int ssm_mode, unsigned char enables)
 {
     TC_STRUCT tc;
+    TC_COORDS coords;
     PmLine line_xyz;
     PmPose start_xyz, end_xyz;
     PmCartesian abc, uvw;
@@ -349,7 +376,7 @@ int tpAddSpindleSyncMotion(TP_STRUCT *tp, EmcPose end, double vel,
     {   // G33.2
         tc.atspeed = 1;
         pmLineInit(&line_xyz, start_xyz, start_xyz);      // prevent motion for xyz for G33.2
-        tc.coords.spindle_sync.spindle_end_angle = end.s / 360.0;
+        coords.spindle_sync.spindle_end_angle = end.s / 360.0;
     }
 
 
@@ -358,9 +385,7 @@ int tpAddSpindleSyncMotion(TP_STRUCT *tp, EmcPose end, double vel,
 
     // tc.target: set as revolutions of spindle
     tc.target = line_xyz.tmag / tp->uu_per_rev;
-    DP("jerk(%f) req_vel(%f) req_acc(%f) ini_maxvel(%f)\n",
-        jerk, vel, acc, ini_maxvel);
-    DP("target(%f) uu_per_rev(%f)\n", tc.target, tp->uu_per_rev);
+    DPT(emcmot_trace, DPT_TP_RIGIDTAP, 0, jerk, vel, acc, tc.target);
 
     tc.progress = 0.0;
     tc.accel_state = ACCEL_S3;
@@ -380,11 +405,12 @@ int tpAddSpindleSyncMotion(TP_STRUCT *tp, EmcPose end, double vel,
     tc.cur_vel = 0.0;
     tc.blending = 0;
 
-    tc.coords.spindle_sync.xyz = line_xyz;
-    tc.coords.spindle_sync.abc = abc;
-    tc.coords.spindle_sync.uvw = uvw;
+    tc.coords = &coords;
+    coords.spindle_sync.xyz = line_xyz;
+    coords.spindle_sync.abc = abc;
+    coords.spindle_sync.uvw = uvw;
     // updated spindle speed constrain based on spindleSyncMotionMsg.vel of emccanon.cc
-    tc.coords.spindle_sync.spindle_reqvel = vel;
+    coords.spindle_sync.spindle_reqvel = vel;
 
     tc.motion_type = TC_SPINDLE_SYNC_MOTION;
 
@@ -393,6 +419,8 @@ int tpAddSpindleSyncMotion(TP_STRUCT *tp, EmcPose end, double vel,
     tc.tolerance = tp->tolerance;
     tc.seamless_blend_mode = SMLBLND_DISABLE;
     tc.nexttc_target = 0;
+    tc.junction_vel = 0;
+    tc.finalvel = 0;
 
     if(!tp->synchronized) {
         rtapi_print_msg(RTAPI_MSG_ERR, "Cannot add unsynchronized spindle sync move.\n");
@@ -404,42 +432,40 @@ int tpAddSpindleSyncMotion(TP_STRUCT *tp, EmcPose end, double vel,
     tc.velocity_mode = tp->velocity_mode;
     tc.enables = enables;
     tc.indexrotary = -1;
-    tc.coords.spindle_sync.spindle_start_pos_latch = 0;
-    tc.coords.spindle_sync.spindle_start_pos = 0;
-    tc.coords.spindle_sync.mode = ssm_mode;
+    coords.spindle_sync.spindle_start_pos_latch = 0;
+    coords.spindle_sync.spindle_start_pos = 0;
+    coords.spindle_sync.mode = ssm_mode;
 
     if ((syncdio.anychanged != 0) || (syncdio.sync_input_triggered != 0)) {
-	tc.syncdio = syncdio; //enqueue the list of DIOs that need toggling
-	tpClearDIOs(); // clear out the list, in order to prepare for the next time we need to use it
+	tc.syncdio = &syncdio; //enqueue the list of DIOs that need toggling
     } else {
-	tc.syncdio.anychanged = 0;
-        tc.syncdio.sync_input_triggered = 0;
+	tc.syncdio = NULL;
     }
 
     if (vel > 0)        // vel is requested spindle velocity
     {
-        tc.coords.spindle_sync.spindle_dir = 1.0;
+        coords.spindle_sync.spindle_dir = 1.0;
     } else
     {
-        tc.coords.spindle_sync.spindle_dir = -1.0;
+        coords.spindle_sync.spindle_dir = -1.0;
     }
 
-    if (tcqPut(&tp->queue, tc) == -1) {
+    if (tcqPut(&tp->queue, &tc) == -1) {
         rtapi_print_msg(RTAPI_MSG_ERR, "tcqPut failed.\n");
         return -1;
     }
     if (ssm_mode == 1)  // for G33.1
     {   // REVERSING
         pmLineInit(&line_xyz, end_xyz, start_xyz);  // reverse the line direction
-        tc.coords.spindle_sync.xyz = line_xyz;
+        coords.spindle_sync.xyz = line_xyz;
         if (vel > 0)
         {
-            tc.coords.spindle_sync.spindle_dir = -1.0;
+            coords.spindle_sync.spindle_dir = -1.0;
         } else
         {
-            tc.coords.spindle_sync.spindle_dir = 1.0;
+            coords.spindle_sync.spindle_dir = 1.0;
         }
-        if (tcqPut(&tp->queue, tc) == -1) {
+        if (tcqPut(&tp->queue, &tc) == -1) {
             rtapi_print_msg(RTAPI_MSG_ERR, "tcqPut failed.\n");
             return -1;
         }
@@ -455,6 +481,9 @@ int tpAddSpindleSyncMotion(TP_STRUCT *tp, EmcPose end, double vel,
     {   // for G33.2
         // TODO: need to change tp->goalPos ?
     }
+    if (tc.syncdio) {
+	tpClearDIOs(); // clear out the list, in order to prepare for the next time we need to use it
+    }
 
 
     tp->done = 0;
@@ -464,6 +493,226 @@ int tpAddSpindleSyncMotion(TP_STRUCT *tp, EmcPose end, double vel,
     return 0;
 }
 
+/*
+ Look-ahead
+
+ tcRunCycle() decelerates so as to stop at tc->target, or, with seamless
+ blending, at tc->target + tc->nexttc_target.  With nexttc_target set to
+ the distance tc needs to come down from finalvel, tc crosses its end at
+ about finalvel and nexttc carries on from there.  tpLookahead() sets
+ finalvel for the last tp->lookahead segments each time one is queued:
+ the fastest velocity from which the rest of the queue can still be run
+ and stopped at its last segment, under each segment's jerk and accel,
+ and no faster than the corner and feed limits (junction_vel) allow.
+
+ Velocities here are per cycle, like tc->cur_vel.  The forward pass, how
+ fast a segment can actually get going, is left to tcRunCycle(), which
+ starts from the velocity the previous segment really handed over.
+ */
+
+/* distance tc needs to stop from vel at zero accel; the S4 (-> S5) -> S6
+   profile tcRunCycle() decelerates on */
+static double tcStopDist(TC_STRUCT * tc, double vel)
+{
+    double a = tc->maxaccel;
+    double j = tc->jerk;
+
+    if (vel <= 0) {
+        return 0;
+    }
+    if (vel * j > a * a) {
+        // S4 -> S5 -> S6: mean vel is vel/2 over a/j + vel/a cycles
+        return 0.5 * vel * (a / j + vel / a);
+    }
+    // S4 -> S6
+    return vel * sqrt(vel / j);
+}
+
+/* inverse of tcStopDist(): fastest velocity tc can stop from within dist */
+static double tcStopVel(TC_STRUCT * tc, double dist)
+{
+    double a = tc->maxaccel;
+    double j = tc->jerk;
+
+    if (dist <= 0) {
+        return 0;
+    }
+    if (dist * j * j > a * a * a) {
+        return 0.5 * (sqrt(a * a * a * a / (j * j) + 8.0 * a * dist) - a * a / j);
+    }
+    return pow(dist * dist * j, 1.0 / 3.0);
+}
+
+/* whether tc may blend seamlessly into nexttc (the tests tpRunCycle
+   makes for SMLBLND_INIT segments) and, if so, tc->junction_vel */
+static int tpJunction(TP_STRUCT * tp, TC_STRUCT * tc, TC_STRUCT * nexttc)
+{
+    double dot, angle, rv, vel;
+    int this_synch_pos = tc->synchronized && !tc->velocity_mode;
+    int next_synch_pos = nexttc->synchronized && !nexttc->velocity_mode;
+
+    if (!tc->blend_with_next || nexttc->atspeed || !nexttc->maxaccel ||
+        (!this_synch_pos && next_synch_pos)) {
+        return 0;
+    }
+    // SMLBLND is for XYZ motion only; arcs always move in XYZ
+    if ((tc->motion_type == TC_LINEAR && tc->coords->line.xyz.tmag_zero) ||
+        (nexttc->motion_type == TC_LINEAR && nexttc->coords->line.xyz.tmag_zero)) {
+        return 0;
+    }
+
+    rv = tc->reqvel * tp->cycleTime;
+    if (rv > tc->maxvel) {
+        rv = tc->maxvel;
+    }
+    pmCartCartDot(tc->utvOut, nexttc->utvIn, &dot);
+    if (dot > 1.0) {
+        dot = 1.0;
+    } else if (dot < -1.0) {
+        dot = -1.0;
+    }
+    angle = acos(dot);
+    // centripetal accel at the corner: (angle / vel) * vel * vel
+    if (angle * rv >= tc->maxaccel) {
+        return 0;
+    }
+
+    vel = tc->maxvel;
+    if (nexttc->maxvel < vel) {
+        vel = nexttc->maxvel;
+    }
+    // same limit at feed overrides above 100%
+    if (angle > tiny && tc->maxaccel / angle < vel) {
+        vel = tc->maxaccel / angle;
+    }
+    // slow down ahead of a slower feed rather than inside nexttc
+    if (nexttc->reqvel < tc->reqvel &&
+        nexttc->reqvel * tp->cycleTime < vel) {
+        vel = nexttc->reqvel * tp->cycleTime;
+    }
+    // tpRunCycle() moves on by at most one tc per cycle
+    if (nexttc->target < vel) {
+        vel = nexttc->target;
+    }
+    tc->junction_vel = vel;
+    return 1;
+}
+
+/* The backward pass, from tp->lookahead_top down: each step raises the
+   finalvel of a segment to what the segment after it can now take.
+   Runways only ever grow, so the walk stops at the first segment that
+   gains nothing, once it is down to tp->lookahead_low.  All the walks of
+   one servo cycle share tp->lookahead steps.  When they run out, the walk
+   is cut short, and the next tpLookahead() or tpRunCycle() carries on
+   from the same segment; segments queued meanwhile, from
+   tp->lookahead_tail on, get one walk of their own after it. */
+static void tpLookaheadWalk(TP_STRUCT * tp)
+{
+    TC_STRUCT *tc, *nexttc;
+    double vel;
+    int n;
+
+    while (tp->lookahead_top >= 0) {
+        for (n = tp->lookahead_top; n >= 0 && n >= tp->lookahead_floor; n--) {
+            tc = tcqItem(&tp->queue, n, 0);
+            nexttc = tcqItem(&tp->queue, n + 1, 0);
+            if (!tc || !nexttc) {
+                break;
+            }
+            if (tp->lookahead_steps <= 0) {
+                tp->lookahead_top = n;
+                if (tp->lookahead_low > n) {
+                    tp->lookahead_low = n;
+                }
+                return;
+            }
+            tp->lookahead_steps--;
+            if (tc->seamless_blend_mode != SMLBLND_ENABLE) {
+                // no runway past here, but the junctions below the low
+                // mark still have to be walked from
+                if (n <= tp->lookahead_low) {
+                    break;
+                }
+                continue;
+            }
+            vel = tcStopVel(nexttc, nexttc->target + nexttc->nexttc_target);
+            if (vel > tc->junction_vel) {
+                vel = tc->junction_vel;
+            }
+            if (vel > tc->finalvel) {
+                tc->finalvel = vel;
+                tc->nexttc_target = tcStopDist(tc, vel);
+            } else if (n <= tp->lookahead_low) {
+                break;
+            }
+        }
+        tp->lookahead_top = -1;
+        if (tp->lookahead_tail >= 0) {
+            // every junction from the tail on is new, walk through them
+            tp->lookahead_top = tcqLen(&tp->queue) - 2;
+            tp->lookahead_low = tp->lookahead_tail;
+            tp->lookahead_floor = tp->lookahead_tail + 1 - tp->lookahead;
+            tp->lookahead_tail = -1;
+        }
+    }
+}
+
+/* tpRunCycle() removed the head of the queue */
+static void tpLookaheadPop(TP_STRUCT * tp)
+{
+    if (tp->lookahead_top < 0) {
+        return;
+    }
+    if (tp->lookahead_top > 0) {
+        tp->lookahead_top--;
+    }
+    tp->lookahead_low--;
+    tp->lookahead_floor--;
+    if (tp->lookahead_tail > 0) {
+        tp->lookahead_tail--;
+    }
+}
+
+/* Settles the junction into the segment just queued, then walks back
+   from there over the last tp->lookahead segments, or after the walk
+   that is still unfinished. */
+static void tpLookahead(TP_STRUCT * tp)
+{
+    TC_STRUCT *tc, *nexttc;
+    int last;
+
+    if (tp->lookahead <= 0) {
+        return;
+    }
+    last = tcqLen(&tp->queue) - 1;
+    tc = tcqItem(&tp->queue, last - 1, 0);
+    nexttc = tcqItem(&tp->queue, last, 0);
+    if (!tc || tc->seamless_blend_mode != SMLBLND_INIT || tc->blending) {
+        return;
+    }
+    // NURBS and spindle synced moves are left to tpRunCycle()
+    if ((tc->motion_type != TC_LINEAR && tc->motion_type != TC_CIRCULAR) ||
+        (nexttc->motion_type != TC_LINEAR && nexttc->motion_type != TC_CIRCULAR)) {
+        return;
+    }
+    if (!tpJunction(tp, tc, nexttc)) {
+        tc->seamless_blend_mode = SMLBLND_DISABLE;
+        return;
+    }
+    tc->seamless_blend_mode = SMLBLND_ENABLE;
+
+    if (tp->lookahead_top >= 0) {
+        if (tp->lookahead_tail < 0) {
+            tp->lookahead_tail = last - 1;
+        }
+    } else {
+        tp->lookahead_top = last - 1;
+        tp->lookahead_low = last - 1;
+        tp->lookahead_floor = last - tp->lookahead;
+    }
+    tpLookaheadWalk(tp);
+}
+
 // Add a straight line to the tc queue.  This is a coordinated
 // move in any or all of the six axes.  it goes from the end
 // of the previous move to the new end specified here at the
@@ -475,6 +724,7 @@ int tpAddLine(TP_STRUCT * tp, EmcPose end, int type, double vel,
               char atspeed, int indexrotary)
 {
     TC_STRUCT tc;
+    TC_COORDS coords;
     PmLine line_xyz, line_uvw, line_abc;
     PmPose start_xyz, end_xyz;
     PmPose start_uvw, end_uvw;
@@ -548,15 +798,18 @@ int tpAddLine(TP_STRUCT * tp, EmcPose end, int type, double vel,
     tc.cur_vel = 0.0;
     tc.blending = 0;
 
-    tc.coords.line.xyz = line_xyz;
-    tc.coords.line.uvw = line_uvw;
-    tc.coords.line.abc = line_abc;
+    tc.coords = &coords;
+    coords.line.xyz = line_xyz;
+    coords.line.uvw = line_uvw;
+    coords.line.abc = line_abc;
     tc.motion_type = TC_LINEAR;
     tc.canon_motion_type = type;
     tc.blend_with_next = tp->termCond == TC_TERM_COND_BLEND;
     tc.tolerance = tp->tolerance;
     tc.seamless_blend_mode = SMLBLND_INIT;
     tc.nexttc_target = 0;
+    tc.junction_vel = 0;
+    tc.finalvel = 0;
 
     tc.synchronized = tp->synchronized;
     tc.velocity_mode = tp->velocity_mode;
@@ -566,20 +819,22 @@ int tpAddLine(TP_STRUCT * tp, EmcPose end, int type, double vel,
     tc.indexrotary = indexrotary;
 
     if ((syncdio.anychanged != 0) || (syncdio.sync_input_triggered != 0)) {
-	tc.syncdio = syncdio; //enqueue the list of DIOs that need toggling
-	tpClearDIOs(); // clear out the list, in order to prepare for the next time we need to use it
+	tc.syncdio = &syncdio; //enqueue the list of DIOs that need toggling
     } else {
-	tc.syncdio.anychanged = 0;
-        tc.syncdio.sync_input_triggered = 0;
+	tc.syncdio = NULL;
     }
     
     tc.utvIn = line_xyz.uVec;
     tc.utvOut = line_xyz.uVec;
     
-    if (tcqPut(&tp->queue, tc) == -1) {
+    if (tcqPut(&tp->queue, &tc) == -1) {
         rtapi_print_msg(RTAPI_MSG_ERR, "tcqPut failed.\n");
 	return -1;
     }
+    if (tc.syncdio) {
+	tpClearDIOs(); // clear out the list, in order to prepare for the next time we need to use it
+    }
+    tpLookahead(tp);
 
     tp->goalPos = end;      // remember the end of this move, as it's
                             // the start of the next one.
@@ -603,6 +858,7 @@ int tpAddCircle(TP_STRUCT * tp, EmcPose end, PmCartesian center,
         double acc, double ini_maxjerk, unsigned char enables, char atspeed) 
 {
     TC_STRUCT tc;
+    TC_COORDS coords;
     PmCircle circle;
     PmLine line_uvw, line_abc;
     PmPose start_xyz, end_xyz;
@@ -671,15 +927,18 @@ int tpAddCircle(TP_STRUCT * tp, EmcPose end, PmCartesian center,
     tc.cur_vel = 0.0;
     tc.blending = 0;
 
-    tc.coords.circle.xyz = circle;
-    tc.coords.circle.uvw = line_uvw;
-    tc.coords.circle.abc = line_abc;
+    tc.coords = &coords;
+    coords.circle.xyz = circle;
+    coords.circle.uvw = line_uvw;
+    coords.circle.abc = line_abc;
     tc.motion_type = TC_CIRCULAR;
     tc.canon_motion_type = type;
     tc.blend_with_next = tp->termCond == TC_TERM_COND_BLEND;
     tc.tolerance = tp->tolerance;
     tc.seamless_blend_mode = SMLBLND_INIT;
     tc.nexttc_target = 0;
+    tc.junction_vel = 0;
+    tc.finalvel = 0;
 
     tc.synchronized = tp->synchronized;
     tc.velocity_mode = tp->velocity_mode;
@@ -689,19 +948,21 @@ int tpAddCircle(TP_STRUCT * tp, EmcPose end, PmCartesian center,
     tc.indexrotary = -1;
     
     if ((syncdio.anychanged != 0) || (syncdio.sync_input_triggered != 0)) {
-	tc.syncdio = syncdio; //enqueue the list of DIOs that need toggling
-	tpClearDIOs(); // clear out the list, in order to prepare for the next time we need to use it
+	tc.syncdio = &syncdio; //enqueue the list of DIOs that need toggling
     } else {
-	tc.syncdio.anychanged = 0;
-        tc.syncdio.sync_input_triggered = 0;
+	tc.syncdio = NULL;
     }
 
     tc.utvIn = circle.utvIn;
     tc.utvOut = circle.utvOut;
     
-    if (tcqPut(&tp->queue, tc) == -1) {
+    if (tcqPut(&tp->queue, &tc) == -1) {
 	return -1;
     }
+    if (tc.syncdio) {
+	tpClearDIOs(); // clear out the list, in order to prepare for the next time we need to use it
+    }
+    tpLookahead(tp);
 
     tp->goalPos = end;
     tp->done = 0;
@@ -719,21 +980,13 @@ int tpAddCircle(TP_STRUCT * tp, EmcPose end, PmCartesian center,
 // allowed; we are guaranteed to have a move in xyz so target is
 // always the circle/arc/helical length.
 
-#ifndef RTAPI_SIM
-#warning "implement rtai_kmalloc() for nurbs"
-static CONTROL_POINT ctrl_pts_array[8192];
-static double knots_array[8192];
-static double N_array[8192];
-#endif
-
 int tpAddNURBS(TP_STRUCT *tp, int type, nurbs_block_t nurbs_block, EmcPose pos,
         unsigned char enables, double vel, double ini_maxvel,
         double ini_maxacc, double ini_maxjerk) 
 {
     static TC_STRUCT tc;
-    static uint32_t knots_todo = 0, order = 0,
-            nr_of_ctrl_pts = 0, nr_of_knots = 0;
-    nurbs_block_t *nurbs_to_tc = &tc.nurbs_block;//EmcPose* control_points;
+    static uint32_t order = 0, nr_of_ctrl_pts = 0, nr_of_knots = 0;
+    uint32_t knots_todo = nurbs_knots_todo;
     if (ini_maxjerk == 0) {
         rtapi_print_msg(RTAPI_MSG_ERR, "jerk is not provided or jerk is 0\n");
         assert(ini_maxjerk > 0);
@@ -755,20 +1008,19 @@ int tpAddNURBS(TP_STRUCT *tp, int type, nurbs_block_t nurbs_block, EmcPose pos,
         nr_of_ctrl_pts = nurbs_block.nr_of_ctrl_pts;
         nr_of_knots = nurbs_block.nr_of_knots;
 
-#ifndef RTAPI_SIM
-#warning "implement rtai_kmalloc() for nurbs"
-	nurbs_to_tc->ctrl_pts_ptr = ctrl_pts_array;
-	nurbs_to_tc->knots_ptr = knots_array;
-	nurbs_to_tc->N = N_array;
-#else
-	// SIM
-        nurbs_to_tc->ctrl_pts_ptr = (CONTROL_POINT*) malloc(
-                sizeof(CONTROL_POINT) * nurbs_block.nr_of_ctrl_pts);
-        /* knots array: allocate 'order' of extra knots for THE-NURBS-BOOK-Algorithm */
-        nurbs_to_tc->knots_ptr = (double*) malloc(sizeof(double)
-                * (nurbs_block.nr_of_knots + nurbs_block.order));
-        nurbs_to_tc->N = (double*) malloc(sizeof(double) * (order + 1));
-#endif
+        if (order < 2 || order > NURBS_MAX_ORDER) {
+            rtapi_print_msg(RTAPI_MSG_ERR,
+                    "NURBS order %d not supported\n", order);
+            knots_todo = 0;
+            return -1;
+        }
+        nurbs_to_tc = nurbsPoolAlloc(tp->queue.nurbs_pool, &nurbs_block);
+        if (0 == nurbs_to_tc) {
+            rtapi_print_msg(RTAPI_MSG_ERR,
+                    "NURBS pool exhausted, raise nurbs_pool_size\n");
+            knots_todo = 0;
+            return -1;
+        }
         nurbs_to_tc->axis_mask = nurbs_block.axis_mask;
 
 
@@ -796,10 +1048,12 @@ int tpAddNURBS(TP_STRUCT *tp, int type, nurbs_block_t nurbs_block, EmcPose pos,
         }
         knots_todo -= 1;
     }
+    nurbs_knots_todo = knots_todo;
 
 
     if ((0 == knots_todo)) {
         int i;
+        double alen;
         /* duplicate 'order' of extra knots for THE-NURBS-BOOK-Algorithm */
         for (i=0; i<nurbs_block.order; i++) {
             nurbs_to_tc->knots_ptr[nr_of_knots + i] = nurbs_block.knot;
@@ -823,11 +1077,17 @@ int tpAddNURBS(TP_STRUCT *tp, int type, nurbs_block_t nurbs_block, EmcPose pos,
         }
 #endif
         // process tc , tp
+        // arc-length table for constant tool-tip speed along the curve
+        alen = nurbs_alen_init(nurbs_to_tc);
 
         tc.sync_accel = 0;
         tc.cycle_time = tp->cycleTime;
 
-        tc.target = nurbs_block.curve_len;
+        if (nurbs_block.curve_len > 0) {
+            tc.target = nurbs_block.curve_len;
+        } else {
+            tc.target = alen;
+        }
 
         tc.progress = 0.0;
         tc.accel_state = ACCEL_S3;
@@ -842,11 +1102,10 @@ int tpAddNURBS(TP_STRUCT *tp, int type, nurbs_block_t nurbs_block, EmcPose pos,
         tc.active = 0;
         tc.atspeed = 0;//atspeed;  // FIXME-eric(L)
 
-        tc.nurbs_block.curve_len = nurbs_block.curve_len;
-        tc.nurbs_block.order = nurbs_block.order;
-        tc.nurbs_block.nr_of_ctrl_pts = nurbs_block.nr_of_ctrl_pts;
-        tc.nurbs_block.nr_of_knots = nurbs_block.nr_of_knots;
-        tc.nurbs_block.reqvel = vel;
+        tc.nurbs_block = nurbs_to_tc;
+        tc.coords = NULL;
+        nurbs_to_tc->curve_len = tc.target;
+        nurbs_to_tc->reqvel = vel;
 
         tc.cur_accel = 0.0;
         tc.cur_vel = 0.0;
@@ -857,6 +1116,8 @@ int tpAddNURBS(TP_STRUCT *tp, int type, nurbs_block_t nurbs_block, EmcPose pos,
         tc.tolerance = tp->tolerance;
         tc.seamless_blend_mode = SMLBLND_INIT;
         tc.nexttc_target = 0;
+        tc.junction_vel = 0;
+        tc.finalvel = 0;
 
         tc.synchronized = tp->synchronized;
         tc.velocity_mode = tp->velocity_mode;
@@ -865,20 +1126,24 @@ int tpAddNURBS(TP_STRUCT *tp, int type, nurbs_block_t nurbs_block, EmcPose pos,
         tc.enables = enables;
         tc.indexrotary = -1;
         if ((syncdio.anychanged != 0) || (syncdio.sync_input_triggered != 0)) {
-            tc.syncdio = syncdio; //enqueue the list of DIOs that need toggling
-            tpClearDIOs(); // clear out the list, in order to prepare for the next time we need to use it
+            tc.syncdio = &syncdio; //enqueue the list of DIOs that need toggling
         } else {
-            tc.syncdio.anychanged = 0;
-            tc.syncdio.sync_input_triggered = 0;
+            tc.syncdio = NULL;
         }
     
         //TODO: tc.utvIn = nurbs...;
         //TODO: tc.utvOut = nurbs...;
         
-        if (tcqPut(&tp->queue, tc) == -1) {
+        if (tcqPut(&tp->queue, &tc) == -1) {
             rtapi_print_msg(RTAPI_MSG_ERR, "tcqPut failed.\n");
+            nurbsPoolFree(tp->queue.nurbs_pool, nurbs_to_tc);
+            nurbs_to_tc = 0;
             return -1;
         }
+        nurbs_to_tc = 0;    // owned by the queued tc now
+        if (tc.syncdio) {
+            tpClearDIOs(); // clear out the list, in order to prepare for the next time we need to use it
+        }
 
         tp->goalPos = pos; // remember the end of this move, ie. last control point
         // the start of the next one.
@@ -1243,7 +1508,8 @@ void tcRunCycle(TP_STRUCT *tp, TC_STRUCT *tc)
             // check if dist would be greater than tc_target at next cycle
             if (tc_target < (dist - (tc->cur_vel + 1.5 * tc->cur_accel - 2.1666667 * tc->jerk))) {
                 tc->accel_state = ACCEL_S4;
-                DPS("should stay in S4 and keep decel\n");
+                DPT(emcmot_trace, DPT_TP_DECEL, ACCEL_S4, tc_target, dist,
+                    tc->cur_vel, tc->cur_accel);
                 break;
             }
                     
@@ -1260,7 +1526,8 @@ void tcRunCycle(TP_STRUCT *tp, TC_STRUCT *tc)
             }
             if ((tc->cur_vel + tc->cur_accel * t + 0.5 * tc->jerk * t * t) <= req_vel) {
                 tc->accel_state = ACCEL_S6;
-                DPS("S4: hit velocity rule; move to S6\n");
+                DPT(emcmot_trace, DPT_TP_REQVEL, ACCEL_S4, tc->cur_vel,
+                    tc->cur_accel, req_vel, 0);
                 break;
             }
             
@@ -1312,7 +1579,8 @@ void tcRunCycle(TP_STRUCT *tp, TC_STRUCT *tc)
             // check if dist would be greater than tc_target at next cycle
             if (tc_target < (dist - (tc->cur_vel + 1.5 * tc->cur_accel))) {
                 tc->accel_state = ACCEL_S5;
-                DPS("should stay in S5 and keep decel\n");
+                DPT(emcmot_trace, DPT_TP_DECEL, ACCEL_S5, tc_target, dist,
+                    tc->cur_vel, tc->cur_accel);
                 break;
             }
 
@@ -1369,11 +1637,10 @@ void tcRunCycle(TP_STRUCT *tp, TC_STRUCT *tc)
         }
     }
 
-    DPS("%11u%6d%15.5f%15.5f%15.5f%15.5f%15.5f%15.5f%15.5f\n",
-        _dt, tc->accel_state, tc->reqvel * tc->feed_override * tc->cycle_time, 
-        tc->cur_accel, tc->cur_vel, tc->progress/tc->target, tc->target, 
-        (tc->target - tc->progress), tc_target);
     tc->distance_to_go = tc->target - tc->progress;
+    DPT(emcmot_trace, DPT_TP_CYCLE, tc->accel_state,
+        tc->reqvel * tc->feed_override * tc->cycle_time, tc->cur_vel,
+        tc->cur_accel, tc->distance_to_go);
     //TODO: this assert will be triggered with rockman.ini: 
     //      assert (tc->cur_vel >= 0);
 }
@@ -1381,22 +1648,25 @@ void tcRunCycle(TP_STRUCT *tp, TC_STRUCT *tc)
 void tpToggleDIOs(TC_STRUCT * tc) 
 {
     int i = 0;
-    if (tc->syncdio.anychanged != 0) { // we have DIO's to turn on or off
+    if (tc->syncdio == NULL) {
+        return;
+    }
+    if (tc->syncdio->anychanged != 0) { // we have DIO's to turn on or off
 	for (i=0; i < emcmotConfig->numDIO; i++) {
-//            if (!(tc->syncdio.dio_mask & (1 << i))) continue;
-	    if (tc->syncdio.dios[i] > 0) emcmotDioWrite(i, 1); // turn DIO[i] on
-	    if (tc->syncdio.dios[i] < 0) emcmotDioWrite(i, 0); // turn DIO[i] off
+//            if (!(tc->syncdio->dio_mask & (1 << i))) continue;
+	    if (tc->syncdio->dios[i] > 0) emcmotDioWrite(i, 1); // turn DIO[i] on
+	    if (tc->syncdio->dios[i] < 0) emcmotDioWrite(i, 0); // turn DIO[i] off
 	}
 	for (i=0; i < emcmotConfig->numAIO; i++) {
-            if (!(tc->syncdio.aio_mask & (1 << i))) continue;
-	    emcmotAioWrite(i, tc->syncdio.aios[i]); // set AIO[i]
+            if (!(tc->syncdio->aio_mask & (1 << i))) continue;
+	    emcmotAioWrite(i, tc->syncdio->aios[i]); // set AIO[i]
         }
-	tc->syncdio.anychanged = 0; //we have turned them all on/off, nothing else to do for this TC the next time
+	tc->syncdio->anychanged = 0; //we have turned them all on/off, nothing else to do for this TC the next time
     }
 
-    if (tc->syncdio.sync_input_triggered != 0) {
-        emcmotSyncInputWrite(tc->syncdio.sync_in, tc->syncdio.timeout, tc->syncdio.wait_type);
-        tc->syncdio.sync_input_triggered = 0; //we have turned them all on/off, nothing else to do for this TC the next time
+    if (tc->syncdio->sync_input_triggered != 0) {
+        emcmotSyncInputWrite(tc->syncdio->sync_in, tc->syncdio->timeout, tc->syncdio->wait_type);
+        tc->syncdio->sync_input_triggered = 0; //we have turned them all on/off, nothing else to do for this TC the next time
     }
 }
 
@@ -1419,10 +1689,6 @@ static int tpGetRotaryIsUnlocked(int axis) {
 
 int tpRunCycle(TP_STRUCT * tp, long period)
 {
-#if (TRACE!=0)
-    _dt += 1;
-#endif
-
     TC_STRUCT *tc, *nexttc;
     EmcPose primary_before, primary_after;
     EmcPose secondary_before, secondary_after;
@@ -1433,12 +1699,19 @@ int tpRunCycle(TP_STRUCT * tp, long period)
 
     emcmotStatus->tcqlen = tcqLen(&tp->queue);
     emcmotStatus->requested_vel = 0.0;
+    // finish the backward pass with what is left of this cycle's steps
+    if (tp->lookahead_top >= 0) {
+        tpLookaheadWalk(tp);
+    }
+    tp->lookahead_steps = tp->lookahead;    // for the next command handler
     tc = tcqItem(&tp->queue, 0, period);
     if (!tc) {
         // this means the motion queue is empty.  This can represent
         // the end of the program OR QUEUE STARVATION.  In either case,
         // I want to stop.  Some may not agree that's what it should do.
         tcqInit(&tp->queue);
+        tp->lookahead_top = -1;
+        tp->lookahead_tail = -1;
         tp->goalPos = tp->currentPos;
         tp->done = 1;
         tp->depth = tp->activeDepth = 0;
@@ -1477,6 +1750,7 @@ int tpRunCycle(TP_STRUCT * tp, long period)
 
         // done with this move
         tcqRemove(&tp->queue, 1);
+        tpLookaheadPop(tp);
         tp->depth = tcqLen(&tp->queue);
 
         // so get next move
@@ -1517,6 +1791,8 @@ int tpRunCycle(TP_STRUCT * tp, long period)
             (tc->cur_vel == 0.0 && !nexttc) || 
             (tc->cur_vel == 0.0 && nexttc && nexttc->cur_vel == 0.0) ) {
             tcqInit(&tp->queue);
+            tp->lookahead_top = -1;
+            tp->lookahead_tail = -1;
             tp->goalPos = tp->currentPos;
             tp->done = 1;
             tp->depth = tp->activeDepth = 0;
@@ -1601,65 +1877,64 @@ int tpRunCycle(TP_STRUCT * tp, long period)
 
     emcmotStatus->spindleSync = tc->synchronized;
     if(tc->synchronized) {
-        if (!tc->coords.spindle_sync.spindle_start_pos_latch)
+        if (!tc->coords->spindle_sync.spindle_start_pos_latch)
         {
-            if (tc->coords.spindle_sync.mode < 2)
+            if (tc->coords->spindle_sync.mode < 2)
             {   // G33, G33.1
-                tc->coords.spindle_sync.spindle_start_pos_latch = 1;
-                tc->coords.spindle_sync.spindle_start_pos = emcmotStatus->carte_pos_cmd.s;
+                tc->coords->spindle_sync.spindle_start_pos_latch = 1;
+                tc->coords->spindle_sync.spindle_start_pos = emcmotStatus->carte_pos_cmd.s;
                 tc->cur_vel = fabs(emcmotStatus->spindle.curr_vel_rps) * tc->cycle_time;
 
                 /* bitmap for rigid-tapping-AXIS_X */
-                if (tc->coords.spindle_sync.xyz.uVec.x > tiny)
+                if (tc->coords->spindle_sync.xyz.uVec.x > tiny)
                 {
-                    emcmotStatus->xuu_per_rev = tc->uu_per_rev * tc->coords.spindle_sync.xyz.uVec.x;
+                    emcmotStatus->xuu_per_rev = tc->uu_per_rev * tc->coords->spindle_sync.xyz.uVec.x;
                 }
                 /* bitmap for rigid-tapping-AXIS_Y */
-                if (tc->coords.spindle_sync.xyz.uVec.y > tiny)
+                if (tc->coords->spindle_sync.xyz.uVec.y > tiny)
                 {
-                    emcmotStatus->yuu_per_rev = tc->uu_per_rev * tc->coords.spindle_sync.xyz.uVec.y;
+                    emcmotStatus->yuu_per_rev = tc->uu_per_rev * tc->coords->spindle_sync.xyz.uVec.y;
                     printf("emcmotStatus->yuu_per_rev(%f)\n",emcmotStatus->yuu_per_rev);
                 }
                 /* bitmap for rigid-tapping-AXIS_Z */
-                if (tc->coords.spindle_sync.xyz.uVec.z > tiny)
+                if (tc->coords->spindle_sync.xyz.uVec.z > tiny)
                 {
-                    emcmotStatus->zuu_per_rev = tc->uu_per_rev * tc->coords.spindle_sync.xyz.uVec.z;
+                    emcmotStatus->zuu_per_rev = tc->uu_per_rev * tc->coords->spindle_sync.xyz.uVec.z;
                 }
                 return 0;   // for atspeed detection
             }
-            else if (tc->coords.spindle_sync.mode == 2)
+            else if (tc->coords->spindle_sync.mode == 2)
             {   // G33.2, wait for spindle to be stopped completely
                 if (emcmotStatus->spindle.curr_vel_rps == 0)
                 {
                     double start_angle; // unit: rev
-                    tc->coords.spindle_sync.spindle_start_pos_latch = 1;
-                    tc->coords.spindle_sync.spindle_start_pos = emcmotStatus->carte_pos_cmd.s;
+                    tc->coords->spindle_sync.spindle_start_pos_latch = 1;
+                    tc->coords->spindle_sync.spindle_start_pos = emcmotStatus->carte_pos_cmd.s;
 
                     tc->cur_vel = 0;
 
                     start_angle = emcmotStatus->carte_pos_cmd.s - floor(emcmotStatus->carte_pos_cmd.s);
-                    tc->target = (tc->coords.spindle_sync.spindle_end_angle - start_angle) * tc->coords.spindle_sync.spindle_dir;
+                    tc->target = (tc->coords->spindle_sync.spindle_end_angle - start_angle) * tc->coords->spindle_sync.spindle_dir;
                     if (tc->target < 0)
                     {
                         tc->target += 1;        // move toward spindle_end_angle
                     }
-                    DP("start_angle(%f)\n", start_angle);
-                    DP("end_angle(%f)\n", tc->coords.spindle_sync.spindle_end_angle);
-                    DP("emcmotStatus->spindle.direction(%d)\n", emcmotStatus->spindle.direction);
-                    DP("tc->coords.spindle_sync.spindle_dir(%f)\n", tc->coords.spindle_sync.spindle_dir);
-                    DP("target(%f)\n", tc->target);
+                    DPT(emcmot_trace, DPT_TP_ORIENT,
+                        emcmotStatus->spindle.direction, start_angle,
+                        tc->coords->spindle_sync.spindle_end_angle,
+                        tc->coords->spindle_sync.spindle_dir, tc->target);
                 }
                 return 0;   // for spindle stop detection
             }
         }
 
-        if (tc->coords.spindle_sync.mode < 2)
+        if (tc->coords->spindle_sync.mode < 2)
         {   // G33, G33.1
             tc->reqvel = fabs(emcmotStatus->spindle.speed_req_rps) * emcmotStatus->net_spindle_scale;
         }
-        else if (tc->coords.spindle_sync.mode == 2)
+        else if (tc->coords->spindle_sync.mode == 2)
         {   // G33.2, unit for spindle_reqvel is RPS
-            tc->reqvel = fabs(tc->coords.spindle_sync.spindle_reqvel) * emcmotStatus->net_spindle_scale;
+            tc->reqvel = fabs(tc->coords->spindle_sync.spindle_reqvel) * emcmotStatus->net_spindle_scale;
         }
 
         if(tp->aborting) {
@@ -1723,7 +1998,7 @@ int tpRunCycle(TP_STRUCT * tp, long period)
             k = acos(dot)/rv;
             ca = k * rv * rv;
             // SMLBLND is for XYZ motion only
-            if ((ca < tc->maxaccel) && (!tc->coords.line.xyz.tmag_zero) && (!nexttc->coords.line.xyz.tmag_zero)) {
+            if ((ca < tc->maxaccel) && (!tc->coords->line.xyz.tmag_zero) && (!nexttc->coords->line.xyz.tmag_zero)) {
                 // allow seamless blending, SMLBLND
                 // also, (nexttc->atspeed == 0)
                 tc->seamless_blend_mode = SMLBLND_ENABLE;
@@ -1731,25 +2006,8 @@ int tpRunCycle(TP_STRUCT * tp, long period)
             } else {
                 tc->seamless_blend_mode = SMLBLND_DISABLE;
             }
-            DPS("tc->utvOut: x(%f) y(%f) z(%f)\n",
-                tc->utvOut.x,
-                tc->utvOut.y,
-                tc->utvOut.z);
-            DPS("nexttc->utvIn: x(%f) y(%f) z(%f)\n",
-                nexttc->utvIn.x,
-                nexttc->utvIn.y,
-                nexttc->utvIn.z);
-            DPS("k(%f) rv(%f) ca(%f) tc.maxaccel(%f) tc.jerk(%f)\n",
-                 k,
-                 rv * 1000000,
-                 ca * 1000000,
-                 tc->maxaccel * 1000000,
-                 tc->jerk * 1000000);
-            if (tc->seamless_blend_mode == SMLBLND_ENABLE) {
-                DPS("SMLBLND_ENABLE\n");
-            } else {
-                DPS("SMLBLND_DISABLE\n");
-            }
+            DPT(emcmot_trace, DPT_TP_BLEND, tc->seamless_blend_mode,
+                k, rv, ca, tc->maxaccel);
         }
 #endif // SMLBLND
     }
@@ -1772,6 +2030,7 @@ int tpRunCycle(TP_STRUCT * tp, long period)
         next_progress = tc->progress - tc->target;
         
         tcqRemove(&tp->queue, 1);
+        tpLookaheadPop(tp);
         tp->depth = tcqLen(&tp->queue);
 
         // so get next move
@@ -57,13 +57,27 @@ typedef struct {
     int velocity_mode; 	        /* TRUE if spindle sync is in velocity mode,
 				   FALSE if in position mode */
     double uu_per_rev;          /* user units per spindle revolution */
+    int lookahead;              /* number of queued segments the junction
+                                   velocities are planned over, 0 for off */
+    int lookahead_steps;        /* backward steps tpLookahead() may still
+                                   take this cycle */
+    int lookahead_top;          /* queue index the backward pass carries on
+                                   from, -1 if it is done */
+    int lookahead_low;          /* it goes on at least down to here, */
+    int lookahead_floor;        /* and at most down to here */
+    int lookahead_tail;         /* first junction queued after it was cut
+                                   short, -1 if none */
 } TP_STRUCT;
 
-extern int tpCreate(TP_STRUCT * tp, int _queueSize, TC_STRUCT * tcSpace);
+extern int tpCreate(TP_STRUCT * tp, int _queueSize, TC_STRUCT * tcSpace,
+                    TC_COORDS * coordsSpace, syncdio_t * syncdioSpace,
+                    int _syncdioSize);
 extern int tpClear(TP_STRUCT * tp);
 extern int tpInit(TP_STRUCT * tp);
+extern int tpSetNurbsPool(TP_STRUCT * tp, NURBS_POOL_STRUCT * pool);
 extern int tpClearDIOs(void);
 extern int tpSetPosCompEnWrite(TP_STRUCT *tp, int en_flag, int pos_comp_ref);
+extern int tpSetLookahead(TP_STRUCT * tp, int depth);
 extern int tpSetCycleTime(TP_STRUCT * tp, double secs);
 extern int tpSetVmax(TP_STRUCT * tp, double vmax, double ini_maxvel);
 extern int tpSetVlimit(TP_STRUCT * tp, double limit);
@@ -0,0 +1,200 @@
+/********************************************************************
+* Description: tp_bench.c
+*   Runs the trajectory planner outside of motion, on a dense 3D
+*   surfacing toolpath with synched I/O, and reports the time the
+*   servo thread would spend in it per cycle.
+*
+* Author:
+* License: GPL Version 2
+* System: Linux
+*
+* Copyright (c) 2014 All rights reserved.
+*
+* Last change:
+********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rtapi.h"
+#include "rtapi_math.h"
+#include "posemath.h"
+#include "tc.h"
+#include "tp.h"
+#include "motion.h"
+#include "hal.h"
+#include "mot_priv.h"
+#include "motion_debug.h"
+
+/* what tp.c expects from the rest of motion */
+emcmot_status_t *emcmotStatus;
+emcmot_config_t *emcmotConfig;
+emcmot_debug_t *emcmotDebug;
+
+static int dio_writes;
+
+void rtapi_print_msg(int level, const char *fmt, ...)
+{
+}
+
+void emcmotDioWrite(int index, char value)
+{
+    dio_writes++;
+}
+
+void emcmotAioWrite(int index, double value)
+{
+}
+
+void emcmotSyncInputWrite(int index, double timeout, int wait_type)
+{
+}
+
+void emcmotSetRotaryUnlock(int axis, int unlock)
+{
+}
+
+int emcmotGetRotaryIsUnlocked(int axis)
+{
+    return 1;
+}
+
+#define CYCLE 0.001		/* servo period, s */
+#define ROWS 10
+#define STEPS 500		/* segments per row */
+#define DIO_EVERY 100		/* a synched M62/M63 every so many moves */
+
+/* the rest of the servo thread (HAL components, kinematics, drivers)
+   runs between two planner cycles; walking this much memory stands in
+   for what it leaves in the caches */
+#define OTHER (3 << 20)
+static volatile char other[OTHER];
+
+static void servo_others(void)
+{
+    int i;
+
+    for (i = 0; i < OTHER; i += 64) {
+        other[i]++;
+    }
+}
+
+static int cmp(const void *a, const void *b)
+{
+    double d = *(const double *) a - *(const double *) b;
+    return d < 0 ? -1 : d > 0;
+}
+
+static double nsnow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* point n of a raster over a gently curved surface: 0.1mm steps along
+   x, with z following the surface, rows 1mm apart */
+static EmcPose surface(int n)
+{
+    EmcPose p;
+    int row = n / (STEPS + 1), step = n % (STEPS + 1);
+    double x = (row & 1) ? (STEPS - step) * 0.1 : step * 0.1;
+
+    memset(&p, 0, sizeof(p));
+    p.tran.x = x;
+    p.tran.y = row * 1.0;
+    p.tran.z = 2.0 * sin(x * 0.05) * cos(row * 0.05);
+    return p;
+}
+
+int main(void)
+{
+    TP_STRUCT *tp;
+    EmcPose end, pos;
+    int n = 1, total = ROWS * (STEPS + 1), cycles = 0, fail = 0;
+    double t, t0, sum = 0;
+    static double times[1000000];
+
+    emcmotStatus = calloc(1, sizeof(emcmot_status_t));
+    emcmotConfig = calloc(1, sizeof(emcmot_config_t));
+    emcmotDebug = calloc(1, sizeof(emcmot_debug_t));
+    emcmotStatus->net_feed_scale = 1.0;
+    emcmotConfig->numDIO = 4;
+    emcmotConfig->numAIO = 4;
+    tp = &emcmotDebug->coord_tp;
+
+    if (-1 == tpCreate(tp, DEFAULT_TC_QUEUE_SIZE, emcmotDebug->queueTcSpace,
+                       emcmotDebug->queueCoordsSpace,
+                       emcmotDebug->queueSyncdioSpace,
+                       DEFAULT_TC_SYNCDIO_SIZE)) {
+        printf("tpCreate failed\n*fail*\n");
+        return 1;
+    }
+    tpSetCycleTime(tp, CYCLE);
+    tpSetVmax(tp, 50.0, 100.0);
+    tpSetVlimit(tp, 100.0);
+    tpSetTermCond(tp, TC_TERM_COND_BLEND, 0.0);
+    tpSetLookahead(tp, DEFAULT_TP_LOOKAHEAD);
+    end = surface(0);
+    tpSetPos(tp, end);
+
+    printf("sizeof(TC_STRUCT) %lu, queue of %d\n",
+           (unsigned long) sizeof(TC_STRUCT), DEFAULT_TC_QUEUE_SIZE);
+
+    do {
+        // task keeps the queue topped up, a couple of moves a cycle
+        int room = cycles ? 2 : DEFAULT_TC_QUEUE_SIZE;
+
+        servo_others();
+        t0 = nsnow();
+        while (n < total && room-- > 0 && !tcqFull(&tp->queue)) {
+            if (n % DIO_EVERY == 0) {
+                tpSetDout(tp, 0, (n / DIO_EVERY) & 1, 0);
+            }
+            end = surface(n);
+            if (-1 == tpAddLine(tp, end, 2, 50.0, 100.0, 1000.0, 1e5,
+                                0, 0, -1)) {
+                printf("tpAddLine %d failed\n", n);
+                fail++;
+                break;
+            }
+            n++;
+        }
+        tpRunCycle(tp, (long) (CYCLE * 1e9));
+        t = nsnow() - t0;
+        // the first cycle fills the queue, which task does beforehand
+        if (cycles > 0) {
+            sum += t;
+            times[cycles - 1] = t;
+        }
+        cycles++;
+    } while (!fail && (n < total || !tpIsDone(tp)) && cycles < 1000000);
+
+    pos = tpGetPos(tp);
+    printf("%d moves in %d cycles (%.1fs of motion)\n", total - 1, cycles,
+           cycles * CYCLE);
+    qsort(times, cycles - 1, sizeof(double), cmp);
+    printf("servo cycle: mean %.0fns  99%% %.0fns  worst %.0fns\n",
+           sum / (cycles - 1), times[(cycles - 1) * 99 / 100],
+           times[cycles - 2]);
+
+    if (fabs(pos.tran.x - end.tran.x) > 1e-6 ||
+        fabs(pos.tran.y - end.tran.y) > 1e-6 ||
+        fabs(pos.tran.z - end.tran.z) > 1e-6) {
+        printf("stopped at %f %f %f, not at %f %f %f\n", pos.tran.x,
+               pos.tran.y, pos.tran.z, end.tran.x, end.tran.y, end.tran.z);
+        fail++;
+    }
+    if (dio_writes < (total - 1) / DIO_EVERY) {
+        printf("%d synched DIO writes, expected %d\n", dio_writes,
+               (total - 1) / DIO_EVERY);
+        fail++;
+    }
+    if (fail) {
+        printf("*fail*\n");
+        return 1;
+    }
+    return 0;
+}
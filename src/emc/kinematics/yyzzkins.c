@@ -32,6 +32,9 @@
 #if (TRACE!=0)
 static FILE *dptrace;
 #endif
+#include "dptrace_ring.h"
+static dpt_ring_t *trace;	/* kinematicsForward/Inverse trace ring */
+static int trace_shmem_id = -1;
 
 typedef struct yyzz_pins {
     hal_float_t *yy_offset;
@@ -63,8 +66,8 @@ int kinematicsForward(const double *joints,
     YY_OFFSET = joints[0] - (joints[1] * GANTRY_POLARITY_Y);
     ZZ_OFFSET = joints[2] - (joints[3] * GANTRY_POLARITY_Z);
 
-    DP("kFWD: y(%f), z(%f), j0(%f), j1(%f), j2(%f), j3(%f)\n",
-        pos->tran.y, pos->tran.z, joints[0], joints[1], joints[2], joints[3]);
+    DPT(trace, DPT_KINS_FWD, 0, pos->tran.x, pos->tran.y, pos->tran.z,
+        joints[3]);
 
     return 0;
 }
@@ -80,8 +83,8 @@ int kinematicsInverse(const EmcPose * pos,
     joints[2] = pos->tran.z;
     joints[3] = (pos->tran.z - ZZ_OFFSET) * GANTRY_POLARITY_Z;
 
-    DP("kINV: j0(%f), j1(%f), j2(%f), j3(%f), y(%f), z(%f)\n",
-              joints[0], joints[1], joints[2], joints[3], pos->tran.y, pos->tran.z);
+    DPT(trace, DPT_KINS_INV, 0, pos->tran.x, pos->tran.y, pos->tran.z,
+        joints[3]);
 
     return 0;
 }
@@ -128,6 +131,7 @@ int rtapi_app_main(void)
     if ((res = hal_pin_float_new("yyzzkins.gantry-polarity-y", HAL_IN, &(yyzz_pins->gantry_polarity_y), comp_id)) < 0) goto error;
     if ((res = hal_pin_float_new("yyzzkins.gantry-polarity-z", HAL_IN, &(yyzz_pins->gantry_polarity_z), comp_id)) < 0) goto error;
 
+    trace_shmem_id = dpt_open(&trace, DPT_RING_KINS, comp_id);
     hal_ready(comp_id);
     DP ("done\n");
     return 0;
@@ -141,4 +145,10 @@ error:
     return res;
 }
 
-void rtapi_app_exit(void) { hal_exit(comp_id); }
+void rtapi_app_exit(void)
+{
+    if (trace_shmem_id >= 0) {
+        rtapi_shmem_delete(trace_shmem_id, comp_id);
+    }
+    hal_exit(comp_id);
+}
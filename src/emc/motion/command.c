@@ -68,6 +68,7 @@
 #include "motion_types.h"
 #include "stdio.h"
 #include "assert.h"
+#include "rtapi_atomic.h"
 #include <sync_cmd.h>
 // Mark strings for translation, but defer translation to userspace
 #define _(s) (s)
@@ -356,10 +357,12 @@ static int is_feed_type(int motion_type)
 }
 
 /*
-  emcmotCommandHandler() is called each main cycle to read the
-  shared memory buffer
+  execute_command() runs the command emcmotCommand points to, either the
+  command slot or an entry of the command ring.  The body keeps the
+  indent of the if-new-command block of emcmotCommandHandler() it came
+  from
  */
-void emcmotCommandHandler(void *arg, long period)
+static void execute_command(void)
 {
     int joint_num, axis_num;
     int n;
@@ -368,41 +371,11 @@ void emcmotCommandHandler(void *arg, long period)
     double tmp1;
     emcmot_comp_entry_t *comp_entry;
     char issue_atspeed = 0;
-    int msg_level_before = rtapi_get_msg_level();
-    //DEBUG: int msg_level_now = msg_level_before | RTAPI_MSG_DBG;
-    int msg_level_now = msg_level_before;
-    static int counter = 0;
-    rtapi_set_msg_level(msg_level_now);
-    counter = counter+1;
-    check_stuff ( "before command_handler()" );
-
-
-    if (*emcmot_hal_data->rcmd_state == RCMD_UPDATE_POS_REQ) {
-        // prevent execute EMCMOT_END_PROBE for G38.x
-        return;
-    }
-
-    /* check for split read */
-    if (emcmotCommand->head != emcmotCommand->tail)
-    {
-        emcmotDebug->split++;
-        return;			/* not really an error */
-    }
 
-    if (emcmotCommand->commandNum != emcmotStatus->commandNumEcho) {
         /* increment head count-- we'll be modifying emcmotStatus */
         emcmotStatus->head++;
         emcmotDebug->head++;
 
-        /* got a new command-- echo command and number... */
-        emcmotStatus->commandEcho = emcmotCommand->command;
-        emcmotStatus->commandNumEcho = emcmotCommand->commandNum;
-
-        /* clear status value by default */
-        emcmotStatus->commandStatus = EMCMOT_COMMAND_OK;
-
-        /* ...and process command */
-
         /* Many commands uses "command->joint" to indicate which joint they
 	   wish to operate on.  This code eliminates the need to copy
 	   command->joint to "joint_num", limit check it, and then set "joint"
@@ -959,12 +932,17 @@ void emcmotCommandHandler(void *arg, long period)
 
         case EMCMOT_SET_NURBS:
             //TODO: have to consider several condition
-            tpAddNURBS(&emcmotDebug->coord_tp, emcmotCommand->motion_type,
+            if (-1 == tpAddNURBS(&emcmotDebug->coord_tp, emcmotCommand->motion_type,
                     emcmotCommand->nurbs_block, emcmotCommand->pos,
                     emcmotStatus->enables_new, emcmotCommand->vel,
                     emcmotCommand->ini_maxvel,
                     emcmotCommand->ini_maxacc,
-                    emcmotCommand->ini_maxjerk);
+                    emcmotCommand->ini_maxjerk)) {
+                reportError(_("can't add NURBS move"));
+                emcmotStatus->commandStatus = EMCMOT_COMMAND_BAD_EXEC;
+                tpAbort(&emcmotDebug->coord_tp);
+                SET_MOTION_ERROR_FLAG(1);
+            }
             break;
         case EMCMOT_SET_LINE:
             /* emcmotDebug->coord_tp up a linear move */
@@ -1855,7 +1833,73 @@ void emcmotCommandHandler(void *arg, long period)
         emcmotStatus->tail = emcmotStatus->head;
         emcmotConfig->tail = emcmotConfig->head;
         emcmotDebug->tail = emcmotDebug->head;
+}
+
+/*
+  emcmotCommandHandler() is called each main cycle to read the
+  shared memory buffer
+ */
+void emcmotCommandHandler(void *arg, long period)
+{
+    emcmot_command_ring_t *ring = &emcmotStruct->command_ring;
+    emcmot_command_t *slot = &emcmotStruct->command;
+    unsigned int put;
+    int new_command, status;
+    int msg_level_before = rtapi_get_msg_level();
+    //DEBUG: int msg_level_now = msg_level_before | RTAPI_MSG_DBG;
+    int msg_level_now = msg_level_before;
+    static int counter = 0;
+    rtapi_set_msg_level(msg_level_now);
+    counter = counter+1;
+    check_stuff ( "before command_handler()" );
+
+
+    if (*emcmot_hal_data->rcmd_state == RCMD_UPDATE_POS_REQ) {
+        // prevent execute EMCMOT_END_PROBE for G38.x
+        return;
+    }
 
+    /* check for split read */
+    if (slot->head != slot->tail) {
+        emcmotDebug->split++;
+        new_command = 0;	/* not really an error, get it next cycle */
+    } else {
+        new_command = (slot->commandNum != emcmotStatus->commandNumEcho);
+    }
+
+    /* the slot is looked at before the ring: task queues into the ring
+       before it writes the slot, so everything queued ahead of a new
+       slot command is visible now and runs first */
+    rtapi_smp_rmb();
+    put = ring->put;
+    while (ring->get != put) {
+        emcmotCommand = &ring->slot[ring->get % EMCMOT_COMMAND_RING_SIZE];
+        /* queued commands are acknowledged through ring->get, keep the
+           status of the last slot command for usrmotWriteEmcmotCommand() */
+        status = emcmotStatus->commandStatus;
+        emcmotStatus->commandStatus = EMCMOT_COMMAND_OK;
+        execute_command();
+        if (emcmotStatus->commandStatus != EMCMOT_COMMAND_OK) {
+            ring->failed++;
+            ring->failedNum = emcmotCommand->commandNum;
+        }
+        emcmotStatus->commandStatus = status;
+        /* done with the entry before task may overwrite it */
+        rtapi_smp_mb();
+        ring->get++;
+    }
+    emcmotCommand = slot;
+
+    if (new_command) {
+        /* got a new command-- echo command and number... */
+        emcmotStatus->commandEcho = emcmotCommand->command;
+        emcmotStatus->commandNumEcho = emcmotCommand->commandNum;
+
+        /* clear status value by default */
+        emcmotStatus->commandStatus = EMCMOT_COMMAND_OK;
+
+        /* ...and process command */
+        execute_command();
     }
     /* end of: if-new-command */
     check_stuff ( "after command_handler()" );
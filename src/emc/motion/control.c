@@ -50,22 +50,10 @@ KINEMATICS_INVERSE_FLAGS iflags = 0;
 /* 1/servo cycle time */
 double servo_freq;
 
-// to disable DP(): #define TRACE 0
-#define TRACE 0
-#include "dptrace.h"
-#if (TRACE!=0)
-static FILE* dptrace = 0;
-static uint32_t _dt = 0;
-#endif
-
 #define CSS_TRACE 0
 #if (CSS_TRACE!=0)
-#if (TRACE==0)
 static FILE* csstrace = 0;
 static uint32_t _dt = 0;
-#else
-#undef CSS_TRACE // disable CSS_TRACE when TRACE is enabled
-#endif
 #endif
 
 /* debugging function - prints a cartesean pose (multplies the floating
@@ -298,17 +286,6 @@ void emcmotController(void *arg, long period)
     emcmot_hal_data->last_period_ns = this_run * 1e6 / cpu_khz;
 #endif
 
-#if (TRACE!=0)
-    if(!dptrace) {
-        dptrace = fopen("control.log", "w");
-        /* prepare header for gnuplot */
-        DPS ("#%10s%10s%10s%10s%10s%17s%17s%17s%17s\n",
-                "dt", "x.pos_cmd", "y.pos_cmd", "z.pos_cmd", "a.pos_cmd",
-                "joint[0]", "joint[1]", "joint[2]", "joint[3]");
-    }
-    _dt+=1;
-#endif
-
 #if (CSS_TRACE!=0)
     if (!csstrace) {
         csstrace = fopen("css.log", "w");
@@ -410,6 +387,7 @@ void emcmotController(void *arg, long period)
     emcmotStatus->heartbeat++;
     /* set tail to head, to indicate work complete */
     emcmotStatus->tail = emcmotStatus->head;
+    emcmotPublishStatus();
     /* clear init flag */
     first_pass = 0;
 
@@ -740,7 +718,8 @@ static int update_current_pos = 0;
 static void handle_special_cmd(void)
 {
     if (*emcmot_hal_data->req_cmd_sync == 1) {
-        DP("req_cmd_sync(%d)\n", *emcmot_hal_data->req_cmd_sync);
+        DPT(emcmot_trace, DPT_CTRL_CMD_SYNC, *emcmot_hal_data->req_cmd_sync,
+            0, 0, 0, 0);
         emcmotStatus->sync_pos_cmd = 1;
         update_current_pos = 1;
         printf("ERROR: handle_special_cmd(): req_cmd_sync(1)\n");
@@ -1294,13 +1273,10 @@ static void get_spindle_cmds (double cycle_time)
                         (emcmotStatus->spindle.css_factor / 60.0
                          - denom * fabs(emcmotStatus->spindle.curr_vel_rps))
                         * emcmotStatus->spindle.direction; // (unit/(2*PI*sec)
-        DP ("css_req(%f)(unit/sec)\n", denom * emcmotStatus->spindle.speed_req_rps * 2 * M_PI);
-        DP ("css_cur(%f)\n", denom * emcmotStatus->spindle.curr_vel_rps * 2 * M_PI);
-        DP ("css_error(%f)(unit/(2*PI*sec))\n", emcmotStatus->spindle.css_error);
-        DP ("speed(%f) denom(%f) s.curr_vel(%f) css_factor(%f)\n",
-                             speed, denom, emcmotStatus->spindle.curr_vel_rps, emcmotStatus->spindle.css_factor);
-        DP ("spindle.direction(%d)\n",
-                             emcmotStatus->spindle.direction);
+        DPT(emcmot_trace, DPT_CTRL_CSS, emcmotStatus->spindle.direction,
+            denom * emcmotStatus->spindle.speed_req_rps * 2 * M_PI,
+            denom * emcmotStatus->spindle.curr_vel_rps * 2 * M_PI,
+            emcmotStatus->spindle.css_error, denom);
 //        DP ("synched-joint-vel(%f)(unit/sec)\n",emcmotStatus->spindle.curr_vel_rps * tp->uu_per_rev);
 #if (CSS_TRACE!=0)
         /* prepare data for gnuplot */
@@ -1495,13 +1471,11 @@ static void get_pos_cmds(long period)
                 kinematicsInverse(&emcmotStatus->carte_pos_cmd, positions,
                         &iflags, &fflags);
                 /* copy to joint structures and spline them up */
-                DPS("%11u", _dt);
-                DPS("x(%10.5f)%10.5f%10.5f%10.5fs(%10.5f)",
-                        emcmotStatus->carte_pos_cmd.tran.x,
-                        emcmotStatus->carte_pos_cmd.tran.y,
-                        emcmotStatus->carte_pos_cmd.tran.z,
-                        emcmotStatus->carte_pos_cmd.a,
-                        emcmotStatus->carte_pos_cmd.s);
+                DPT(emcmot_trace, DPT_CTRL_COORD, 0,
+                    emcmotStatus->carte_pos_cmd.tran.x,
+                    emcmotStatus->carte_pos_cmd.tran.y,
+                    emcmotStatus->carte_pos_cmd.tran.z,
+                    emcmotStatus->carte_pos_cmd.s);
                 for (joint_num = 0; joint_num < emcmotConfig->numJoints; joint_num++) {
                     /* point to joint struct */
                     joint = &joints[joint_num];
@@ -1524,9 +1498,9 @@ static void get_pos_cmds(long period)
                 /* interpolate to get new one */
                 joint->pos_cmd = cubicInterpolate(&(joint->cubic), 0, 0, 0, 0);
                 joint->vel_cmd = (joint->pos_cmd - old_pos_cmd) * servo_freq;
-                DPS ("%17.7f", joint->pos_cmd);
+                DPT(emcmot_trace, DPT_CTRL_JOINT, joint_num, joint->pos_cmd,
+                    joint->vel_cmd, joint->coarse_pos, 0);
             }
-            DPS("\n");
             /* report motion status */
             SET_MOTION_INPOS_FLAG(0);
             if (tpIsDone(&emcmotDebug->coord_tp)) {
@@ -1608,26 +1582,21 @@ static void get_pos_cmds(long period)
                     emcmotDebug->teleop_data.currentVel.c *
                     servo_period;
 
-            DP("EMCMOT_MOTION_TELEOP: emcmotStatus->carte_pos_cmd:\n");
-            DPS("x.pos_cmd(%f) x.cur_vel(%f) x.desired_vel(%f) x.desired_acc(%f)\n",
+            DPT(emcmot_trace, DPT_CTRL_TELEOP, 0,
                     emcmotStatus->carte_pos_cmd.tran.x,
                     emcmotDebug->teleop_data.currentVel.tran.x,
                     emcmotDebug->teleop_data.desiredVel.tran.x,
-                    emcmotDebug->teleop_data.desiredAccell.tran.x
-            );
-            DPS("y.pos_cmd(%f) y.cur_vel(%f) y.desired_vel(%f) y.desired_acc(%f)\n",
+                    emcmotDebug->teleop_data.desiredAccell.tran.x);
+            DPT(emcmot_trace, DPT_CTRL_TELEOP, 1,
                     emcmotStatus->carte_pos_cmd.tran.y,
                     emcmotDebug->teleop_data.currentVel.tran.y,
                     emcmotDebug->teleop_data.desiredVel.tran.y,
-                    emcmotDebug->teleop_data.desiredAccell.tran.y
-            );
-
-            DPS("z.pos_cmd(%f) z.cur_vel(%f) z.desired_vel(%f) z.desired_acc(%f)\n",
+                    emcmotDebug->teleop_data.desiredAccell.tran.y);
+            DPT(emcmot_trace, DPT_CTRL_TELEOP, 2,
                     emcmotStatus->carte_pos_cmd.tran.z,
                     emcmotDebug->teleop_data.currentVel.tran.z,
                     emcmotDebug->teleop_data.desiredVel.tran.z,
-                    emcmotDebug->teleop_data.desiredAccell.tran.z
-            );
+                    emcmotDebug->teleop_data.desiredAccell.tran.z);
 
             /* the next position then gets run through the inverse kins,
                    to compute the next positions of the joints */
@@ -64,10 +64,32 @@
 #define DEFAULT_AIO 16
 
 /* size of motion queue
- * a TC_STRUCT is about 512 bytes so this queue is
- * about a megabyte.  */
+ * a TC_STRUCT is about 350 bytes and its geometry about 600 more, so
+ * this queue is a bit under two megabytes.  */
 #define DEFAULT_TC_QUEUE_SIZE 2000
 
+/* number of queued segments that may carry synched I/O (M62-M68)
+ * at once; each takes about 650 bytes */
+#define DEFAULT_TC_SYNCDIO_SIZE 256
+
+/* number of queued segments the trajectory planner looks ahead when
+ * planning the velocity at each junction; every tpAddLine/tpAddCircle
+ * walks back at most this far */
+#define DEFAULT_TP_LOOKAHEAD 200
+
+/* with the simulator's virtual clock, motion holds the clock while a
+ * program is running with fewer segments than this queued, so task and
+ * the interpreter keep ahead of it (SIM_RTAPI_CLOCK in rtapi/README) */
+#define DEFAULT_SIM_QUEUE_MIN 20
+
+/* size of NURBS storage pool, in doubles
+ * a NURBS segment takes about 12 doubles per control point plus its
+ * knots and arc-length table, so this holds some 60 curves of 100
+ * control points (1 MB) */
+#define DEFAULT_NURBS_POOL_SIZE 131072
+/* shmem key of the NURBS storage pool ("NRBS") */
+#define NURBS_POOL_SHMEM_KEY 0x4e524253
+
 /* max following error */
 #define DEFAULT_MAX_FERROR 100
 
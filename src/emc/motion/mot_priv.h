@@ -11,6 +11,8 @@
 #ifndef MOT_PRIV_H
 #define MOT_PRIV_H
 
+#include "dptrace_ring.h"
+
 /***********************************************************************
 *                       TYPEDEFS, ENUMS, ETC.                          *
 ************************************************************************/
@@ -274,6 +276,9 @@ extern struct emcmot_config_t *emcmotConfig;
 extern struct emcmot_debug_t *emcmotDebug;
 extern struct emcmot_error_t *emcmotError;
 
+/* trace ring of tp.c, tc.c and control.c, 0 if there is none */
+extern dpt_ring_t *emcmot_trace;
+
 /***********************************************************************
 *                    PUBLIC FUNCTION PROTOTYPES                        *
 ************************************************************************/
@@ -282,6 +287,7 @@ extern struct emcmot_error_t *emcmotError;
 extern void emcmotCommandHandler(void *arg, long period);
 extern void emcmotController(void *arg, long period);
 extern void emcmotSetCycleTime(unsigned long nsec);
+extern void emcmotPublishStatus(void);
 
 /* these are related to synchronized I/O */
 extern void emcmotDioWrite(int index, char value);
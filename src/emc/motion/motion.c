@@ -20,6 +20,7 @@
 #include "motion_struct.h"
 #include "mot_priv.h"
 #include "rtapi_math.h"
+#include "rtapi_atomic.h"
 #include "sync_cmd.h"
 
 // Mark strings for translation, but defer translation to userspace
@@ -54,6 +55,14 @@ static int num_aio = DEFAULT_AIO;	/* default number of motion synched AIO */
 RTAPI_MP_INT(num_aio, "number of analog inputs/outputs");
 static int num_sync_in = DEFAULT_DIO;
 RTAPI_MP_INT(num_sync_in,"number of synchornized input from 7i43");
+static int nurbs_pool_size = DEFAULT_NURBS_POOL_SIZE;
+RTAPI_MP_INT(nurbs_pool_size, "NURBS control point/knot storage (doubles)");
+static int tp_lookahead = DEFAULT_TP_LOOKAHEAD;
+RTAPI_MP_INT(tp_lookahead, "segments planned ahead for junction velocities (0: off)");
+#ifdef SIM
+static int sim_queue_min = DEFAULT_SIM_QUEUE_MIN;
+RTAPI_MP_INT(sim_queue_min, "virtual clock: hold it while fewer segments are queued (0: off)");
+#endif
 /***********************************************************************
  *                  GLOBAL VARIABLE DEFINITIONS                         *
  ************************************************************************/
@@ -95,6 +104,7 @@ struct emcmot_status_t *emcmotStatus = 0;
 struct emcmot_config_t *emcmotConfig = 0;
 struct emcmot_debug_t *emcmotDebug = 0;
 struct emcmot_error_t *emcmotError = 0;	/* unused for RT_FIFO */
+dpt_ring_t *emcmot_trace = 0;	/* binary trace ring, see dptrace_ring.h */
 
 /***********************************************************************
  *                  LOCAL VARIABLE DECLARATIONS                         *
@@ -102,6 +112,8 @@ struct emcmot_error_t *emcmotError = 0;	/* unused for RT_FIFO */
 
 /* RTAPI shmem ID - for comms with higher level user space stuff */
 static int emc_shmem_id;	/* the shared memory ID */
+static int nurbs_shmem_id;	/* shmem ID of the NURBS storage pool */
+static int trace_shmem_id = -1;	/* shmem ID of the trace ring */
 
 static int mot_comp_id;	/* component ID for motion module */
 
@@ -170,6 +182,30 @@ static void emc_message_handler(msg_level_t level, const char *fmt, va_list ap)
     va_end(apc);
 }
 
+#ifdef SIM
+/* With the simulator's virtual clock, motion would run the queue dry
+   long before task and the interpreter refill it.  Hold the clock while
+   a program is streaming into a short queue, but never while commands
+   wait, or task would wait for motion as motion waits for task.  The
+   value changes with every command task sends; once rtapi_app has held
+   the clock long enough on one value (task may be waiting for the queue
+   to drain), it runs until task sends more. */
+static long clock_hold(void)
+{
+    emcmot_command_ring_t *ring = &emcmotStruct->command_ring;
+    emcmot_command_t *slot = &emcmotStruct->command;
+
+    if (ring->get != ring->put || slot->commandNum != emcmotStatus->commandNumEcho) {
+        return 0;
+    }
+    if (!emcmotDebug->coordinating || emcmotStatus->paused
+            || emcmotStatus->depth == 0 || emcmotStatus->depth >= sim_queue_min) {
+        return 0;
+    }
+    return ((ring->put + slot->commandNum) & 0x3fffffff) + 1;
+}
+#endif
+
 int rtapi_app_main(void)
 {
     int retval;
@@ -228,6 +264,13 @@ int rtapi_app_main(void)
         return -1;
     }
 
+    /* tracing is optional, motion runs without its ring */
+    trace_shmem_id = dpt_open(&emcmot_trace, DPT_RING_MOTION, mot_comp_id);
+    if (trace_shmem_id < 0) {
+        rtapi_print_msg(RTAPI_MSG_WARN,
+                "MOTION: no trace ring, dpt_open() returned %d\n", trace_shmem_id);
+    }
+
     /* set up for realtime execution of code */
     retval = init_threads();
     if (retval != 0) {
@@ -242,6 +285,11 @@ int rtapi_app_main(void)
 
     old_handler = rtapi_get_msg_handler();
     rtapi_set_msg_handler(emc_message_handler);
+#ifdef SIM
+    if (sim_queue_min > 0) {
+        rtapi_set_clock_hold(clock_hold);
+    }
+#endif
     return 0;
 }
 
@@ -250,6 +298,9 @@ void rtapi_app_exit(void)
     int retval;
 
     rtapi_set_msg_handler(old_handler);
+#ifdef SIM
+    rtapi_set_clock_hold(NULL);
+#endif
 
     rtapi_print_msg(RTAPI_MSG_INFO, "MOTION: cleanup_module() started.\n");
 
@@ -259,6 +310,15 @@ void rtapi_app_exit(void)
                 _("MOTION: hal_stop_threads() failed, returned %d\n"), retval);
     }
     /* free shared memory */
+    if (trace_shmem_id >= 0) {
+        emcmot_trace = 0;
+        rtapi_shmem_delete(trace_shmem_id, mot_comp_id);
+    }
+    retval = rtapi_shmem_delete(nurbs_shmem_id, mot_comp_id);
+    if (retval < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR,
+                _("MOTION: rtapi_shmem_delete() failed, returned %d\n"), retval);
+    }
     retval = rtapi_shmem_delete(emc_shmem_id, mot_comp_id);
     if (retval < 0) {
         rtapi_print_msg(RTAPI_MSG_ERR,
@@ -626,6 +686,7 @@ static int init_comm_buffers(void)
     int joint_num, n;
     emcmot_joint_t *joint;
     int retval;
+    double *nurbs_space;
 
     rtapi_print_msg(RTAPI_MSG_INFO, "MOTION: init_comm_buffers() starting...\n");
 
@@ -805,12 +866,42 @@ static int init_comm_buffers(void)
 
     /* init motion emcmotDebug->coord_tp */
     if (-1 == tpCreate(&emcmotDebug->coord_tp, DEFAULT_TC_QUEUE_SIZE,
-            emcmotDebug->queueTcSpace)) {
+            emcmotDebug->queueTcSpace, emcmotDebug->queueCoordsSpace,
+            emcmotDebug->queueSyncdioSpace, DEFAULT_TC_SYNCDIO_SIZE)) {
         rtapi_print_msg(RTAPI_MSG_ERR,
                 "MOTION: failed to create motion emcmotDebug->coord_tp\n");
         return -1;
     }
     //    tpInit(&emcmotDebug->coord_tp); // tpInit called from tpCreate
+
+    /* NURBS segments keep their control points and knots in a pool of
+       their own, so several of them can be queued at once */
+    if (nurbs_pool_size <= 0) {
+        nurbs_pool_size = DEFAULT_NURBS_POOL_SIZE;
+    }
+    nurbs_shmem_id = rtapi_shmem_new(NURBS_POOL_SHMEM_KEY, mot_comp_id,
+            sizeof(double) * nurbs_pool_size);
+    if (nurbs_shmem_id < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR,
+                "MOTION: rtapi_shmem_new failed for NURBS pool, returned %d\n",
+                nurbs_shmem_id);
+        return -1;
+    }
+    retval = rtapi_shmem_getptr(nurbs_shmem_id, (void **) &nurbs_space);
+    if (retval < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR,
+                "MOTION: rtapi_shmem_getptr failed for NURBS pool, returned %d\n",
+                retval);
+        return -1;
+    }
+    if (-1 == nurbsPoolCreate(&emcmotDebug->nurbs_pool, nurbs_pool_size,
+            nurbs_space)) {
+        rtapi_print_msg(RTAPI_MSG_ERR,
+                "MOTION: failed to create NURBS pool\n");
+        return -1;
+    }
+    tpSetNurbsPool(&emcmotDebug->coord_tp, &emcmotDebug->nurbs_pool);
+    tpSetLookahead(&emcmotDebug->coord_tp, tp_lookahead);
     tpSetCycleTime(&emcmotDebug->coord_tp, emcmotConfig->trajCycleTime);
     tpSetPos(&emcmotDebug->coord_tp, emcmotStatus->carte_pos_cmd);
     tpSetVmax(&emcmotDebug->coord_tp, emcmotStatus->vel, emcmotStatus->vel);
@@ -818,6 +909,7 @@ static int init_comm_buffers(void)
 
     emcmotStatus->tail = 0;
     emcmotStatus->update_pos_ack = 0;
+    emcmotPublishStatus();
 
     rtapi_print_msg(RTAPI_MSG_INFO, "MOTION: init_comm_buffers() complete\n");
     return 0;
@@ -919,6 +1011,20 @@ void emcmotSetCycleTime(unsigned long nsec )
     setServoCycleTime(nsec * servo_mult * 1e-9);
 }
 
+/* emcmotPublishStatus() copies the status into the snapshot buffer
+   user space reads, see emcmot_status_snap_t */
+void emcmotPublishStatus(void)
+{
+    emcmot_status_snap_t *snap = &emcmotStruct->status_snap;
+    unsigned int n = snap->seq + 1;
+
+    snap->begin = n;
+    rtapi_smp_wmb();
+    snap->buf[n & 1] = *emcmotStatus;
+    rtapi_smp_wmb();
+    snap->seq = n;
+}
+
 /* call this when setting the trajectory cycle time */
 static int setTrajCycleTime(double secs)
 {
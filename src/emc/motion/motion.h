@@ -281,6 +281,21 @@ typedef struct emcmot_command_t {
     int ssm_mode;           /* spindle sync motion mode: G33(0) /rigid_tap G33.1(1) */
 } emcmot_command_t;
 
+/* ring of queued commands, single producer (task) and single consumer
+   (emcmotCommandHandler). Used for commands task doesn't need an answer
+   to right away, like moves; motion runs every queued command before it
+   looks at the command slot, so ring and slot commands stay in order.
+   put and get are free running, the entry is slot[n % SIZE]. */
+#define EMCMOT_COMMAND_RING_SIZE 64	/* power of 2 */
+
+typedef struct emcmot_command_ring_t {
+    volatile unsigned int put;	/* commands queued, written by task */
+    volatile unsigned int get;	/* commands done, written by motion */
+    volatile unsigned int failed;	/* count of queued commands that failed */
+    int failedNum;		/* commandNum of the last one that failed */
+    emcmot_command_t slot[EMCMOT_COMMAND_RING_SIZE];
+} emcmot_command_ring_t;
+
 /*! \todo FIXME - these packed bits might be replaced with chars
    memory is cheap, and being able to access them without those
    damn macros would be nice
@@ -591,7 +606,7 @@ typedef struct {
    now is to get get the large joint struct out of status.
 
  */
-typedef struct {
+typedef struct emcmot_joint_status_t {
     EMCMOT_JOINT_FLAG flag;	/* see above for bit details */
     double pos_cmd;		/* commanded joint position */
     double pos_fb;		/* position feedback, comp removed */
@@ -613,7 +628,7 @@ typedef struct {
 } emcmot_joint_status_t;
 
 
-typedef struct {
+typedef struct spindle_status {
     double speed;               // spindle speed command in RPM; set at command.c
     double speed_rps;           // spindle speed command in RPS; set at command.c
     double speed_req_rps;       // calculated spindle speed command in RPS
@@ -761,6 +776,42 @@ typedef struct emcmot_status_t {
 
 } emcmot_status_t;
 
+/* Status as published for user space, once per servo cycle after the
+   controller is done with it.  Motion alternates between the two
+   buffers: it sets 'begin' to the number of the snapshot it is about to
+   write into buf[begin & 1], copies the status, then sets 'seq' to the
+   same number.  A reader copies from buf[seq & 1] and keeps the copy if
+   'begin' has not moved two past 'seq' meanwhile, so readers never
+   block motion, never block each other and can copy only the part they
+   need. */
+typedef struct emcmot_status_snap_t {
+    volatile unsigned int begin;	/* snapshot being written */
+    volatile unsigned int seq;	/* last complete snapshot */
+    emcmot_status_t buf[2];
+} emcmot_status_snap_t;
+
+/* the per-cycle trajectory part of the status, for readers that poll it
+   at a high rate; see usrmotReadEmcmotTrajStatus() */
+typedef struct emcmot_traj_status_t {
+    unsigned int heartbeat;
+    int commandNumEcho;
+    cmd_status_t commandStatus;
+    EMCMOT_MOTION_FLAG motionFlag;
+    EmcPose carte_pos_cmd;
+    EmcPose carte_pos_fb;
+    int id;
+    int depth;
+    int activeDepth;
+    int queueFull;
+    int paused;
+    int motionType;
+    double distance_to_go;
+    EmcPose dtg;
+    double current_vel;
+    double requested_vel;
+    double net_feed_scale;
+} emcmot_traj_status_t;
+
 /*********************************
         CONFIG STRUCTURE
  *********************************/
@@ -70,6 +70,13 @@
 /* space for trajectory planner queues, plus 10 more for safety */
 /*! \todo FIXME-- default is used; dynamic is not honored */
 	TC_STRUCT queueTcSpace[DEFAULT_TC_QUEUE_SIZE + 10];
+	/* their geometry, one per tc, and the synched I/O of those
+	   that carry any */
+	TC_COORDS queueCoordsSpace[DEFAULT_TC_QUEUE_SIZE + 10];
+	syncdio_t queueSyncdioSpace[DEFAULT_TC_SYNCDIO_SIZE];
+	/* control points and knots of queued NURBS segments; the space
+	   itself is a separate shmem block sized by nurbs_pool_size */
+	NURBS_POOL_STRUCT nurbs_pool;
 
 	int enabling;		/* starts up disabled */
 	int coordinating;	/* starts up in free mode */
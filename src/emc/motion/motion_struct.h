@@ -16,7 +16,10 @@
     typedef struct emcmot_struct_t {
 	struct emcmot_command_t command;	/* struct used to pass commands/data
 					   to the RT module from usr space */
+	struct emcmot_command_ring_t command_ring;	/* queued commands */
 	struct emcmot_status_t status;	/* Struct used to store RT status */
+	struct emcmot_status_snap_t status_snap;	/* status as published
+					   to user space */
 	struct emcmot_config_t config;	/* Struct used to store RT config */
 	struct emcmot_error_t error;	/* ring buffer for error messages */
 	struct emcmot_debug_t debug;	/* Struct used to store RT status and debug
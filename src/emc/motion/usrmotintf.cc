@@ -33,6 +33,7 @@
 #define READ_TIMEOUT_USEC 100000	/* microseconds for timeout */
 
 #include "rtapi.h"
+#include "rtapi_atomic.h"
 
 #include "dbuf.h"
 #include "stashf.h"
@@ -45,6 +46,8 @@ static emcmot_config_t *emcmotConfig = 0;
 static emcmot_debug_t *emcmotDebug = 0;
 static emcmot_error_t *emcmotError = 0;
 static emcmot_struct_t *emcmotStruct = 0;
+static emcmot_command_ring_t *emcmotCommandRing = 0;
+static unsigned int ringFailed = 0;	/* last ring->failed seen */
 
 /* usrmotIniLoad() loads params (SHMEM_KEY, COMM_TIMEOUT, COMM_WAIT)
    from named ini file */
@@ -75,7 +78,7 @@ int usrmotIniLoad(const char *filename)
 /* writes command from c */
 int usrmotWriteEmcmotCommand(emcmot_command_t * c)
 {
-    emcmot_status_t s;
+    emcmot_traj_status_t s;
     static int commandNum = 0;
     static unsigned char headCount = 0;
     double end;
@@ -101,7 +104,7 @@ int usrmotWriteEmcmotCommand(emcmot_command_t * c)
     /* now check to see if it got it */
     while (etime() < end) {
 	/* update status */
-	if (( usrmotReadEmcmotStatus(&s) == 0 ) && ( s.commandNumEcho == commandNum )) {
+	if (( usrmotReadEmcmotTrajStatus(&s) == 0 ) && ( s.commandNumEcho == commandNum )) {
 	    /* now check emcmot status flag */
 	    if (s.commandStatus == EMCMOT_COMMAND_OK) {
 		return EMCMOT_COMM_OK;
@@ -116,26 +119,208 @@ int usrmotWriteEmcmotCommand(emcmot_command_t * c)
     return EMCMOT_COMM_ERROR_TIMEOUT;
 }
 
+/* queues command from c without waiting for motion to run it; only
+   for commands whose result task does not need right away, such as
+   motion segments.  Errors show up in usrmotFlushEmcmotCommands() */
+int usrmotQueueEmcmotCommand(emcmot_command_t * c)
+{
+    static int commandNum = 0;
+    emcmot_command_ring_t *ring = emcmotCommandRing;
+    double end;
+
+    if (!MOTION_ID_VALID(c->id)) {
+        rcs_print("USRMOT: ERROR: invalid motion id: %d\n",c->id);
+	return EMCMOT_COMM_INVALID_MOTION_ID;
+    }
+    /* check for mapped mem still around */
+    if (0 == ring) {
+        rcs_print("USRMOT: ERROR: can't connect to shared memory\n");
+	return EMCMOT_COMM_ERROR_CONNECT;
+    }
+    c->commandNum = ++commandNum;
+    c->head = c->tail = 0;
+    /* wait for a free entry, motion takes all of them every cycle */
+    end = etime() + EMCMOT_COMM_TIMEOUT;
+    while (ring->put - ring->get >= EMCMOT_COMMAND_RING_SIZE) {
+	if (etime() >= end) {
+	    rcs_print("USRMOT: ERROR: command ring timeout\n");
+	    return EMCMOT_COMM_ERROR_TIMEOUT;
+	}
+	esleep(25e-6);
+    }
+    ring->slot[ring->put % EMCMOT_COMMAND_RING_SIZE] = *c;
+    /* publish the entry before the index */
+    rtapi_smp_wmb();
+    ring->put++;
+    return EMCMOT_COMM_OK;
+}
+
+/* waits until motion took every queued command, returns
+   EMCMOT_COMM_ERROR_COMMAND if any of them failed since the last flush */
+int usrmotFlushEmcmotCommands(void)
+{
+    emcmot_command_ring_t *ring = emcmotCommandRing;
+    double end;
+
+    if (0 == ring) {
+	return EMCMOT_COMM_ERROR_CONNECT;
+    }
+    end = etime() + EMCMOT_COMM_TIMEOUT;
+    while (ring->get != ring->put) {
+	if (etime() >= end) {
+	    rcs_print("USRMOT: ERROR: command ring timeout\n");
+	    return EMCMOT_COMM_ERROR_TIMEOUT;
+	}
+	esleep(25e-6);
+    }
+    return usrmotCheckEmcmotCommands();
+}
+
+/* like usrmotFlushEmcmotCommands(), but only looks at the commands motion
+   already took */
+int usrmotCheckEmcmotCommands(void)
+{
+    emcmot_command_ring_t *ring = emcmotCommandRing;
+
+    if (0 == ring) {
+	return EMCMOT_COMM_ERROR_CONNECT;
+    }
+    if (ring->failed != ringFailed) {
+	ringFailed = ring->failed;
+	rcs_print("USRMOT: ERROR: queued command %d failed\n",
+	    ring->failedNum);
+	return EMCMOT_COMM_ERROR_COMMAND;
+    }
+    return EMCMOT_COMM_OK;
+}
+
+/* number of queued commands motion has not taken yet */
+int usrmotCommandRingPending(void)
+{
+    if (0 == emcmotCommandRing) {
+	return 0;
+    }
+    return (int) (emcmotCommandRing->put - emcmotCommandRing->get);
+}
+
+/* status_begin() points at the newest status snapshot and remembers
+   its number in seq; status_valid() tells whether what was copied out of
+   it since is still intact.  Motion would have to publish twice during
+   the copy to break it, so a retry nearly always succeeds */
+#define STATUS_READ_RETRIES 100
+
+static const emcmot_status_t *status_begin(unsigned int *seq)
+{
+    const emcmot_status_snap_t *snap = &emcmotStruct->status_snap;
+
+    *seq = snap->seq;
+    rtapi_smp_rmb();
+    return &snap->buf[*seq & 1];
+}
+
+static int status_valid(unsigned int seq)
+{
+    rtapi_smp_rmb();
+    return emcmotStruct->status_snap.begin - seq < 2;
+}
+
 /* copies status to s */
 int usrmotReadEmcmotStatus(emcmot_status_t * s)
 {
-    int split_read_count;
-    
+    const emcmot_status_t *snap;
+    unsigned int seq;
+    int n;
+
     /* check for shmem still around */
-    if (0 == emcmotStatus) {
+    if (0 == emcmotStruct) {
 	return EMCMOT_COMM_ERROR_CONNECT;
     }
-    split_read_count = 0;
-    do {
-	/* copy status struct from shmem to local memory */
-	memcpy(s, emcmotStatus, sizeof(emcmot_status_t));
-	/* got it, now check head-tail matche */
-	if (s->head == s->tail) {
-	    /* head and tail match, done */
+    for (n = 0; n < STATUS_READ_RETRIES; n++) {
+	snap = status_begin(&seq);
+	memcpy(s, (const void *) snap, sizeof(emcmot_status_t));
+	if (status_valid(seq)) {
 	    return EMCMOT_COMM_OK;
 	}
-	/* inc counter and try again, max three times */
-    } while ( ++split_read_count < 3 );
+    }
+    return EMCMOT_COMM_SPLIT_READ_TIMEOUT;
+}
+
+/* copies the status of one joint to js */
+int usrmotReadEmcmotJointStatus(int joint, emcmot_joint_status_t * js)
+{
+    const emcmot_status_t *snap;
+    unsigned int seq;
+    int n;
+
+    if (0 == emcmotStruct) {
+	return EMCMOT_COMM_ERROR_CONNECT;
+    }
+    if (joint < 0 || joint >= EMCMOT_MAX_JOINTS) {
+	return EMCMOT_COMM_ERROR_COMMAND;
+    }
+    for (n = 0; n < STATUS_READ_RETRIES; n++) {
+	snap = status_begin(&seq);
+	*js = snap->joint_status[joint];
+	if (status_valid(seq)) {
+	    return EMCMOT_COMM_OK;
+	}
+    }
+    return EMCMOT_COMM_SPLIT_READ_TIMEOUT;
+}
+
+/* copies the spindle status to ss */
+int usrmotReadEmcmotSpindleStatus(spindle_status * ss)
+{
+    const emcmot_status_t *snap;
+    unsigned int seq;
+    int n;
+
+    if (0 == emcmotStruct) {
+	return EMCMOT_COMM_ERROR_CONNECT;
+    }
+    for (n = 0; n < STATUS_READ_RETRIES; n++) {
+	snap = status_begin(&seq);
+	*ss = snap->spindle;
+	if (status_valid(seq)) {
+	    return EMCMOT_COMM_OK;
+	}
+    }
+    return EMCMOT_COMM_SPLIT_READ_TIMEOUT;
+}
+
+/* copies the trajectory part of the status to t */
+int usrmotReadEmcmotTrajStatus(emcmot_traj_status_t * t)
+{
+    const emcmot_status_t *snap;
+    unsigned int seq;
+    int n;
+
+    if (0 == emcmotStruct) {
+	return EMCMOT_COMM_ERROR_CONNECT;
+    }
+    for (n = 0; n < STATUS_READ_RETRIES; n++) {
+	snap = status_begin(&seq);
+	t->heartbeat = snap->heartbeat;
+	t->commandNumEcho = snap->commandNumEcho;
+	t->commandStatus = snap->commandStatus;
+	t->motionFlag = snap->motionFlag;
+	t->carte_pos_cmd = snap->carte_pos_cmd;
+	t->carte_pos_fb = snap->carte_pos_fb;
+	t->id = snap->id;
+	t->depth = snap->depth;
+	t->activeDepth = snap->activeDepth;
+	t->queueFull = snap->queueFull;
+	t->paused = snap->paused;
+	t->motionType = snap->motionType;
+	t->distance_to_go = snap->distance_to_go;
+	t->dtg = snap->dtg;
+	t->current_vel = snap->current_vel;
+	t->requested_vel = snap->requested_vel;
+	t->net_feed_scale = snap->net_feed_scale;
+	if (status_valid(seq)) {
+	    return EMCMOT_COMM_OK;
+	}
+    }
     return EMCMOT_COMM_SPLIT_READ_TIMEOUT;
 }
 
@@ -679,6 +864,8 @@ int usrmotInit(const char *modname)
     emcmotDebug = &(emcmotStruct->debug);
     emcmotConfig = &(emcmotStruct->config);
     emcmotError = &(emcmotStruct->error);
+    emcmotCommandRing = &(emcmotStruct->command_ring);
+    ringFailed = emcmotCommandRing->failed;
 
     inited = 1;
 
@@ -694,6 +881,7 @@ int usrmotExit(void)
 
     emcmotStruct = 0;
     emcmotCommand = 0;
+    emcmotCommandRing = 0;
     emcmotStatus = 0;
     emcmotError = 0;
 /*! \todo Another #if 0 */
@@ -16,6 +16,9 @@
 #define USRMOTINTF_H
 
 struct emcmot_status_t;
+struct emcmot_joint_status_t;
+struct emcmot_traj_status_t;
+struct spindle_status;
 struct emcmot_command_t;
 struct emcmot_config_t;
 struct emcmot_debug_t;
@@ -33,6 +36,14 @@ extern "C" {
    the emcmot controller and puts it in arg */
     extern int usrmotReadEmcmotStatus(emcmot_status_t * s);
 
+/* usrmotReadEmcmotJointStatus(), usrmotReadEmcmotSpindleStatus() and
+   usrmotReadEmcmotTrajStatus() get just that part of the status, from
+   the same consistent snapshot usrmotReadEmcmotStatus() copies */
+    extern int usrmotReadEmcmotJointStatus(int joint,
+	emcmot_joint_status_t * js);
+    extern int usrmotReadEmcmotSpindleStatus(spindle_status * ss);
+    extern int usrmotReadEmcmotTrajStatus(emcmot_traj_status_t * t);
+
 /* usrmotReadEmcmotConfig() gets the config info out of
    the emcmot controller and puts it in arg */
     extern int usrmotReadEmcmotConfig(emcmot_config_t * s);
@@ -70,6 +81,22 @@ extern "C" {
    Return values are as per the #defines above */
     extern int usrmotWriteEmcmotCommand(emcmot_command_t * c);
 
+/* usrmotQueueEmcmotCommand() puts the command in the command ring and
+   returns without waiting for the emcmot process to run it */
+    extern int usrmotQueueEmcmotCommand(emcmot_command_t * c);
+
+/* usrmotFlushEmcmotCommands() waits for the command ring to drain and
+   reports whether a queued command failed */
+    extern int usrmotFlushEmcmotCommands(void);
+
+/* usrmotCheckEmcmotCommands() reports whether a queued command failed,
+   without waiting for the rest */
+    extern int usrmotCheckEmcmotCommands(void);
+
+/* usrmotCommandRingPending() returns the number of queued commands the
+   emcmot process has not taken yet */
+    extern int usrmotCommandRingPending(void);
+
 /* usrmotInit() initializes communication with the emcmot process */
     extern int usrmotInit(const char *name);
 
@@ -495,6 +495,7 @@ extern int emcTrajNurbsMove(EmcPose end, int type,nurbs_block_t nurbs_block, dou
                             double ini_maxacc,double ini_maxjerk);
 extern int emcTrajCircularMove(EmcPose end, PM_CARTESIAN center, PM_CARTESIAN
         normal, int turn, int type, double vel, double ini_maxvel, double acc, double ini_maxjerk);
+extern int emcTrajCheckQueued(int wait);
 extern int emcTrajSetTermCond(int cond, double tolerance);
 extern int emcTrajSetSpindleSync(double feed_per_revolution, bool wait_for_index, bool spindlesync);
 extern int emcTrajSetOffset(EmcPose tool_offset);
@@ -523,6 +524,7 @@ extern int emcMotionSetDout(unsigned char index, unsigned char start,
 extern int emcMotionSetSyncInput(unsigned char index, unsigned char now,
         int wait_type, double timeout);
 extern int emcMotionUpdate(EMC_MOTION_STAT * stat);
+extern int emcMotionPoll();
 // implementation functions for EMC_TASK types
 
 extern int emcTaskInit();
@@ -548,6 +550,7 @@ extern int emcTaskPlanClose();
 extern int emcTaskPlanReset();
 
 extern int emcTaskPlanLine();
+extern int emcTaskPlanRestore(int line);
 extern int emcTaskPlanLevel();
 extern int emcTaskPlanCommand(char *cmd);
 
@@ -622,6 +625,7 @@ extern int emcIoSetCycleTime(double cycleTime);
 extern int emcIoSetDebug(int debug);
 
 extern int emcIoUpdate(EMC_IO_STAT * stat);
+extern int emcIoPoll(const EMC_IO_STAT * stat);
 
 // implementation functions for EMC aggregate types
 
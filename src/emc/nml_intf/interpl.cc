@@ -17,20 +17,41 @@
 
 
 #include <string.h>		/* memcpy() */
+#include <stdlib.h>		/* malloc(), free() */
 
-#include "rcs.hh"		// LinkedList
+#include "rcs.hh"		// NMLmsg
 #include "interpl.hh"		// these decls
 #include "emc.hh"
 #include "emcglb.h"
-#include "linklist.hh"
 #include "nmlmsg.hh"            /* class NMLmsg */
 #include "rcs_print.hh"
 
 NML_INTERP_LIST interp_list;	/* NML Union, for interpreter */
 
+/*
+  The list is a ring of records in one arena: append() copies the command
+  in at tail, get() hands out a pointer into the arena.  A record never
+  wraps around the end of the arena; when it does not fit, the rest of the
+  arena is skipped, marked by a header with size 0 if there is room for
+  one.  The record get() returned last is only given up by the next get()
+  that finds something, which is as long as the old LinkedList kept it.
+ */
+
+#define NODE_SIZE (sizeof(NML_INTERP_LIST_NODE))
+
+static size_t record_size(long msg_size)
+{
+    return (NODE_SIZE + msg_size + NODE_SIZE - 1) / NODE_SIZE * NODE_SIZE;
+}
+
 NML_INTERP_LIST::NML_INTERP_LIST()
 {
-    linked_list_ptr = new LinkedList;
+    arena = (char *) malloc(INTERP_LIST_ARENA_SIZE);
+    arena_size = NULL == arena ? 0 : INTERP_LIST_ARENA_SIZE;
+    head = first = tail = 0;
+    used = held = 0;
+    count = 0;
+    retired = NULL;
 
     next_line_number = 0;
     line_number = 0;
@@ -38,10 +59,10 @@ NML_INTERP_LIST::NML_INTERP_LIST()
 
 NML_INTERP_LIST::~NML_INTERP_LIST()
 {
-    if (NULL != linked_list_ptr) {
-	delete linked_list_ptr;
-	linked_list_ptr = NULL;
-    }
+    free(arena);
+    arena = NULL;
+    free(retired);
+    retired = NULL;
 }
 
 int NML_INTERP_LIST::append(NMLmsg & nml_msg)
@@ -57,8 +78,73 @@ int NML_INTERP_LIST::set_line_number(int line)
     return 0;
 }
 
+// returns the record at *pos, moving *pos past a wrap first
+NML_INTERP_LIST_NODE *NML_INTERP_LIST::node_at(size_t *pos)
+{
+    if (arena_size - *pos < NODE_SIZE ||
+	((NML_INTERP_LIST_NODE *) (arena + *pos))->size == 0) {
+	*pos = 0;
+    }
+    return (NML_INTERP_LIST_NODE *) (arena + *pos);
+}
+
+// moves the records in use to the front of an arena big enough for need
+// more bytes
+int NML_INTERP_LIST::grow(size_t need)
+{
+    size_t new_size, pos, new_first, new_tail;
+    NML_INTERP_LIST_NODE *node;
+    char *new_arena;
+    int n;
+
+    new_size = arena_size ? arena_size : INTERP_LIST_ARENA_SIZE;
+    while (new_size < used + need + NODE_SIZE) {
+	new_size *= 2;
+    }
+    new_arena = (char *) malloc(new_size);
+    if (NULL == new_arena) {
+	return -1;
+    }
+
+    new_tail = 0;
+    pos = head;
+    if (held) {
+	node = node_at(&pos);
+	memcpy(new_arena, node, node->size);
+	new_tail = node->size;
+	pos = first;
+    }
+    new_first = new_tail;
+    for (n = 0; n < count; n++) {
+	node = node_at(&pos);
+	memcpy(new_arena + new_tail, node, node->size);
+	new_tail += node->size;
+	pos += node->size;
+    }
+
+    // get() handed out a pointer into the old arena, keep that one
+    if (held && NULL == retired) {
+	retired = arena;
+    } else {
+	free(arena);
+    }
+    arena = new_arena;
+    arena_size = new_size;
+    head = 0;
+    held = new_first;
+    first = new_first;
+    tail = new_tail;
+    used = new_tail;
+
+    return 0;
+}
+
 int NML_INTERP_LIST::append(NMLmsg * nml_msg_ptr)
 {
+    NML_INTERP_LIST_NODE *node;
+    size_t need, waste;
+    int wrap;
+
     /* check for invalid data */
     if (NULL == nml_msg_ptr) {
 	rcs_print_error
@@ -82,38 +168,42 @@ int NML_INTERP_LIST::append(NMLmsg * nml_msg_ptr)
 	    ("NML_INTERP_LIST::append : command size is invalid.");
 	return -1;
     }
-#ifdef DEBUG_INTERPL
-    if (sizeof(temp_node) < MAX_NML_COMMAND_SIZE + 4 ||
-	sizeof(temp_node) > MAX_NML_COMMAND_SIZE + 16 ||
-	((void *) &temp_node.line_number) >
-	((void *) &temp_node.command.commandbuf)) {
-	rcs_print_error
-	    ("NML_INTERP_LIST::append : assumptions about NML_INTERP_LIST_NODE have been violated.");
-	return -1;
-    }
-#endif
 
-    if (NULL == linked_list_ptr) {
-	return -1;
+    need = record_size(nml_msg_ptr->size);
+    wrap = arena_size - tail < need;
+    waste = wrap ? arena_size - tail : 0;
+    if (used + waste + need > arena_size) {
+	if (0 != grow(need)) {
+	    rcs_print_error
+		("NML_INTERP_LIST::append : out of memory.\n");
+	    return -1;
+	}
+	wrap = 0;
+	waste = 0;
+    }
+    if (wrap) {
+	// skip the rest of the arena
+	if (waste >= NODE_SIZE) {
+	    ((NML_INTERP_LIST_NODE *) (arena + tail))->size = 0;
+	}
+	used += waste;
+	tail = 0;
     }
-    // fill in the NML_INTERP_LIST_NODE
-    temp_node.line_number = next_line_number;
-    memcpy(temp_node.command.commandbuf, nml_msg_ptr, nml_msg_ptr->size);
-
-    // stick it on the list
-    linked_list_ptr->store_at_tail(&temp_node,
-				   nml_msg_ptr->size +
-				   sizeof(temp_node.line_number) +
-				   sizeof(temp_node.dummy) + 32 + (32 -
-								   nml_msg_ptr->
-								   size %
-								   32), 1);
+
+    // fill in the NML_INTERP_LIST_NODE and the command behind it
+    node = (NML_INTERP_LIST_NODE *) (arena + tail);
+    node->line_number = next_line_number;
+    node->size = need;
+    memcpy(node + 1, nml_msg_ptr, nml_msg_ptr->size);
+    tail += need;
+    used += need;
+    count++;
 
     if (emc_debug & EMC_DEBUG_INTERP_LIST) {
 	rcs_print
 	    ("NML_INTERP_LIST::append(nml_msg_ptr{size=%ld,type=%s}) : list_size=%d, line_number=%d\n",
 	     nml_msg_ptr->size, emc_symbol_lookup(nml_msg_ptr->type),
-	     linked_list_ptr->list_size, temp_node.line_number);
+	     count, node->line_number);
     }
 
     return 0;
@@ -121,66 +211,63 @@ int NML_INTERP_LIST::append(NMLmsg * nml_msg_ptr)
 
 NMLmsg *NML_INTERP_LIST::get()
 {
-    NMLmsg *ret;
     NML_INTERP_LIST_NODE *node_ptr;
+    size_t pos;
 
-    if (NULL == linked_list_ptr) {
+    if (0 == count) {
 	line_number = 0;
 	return NULL;
     }
 
-    node_ptr = (NML_INTERP_LIST_NODE *) linked_list_ptr->retrieve_head();
+    // give up the one handed out before
+    used -= held;
+    head = first;
+    free(retired);
+    retired = NULL;
+
+    pos = first;
+    node_ptr = node_at(&pos);
+    held = (pos < first ? arena_size - first : 0) + node_ptr->size;
+    first = pos + node_ptr->size;
+    count--;
 
-    if (NULL == node_ptr) {
-	line_number = 0;
-	return NULL;
-    }
     // save line number of this one, for use by get_line_number
     line_number = node_ptr->line_number;
 
-    // get it off the front
-    ret = (NMLmsg *) ((char *) node_ptr->command.commandbuf);
-
-    return ret;
+    return (NMLmsg *) (node_ptr + 1);
 }
 
 void NML_INTERP_LIST::clear()
 {
-    if (NULL != linked_list_ptr) {
-	linked_list_ptr->delete_members();
-    }
+    // keeps the one get() handed out, like LinkedList::delete_members()
+    tail = first;
+    used = held;
+    count = 0;
 }
 
 void NML_INTERP_LIST::print()
 {
     NMLmsg *ret;
     NML_INTERP_LIST_NODE *node_ptr;
-    int line_number;
-
-    if (NULL == linked_list_ptr) {
-	return;
-    }
-    node_ptr = (NML_INTERP_LIST_NODE *) linked_list_ptr->get_head();
+    size_t pos;
+    int n;
 
-    rcs_print("NML_INTERP_LIST::print(): list size=%d\n",linked_list_ptr->list_size);
-    while (NULL != node_ptr) {
-	line_number = node_ptr->line_number;
-	ret = (NMLmsg *) ((char *) node_ptr->command.commandbuf);
+    rcs_print("NML_INTERP_LIST::print(): list size=%d\n", count);
+    pos = first;
+    for (n = 0; n < count; n++) {
+	node_ptr = node_at(&pos);
+	ret = (NMLmsg *) (node_ptr + 1);
 	rcs_print("--> type=%s,  line_number=%d\n",
 		  emc_symbol_lookup((int)ret->type),
-		  line_number);
-	node_ptr = (NML_INTERP_LIST_NODE *) linked_list_ptr->get_next();
+		  node_ptr->line_number);
+	pos += node_ptr->size;
     }
     rcs_print("\n");
 }
 
 int NML_INTERP_LIST::len()
 {
-    if (NULL == linked_list_ptr) {
-	return 0;
-    }
-
-    return ((int) linked_list_ptr->list_size);
+    return count;
 }
 
 int NML_INTERP_LIST::get_line_number()
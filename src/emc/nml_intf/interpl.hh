@@ -17,11 +17,18 @@
 #ifndef INTERP_LIST_HH
 #define INTERP_LIST_HH
 
+#include <stddef.h>		/* size_t */
+
 #define MAX_NML_COMMAND_SIZE 1000
 
-// these go on the interp list
+// initial size of the record arena, it doubles whenever it runs out
+#define INTERP_LIST_ARENA_SIZE 65536
+
+// these go on the interp list: each record in the arena is this header
+// followed by the NML command, padded to a multiple of the header size
 struct NML_INTERP_LIST_NODE {
     int line_number;		// line number it was on
+    int size;			// bytes taken by the record, 0 marks a wrap
     union _dummy_union {
 	int i;
 	long l;
@@ -30,16 +37,6 @@ struct NML_INTERP_LIST_NODE {
 	long long ll;
 	long double ld;
     } dummy;			// paranoid alignment variable.
-
-    union _command_union {
-	char commandbuf[MAX_NML_COMMAND_SIZE];	// the NML command;
-	int i;
-	long l;
-	double d;
-	float f;
-	long long ll;
-	long double ld;
-    } command;
 };
 
 // here's the interp list itself
@@ -58,9 +55,22 @@ class NML_INTERP_LIST {
     int len();
 
   private:
-    class LinkedList * linked_list_ptr;
-    NML_INTERP_LIST_NODE temp_node;	// filled in and put on the list
-    int next_line_number;	// line number used to fill temp_node
+    int grow(size_t need);
+    NML_INTERP_LIST_NODE *node_at(size_t *pos);
+
+    // the commands are kept in a ring of variable length records; the
+    // one handed out by get() stays where it is until the next get()
+    char *arena;
+    size_t arena_size;
+    size_t head;		// record handed out by get(), or first
+    size_t first;		// first queued record
+    size_t tail;		// where the next record goes
+    size_t used;		// bytes from head to tail, including waste
+    size_t held;		// bytes from head to first
+    int count;			// queued records
+    char *retired;		// arena given up by grow() while the
+				// record from get() was still in it
+    int next_line_number;	// line number used for appends
     int line_number;		// line number of node from get()
 };
 
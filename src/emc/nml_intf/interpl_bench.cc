@@ -0,0 +1,200 @@
+/********************************************************************
+* Description: interpl_bench.cc
+*   Checks NML_INTERP_LIST against a plain FIFO and compares its
+*   append/get throughput with the LinkedList based list it replaced.
+*
+* Author:
+* License: GPL Version 2
+* System: Linux
+*
+* Copyright (c) 2014 All rights reserved.
+*
+* Last change:
+********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "rcs.hh"		// NMLmsg, LinkedList
+#include "linklist.hh"
+#include "emc.hh"
+#include "emc_nml.hh"
+#include "interpl.hh"
+
+// the list as it was: every append copies a 1000 byte node into a
+// LinkedList node of its own
+struct OLD_INTERP_LIST_NODE {
+    int line_number;
+    union {
+	int i;
+	long l;
+	double d;
+	float f;
+	long long ll;
+	long double ld;
+    } dummy;
+    union {
+	char commandbuf[MAX_NML_COMMAND_SIZE];
+	long double ld;
+    } command;
+};
+
+class OLD_INTERP_LIST {
+  public:
+    OLD_INTERP_LIST() { next_line_number = 0; }
+
+    void set_line_number(int line) { next_line_number = line; }
+    int append(NMLmsg * nml_msg_ptr) {
+	temp_node.line_number = next_line_number;
+	memcpy(temp_node.command.commandbuf, nml_msg_ptr, nml_msg_ptr->size);
+	list.store_at_tail(&temp_node,
+			   nml_msg_ptr->size +
+			   sizeof(temp_node.line_number) +
+			   sizeof(temp_node.dummy) + 32 +
+			   (32 - nml_msg_ptr->size % 32), 1);
+	return 0;
+    }
+    NMLmsg *get() {
+	OLD_INTERP_LIST_NODE *node_ptr =
+	    (OLD_INTERP_LIST_NODE *) list.retrieve_head();
+	if (NULL == node_ptr) {
+	    return NULL;
+	}
+	return (NMLmsg *) node_ptr->command.commandbuf;
+    }
+    int len() { return list.list_size; }
+
+  private:
+    LinkedList list;
+    OLD_INTERP_LIST_NODE temp_node;
+    int next_line_number;
+};
+
+static double unow()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6;
+}
+
+#define N (1000000)
+#define DEPTH 1000		// like [TASK] INTERP_MAX_LEN
+
+static EMC_TRAJ_LINEAR_MOVE line;
+static EMC_TRAJ_SET_TERM_COND cond;
+static EMC_OPERATOR_DISPLAY display;
+
+static NMLmsg *pick(int i)
+{
+    switch (i % 7) {
+    case 0:
+	return &cond;
+    case 3:
+	return &display;
+    default:
+	return &line;
+    }
+}
+
+// random appends, gets and clears against a ring of expected serials
+static int check(void)
+{
+    NML_INTERP_LIST list;
+    static int expect[4 * DEPTH];
+    int in = 0, out = 0, i, n, fail = 0;
+    NMLmsg *msg, *last = NULL;
+    int last_serial = -1;
+
+    srand(1);
+    for (i = 0; i < N / 10 && !fail; i++) {
+	n = rand() % 100;
+	if (n < 55 && in - out < 4 * DEPTH) {
+	    msg = pick(rand());
+	    // the serial rides in the line number and in the message
+	    list.set_line_number(in);
+	    ((RCS_CMD_MSG *) msg)->serial_number = in;
+	    if (0 != list.append(msg)) {
+		printf("append %d failed\n", in);
+		fail++;
+	    }
+	    expect[in % (4 * DEPTH)] = msg->type;
+	    in++;
+	} else if (n < 99) {
+	    msg = list.get();
+	    if (in == out) {
+		if (NULL != msg) {
+		    printf("get from empty list returned a message\n");
+		    fail++;
+		}
+		continue;
+	    }
+	    if (NULL == msg || msg->type != expect[out % (4 * DEPTH)] ||
+		((RCS_CMD_MSG *) msg)->serial_number != out ||
+		list.get_line_number() != out) {
+		printf("get %d returned the wrong message\n", out);
+		fail++;
+	    }
+	    last = msg;
+	    last_serial = out;
+	    out++;
+	} else {
+	    list.clear();
+	    out = in;
+	}
+	// what get() returned must survive appends and clears
+	if (NULL != last &&
+	    ((RCS_CMD_MSG *) last)->serial_number != last_serial) {
+	    printf("message %d was overwritten\n", last_serial);
+	    fail++;
+	}
+	if (list.len() != in - out) {
+	    printf("len() is %d, expected %d\n", list.len(), in - out);
+	    fail++;
+	}
+    }
+    return fail;
+}
+
+template < class LIST > static double run(LIST & list)
+{
+    double t0 = unow();
+    int i, j;
+
+    // keep DEPTH messages queued, like task does while reading ahead
+    for (j = 0; j < DEPTH; j++) {
+	list.append(pick(j));
+    }
+    for (i = 0; i < N; i++) {
+	list.set_line_number(i);
+	list.append(pick(i));
+	list.get();
+    }
+    while (list.len()) {
+	list.get();
+    }
+    return unow() - t0;
+}
+
+int main(void)
+{
+    NML_INTERP_LIST ring;
+    OLD_INTERP_LIST old;
+    double t_ring, t_old;
+    int fail;
+
+    fail = check();
+
+    t_old = run(old);
+    t_ring = run(ring);
+    printf("append+get, %d deep: LinkedList %.1fns  ring %.1fns\n", DEPTH,
+	   t_old * 1e9 / N, t_ring * 1e9 / N);
+
+    if (fail) {
+	printf("*fail*\n");
+	return 1;
+    }
+    return 0;
+}
@@ -53,10 +53,35 @@ typedef struct
     double                     weight;
     double                     *N; // basis function buffer
     int 		        axis_mask;
+    // arc-length table: alen_ptr[k] is the chord length from u=0 to
+    // u=k/(nr_of_alen-1); built by nurbs_alen_init() once all knots are in
+    double                     *alen_ptr;
+    uint32_t                    nr_of_alen;
+    uint32_t                    alen_idx; // cached table interval of last lookup
+    int                         span_idx; // cached knot span of last evaluation
+    // storage pool bookkeeping, see nurbsPoolAlloc()
+    uint32_t                    pool_next; // offset just past this block
+    uint32_t                    pool_used; // doubles taken, including wrap waste
 } nurbs_block_t;
 
+/* highest curve order the realtime evaluator accepts */
+#define NURBS_MAX_ORDER         16
+
+/* a CONTROL_POINT as an array of doubles: X Y Z A B C U V W R D */
+#define NURBS_CP_DIM            ((int) (sizeof(CONTROL_POINT) / sizeof(double)))
+#define NURBS_CP_R              9
+
+/* arc-length table sampling: NURBS_ALEN_PER_CP samples per control point,
+ * never more than NURBS_MAX_ALEN intervals per curve */
+#define NURBS_ALEN_PER_CP       8
+#define NURBS_MAX_ALEN          1024
+
 extern int nurbs_findspan(int n, int p, double u, double *U);
 extern void nurbs_basisfun(int i, double u, int p, double *U, double *N);
+extern void nurbs_evaluate(nurbs_block_t *nb, double u, CONTROL_POINT *cp);
+extern uint32_t nurbs_alen_size(uint32_t nr_of_ctrl_pts);
+extern double nurbs_alen_init(nurbs_block_t *nb);
+extern double nurbs_alen_to_u(nurbs_block_t *nb, double ratio);
 
 enum {
     AXIS_MASK_X =   1, AXIS_MASK_Y =   2, AXIS_MASK_Z =   4,
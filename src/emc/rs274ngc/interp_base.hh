@@ -26,6 +26,7 @@ public:
     virtual int read(const char *line) = 0;
     virtual int close() = 0;
     virtual int reset() = 0;
+    virtual int restore(int start_line) = 0;
     virtual int line() = 0;
     virtual int call_level() = 0;
     virtual char *command(char *buf, size_t buflen) = 0;
@@ -0,0 +1,578 @@
+/********************************************************************
+* Description: interp_checkpoint.cc
+*   Interpreter state checkpoints for fast run-from-line
+*
+*   Running a program from line N used to mean interpreting every line
+*   before N and throwing away the result.  While a program is read
+*   (by task, or by a preview), every [RS274NGC]CHECKPOINT_INTERVAL
+*   lines the interpreter writes its state at call level 0 to a side
+*   file in [RS274NGC]CHECKPOINT_DIR (default ~/.cache/linuxcnc/
+*   checkpoints), named after a hash of the program's real path: file
+*   offset, modal codes, motion mode, tool numbers, parameters changed
+*   since open, global named parameters and known subs.  restore(N)
+*   picks the last checkpoint taken before line N-1 was first read, and
+*   reading goes on from there.  Tools are kept by number and the tool
+*   length offset by the G43/G43.1/G49 that set it, so both are taken
+*   from the tool table as it is now, as reading the lines would.
+*
+* License: GPL Version 2
+* System: Linux
+*
+* Copyright (c) 2014 All rights reserved.
+*
+********************************************************************/
+#include <boost/python.hpp>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "rs274ngc.hh"
+#include "rs274ngc_return.hh"
+#include "interp_internal.hh"
+#include "rs274ngc_interp.hh"
+
+#define CHECKPOINT_MAGIC 0x434b5033	// "CKP3"
+
+// named parameters the interpreter computes or fetches itself
+#define CHECKPOINT_PA_SKIP (PA_READONLY | PA_USE_LOOKUP | PA_FROM_INI | PA_PYTHON)
+
+struct checkpoint_header {
+    unsigned magic;
+    long size;			// of the program the checkpoints belong to
+    long mtime;
+    int last;			// sequence number of the last checkpoint
+};
+
+struct checkpoint_record {
+    int sequence_number;	// of the last line executed
+    int reached;		// highest line read at call level 0 so far
+    long offset;		// of the next line
+    int g_codes[ACTIVE_G_CODES];
+    int m_codes[ACTIVE_M_CODES];
+    double settings[ACTIVE_SETTINGS];
+    double current[9];		// x y z a b c u v w
+    int motion_mode;		// G0/G1/G2/G3..., not in g_codes[] restore
+    int current_toolno;		// in current_pocket, -1 if none
+    int selected_toolno;	// in selected_pocket, -1 if none
+    int selected_tool;
+    int tool_offset_code;	// G_43, G_43_1 or G_49
+    int tool_offset_h;		// H word of that G43, -1 if none
+    EmcPose tool_offset;	// only used for G43.1
+    int n_params;		// followed by n_params (index, value) pairs,
+    int n_named;		// n_named (name, value, attr) and
+    int n_subs;			// n_subs (name, offset) entries
+};
+
+struct checkpoint_param {
+    int index;
+    double value;
+};
+
+// fields go out one by one; structs with pointers never do
+template <class T> static int write_value(FILE *fp, const T &v)
+{
+    return fwrite(&v, sizeof(v), 1, fp) == 1 ? 0 : -1;
+}
+
+template <class T> static int read_value(FILE *fp, T &v)
+{
+    return fread(&v, sizeof(v), 1, fp) == 1 ? 0 : -1;
+}
+
+static int write_string(FILE *fp, const char *s)
+{
+    int len = strlen(s);
+
+    if (fwrite(&len, sizeof(len), 1, fp) != 1 ||
+	fwrite(s, 1, len, fp) != (size_t) len)
+	return -1;
+    return 0;
+}
+
+static int read_string(FILE *fp, std::string &s)
+{
+    int len;
+
+    if (fread(&len, sizeof(len), 1, fp) != 1 || len < 0 || len >= PATH_MAX)
+	return -1;
+    s.resize(len);
+    if (len && fread(&s[0], 1, len, fp) != (size_t) len)
+	return -1;
+    return 0;
+}
+
+// size and mtime identify the program a side file belongs to
+// toolno's pocket in the tool table, -1 if it is not there; like
+// find_tool_pocket() but a missing tool is no error
+static int tool_pocket(setup_pointer settings, int toolno)
+{
+    int i, pocket = -1;
+
+    if (!settings->random_toolchanger && toolno == 0)
+	return 0;
+    for (i = 0; i < CANON_POCKETS_MAX; i++)
+	if (settings->tool_table[i].toolno == toolno)
+	    pocket = i;
+    return pocket;
+}
+
+static int pocket_toolno(setup_pointer settings, int pocket)
+{
+    if (pocket < 0 || pocket >= CANON_POCKETS_MAX)
+	return -1;
+    return settings->tool_table[pocket].toolno;
+}
+
+static int program_stamp(const char *filename, long *size, long *mtime)
+{
+    struct stat st;
+
+    if (stat(filename, &st) != 0)
+	return -1;
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+    return 0;
+}
+
+// mkdir -p, for the side file directory
+static int make_dir(const char *dir)
+{
+    char tmp[PATH_MAX];
+    char *p;
+
+    if (snprintf(tmp, sizeof(tmp), "%s", dir) >= (int) sizeof(tmp))
+	return -1;
+    for (p = tmp + 1; *p; p++) {
+	if (*p != '/')
+	    continue;
+	*p = 0;
+	if (mkdir(tmp, 0700) != 0 && errno != EEXIST)
+	    return -1;
+	*p = '/';
+    }
+    if (mkdir(tmp, 0700) != 0 && errno != EEXIST)
+	return -1;
+    return 0;
+}
+
+/* The side file of @filename: @dir, or the user's cache directory, and a
+   hash of the program's real path, which goes to @program. */
+static int side_file(const char *dir, const char *filename,
+		     char *program, char *path, size_t len)
+{
+    char cache[PATH_MAX];
+    const char *home;
+    unsigned long long h = 14695981039346656037ULL;	// FNV-1a
+    const char *c;
+
+    if (realpath(filename, program) == NULL)
+	return -1;
+    if (dir[0] == 0) {
+	if ((home = getenv("XDG_CACHE_HOME")) != NULL && home[0])
+	    snprintf(cache, sizeof(cache), "%s/linuxcnc/checkpoints", home);
+	else if ((home = getenv("HOME")) != NULL && home[0])
+	    snprintf(cache, sizeof(cache), "%s/.cache/linuxcnc/checkpoints",
+		     home);
+	else
+	    return -1;
+	dir = cache;
+    }
+    for (c = program; *c; c++) {
+	h ^= (unsigned char) *c;
+	h *= 1099511628211ULL;
+    }
+    if (snprintf(path, len, "%s/%016llx.ckpt", dir, h) >= (int) len)
+	return -1;
+    return 0;
+}
+
+// the program's real path follows the header
+static int read_header(FILE *fp, struct checkpoint_header *h,
+		       const char *program)
+{
+    std::string owner;
+
+    if (fread(h, sizeof(*h), 1, fp) != 1 || h->magic != CHECKPOINT_MAGIC ||
+	read_string(fp, owner) || owner != program)
+	return -1;
+    return 0;
+}
+
+/* Starts collecting checkpoints for a program that was just opened. */
+int Interp::checkpoint_open(const char *filename)
+{
+    checkpoint_state *cp = &_setup.checkpoint;
+    struct checkpoint_header h;
+    char dir[PATH_MAX];
+
+    checkpoint_close();
+    cp->reached = _setup.sequence_number;
+    if (cp->interval <= 0)
+	return INTERP_OK;
+    if (program_stamp(filename, &cp->size, &cp->mtime) != 0 ||
+	side_file(cp->dir, filename, cp->program, cp->path,
+		  sizeof(cp->path)) != 0 ||
+	snprintf(cp->tmp, sizeof(cp->tmp), "%s.%d", cp->path, getpid()) >=
+	(int) sizeof(cp->tmp))
+	return INTERP_OK;
+    snprintf(dir, sizeof(dir), "%s", cp->path);
+    *strrchr(dir, '/') = 0;
+    if (make_dir(dir) != 0 || (cp->fp = fopen(cp->tmp, "w")) == NULL) {
+	logDebug("checkpoint_open: cannot write %s, no checkpoints", cp->tmp);
+	return INTERP_OK;
+    }
+    h.magic = CHECKPOINT_MAGIC;
+    h.size = cp->size;
+    h.mtime = cp->mtime;
+    h.last = 0;
+    if (fwrite(&h, sizeof(h), 1, cp->fp) != 1 ||
+	write_string(cp->fp, cp->program)) {
+	checkpoint_discard();
+	return INTERP_OK;
+    }
+    memcpy(cp->parameters, _setup.parameters, sizeof(cp->parameters));
+    cp->next = _setup.sequence_number + cp->interval;
+    cp->last = 0;
+    return INTERP_OK;
+}
+
+/* Drops the checkpoints of this run. */
+void Interp::checkpoint_discard()
+{
+    checkpoint_state *cp = &_setup.checkpoint;
+
+    if (cp->fp == NULL)
+	return;
+    fclose(cp->fp);
+    cp->fp = NULL;
+    unlink(cp->tmp);
+}
+
+/* Finishes the side file.  It replaces the one there unless that one is
+   for the same program and reaches at least as far. */
+int Interp::checkpoint_close()
+{
+    checkpoint_state *cp = &_setup.checkpoint;
+    struct checkpoint_header h, old;
+    FILE *fp;
+
+    if (cp->fp == NULL)
+	return INTERP_OK;
+    h.magic = CHECKPOINT_MAGIC;
+    h.size = cp->size;
+    h.mtime = cp->mtime;
+    h.last = cp->last;
+    if (cp->last == 0 || fseek(cp->fp, 0, SEEK_SET) != 0 ||
+	fwrite(&h, sizeof(h), 1, cp->fp) != 1) {
+	checkpoint_discard();
+	return INTERP_OK;
+    }
+    if ((fp = fopen(cp->path, "r")) != NULL) {
+	if (read_header(fp, &old, cp->program) == 0 &&
+	    old.size == h.size &&
+	    old.mtime == h.mtime && old.last >= h.last) {
+	    fclose(fp);
+	    checkpoint_discard();
+	    return INTERP_OK;
+	}
+	fclose(fp);
+    }
+    if (fclose(cp->fp) != 0 || rename(cp->tmp, cp->path) != 0)
+	unlink(cp->tmp);
+    cp->fp = NULL;
+    return INTERP_OK;
+}
+
+/* Called after each line of the program is executed; writes a
+   checkpoint when one is due and the state can be restored from scratch:
+   no sub, remap or skip in progress and no cutter compensation, whose
+   queued moves are not part of the state saved. */
+int Interp::checkpoint_take()
+{
+    checkpoint_state *cp = &_setup.checkpoint;
+    struct checkpoint_record r;
+    std::vector<checkpoint_param> params;
+    parameter_map_iterator pi;
+    offset_map_iterator oi;
+    int i, k;
+
+    if (cp->fp == NULL || _setup.sequence_number < cp->next ||
+	_setup.call_level != 0 || _setup.remap_level != 0 ||
+	_setup.skipping_o || _setup.defining_sub ||
+	_setup.cutter_comp_side || _setup.file_pointer == NULL)
+	return INTERP_OK;
+
+    write_g_codes((block_pointer) NULL, &_setup);
+    write_m_codes((block_pointer) NULL, &_setup);
+    write_settings(&_setup);
+
+    r.sequence_number = _setup.sequence_number;
+    r.reached = cp->reached;
+    r.offset = ngc_tell(_setup.file_pointer);
+    memcpy(r.g_codes, _setup.active_g_codes, sizeof(r.g_codes));
+    memcpy(r.m_codes, _setup.active_m_codes, sizeof(r.m_codes));
+    memcpy(r.settings, _setup.active_settings, sizeof(r.settings));
+    r.current[0] = _setup.current_x;
+    r.current[1] = _setup.current_y;
+    r.current[2] = _setup.current_z;
+    r.current[3] = _setup.AA_current;
+    r.current[4] = _setup.BB_current;
+    r.current[5] = _setup.CC_current;
+    r.current[6] = _setup.u_current;
+    r.current[7] = _setup.v_current;
+    r.current[8] = _setup.w_current;
+    r.motion_mode = _setup.motion_mode;
+    r.current_toolno = pocket_toolno(&_setup, _setup.current_pocket);
+    r.selected_toolno = pocket_toolno(&_setup, _setup.selected_pocket);
+    r.selected_tool = _setup.selected_tool;
+    r.tool_offset_code = _setup.tool_offset_code;
+    r.tool_offset_h = _setup.tool_offset_h;
+    r.tool_offset = _setup.tool_offset;
+
+    for (i = 1; i < RS274NGC_MAX_PARAMETERS; i++) {
+	if (_setup.parameters[i] == cp->parameters[i])
+	    continue;
+	for (k = 0; k < _n_readonly_parameters; k++)
+	    if (_readonly_parameters[k] == i)
+		break;
+	if (k < _n_readonly_parameters)
+	    continue;
+	checkpoint_param p = { i, _setup.parameters[i] };
+	params.push_back(p);
+    }
+    r.n_params = params.size();
+
+    parameter_map &named = _setup.sub_context[0].named_params;
+    r.n_named = 0;
+    for (pi = named.begin(); pi != named.end(); pi++)
+	if (!(pi->second.attr & CHECKPOINT_PA_SKIP))
+	    r.n_named++;
+    r.n_subs = _setup.offset_map.size();
+
+    if (fwrite(&r, sizeof(r), 1, cp->fp) != 1 ||
+	(r.n_params && fwrite(&params[0], sizeof(params[0]), r.n_params,
+			      cp->fp) != (size_t) r.n_params))
+	goto fail;
+    for (pi = named.begin(); pi != named.end(); pi++) {
+	if (pi->second.attr & CHECKPOINT_PA_SKIP)
+	    continue;
+	if (write_string(cp->fp, pi->first) ||
+	    write_value(cp->fp, pi->second.value) ||
+	    write_value(cp->fp, pi->second.attr))
+	    goto fail;
+    }
+    for (oi = _setup.offset_map.begin(); oi != _setup.offset_map.end(); oi++) {
+	offset o = oi->second;
+	if (write_string(cp->fp, oi->first) ||
+	    write_string(cp->fp, o.filename ? o.filename : "") ||
+	    write_value(cp->fp, o.type) || write_value(cp->fp, o.offset) ||
+	    write_value(cp->fp, o.sequence_number) ||
+	    write_value(cp->fp, o.repeat_count))
+	    goto fail;
+    }
+    cp->last = r.sequence_number;
+    cp->next = r.sequence_number + cp->interval;
+    return INTERP_OK;
+
+fail:
+    logDebug("checkpoint_take: write to %s failed, no more checkpoints",
+	     cp->tmp);
+    checkpoint_discard();
+    return INTERP_OK;
+}
+
+/* Resumes the open program from the last checkpoint taken before line
+   start_line - 1 was first read, so the caller's run-from-line logic
+   still sees that line go by.  Without a usable checkpoint nothing
+   changes and the program is read from where it is. */
+int Interp::restore(int start_line)
+{
+    checkpoint_state *cp = &_setup.checkpoint;
+    struct checkpoint_header h;
+    struct checkpoint_record r, best;
+    std::vector<checkpoint_param> params, best_params;
+    std::vector<std::string> names, best_names;
+    std::vector<parameter_value> values, best_values;
+    std::vector<std::string> subs, best_subs, files, best_files;
+    std::vector<offset> offsets, best_offsets;
+    std::vector<double> saved_parameters;
+    char path[PATH_MAX], program[PATH_MAX];
+    char cmd[LINELEN];
+    long size, mtime;
+    bool found = false;
+    FILE *fp;
+    int current_pocket, selected_pocket;
+    int i, status;
+
+    // a run that did not start at the top would leave holes
+    checkpoint_discard();
+
+    CHKS((_setup.file_pointer == NULL), NCE_FILE_NOT_OPEN);
+    if (program_stamp(_setup.filename, &size, &mtime) != 0 ||
+	side_file(cp->dir, _setup.filename, program, path,
+		  sizeof(path)) != 0 || (fp = fopen(path, "r")) == NULL)
+	return INTERP_OK;
+    if (read_header(fp, &h, program) != 0 ||
+	h.size != size || h.mtime != mtime) {
+	logDebug("restore: %s is stale", path);
+	fclose(fp);
+	return INTERP_OK;
+    }
+
+    while (fread(&r, sizeof(r), 1, fp) == 1) {
+	// reached only grows, so nothing further on can be used
+	if (r.reached > start_line - 2 || r.n_params < 0 ||
+	    r.n_named < 0 || r.n_subs < 0)
+	    break;
+	params.resize(r.n_params);
+	names.resize(r.n_named);
+	values.resize(r.n_named);
+	subs.resize(r.n_subs);
+	files.resize(r.n_subs);
+	offsets.resize(r.n_subs);
+	if (r.n_params && fread(&params[0], sizeof(params[0]), r.n_params,
+				fp) != (size_t) r.n_params)
+	    break;
+	for (i = 0; i < r.n_named; i++)
+	    if (read_string(fp, names[i]) ||
+		read_value(fp, values[i].value) ||
+		read_value(fp, values[i].attr))
+		break;
+	if (i < r.n_named)
+	    break;
+	for (i = 0; i < r.n_subs; i++)
+	    if (read_string(fp, subs[i]) || read_string(fp, files[i]) ||
+		read_value(fp, offsets[i].type) ||
+		read_value(fp, offsets[i].offset) ||
+		read_value(fp, offsets[i].sequence_number) ||
+		read_value(fp, offsets[i].repeat_count))
+		break;
+	if (i < r.n_subs)
+	    break;
+	best = r;
+	best_params.swap(params);
+	best_names.swap(names);
+	best_values.swap(values);
+	best_subs.swap(subs);
+	best_files.swap(files);
+	best_offsets.swap(offsets);
+	found = true;
+    }
+    fclose(fp);
+    if (!found)
+	return INTERP_OK;
+
+    // the tool table may have changed since; its tools must still be
+    // there, or reading the lines would not get this far either
+    current_pocket = selected_pocket = -1;
+    if (best.current_toolno >= 0 &&
+	(current_pocket = tool_pocket(&_setup, best.current_toolno)) < 0) {
+	logDebug("restore: tool %d is gone", best.current_toolno);
+	return INTERP_OK;
+    }
+    if (best.selected_toolno >= 0 &&
+	(selected_pocket = tool_pocket(&_setup, best.selected_toolno)) < 0) {
+	logDebug("restore: tool %d is gone", best.selected_toolno);
+	return INTERP_OK;
+    }
+    if (best.tool_offset_code == G_43 && best.tool_offset_h >= 0 &&
+	tool_pocket(&_setup, best.tool_offset_h) < 0) {
+	logDebug("restore: tool %d is gone", best.tool_offset_h);
+	return INTERP_OK;
+    }
+    logDebug("restore: line %d from checkpoint at line %d",
+	     start_line, best.sequence_number);
+
+    saved_parameters.assign(_setup.parameters,
+			    _setup.parameters + RS274NGC_MAX_PARAMETERS);
+    for (i = 0; i < best.n_params; i++) {
+	if (best_params[i].index > 0 &&
+	    best_params[i].index < RS274NGC_MAX_PARAMETERS)
+	    _setup.parameters[best_params[i].index] = best_params[i].value;
+    }
+
+    // pockets as the tool table has them now; tool_table[0] is the
+    // machine's, which is what reading the lines leaves there too
+    if (current_pocket >= 0)
+	_setup.current_pocket = current_pocket;
+    if (selected_pocket >= 0)
+	_setup.selected_pocket = selected_pocket;
+    _setup.selected_tool = best.selected_tool;
+
+    // modal state goes back through the M72 path, so canon hears of it;
+    // the coordinate system and G92 offsets are applied from the
+    // parameters restored above whether or not they look changed
+    context_pointer frame = &_setup.sub_context[0];
+    memcpy(frame->saved_g_codes, best.g_codes, sizeof(best.g_codes));
+    memcpy(frame->saved_m_codes, best.m_codes, sizeof(best.m_codes));
+    memcpy(frame->saved_settings, best.settings, sizeof(best.settings));
+    status = restore_settings(&_setup, 0);
+    if (status == INTERP_OK) {
+	int g5x = best.g_codes[8];
+	if (g5x % 10)
+	    snprintf(cmd, sizeof(cmd), "G%d.%d %s", g5x / 10, g5x % 10,
+		     _setup.parameters[5210] ? "G92.3" : "G92.2");
+	else
+	    snprintf(cmd, sizeof(cmd), "G%d %s", g5x / 10,
+		     _setup.parameters[5210] ? "G92.3" : "G92.2");
+	status = execute(cmd);
+    }
+    if (status == INTERP_OK) {
+	// the M72 path leaves the tool length offset alone; G43 takes it
+	// from the current tool table, only G43.1 values are programmed
+	if (best.tool_offset_code == G_43_1) {
+	    _setup.tool_offset = best.tool_offset;
+	    _setup.tool_offset_code = G_43_1;
+	    _setup.tool_offset_h = -1;
+	    USE_TOOL_LENGTH_OFFSET(_setup.tool_offset);
+	} else {
+	    if (best.tool_offset_code != G_43)
+		snprintf(cmd, sizeof(cmd), "G49");
+	    else if (best.tool_offset_h >= 0)
+		snprintf(cmd, sizeof(cmd), "G43 H%d", best.tool_offset_h);
+	    else
+		snprintf(cmd, sizeof(cmd), "G43");
+	    status = execute(cmd);
+	}
+    }
+    if (status == INTERP_OK) {
+	// nor does it touch motion mode
+	_setup.motion_mode = best.motion_mode;
+    }
+    if (status != INTERP_OK) {
+	std::copy(saved_parameters.begin(), saved_parameters.end(),
+		  _setup.parameters);
+	ERS(_("Cannot restore checkpoint at line %d for line %d"),
+	    best.sequence_number, start_line);
+    }
+
+    for (i = 0; i < best.n_named; i++)
+	frame->named_params[strstore(best_names[i].c_str())] = best_values[i];
+    for (i = 0; i < best.n_subs; i++) {
+	offset o = best_offsets[i];
+	o.filename = strstore(best_files[i].c_str());
+	_setup.offset_map[strstore(best_subs[i].c_str())] = o;
+    }
+
+    _setup.current_x = best.current[0];
+    _setup.current_y = best.current[1];
+    _setup.current_z = best.current[2];
+    _setup.AA_current = best.current[3];
+    _setup.BB_current = best.current[4];
+    _setup.CC_current = best.current[5];
+    _setup.u_current = best.current[6];
+    _setup.v_current = best.current[7];
+    _setup.w_current = best.current[8];
+
+    ngc_seek(_setup.file_pointer, best.offset);
+    _setup.sequence_number = best.sequence_number;
+    cp->reached = best.reached;
+    return INTERP_OK;
+}
@@ -227,7 +227,8 @@ int Interp::convert_nurbs(int mode, block_pointer block,	//!< pointer to a block
             CHKS((!nurbs_control_points.empty()),
                     ("Must specify NURBS curve order at 1st Control Point"));
             nurbs_order = block->p_number;
-
+            CHKS((nurbs_order < 2 || nurbs_order > NURBS_MAX_ORDER),
+                    ("NURBS curve order must be between 2 and %d"), NURBS_MAX_ORDER);
         }
         // I: NURBS Curve Length
         if (block->i_flag == ON) {
@@ -4354,13 +4355,13 @@ int Interp::convert_stop(block_pointer block,    //!< pointer to a block of RS27
         if (_setup.percent_flag && _setup.file_pointer) {
             line = _setup.linetext;
             for (;;) {                /* check for ending percent sign and comment if missing */
-                if (fgets(line, LINELEN, _setup.file_pointer) == NULL) {
+                if (ngc_gets(line, LINELEN, _setup.file_pointer) == NULL) {
                     enqueue_COMMENT("interpreter: percent sign missing from end of file");
                     break;
                 }
                 length = strlen(line);
                 if (length == (LINELEN - 1)) {       // line is too long. need to finish reading the line
-                    for (; fgetc(_setup.file_pointer) != '\n';);
+                    for (; ngc_getc(_setup.file_pointer) != '\n';);
                     continue;
                 }
                 for (index = (length - 1);      // index set on last char
@@ -5396,6 +5397,8 @@ int Interp::convert_tool_length_offset(int g_code,       //!< g_code being execu
     settings->w_current += settings->tool_offset.w - tool_offset.w;
 
     settings->tool_offset = tool_offset;
+    settings->tool_offset_code = g_code;
+    settings->tool_offset_h = (g_code == G_43 && block->h_flag) ? block->h_number : -1;
     return INTERP_OK;
 }
 
@@ -24,6 +24,7 @@
 #include "emcpos.h"
 #include "libintl.h"
 #include "python_plugin.hh"
+#include "ngc_file.hh"
 
 
 #define _(s) gettext(s)
@@ -554,6 +555,22 @@ typedef struct offset_struct {
 typedef std::map<const char *, offset, nocase_cmp> offset_map_type;
 typedef std::map<const char *, offset, nocase_cmp>::iterator offset_map_iterator;
 
+// run-from-line checkpoints of the open program, see interp_checkpoint.cc
+typedef struct checkpoint_struct {
+  int interval;          // lines between checkpoints, 0 = off
+  int next;              // sequence number due for the next one
+  int last;              // sequence number of the last one written
+  int reached;           // highest line read at call level 0
+  FILE *fp;              // checkpoints of this run, or NULL
+  char dir[PATH_MAX];    // [RS274NGC]CHECKPOINT_DIR, "" = ~/.cache/...
+  char program[PATH_MAX]; // real path of the program
+  char path[PATH_MAX];   // side file they end up in
+  char tmp[PATH_MAX];    // file they are written to meanwhile
+  long size;             // program size and mtime they belong to
+  long mtime;
+  double parameters[RS274NGC_MAX_PARAMETERS]; // values at open
+} checkpoint_state;
+
 /*
 
 The current_x, current_y, and current_z are the location of the tool
@@ -629,7 +646,7 @@ typedef struct setup_struct
   bool feed_override;         // whether feed override is enabled
   double feed_rate;             // feed rate in current units/min
   char filename[PATH_MAX];      // name of currently open NC code file
-  FILE *file_pointer;           // file pointer for open NC code file
+  NGC_FILE *file_pointer;       // open NC code file
   bool flood;                 // whether flood coolant is on
   CANON_UNITS length_units;     // millimeters or inches
   int line_length;              // length of line last read
@@ -672,6 +689,8 @@ typedef struct setup_struct
   char stack[STACK_LEN][STACK_ENTRY_LEN];      // stack of calls for error reporting
   int stack_index;              // index into the stack
   EmcPose tool_offset;          // tool length offset
+  int tool_offset_code;         // G_43, G_43_1 or G_49 that set tool_offset
+  int tool_offset_h;            // H word of that G43, -1 if it had none
   int pockets_max;                 // number of pockets in carousel (including pocket 0, the spindle)
   CANON_TOOL_TABLE tool_table[CANON_POCKETS_MAX];      // index is pocket number
   double traverse_rate;         // rate for traverse motions
@@ -693,6 +712,7 @@ typedef struct setup_struct
   context sub_context[INTERP_SUB_ROUTINE_LEVELS];
   int call_state;                  //  enum call_states - inidicate Py handler reexecution
   offset_map_type offset_map;      // store label x name, file, line
+  checkpoint_state checkpoint;     // run-from-line checkpoints
 
   bool adaptive_feed;              // adaptive feed is enabled
   bool feed_hold;                  // feed hold is enabled
@@ -205,7 +205,7 @@ int Interp::execute_call(setup_pointer settings,
 	if (settings->file_pointer == NULL) {
 	    previous_frame->position = -1;
 	} else {
-	    previous_frame->position = ftell(settings->file_pointer);
+	    previous_frame->position = ngc_tell(settings->file_pointer);
 	}
 
 	// save return location
@@ -406,11 +406,11 @@ int Interp::execute_return(setup_pointer settings, context_pointer current_frame
 		}
 		//!!!KL must open the new file, if changed
 		if (0 != strcmp(settings->filename, previous_frame->filename))  {
-		    fclose(settings->file_pointer);
-		    settings->file_pointer = fopen(previous_frame->filename, "r");
+		    ngc_close(settings->file_pointer);
+		    settings->file_pointer = ngc_open(previous_frame->filename);
 		    strcpy(settings->filename, previous_frame->filename);
 		}
-		fseek(settings->file_pointer, previous_frame->position, SEEK_SET);
+		ngc_seek(settings->file_pointer, previous_frame->position);
 		settings->sequence_number = previous_frame->sequence_number;
 		logOword("endsub/return: %s:%d pos=%ld", 
 			 settings->filename,previous_frame->sequence_number,
@@ -467,7 +467,8 @@ int Interp::control_back_to( block_pointer block, // pointer to block
     static char name[] = "control_back_to";
     char newFileName[PATH_MAX+1];
     char tmpFileName[PATH_MAX+1];
-    FILE *newFP;
+    NGC_FILE *newFP;
+    FILE *fp;
     offset_map_iterator it;
     offset_pointer op;
 
@@ -483,7 +484,7 @@ int Interp::control_back_to( block_pointer block, // pointer to block
 	if (0 != strcmp(settings->filename,
 			op->filename)) {
 	    // open the new file...
-	    newFP = fopen(op->filename, "r");
+	    newFP = ngc_open(op->filename);
 	    // set the line number
 	    settings->sequence_number = 0;
 	    strcpy(settings->filename, op->filename);
@@ -491,7 +492,7 @@ int Interp::control_back_to( block_pointer block, // pointer to block
 	    if (newFP) {
 		// close the old file...
 		if (settings->file_pointer) // only close if it was open
-		    fclose(settings->file_pointer);
+		    ngc_close(settings->file_pointer);
 		settings->file_pointer = newFP;
 	    } else {
 		logOword("Unable to open file: %s", settings->filename);
@@ -499,13 +500,17 @@ int Interp::control_back_to( block_pointer block, // pointer to block
 	    }
 	}
 	if (settings->file_pointer) { // only seek if it was open
-	    fseek(settings->file_pointer,
-		  op->offset, SEEK_SET);
+	    ngc_seek(settings->file_pointer, op->offset);
 	}
 	settings->sequence_number = op->sequence_number;
 	return INTERP_OK;
     }
-    newFP = find_ngc_file(settings, block->o_name, newFileName);
+    newFP = NULL;
+    fp = find_ngc_file(settings, block->o_name, newFileName);
+    if (fp) {
+	fclose(fp);
+	newFP = ngc_open(newFileName);
+    }
 
     if (newFP) {
 	logOword("fopen: |%s| OK", newFileName);
@@ -513,7 +518,7 @@ int Interp::control_back_to( block_pointer block, // pointer to block
 
 	// close the old file...
 	if (settings->file_pointer)
-	    fclose(settings->file_pointer);
+	    ngc_close(settings->file_pointer);
 	settings->file_pointer = newFP;
 	strcpy(settings->filename, newFileName);
     } else {
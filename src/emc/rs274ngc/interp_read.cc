@@ -2986,7 +2986,7 @@ the reduced line.
 
 int Interp::read_text(
     const char *command,       //!< a string which may have input text, or null
-    FILE * inport,     //!< a file pointer for an input file, or null
+    NGC_FILE * inport, //!< an open input file, or null
     char *raw_line,    //!< array to write raw input line into
     char *line,        //!< array for input line to be processed in
     int *length)       //!< a pointer to an integer to be set
@@ -2994,7 +2994,7 @@ int Interp::read_text(
   int index;
 
   if (command == NULL) {
-    if (fgets(raw_line, LINELEN, inport) == NULL) {
+    if (ngc_gets(raw_line, LINELEN, inport) == NULL) {
       if(_setup.skipping_to_sub)
       {
         ERS(_("EOF in file:%s seeking o-word: o<%s> from line: %d"),
@@ -3013,7 +3013,7 @@ int Interp::read_text(
     }
     _setup.sequence_number++;   /* moved from version1, was outside if */
     if (strlen(raw_line) == (LINELEN - 1)) { // line is too long. need to finish reading the line to recover
-      for (; fgetc(inport) != '\n';) {
+      for (; ngc_getc(inport) != '\n';) {
       }                         // could also look for EOF
       ERS(NCE_COMMAND_TOO_LONG);
     }
@@ -0,0 +1,359 @@
+/********************************************************************
+* Description: ngc_file.cc
+*   Memory mapped NC program files with a line and o-word index
+*
+*   The interpreter used to fgets() its way through a program and,
+*   when skipping to an o-word (a sub definition, a false if, a call
+*   to a sub not seen yet), parse every line in between.  Here the
+*   file is mapped once, and the first skip indexes the line starts
+*   and o-word lines so later skips land on the right line at once.
+*   A program cut short while it runs (saved in place from an editor)
+*   would raise SIGBUS on the pages past its new end, so the size is
+*   checked again with fstat() before reading on into a new chunk.
+*
+* License: GPL Version 2
+* System: Linux
+*
+* Copyright (c) 2014 All rights reserved.
+*
+********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <algorithm>
+
+#include "config.h"		// LINELEN
+#include "ngc_file.hh"
+
+// how far a mapped file is read on one fstat()
+#define NGC_CHECK_CHUNK 65536
+
+// slurp what cannot be mapped (pipes, empty files)
+static int ngc_read_all(NGC_FILE * f, int fd)
+{
+    size_t room = 65536;
+    ssize_t n;
+
+    f->base = (char *) malloc(room);
+    if (f->base == NULL)
+	return -1;
+    while ((n = read(fd, f->base + f->size, room - f->size)) > 0) {
+	f->size += n;
+	if (f->size == room) {
+	    char *bigger = (char *) realloc(f->base, room * 2);
+	    if (bigger == NULL)
+		return -1;
+	    f->base = bigger;
+	    room *= 2;
+	}
+    }
+    return n < 0 ? -1 : 0;
+}
+
+// makes sure [0, end) of a mapped file is still there, or cuts size
+// down to what is; a truncated program simply ends early
+static void ngc_check(NGC_FILE * f, size_t end)
+{
+    struct stat st;
+
+    if (!f->mapped || end <= f->checked)
+	return;
+    if (fstat(f->fd, &st) == 0 && (size_t) st.st_size < f->size)
+	f->size = st.st_size;
+    f->checked = std::min(f->size, (end / NGC_CHECK_CHUNK + 1) *
+			  NGC_CHECK_CHUNK);
+}
+
+NGC_FILE *ngc_open(const char *filename)
+{
+    NGC_FILE *f;
+    struct stat st;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+	return NULL;
+    f = new NGC_FILE;
+    f->base = NULL;
+    f->size = 0;
+    f->pos = 0;
+    f->mapped = false;
+    f->fd = -1;
+    f->map_size = 0;
+    f->checked = 0;
+    f->indexed = false;
+    f->jumpable = false;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p != MAP_FAILED) {
+	    f->base = (char *) p;
+	    f->size = f->map_size = st.st_size;
+	    f->mapped = true;
+	    // kept open for ngc_check()
+	    f->fd = fd;
+	    // programs are mostly read front to back
+	    madvise(p, st.st_size, MADV_SEQUENTIAL);
+	    return f;
+	}
+    }
+    if (ngc_read_all(f, fd) < 0) {
+	close(fd);
+	ngc_close(f);
+	return NULL;
+    }
+    close(fd);
+    return f;
+}
+
+void ngc_close(NGC_FILE * f)
+{
+    if (f == NULL)
+	return;
+    if (f->mapped) {
+	munmap(f->base, f->map_size);
+	close(f->fd);
+    } else
+	free(f->base);
+    delete f;
+}
+
+char *ngc_gets(char *buf, int size, NGC_FILE * f)
+{
+    size_t n, left;
+    const char *nl;
+
+    if (size >= 1)
+	ngc_check(f, f->pos + size - 1);
+    if (size < 1 || f->pos >= f->size)
+	return NULL;
+    left = f->size - f->pos;
+    n = (size_t) (size - 1) < left ? (size_t) (size - 1) : left;
+    nl = (const char *) memchr(f->base + f->pos, '\n', n);
+    if (nl)
+	n = nl - (f->base + f->pos) + 1;
+    memcpy(buf, f->base + f->pos, n);
+    buf[n] = 0;
+    f->pos += n;
+    return buf;
+}
+
+int ngc_getc(NGC_FILE * f)
+{
+    ngc_check(f, f->pos + 1);
+    if (f->pos >= f->size)
+	return EOF;
+    return (unsigned char) f->base[f->pos++];
+}
+
+long ngc_tell(NGC_FILE * f)
+{
+    return f->pos;
+}
+
+int ngc_seek(NGC_FILE * f, long offset)
+{
+    if (offset < 0 || (size_t) offset > f->size)
+	return -1;
+    f->pos = offset;
+    // the file may have been cut short behind us, look again
+    f->checked = 0;
+    return 0;
+}
+
+/* Reduces a line the way close_and_downcase() does (blanks out, letters
+   down) and reports the o-word on it, if any.  Returns 1 for an o-word
+   line with its name in name, 0 for any other line, -1 for a line whose
+   o-word cannot be known without running the program. */
+static int ngc_label_of(const char *text, size_t len, std::string & name,
+			bool * global)
+{
+    char line[LINELEN];
+    int comment = 0, semicomment = 0, n = 0;
+    size_t m;
+    const char *p;
+
+    if (len >= LINELEN - 1)
+	return -1;		// read_text() errors out on these
+    for (m = 0; m < len; m++) {
+	char c = text[m];
+	if (c == ';' && !comment)
+	    semicomment = 1;
+	if (semicomment || comment) {
+	    if (comment && c == ')')
+		comment = 0;
+	    else if (comment && c == '(')
+		return -1;
+	    line[n++] = c;
+	} else if (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+	else if (c == '(') {
+	    comment = 1;
+	    line[n++] = c;
+	} else
+	    line[n++] = tolower(c);
+    }
+    if (comment)
+	return -1;
+    line[n] = 0;
+
+    p = line;
+    if (*p == '/') {
+	// whether this line runs depends on the block delete switch
+	return strchr(p, 'o') ? -1 : 0;
+    }
+    if (*p == 'n') {
+	if (!isdigit(*++p))
+	    return -1;
+	for (; isdigit(*p) || *p == '.'; p++);
+    }
+    if (*p != 'o')
+	return 0;
+    p++;
+    if (*p == '<') {
+	const char *end = strchr(p, '>');
+	if (end == NULL || memchr(p, '#', end - p))
+	    return -1;
+	name.assign(p + 1, end - p - 1);
+	p = end + 1;
+    } else if (isdigit(*p)) {
+	char num[32];
+	long v = strtol(p, (char **) &p, 10);
+	if (*p == '.')
+	    return -1;
+	snprintf(num, sizeof(num), "%ld", v);
+	name = num;
+    } else {
+	return -1;		// o#1, o[...]: computed
+    }
+    // same order of tests as read_o()
+    *global = !strncmp(p, "sub", 3) || !strncmp(p, "endsub", 6) ||
+	!strncmp(p, "call", 4) || !strncmp(p, "return", 6);
+    return 1;
+}
+
+int ngc_index(NGC_FILE * f)
+{
+    size_t off = 0;
+    int line = 1;
+
+    if (f->indexed)
+	return 0;
+    ngc_check(f, f->size);
+    f->jumpable = true;
+    while (off < f->size) {
+	const char *start = f->base + off;
+	const char *nl = (const char *) memchr(start, '\n', f->size - off);
+	size_t len = nl ? (size_t) (nl - start + 1) : f->size - off;
+	std::string name;
+	bool global = false;
+	size_t i;
+
+	if ((line - 1) % NGC_LINE_STRIDE == 0)
+	    f->line_index.push_back(off);
+	for (i = 0; i < len && isspace(start[i]); i++);
+	if (i < len && start[i] == '%') {
+	    for (i++; i < len && isspace(start[i]); i++);
+	    if (i == len)
+		f->percent_lines.push_back(line);
+	}
+	switch (ngc_label_of(start, len, name, &global)) {
+	case 1:{
+		ngc_label l;
+		l.line = line;
+		l.offset = off;
+		l.global = global;
+		f->labels[name].push_back(l);
+		break;
+	    }
+	case -1:
+	    f->jumpable = false;
+	    break;
+	}
+	off += len;
+	line++;
+    }
+    f->indexed = true;
+    return 0;
+}
+
+int ngc_line_of(NGC_FILE * f, long offset)
+{
+    std::vector<long>::iterator it;
+    size_t off;
+    int line;
+
+    ngc_index(f);
+    ngc_check(f, offset);
+    if (f->line_index.empty())
+	return 1;
+    if ((size_t) offset > f->size)
+	offset = f->size;
+    it = std::upper_bound(f->line_index.begin(), f->line_index.end(),
+			  offset) - 1;
+    line = (it - f->line_index.begin()) * NGC_LINE_STRIDE + 1;
+    for (off = *it; off < (size_t) offset; line++) {
+	const char *nl = (const char *) memchr(f->base + off, '\n',
+					       offset - off);
+	if (nl == NULL)
+	    break;
+	off = nl - f->base + 1;
+    }
+    return line;
+}
+
+static bool ngc_before(const ngc_label & l, long offset)
+{
+    return l.offset < offset;
+}
+
+static const ngc_label *ngc_next(NGC_FILE * f, const std::string & name,
+				 bool global, long from)
+{
+    ngc_label_map::iterator it = f->labels.find(name);
+    ngc_label_list::iterator l;
+
+    if (it == f->labels.end())
+	return NULL;
+    for (l = std::lower_bound(it->second.begin(), it->second.end(), from,
+			      ngc_before); l != it->second.end(); l++) {
+	if (l->global == global)
+	    return &*l;
+    }
+    return NULL;
+}
+
+int ngc_find_label(NGC_FILE * f, const char *o_name, int *line,
+		   long *offset)
+{
+    const char *hash;
+    const ngc_label *l;
+    int from;
+
+    ngc_index(f);
+    if (!f->jumpable)
+	return -1;
+    // read_o() names local o-words "<sub>#<label>" and global ones
+    // just "<label>"; labels never hold a '#' once indexed
+    hash = strrchr(o_name, '#');
+    if (hash)
+	l = ngc_next(f, hash + 1, false, f->pos);
+    else
+	l = ngc_next(f, o_name, true, f->pos);
+    if (l == NULL)
+	return -1;
+    from = ngc_line_of(f, f->pos);
+    if (std::lower_bound(f->percent_lines.begin(), f->percent_lines.end(),
+			 from) !=
+	std::lower_bound(f->percent_lines.begin(), f->percent_lines.end(),
+			 l->line))
+	return -1;
+    *line = l->line;
+    *offset = l->offset;
+    return 0;
+}
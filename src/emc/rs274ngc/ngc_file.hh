@@ -0,0 +1,74 @@
+/********************************************************************
+* Description: ngc_file.hh
+*   NC program files held in memory, with a line and o-word index
+*
+* License: GPL Version 2
+* System: Linux
+*
+* Copyright (c) 2014 All rights reserved.
+*
+********************************************************************/
+#ifndef NGC_FILE_HH
+#define NGC_FILE_HH
+
+#include <stddef.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// every NGC_LINE_STRIDE'th line start is kept in the line index, so
+// locating any line costs one lookup plus a scan of at most
+// NGC_LINE_STRIDE-1 newlines
+#define NGC_LINE_STRIDE 64
+
+struct ngc_label {
+    int line;			// line number, counting from 1
+    long offset;		// file offset of the line
+    bool global;		// sub, endsub, call or return: name not scoped
+};
+
+typedef std::vector<ngc_label> ngc_label_list;
+typedef std::map<std::string, ngc_label_list> ngc_label_map;
+
+typedef struct ngc_file {
+    char *base;			// file contents, mapped or malloc()ed
+    size_t size;		// shrinks if a mapped file is cut short
+    size_t pos;			// offset of the next character to read
+    bool mapped;
+    int fd;			// of a mapped file, for fstat()
+    size_t map_size;		// as mapped, for munmap()
+    size_t checked;		// [0, checked) known to be in the file
+
+    // built on first use by ngc_index(), so opening a file costs the
+    // same whatever its size
+    bool indexed;
+    bool jumpable;		// o-word labels are all literal and unambiguous
+    std::vector<long> line_index;	// offset of lines 1, 1+STRIDE, ...
+    std::vector<int> percent_lines;	// lines holding just a '%'
+    ngc_label_map labels;	// o-word lines by name, in file order
+} NGC_FILE;
+
+extern NGC_FILE *ngc_open(const char *filename);
+extern void ngc_close(NGC_FILE * f);
+
+/* stdio lookalikes so the interpreter reads a file in memory the way it
+   read a FILE */
+extern char *ngc_gets(char *buf, int size, NGC_FILE * f);
+extern int ngc_getc(NGC_FILE * f);
+extern long ngc_tell(NGC_FILE * f);
+extern int ngc_seek(NGC_FILE * f, long offset);
+
+/* builds the line and label index, returns 0 */
+extern int ngc_index(NGC_FILE * f);
+
+/* line number (from 1) of the line starting at or containing offset */
+extern int ngc_line_of(NGC_FILE * f, long offset);
+
+/* finds the first line at or after the current position whose o-word
+   the interpreter would name o_name.  Returns its line number and offset
+   and 0, or -1 if there is none, the file's labels cannot be trusted, or
+   a '%' line lies in between and must be read. */
+extern int ngc_find_label(NGC_FILE * f, const char *o_name,
+			  int *line, long *offset);
+
+#endif
@@ -44,6 +44,8 @@ typedef context *context_pointer;
 typedef struct offset_struct offset;
 typedef offset *offset_pointer;
 
+typedef struct ngc_file NGC_FILE;
+
 // Declare class so that we can use it in the typedef.
 class Interp;
 typedef int (Interp::*read_function_pointer) (char *, int *, block_pointer, double *);
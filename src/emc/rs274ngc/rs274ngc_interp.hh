@@ -40,6 +40,9 @@ public:
 // reset yourself
  int reset();
 
+// resume the open file from its checkpoint nearest before start_line
+ int restore(int start_line);
+
 // restore interpreter variables from a file
  int restore_parameters(const char *filename);
 
@@ -393,6 +396,10 @@ public:
     int init_readonly_param(const char *nameBuf, double value, int attr);
     int free_named_parameters(context_pointer frame);
  int save_settings(setup_pointer settings);
+ int checkpoint_open(const char *filename);
+ int checkpoint_take();
+ int checkpoint_close();
+ void checkpoint_discard();
  int restore_settings(setup_pointer settings, int from_level);
  int gen_settings(double *current, double *saved, char *cmd);
  int gen_g_codes(int *current, int *saved, char *cmd);
@@ -421,7 +428,7 @@ public:
                   double *parameters);
  int read_t(char *line, int *counter, block_pointer block,
                   double *parameters);
- int read_text(const char *command, FILE * inport, char *raw_line,
+ int read_text(const char *command, NGC_FILE * inport, char *raw_line,
                      char *line, int *length);
  int read_unary(char *line, int *counter, double *double_ptr,
                       double *parameters);
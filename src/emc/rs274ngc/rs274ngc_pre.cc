@@ -175,6 +175,7 @@ Called By: external programs
 int Interp::close()
 {
     logOword("close()");
+    checkpoint_close();
     // be "lazy" only if we're not aborting a call in progress
     // in which case we need to reset() the call stack
     // this does not reset the filename properly 
@@ -185,7 +186,7 @@ int Interp::close()
     }
 
   if (_setup.file_pointer != NULL) {
-    fclose(_setup.file_pointer);
+    ngc_close(_setup.file_pointer);
     _setup.file_pointer = NULL;
     _setup.percent_flag = false;
   }
@@ -466,6 +467,8 @@ int Interp::execute(const char *command)
     int status;
     if ((status = _execute(command)) > INTERP_MIN_ERROR) {
         unwind_call(status, __FILE__,__LINE__,__FUNCTION__);
+    } else if ((status == INTERP_OK) && (command == NULL)) {
+        checkpoint_take();
     }
     return status;
 }
@@ -747,6 +750,8 @@ int Interp::init()
   _setup.b_axis_wrapped = 0;
   _setup.c_axis_wrapped = 0;
   _setup.random_toolchanger = 0;
+  _setup.checkpoint.interval = 0;
+  _setup.checkpoint.dir[0] = 0;
   _setup.a_indexer = 0;
   _setup.b_indexer = 0;
   _setup.c_indexer = 0;
@@ -777,6 +782,12 @@ int Interp::init()
           inifile.Find(&_setup.b_indexer, "LOCKING_INDEXER", "AXIS_4");
           inifile.Find(&_setup.c_indexer, "LOCKING_INDEXER", "AXIS_5");
           inifile.Find(&_setup.orient_offset, "ORIENT_OFFSET", "RS274NGC");
+          inifile.Find(&_setup.checkpoint.interval, "CHECKPOINT_INTERVAL", "RS274NGC");
+          if(NULL != (inistring = inifile.Find("CHECKPOINT_DIR", "RS274NGC")))
+          {
+              snprintf(_setup.checkpoint.dir, sizeof(_setup.checkpoint.dir),
+                       "%s", inistring);
+          }
 
           inifile.Find(&_setup.debugmask, "DEBUG", "EMC");
 
@@ -1054,6 +1065,8 @@ int Interp::init()
 //_setup.stack does not need initialization
 //_setup.stack_index does not need initialization
    ZERO_EMC_POSE(_setup.tool_offset);
+  _setup.tool_offset_code = G_49;
+  _setup.tool_offset_h = -1;
 //_setup.tool_max set in Interp::synch
 //_setup.tool_table set in Interp::synch
 //_setup.traverse_rate set in Interp::synch
@@ -1249,15 +1262,15 @@ int Interp::open(const char *filename) //!< string: the name of the input NC-pro
     }
   CHKS((_setup.file_pointer != NULL), NCE_A_FILE_IS_ALREADY_OPEN);
   CHKS((strlen(filename) > (LINELEN - 1)), NCE_FILE_NAME_TOO_LONG);
-  _setup.file_pointer = fopen(filename, "r");
+  _setup.file_pointer = ngc_open(filename);
   CHKS((_setup.file_pointer == NULL), NCE_UNABLE_TO_OPEN_FILE, filename);
   line = _setup.linetext;
   for (index = -1; index == -1;) {      /* skip blank lines */
-    CHKS((fgets(line, LINELEN, _setup.file_pointer) ==
+    CHKS((ngc_gets(line, LINELEN, _setup.file_pointer) ==
          NULL), NCE_FILE_ENDED_WITH_NO_PERCENT_SIGN);
     length = strlen(line);
     if (length == (LINELEN - 1)) {   // line is too long. need to finish reading the line to recover
-      for (; fgetc(_setup.file_pointer) != '\n';);      // could look for EOF
+      for (; ngc_getc(_setup.file_pointer) != '\n';);      // could look for EOF
       ERS(NCE_COMMAND_TOO_LONG);
     }
     for (index = (length - 1);  // index set on last char
@@ -1270,17 +1283,18 @@ int Interp::open(const char *filename) //!< string: the name of the input NC-pro
       _setup.sequence_number = 1;       // We have already read the first line
       // and we are not going back to it.
     } else {
-      fseek(_setup.file_pointer, 0, SEEK_SET);
+      ngc_seek(_setup.file_pointer, 0);
       _setup.percent_flag = false;
       _setup.sequence_number = 0;       // Going back to line 0
     }
   } else {
-    fseek(_setup.file_pointer, 0, SEEK_SET);
+    ngc_seek(_setup.file_pointer, 0);
     _setup.percent_flag = false;
     _setup.sequence_number = 0; // Going back to line 0
   }
   strcpy(_setup.filename, filename);
   reset();
+  checkpoint_open(filename);
   return INTERP_OK;
 }
 
@@ -1464,7 +1478,20 @@ int Interp::_read(const char *command)  //!< may be NULL or a string to read
 
   if(_setup.file_pointer)
   {
-      EXECUTING_BLOCK(_setup).offset = ftell(_setup.file_pointer);
+      if (_setup.skipping_o && (command == NULL)) {
+	  int line;
+	  long offset;
+	  // go straight to the next line that can end the skip instead
+	  // of reading every line up to it
+	  if (ngc_find_label(_setup.file_pointer, _setup.skipping_o,
+			     &line, &offset) == 0) {
+	      _setup.sequence_number += line -
+		  ngc_line_of(_setup.file_pointer,
+			      ngc_tell(_setup.file_pointer));
+	      ngc_seek(_setup.file_pointer, offset);
+	  }
+      }
+      EXECUTING_BLOCK(_setup).offset = ngc_tell(_setup.file_pointer);
   }
 
   read_status =
@@ -1474,6 +1501,10 @@ int Interp::_read(const char *command)  //!< may be NULL or a string to read
   if (read_status == INTERP_ERROR && _setup.skipping_to_sub) {
     _setup.skipping_to_sub = NULL;
   }
+  if ((command == NULL) && (_setup.call_level == 0) &&
+      (_setup.sequence_number > _setup.checkpoint.reached)) {
+    _setup.checkpoint.reached = _setup.sequence_number;
+  }
 
   if(command)logDebug("%s:[cmd]:|%s|", name, command);
   else logDebug("%s:|%s|", name, _setup.linetext);
@@ -1544,13 +1575,13 @@ int Interp::unwind_call(int status, const char *file, int line, const char *func
 	// needed to make sure this works in rs274 -n 0 (continue on error) mode
 	if (sub->filename && sub->filename[0]) {
 	    if(0 != strcmp(_setup.filename, sub->filename)) {
-		fclose(_setup.file_pointer);
-		_setup.file_pointer = fopen(sub->filename, "r");
+		ngc_close(_setup.file_pointer);
+		_setup.file_pointer = ngc_open(sub->filename);
 		logDebug("unwind_call: reopening '%s' at %ld",
 			 sub->filename, sub->position);
 		strcpy(_setup.filename, sub->filename);
 	    }
-	    fseek(_setup.file_pointer, sub->position, SEEK_SET);
+	    ngc_seek(_setup.file_pointer, sub->position);
 	}
 	_setup.sequence_number = sub->sequence_number;
 	logDebug("unwind_call: setting sequence number=%d from frame %d",
@@ -239,6 +239,9 @@ If the do_next argument is 2, an error stops interpretation.
 
 */
 
+static int start_line = 0;     /* -r: run from this line, as task does */
+static FILE *start_outfile = NULL; /* output from start_line on */
+
 int interpret_from_file( /* ARGUMENTS                  */
  int do_next,            /* what to do if error        */
  int block_delete,       /* switch which is ON or OFF  */
@@ -281,6 +284,12 @@ int interpret_from_file( /* ARGUMENTS                  */
           else /* if do_next == 0 -- 0 means continue */
             continue;
         }
+      if (start_outfile && (sequence_number() >= start_line))
+        {
+          fclose(_outfile);
+          _outfile = start_outfile;
+          start_outfile = NULL;
+        }
       status = interp_execute();
       if ((status != INTERP_OK) &&
           (status != INTERP_EXIT) &&
@@ -557,7 +566,7 @@ int main (int argc, char ** argv)
   go_flag = 0;
 
   while(1) {
-      int c = getopt(argc, argv, "p:t:v:bsn:gi:l:T");
+      int c = getopt(argc, argv, "p:t:v:bsn:gi:l:Tr:");
       if(c == -1) break;
 
       switch(c) {
@@ -571,6 +580,7 @@ int main (int argc, char ** argv)
           case 'g': go_flag = !go_flag; break;
           case 'i': inifile = optarg; break;
           case 'T': _task = 1; break;
+          case 'r': start_line = atoi(optarg); break;
           case '?': default: goto usage;
       }
   }
@@ -580,7 +590,7 @@ int main (int argc, char ** argv)
 usage:
       fprintf(stderr,
             "Usage: %s [-p interp.so] [-t tool.tbl] [-v var-file.var] [-n 0|1|2]\n"
-            "          [-b] [-s] [-g] [input file [output file]]\n"
+            "          [-b] [-s] [-g] [-r line] [input file [output file]]\n"
             "\n"
             "    -p: Specify the pluggable interpreter to use\n"
             "    -t: Specify the .tbl (tool table) file to use\n"
@@ -595,6 +605,8 @@ usage:
             "    -i: specify the .ini file (default: no ini file)\n"
             "    -T: call task_init()\n"
             "    -l: specify the log_level (default: -1)\n"
+            "    -r: run from the given line; the lines before it are read\n"
+            "        from the nearest checkpoint, if any, with no output\n"
             , argv[0]);
       exit(1);
     }
@@ -656,6 +668,16 @@ usage:
           exit(1);
         }
     }
+  if (start_line > 1)
+    {
+      start_outfile = _outfile;
+      _outfile = fopen("/dev/null", "w");
+      if (_outfile == NULL)
+        {
+          fprintf(stderr, "could not open /dev/null\n");
+          exit(1);
+        }
+    }
   if (inifile!= 0) {
       setenv("INI_FILE_NAME",inifile,1);
   } else
@@ -681,6 +703,12 @@ usage:
           report_error(status, print_stack);
           exit(1);
         }
+      if ((start_line > 1) &&
+          ((status = interp_new.restore(start_line)) != INTERP_OK))
+        {
+          report_error(status, print_stack);
+          exit(1);
+        }
       status = interpret_from_file(do_next, block_delete, print_stack);
       file_name(buffer, 5);  /* called to exercise the function */
       file_name(buffer, 79); /* called to exercise the function */
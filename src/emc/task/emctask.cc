@@ -492,8 +492,15 @@ int emcTaskPlanSetBlockDelete(bool state)
 
 int emcTaskPlanSynch()
 {
+    // the interpreter takes its position from motion, which must have
+    // every queued move by then
+    int queued = emcTrajCheckQueued(1);
     int retval = interp.synch();
 
+    if (queued != 0 && retval == INTERP_OK) {
+	retval = INTERP_ERROR;
+    }
+
     if (emc_debug & EMC_DEBUG_INTERP) {
         rcs_print("emcTaskPlanSynch() returned %d\n", retval);
     }
@@ -615,6 +622,20 @@ int emcTaskPlanReset()
     return retval;
 }
 
+int emcTaskPlanRestore(int line)
+{
+    int retval = interp.restore(line);
+    if (retval > INTERP_MIN_ERROR) {
+	print_interp_error(retval);
+    }
+
+    if (emc_debug & EMC_DEBUG_INTERP) {
+        rcs_print("emcTaskPlanRestore(%d) returned %d\n", line, retval);
+    }
+
+    return retval;
+}
+
 int emcTaskPlanLine()
 {
     int retval = interp.line();
@@ -56,6 +56,7 @@
 #include <unistd.h>		// fork()
 #include <sys/wait.h>		// waitpid(), WNOHANG, WIFEXITED
 #include <ctype.h>		// isspace()
+#include <pthread.h>		// pthread_create()
 #include <libintl.h>
 #include <locale.h>
 
@@ -115,6 +116,40 @@ static int emcTaskNoDelay = 0;
 // space, annd reset otherwise.
 static int emcTaskEager = 0;
 
+// flag signifying that ini file [TASK] EVENT_DRIVEN is set: instead of
+// sleeping a full cycle, task blocks on the command channel and wakes up
+// as soon as a command arrives or motion or io changed state, looking at
+// them every [TASK] EVENT_POLL seconds. CYCLE_TIME is then the longest
+// task sleeps, so status still goes out at least that often.
+static int emcTaskEventDriven = 0;
+static double emcTaskEventPoll = 0.0005;
+// set when the wait consumed a new command with a blocking read
+static int emcTaskCommandArrived = 0;
+// cleared when emcCommand has no BSEM= semaphore to block on
+static int emcTaskCommandBlocking = 1;
+
+// flag signifying that ini file [TASK] INTERP_THREAD is set: read-ahead
+// runs on its own thread instead of within the task cycle. interp_mutex
+// is held by task for its whole cycle and by the interpreter thread for
+// one line at a time, so the interpreter, interp_list and emcStatus are
+// never touched by both at once. interp_list is the bounded queue
+// between them: the thread stops reading while it holds more than
+// [TASK] INTERP_MAX_LEN messages and task kicks it again every cycle.
+// Task sets interp_task_waiting before it locks interp_mutex; the thread
+// then hands the mutex over after its current line and waits on
+// interp_turn_cond until task finished a cycle (interp_task_cycles),
+// so it cannot take the mutex straight back, and reads at least one
+// line before it gives way again.
+static int emcTaskInterpThread = 0;
+static pthread_t interp_thread;
+static pthread_mutex_t interp_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t interp_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t interp_turn_cond = PTHREAD_COND_INITIALIZER;
+static volatile int interp_task_waiting = 0;
+static unsigned int interp_task_cycles = 0;
+static int interp_thread_kicked = 0;
+static int interp_thread_exit = 0;
+
 static int no_force_homing = 0; // forces the user to home first before allowing MDI and Program run
 //can be overriden by [TRAJ]NO_FORCE_HOMING=1
 
@@ -417,6 +452,7 @@ static EMC_TASK_PLAN_SYNCH taskPlanSynchCmd;
 
 static int interpResumeState = EMC_TASK_INTERP_IDLE;
 static int programStartLine = 0;	// which line to run program from
+static int programRestore = 0;	// try a checkpoint before the first read
 // how long the interp list can be
 
 int stepping = 0;
@@ -520,7 +556,7 @@ static int checkInterpList(NML_INTERP_LIST * il, EMC_STAT * stat)
 }
 extern int emcTaskMopup();
 
-void readahead_reading(void)
+void readahead_reading(int extra_lines)
 {
     int readRetval;
     int execRetval;
@@ -537,6 +573,19 @@ interpret_again:
 			    emcTaskPlanClearWait();
 			 }
 		    } else {
+			if (programRestore) {
+			    // jump to the interpreter's checkpoint nearest
+			    // before the start line; what it issues to bring
+			    // canon up to date is checked and dropped like
+			    // the lines it stands in for
+			    programRestore = 0;
+			    if (programStartLine > 1 &&
+				emcStatus->task.readLine == 0) {
+				emcTaskPlanRestore(programStartLine);
+				checkInterpList(&interp_list, emcStatus);
+				interp_list.clear();
+			    }
+			}
 			readRetval = emcTaskPlanRead();
 			/*! \todo MGS FIXME
 			   This if() actually evaluates to if (readRetval != INTERP_OK)...
@@ -638,7 +687,7 @@ interpret_again:
                                 }
 			    }
 
-                            if (count++ < emc_task_interp_max_len
+                            if (count++ < extra_lines
                                     && emcStatus->task.interpState == EMC_TASK_INTERP_READING
                                     && interp_list.len() <= emc_task_interp_max_len * 2/3) {
                                 goto interpret_again;
@@ -713,6 +762,47 @@ static void mdi_execute_hook(void)
     interp_list.append(msg);
 }
 
+/*
+  interpThreadMain() is the [TASK] INTERP_THREAD read-ahead loop. It reads
+  one line per turn while task keeps the interpreter in READING and
+  interp_list has room, and goes to sleep until the next kick from task
+  once a turn made no progress.
+ */
+static void *interpThreadMain(void *arg)
+{
+    int len, line, state;
+
+    pthread_mutex_lock(&interp_mutex);
+    while (!interp_thread_exit) {
+	if (!interp_thread_kicked ||
+	    emcStatus->task.mode != EMC_TASK_MODE_AUTO ||
+	    emcStatus->task.interpState != EMC_TASK_INTERP_READING) {
+	    interp_thread_kicked = 0;
+	    pthread_cond_wait(&interp_cond, &interp_mutex);
+	    continue;
+	}
+	len = interp_list.len();
+	line = emcStatus->task.readLine;
+	state = emcStatus->task.interpState;
+	readahead_reading(0);	// one line per turn
+	if (interp_list.len() == len &&
+	    emcStatus->task.readLine == line &&
+	    emcStatus->task.interpState == state) {
+	    // queue full or waiting for motion, nothing to do until task ran
+	    interp_thread_kicked = 0;
+	}
+	// let task in between lines
+	if (interp_task_waiting) {
+	    unsigned int cycle = interp_task_cycles;
+	    while (cycle == interp_task_cycles && !interp_thread_exit) {
+		pthread_cond_wait(&interp_turn_cond, &interp_mutex);
+	    }
+	}
+    }
+    pthread_mutex_unlock(&interp_mutex);
+    return 0;
+}
+
 void readahead_waiting(void)
 {
 	// now handle call logic
@@ -1140,7 +1230,12 @@ static int emcTaskPlan(void)
 		}		// switch (type) in ON, AUTO, READING
 
                // handle interp readahead logic
-                readahead_reading();
+                if (emcTaskInterpThread) {
+                    interp_thread_kicked = 1;
+                    pthread_cond_signal(&interp_cond);
+                } else {
+                    readahead_reading(emc_task_interp_max_len);
+                }
                 
 		break;		// EMC_TASK_INTERP_READING
 
@@ -2272,6 +2367,7 @@ static int emcTaskIssueCommand(NMLmsg * cmd)
 	}
 	run_msg = (EMC_TASK_PLAN_RUN *) cmd;
 	programStartLine = run_msg->line;
+	programRestore = 1;
 	emcStatus->task.interpState = EMC_TASK_INTERP_READING;
 	emcStatus->task.task_paused = 0;
 	retval = 0;
@@ -3183,6 +3279,14 @@ static int iniLoad(const char *filename)
 	}
     }
 
+    if (NULL != (inistring = inifile.Find("INTERP_THREAD", "TASK"))) {
+	if (1 != sscanf(inistring, "%d", &emcTaskInterpThread)) {
+	    emcTaskInterpThread = 0;
+	    rcs_print("invalid [TASK] INTERP_THREAD in %s (%s); not used\n",
+		      filename, inistring);
+	}
+    }
+
     if (NULL != (inistring = inifile.Find("RS274NGC_STARTUP_CODE", "RS274NGC"))) {
 	// copy to global
 	strcpy(rs274ngc_startup_code, inistring);
@@ -3221,6 +3325,23 @@ static int iniLoad(const char *filename)
 		  filename, emc_task_cycle_time);
     }
 
+    if (NULL != (inistring = inifile.Find("EVENT_DRIVEN", "TASK"))) {
+	if (1 != sscanf(inistring, "%d", &emcTaskEventDriven)) {
+	    emcTaskEventDriven = 0;
+	    rcs_print("invalid [TASK] EVENT_DRIVEN in %s (%s); not used\n",
+		      filename, inistring);
+	}
+    }
+
+    if (NULL != (inistring = inifile.Find("EVENT_POLL", "TASK"))) {
+	if (1 != sscanf(inistring, "%lf", &emcTaskEventPoll) ||
+	    emcTaskEventPoll <= 0.0) {
+	    emcTaskEventPoll = 0.0005;
+	    rcs_print("invalid [TASK] EVENT_POLL in %s (%s); using default %f\n",
+		      filename, inistring, emcTaskEventPoll);
+	}
+    }
+
 
     if (NULL != (inistring = inifile.Find("NO_FORCE_HOMING", "TRAJ"))) {
 	if (1 == sscanf(inistring, "%d", &no_force_homing)) {
@@ -3260,6 +3381,55 @@ static int iniLoad(const char *filename)
 /*
   syntax: a.out {-d -ini <inifile>} {-nml <nmlfile>} {-shm <key>}
   */
+/*
+  emcTaskWaitForEvent() is the [TASK] EVENT_DRIVEN replacement for
+  timer->wait(). It returns when a command arrived on emcCommand, when
+  emcMotionPoll() or emcIoPoll() report a change, or when the cycle time
+  is up, whichever comes first.
+ */
+static void emcTaskWaitForEvent()
+{
+    static double next = 0.0;
+    double now = etime();
+    double slice;
+    NMLTYPE type;
+
+    // early wakeups keep the deadline, only a timeout moves it on
+    if (next <= now) {
+	next += emc_task_cycle_time;
+	if (next <= now) {
+	    next = now + emc_task_cycle_time;
+	}
+    }
+
+    while ((now = etime()) < next) {
+	slice = next - now;
+	if (slice > emcTaskEventPoll) {
+	    slice = emcTaskEventPoll;
+	}
+	if (emcTaskCommandBlocking) {
+	    type = emcCommandBuffer->blocking_read(slice);
+	    if (type < 0) {
+		rcs_print("emcCommand can't block, add BSEM= to it in %s; "
+			  "polling every %f seconds\n", emc_nmlfile,
+			  emcTaskEventPoll);
+		emcTaskCommandBlocking = 0;
+		continue;
+	    }
+	} else {
+	    esleep(slice);
+	    type = emcCommandBuffer->peek();
+	}
+	if (type > 0) {
+	    emcTaskCommandArrived = 1;
+	    return;
+	}
+	if (emcMotionPoll() || emcIoPoll(&emcStatus->io)) {
+	    return;
+	}
+    }
+}
+
 int main(int argc, char *argv[])
 {
     int taskPlanError = 0;
@@ -3351,10 +3521,21 @@ int main(int argc, char *argv[])
     minTime = DBL_MAX;		// set to value that can never be exceeded
     maxTime = 0.0;		// set to value that can never be underset
 
+    if (emcTaskInterpThread) {
+	if (0 != pthread_create(&interp_thread, NULL, interpThreadMain, NULL)) {
+	    rcs_print("can't start interpreter thread, reading ahead in task\n");
+	    emcTaskInterpThread = 0;
+	}
+    }
+    interp_task_waiting = 1;
+    pthread_mutex_lock(&interp_mutex);
+    interp_task_waiting = 0;
+
     while (!done) {
 	// read command
-	if (0 != emcCommandBuffer->peek()) {
+	if (0 != emcCommandBuffer->peek() || emcTaskCommandArrived) {
 	    // got a new command, so clear out errors
+	    emcTaskCommandArrived = 0;
 	    taskPlanError = 0;
 	    taskExecuteError = 0;
 	}
@@ -3370,6 +3551,11 @@ int main(int argc, char *argv[])
 
 	emcIoUpdate(&emcStatus->io);
 	emcMotionUpdate(&emcStatus->motion);
+	// a move queued through the command ring fails after it was issued;
+	// on a full queue, wait for motion to take them all
+	if (0 != emcTrajCheckQueued(emcStatus->motion.traj.queueFull)) {
+	    emcStatus->task.execState = EMC_TASK_EXEC_ERROR;
+	}
 	// synchronize subordinate states
 	if (emcStatus->io.aux.estop) {
 	    if (emcStatus->motion.traj.enabled) {
@@ -3529,13 +3715,29 @@ int main(int argc, char *argv[])
 	    startTime = endTime;
 	}
 
+	// the interpreter thread reads ahead while task waits
+	interp_task_cycles++;
+	pthread_cond_signal(&interp_turn_cond);
+	pthread_mutex_unlock(&interp_mutex);
 	if ((emcTaskNoDelay) || (emcTaskEager)) {
 	    emcTaskEager = 0;
+	} else if (emcTaskEventDriven) {
+	    emcTaskWaitForEvent();
 	} else {
 	    timer->wait();
 	}
+	interp_task_waiting = 1;
+	pthread_mutex_lock(&interp_mutex);
+	interp_task_waiting = 0;
     }
     // end of while (! done)
+    interp_thread_exit = 1;
+    pthread_cond_signal(&interp_cond);
+    pthread_cond_signal(&interp_turn_cond);
+    pthread_mutex_unlock(&interp_mutex);
+    if (emcTaskInterpThread) {
+	pthread_join(interp_thread, NULL);
+    }
 
     // clean up everything
     emctask_shutdown();
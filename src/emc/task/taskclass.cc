@@ -689,6 +689,32 @@ int Task::emcToolSetNumber(int number)
 
 // Status functions
 
+// Returns non-zero if iocontrol posted a status that differs from stat,
+// the one emcIoUpdate() copied last. With the python io plugin the status
+// only changes from within task, so there is nothing to look for.
+int emcIoPoll(const EMC_IO_STAT * stat)
+{
+    int status;
+
+    if (!task_methods->use_iocontrol) {
+	return 0;
+    }
+    if (0 == emcIoStatusBuffer || !emcIoStatusBuffer->valid() ||
+	emcIoStatusBuffer->peek() < 0) {
+	return 0;
+    }
+    // same forcing as in Task::emcIoUpdate()
+    status = emcIoStatus->status;
+    if (emcIoStatus->echo_serial_number != emcIoCommandSerialNumber) {
+	status = RCS_EXEC;
+    }
+    return status != stat->status ||
+	emcIoStatus->echo_serial_number != stat->echo_serial_number ||
+	emcIoStatus->aux.estop != stat->aux.estop ||
+	emcIoStatus->tool.pocketPrepped != stat->tool.pocketPrepped ||
+	emcIoStatus->tool.toolInSpindle != stat->tool.toolInSpindle;
+}
+
 int Task::emcIoUpdate(EMC_IO_STAT * stat)
 {
     if (!use_iocontrol) {
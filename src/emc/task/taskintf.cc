@@ -22,6 +22,7 @@
 				// etc.
 #include "motion.h"		// emcmot_command_t,STATUS, etc.
 #include "motion_debug.h"
+#include "emcmotcfg.h"		// DEFAULT_TC_QUEUE_SIZE
 #include "emc.hh"
 #include "emccfg.h"		// DEFAULT_EMC_INIFILE
 #include "emcglb.h"		// emc_inifile
@@ -1317,9 +1318,15 @@ int emcTrajDisable()
 
 int emcTrajAbort()
 {
+    int retval;
+
     emcmotCommand.command = EMCMOT_ABORT;
 
-    return usrmotWriteEmcmotCommand(&emcmotCommand);
+    retval = usrmotWriteEmcmotCommand(&emcmotCommand);
+    // motion ran the queued moves before the abort; the ones it turned
+    // down meanwhile are not errors of the next program
+    usrmotCheckEmcmotCommands();
+    return retval;
 }
 
 int emcTrajPause()
@@ -1410,7 +1417,7 @@ int emcTrajNurbsMove(EmcPose end, int type,nurbs_block_t nurbs_block,double vel,
     emcmotCommand.ini_maxacc = ini_maxacc;
     emcmotCommand.ini_maxjerk = ini_maxjerk;
     memcpy(&emcmotCommand.nurbs_block,&nurbs_block,sizeof(nurbs_block_t));
-    return usrmotWriteEmcmotCommand(&emcmotCommand);
+    return usrmotQueueEmcmotCommand(&emcmotCommand);
 }
 
 int emcTrajLinearMove(EmcPose end, int type, double vel, double ini_maxvel, double acc, double jerk,
@@ -1431,7 +1438,7 @@ int emcTrajLinearMove(EmcPose end, int type, double vel, double ini_maxvel, doub
     emcmotCommand.acc = acc;
     emcmotCommand.ini_maxjerk = jerk;
     emcmotCommand.turn = indexrotary;
-    return usrmotWriteEmcmotCommand(&emcmotCommand);
+    return usrmotQueueEmcmotCommand(&emcmotCommand);
 }
 
 int emcTrajCircularMove(EmcPose end, PM_CARTESIAN center,
@@ -1465,7 +1472,22 @@ int emcTrajCircularMove(EmcPose end, PM_CARTESIAN center,
     emcmotCommand.ini_maxjerk = ini_maxjerk;
     emcmotCommand.acc = acc;
 
-    return usrmotWriteEmcmotCommand(&emcmotCommand);
+    return usrmotQueueEmcmotCommand(&emcmotCommand);
+}
+
+/* moves go through the command ring, so emcTrajLinearMove() and friends
+   only tell whether they were queued; this reports a move motion turned
+   down since the last call.  With wait, it first waits for motion to
+   take every queued move. */
+int emcTrajCheckQueued(int wait)
+{
+    int retval;
+
+    retval = wait ? usrmotFlushEmcmotCommands() : usrmotCheckEmcmotCommands();
+    if (retval == EMCMOT_COMM_ERROR_COMMAND) {
+	emcOperatorError(0, "motion rejected a queued move");
+    }
+    return retval == EMCMOT_COMM_OK ? 0 : -1;
 }
 
 int emcTrajClearProbeTrippedFlag()
@@ -1525,6 +1547,18 @@ static int last_id_printed = 0;
 static int last_status = 0;
 static double last_id_time;
 
+/* TC queue entries task leaves free beyond a full command ring */
+#define TRAJ_QUEUE_MARGIN 10
+
+/* motion only knows about the moves it took; leave room for a full
+   command ring in flight behind its status */
+static int trajQueueFull(int depth, int queueFull)
+{
+    return queueFull ||
+	depth + EMCMOT_COMMAND_RING_SIZE >=
+	DEFAULT_TC_QUEUE_SIZE - TRAJ_QUEUE_MARGIN;
+}
+
 int emcTrajUpdate(EMC_TRAJ_STAT * stat)
 {
     int joint, enables;
@@ -1558,9 +1592,11 @@ int emcTrajUpdate(EMC_TRAJ_STAT * stat)
     }
 
     stat->inpos = emcmotStatus.motionFlag & EMCMOT_MOTION_INPOS_BIT;
-    stat->queue = emcmotStatus.depth;
+    /* moves still in the command ring are part of the queue */
+    stat->queue = emcmotStatus.depth + usrmotCommandRingPending();
     stat->activeQueue = emcmotStatus.activeDepth;
-    stat->queueFull = emcmotStatus.queueFull;
+    stat->queueFull = trajQueueFull(emcmotStatus.depth,
+				    emcmotStatus.queueFull);
     stat->id = emcmotStatus.id;
     stat->motion_type = emcmotStatus.motionType;
     stat->distance_to_go = emcmotStatus.distance_to_go;
@@ -1915,6 +1951,28 @@ int emcSpindleConstant()
 
 
 
+/*
+  emcMotionPoll() looks at the small trajectory part of the motion status
+  and returns non-zero if something task may be waiting on changed since
+  the last emcMotionUpdate(): a command was acknowledged, queue space
+  came free, motion finished or the motion flags changed.
+ */
+int emcMotionPoll()
+{
+    emcmot_traj_status_t t;
+
+    if (0 != usrmotReadEmcmotTrajStatus(&t)) {
+	return 0;
+    }
+    return t.commandNumEcho != emcmotStatus.commandNumEcho ||
+	t.commandStatus != emcmotStatus.commandStatus ||
+	t.motionFlag != emcmotStatus.motionFlag ||
+	t.paused != emcmotStatus.paused ||
+	(t.depth == 0) != (emcmotStatus.depth == 0) ||
+	trajQueueFull(t.depth, t.queueFull) !=
+	trajQueueFull(emcmotStatus.depth, emcmotStatus.queueFull);
+}
+
 int emcMotionUpdate(EMC_MOTION_STAT * stat)
 {
     int r1, r2, r3;
@@ -40,6 +40,7 @@
 #include "vars_names.h"
 #endif
 #include "arithm_eval.h"
+#include "rtapi_atomic.h"
 
 
 char * Expr;
@@ -690,3 +691,616 @@ char * VerifySyntaxForMakeCalc(char * StringToVerify)
 	return VerifyErrorDesc;
 }
 
+
+
+/* ------------------------------------------------------------------ */
+/* Compiled form of the expressions, used by the refresh of the rungs */
+/* ------------------------------------------------------------------ */
+/* The text above is parsed again at each scan; instead the refresh   */
+/* compiles each expression once after it has been loaded or edited   */
+/* into a little stack machine code, with the variables resolved to   */
+/* their addresses where possible, and runs that.  Compiling uses the */
+/* same parsing as the evaluation, so both give the same results. An  */
+/* expression with a syntax error is not compiled and is still        */
+/* evaluated from the text, which displays the error as before.       */
+
+#define OP_END 0
+#define OP_TEXT 1	/* not compiled: evaluate the text */
+#define OP_CONST 2
+#define OP_BIT 3
+#define OP_WORD 4
+#define OP_FLOAT 5
+#define OP_VAR 6	/* ReadVar( Type, Offset ) */
+#define OP_VAR_INDEXED 7	/* next op reads the index */
+#define OP_NOT 8
+#define OP_POW 9
+#define OP_MUL 10
+#define OP_DIV 11
+#define OP_MOD 12
+#define OP_ADD 13
+#define OP_SUB 14
+#define OP_AND 15
+#define OP_XOR 16
+#define OP_OR 17
+#define OP_ABS 18
+#define OP_MINI 19	/* of the Value last ones */
+#define OP_MAXI 20
+#define OP_AVG 21
+#define OP_COMPARE 22	/* Value: 1 if '<' is true, 2 if '=', 4 if '>' */
+#define OP_STORE_WORD 23
+#define OP_STORE 24	/* WriteVar( Type, Offset ) */
+#define OP_STORE_INDEXED 25	/* next op reads the index */
+
+static StrArithmOp * CodeEnd;
+static StrArithmOp * CodeLimit;
+
+StrArithmOp * EmitOp(int Op)
+{
+	if ( CodeEnd>=CodeLimit )
+	{
+		ErrorDesc = "Expression too long to be compiled";
+		return CodeLimit;
+	}
+	CodeEnd->Op = Op;
+	return CodeEnd++;
+}
+
+/* the op reading variable Type/Offset */
+void EmitReadVar(int Type,int Offset)
+{
+	StrArithmOp * pOp = EmitOp( OP_VAR );
+	pOp->Type = Type;
+	pOp->Offset = Offset;
+	switch( Type )
+	{
+#ifndef MAT_CONNECTION
+		case VAR_MEM_BIT:
+			pOp->Op = OP_BIT;
+			pOp->u.PtrBit = &VarArray[Offset];
+			break;
+		case VAR_ERROR_BIT:
+			pOp->Op = OP_BIT;
+			pOp->u.PtrBit = &VarArray[NBR_STEPS+NBR_BITS+NBR_PHYS_INPUTS+NBR_PHYS_OUTPUTS+Offset];
+			break;
+#ifdef SEQUENTIAL_SUPPORT
+		case VAR_STEP_ACTIVITY:
+			pOp->Op = OP_BIT;
+			pOp->u.PtrBit = &VarArray[NBR_BITS+NBR_PHYS_INPUTS+NBR_PHYS_OUTPUTS+Offset];
+			break;
+#endif
+		case VAR_PHYS_INPUT:
+			pOp->Op = OP_BIT;
+			pOp->u.PtrBit = &VarArray[NBR_BITS+Offset];
+			break;
+		case VAR_PHYS_OUTPUT:
+			pOp->Op = OP_BIT;
+			pOp->u.PtrBit = &VarArray[NBR_BITS+NBR_PHYS_INPUTS+Offset];
+			break;
+#endif
+		case VAR_MEM_WORD:
+			pOp->Op = OP_WORD;
+			pOp->u.PtrWord = &VarWordArray[Offset];
+			break;
+#ifdef SEQUENTIAL_SUPPORT
+		case VAR_STEP_TIME:
+			pOp->Op = OP_WORD;
+			pOp->u.PtrWord = &VarWordArray[NBR_WORDS+Offset];
+			break;
+#endif
+		case VAR_PHYS_WORD_INPUT:
+			pOp->Op = OP_WORD;
+			pOp->u.PtrWord = &VarWordArray[NBR_WORDS+Offset];
+			break;
+		case VAR_PHYS_WORD_OUTPUT:
+			pOp->Op = OP_WORD;
+			pOp->u.PtrWord = &VarWordArray[NBR_WORDS+NBR_PHYS_WORDS_INPUTS+Offset];
+			break;
+		case VAR_PHYS_FLOAT_INPUT:
+			pOp->Op = OP_FLOAT;
+			pOp->u.PtrFloat = &VarFloatArray[Offset];
+			break;
+		case VAR_PHYS_FLOAT_OUTPUT:
+			pOp->Op = OP_FLOAT;
+			pOp->u.PtrFloat = &VarFloatArray[NBR_PHYS_FLOAT_INPUTS+Offset];
+			break;
+	}
+}
+
+/* compiles the var at Expr "@xx/yy@" or "@xx/yy[xx/yy]@" as Variable( ) */
+/* reads it, or as the destination of a calc if StoreIt */
+void CompileVariable(int StoreIt)
+{
+	int VarType,VarOffset,IndexType,IndexOffset;
+	StrArithmOp * pOp;
+	if (!IdentifyVarIndexedOrNot(Expr,&VarType,&VarOffset,&IndexType,&IndexOffset))
+	{
+		return;
+	}
+	/* flush var found */
+	Expr++;
+	do
+	{
+		Expr++;
+	}
+	while( (*Expr!='@') && (*Expr!='\0') );
+	if (*Expr=='\0')
+	{
+		ErrorDesc = "Bad var coding, should end with @";
+		return;
+	}
+	Expr++;
+	if ( IndexType!=-1 && IndexOffset!=-1 )
+	{
+		pOp = EmitOp( StoreIt?OP_STORE_INDEXED:OP_VAR_INDEXED );
+		pOp->Type = VarType;
+		pOp->Offset = VarOffset;
+		EmitReadVar( IndexType, IndexOffset );
+	}
+	else if ( StoreIt )
+	{
+		pOp = EmitOp( OP_STORE );
+		pOp->Type = VarType;
+		pOp->Offset = VarOffset;
+		if ( VarType==VAR_MEM_WORD )
+		{
+			pOp->Op = OP_STORE_WORD;
+			pOp->u.PtrWord = &VarWordArray[VarOffset];
+		}
+		else if ( VarType==VAR_PHYS_WORD_OUTPUT )
+		{
+			pOp->Op = OP_STORE_WORD;
+			pOp->u.PtrWord = &VarWordArray[NBR_WORDS+NBR_PHYS_WORDS_INPUTS+VarOffset];
+		}
+	}
+	else
+	{
+		EmitReadVar( VarType, VarOffset );
+	}
+}
+
+void CompileOr(void);
+
+void CompileFunction(void)
+{
+	char tcFonc[ 20 ], *pFonc;
+	int Op = OP_END;
+	int NbrVars = 0;
+
+	pFonc = tcFonc;
+	while((unsigned int)(pFonc-tcFonc)<sizeof(tcFonc)-1 && *Expr>='A' && *Expr<='Z')
+	{
+		*pFonc++ = *Expr;
+		Expr++;
+	}
+	*pFonc = '\0';
+
+	if ( !strcmp(tcFonc, "ABS") )
+	{
+		Expr++; /* ( */
+		CompileVariable( FALSE );
+		Expr++; /* ) */
+		EmitOp( OP_ABS );
+		return;
+	}
+	if ( !strcmp(tcFonc, "MINI") )
+		Op = OP_MINI;
+	if ( !strcmp(tcFonc, "MAXI") )
+		Op = OP_MAXI;
+	if ( !strcmp(tcFonc, "MOY") || !strcmp(tcFonc, "AVG") )
+		Op = OP_AVG;
+	if ( Op==OP_END )
+	{
+		ErrorDesc = "Unknown function";
+		return;
+	}
+	do
+	{
+		Expr++; /* ( -or- , */
+		CompileVariable( FALSE );
+		NbrVars++;
+	}
+	while( *Expr!=')' && ErrorDesc==NULL );
+	Expr++; /* ) */
+	EmitOp( Op )->u.Value = NbrVars;
+}
+
+void CompileTerm(void)
+{
+	if (*Expr=='(')
+	{
+		Expr++;
+		CompileOr();
+		if (*Expr!=')')
+		{
+			ErrorDesc = "Missing parenthesis";
+			return;
+		}
+		Expr++;
+	}
+	else if ( (*Expr>='0' && *Expr<='9') || (*Expr=='$') || (*Expr=='-') )
+	{
+		arithmtype Value = Constant();
+		EmitOp( OP_CONST )->u.Value = Value;
+	}
+	else if (*Expr>='A' && *Expr<='Z')
+		CompileFunction();
+	else if (*Expr=='@')
+		CompileVariable( FALSE );
+	else if (*Expr=='!')
+	{
+		Expr++;
+		CompileTerm();
+		EmitOp( OP_NOT );
+	}
+	else
+	{
+		ErrorDesc = "Unknown term";
+	}
+}
+
+void CompilePow(void)
+{
+	CompileTerm();
+	while(*Expr=='^')
+	{
+		if ( ErrorDesc )
+			break;
+		Expr++;
+		CompilePow();
+		EmitOp( OP_POW );
+	}
+}
+
+void CompileMulDivMod(void)
+{
+	CompilePow();
+	while( ErrorDesc==NULL && (*Expr=='*' || *Expr=='/' || *Expr=='%') )
+	{
+		char Oper = *Expr++;
+		CompilePow();
+		EmitOp( Oper=='*'?OP_MUL:(Oper=='/'?OP_DIV:OP_MOD) );
+	}
+}
+
+void CompileAddSub(void)
+{
+	CompileMulDivMod();
+	while( ErrorDesc==NULL && (*Expr=='+' || *Expr=='-') )
+	{
+		char Oper = *Expr++;
+		CompileMulDivMod();
+		EmitOp( Oper=='+'?OP_ADD:OP_SUB );
+	}
+}
+
+void CompileAnd(void)
+{
+	CompileAddSub();
+	while( ErrorDesc==NULL && *Expr=='&' )
+	{
+		Expr++;
+		CompileAddSub();
+		EmitOp( OP_AND );
+	}
+}
+
+void CompileXor(void)
+{
+	CompileAnd();
+	while( ErrorDesc==NULL && *Expr=='^' )
+	{
+		Expr++;
+		CompileAnd();
+		EmitOp( OP_XOR );
+	}
+}
+
+void CompileOr(void)
+{
+	CompileXor();
+	while( ErrorDesc==NULL && *Expr=='|' )
+	{
+		Expr++;
+		CompileXor();
+		EmitOp( OP_OR );
+	}
+}
+
+/* as EvalCompare( ) */
+void CompileCompare(char * CompareString)
+{
+	char StrCopy[ARITHM_EXPR_SIZE+1];
+	char * SearchSep = CompareString;
+	char * CutFirst = StrCopy;
+	char * SecondExpr = NULL;
+	int Found = FALSE;
+	int Mask = 0;
+
+	if (*CompareString=='\0' || *CompareString=='#')
+	{
+		EmitOp( OP_CONST )->u.Value = 0;
+		return;
+	}
+	strcpy(StrCopy,CompareString);
+	do
+	{
+		if ( (*SearchSep=='>') || (*SearchSep=='<') || (*SearchSep=='=') )
+		{
+			Found = TRUE;
+			*CutFirst = '\0';
+			CutFirst++;
+			SecondExpr = CutFirst;
+			if ( *CutFirst=='=' || *CutFirst=='>')
+			{
+				CutFirst++;
+				SecondExpr = CutFirst;
+			}
+		}
+		else
+		{
+			SearchSep++;
+			CutFirst++;
+		}
+	}
+	while (*SearchSep!='\0' && !Found);
+	if (!Found)
+	{
+		ErrorDesc = "Missing < or > or = or ... to make compare";
+		return;
+	}
+	Expr = StrCopy;
+	CompileOr();
+	if ( ErrorDesc )
+		return;
+	Expr = SecondExpr;
+	CompileOr();
+	if ( *SearchSep=='>' )
+		Mask |= 4;
+	if ( *SearchSep=='<' )
+		Mask |= *(SearchSep+1)=='>'?1|4:1;
+	if ( *SearchSep=='=' || *(SearchSep+1)=='=' )
+		Mask |= 2;
+	EmitOp( OP_COMPARE )->u.Value = Mask;
+}
+
+/* as MakeCalc( ) */
+void CompileCalc(char * CalcString)
+{
+	char StrCopy[ARITHM_EXPR_SIZE+1];
+	StrArithmOp * TargetStart;
+	StrArithmOp Target[ 2 ];
+	int NbrTargetOps;
+	int Found = FALSE;
+
+	if (*CalcString=='\0' || *CalcString=='#')
+		return;
+	strcpy(StrCopy,CalcString);
+	Expr = StrCopy;
+	/* the store ops are compiled first, and moved after the expression */
+	TargetStart = CodeEnd;
+	CompileVariable( TRUE );
+	if ( ErrorDesc )
+		return;
+	NbrTargetOps = CodeEnd-TargetStart;
+	memcpy( Target, TargetStart, NbrTargetOps*sizeof(StrArithmOp) );
+	CodeEnd = TargetStart;
+	do
+	{
+		char * Before = Expr;
+		if (*Expr==':')
+			Expr++;
+		if (*Expr=='=')
+		{
+			Found = TRUE;
+			Expr++;
+		}
+		if (*Expr==' ')
+			Expr++;
+		if ( Expr==Before )
+			break;
+	}
+	while( !Found && *Expr!='\0' );
+	while( *Expr==' ')
+		Expr++;
+	if (!Found)
+	{
+		ErrorDesc = "Missing := to make operate";
+		return;
+	}
+	CompileOr();
+	if ( CodeEnd+NbrTargetOps>CodeLimit )
+	{
+		ErrorDesc = "Expression too long to be compiled";
+		return;
+	}
+	memcpy( CodeEnd, Target, NbrTargetOps*sizeof(StrArithmOp) );
+	CodeEnd += NbrTargetOps;
+}
+
+/* compiles pArithm->Expr, a compare if IsCompare, else a calc */
+void CompileArithmExpr(StrArithmExpr * pArithm,int IsCompare)
+{
+	int Revision = pArithm->Revision;
+	int WasUnderVerify = UnderVerify;
+	char * WasVerifyErrorDesc = VerifyErrorDesc;
+	/* read Revision before Expr, see ArithmExprChanged( ) */
+	rtapi_smp_rmb();
+	/* errors are displayed when evaluating the text, not here */
+	UnderVerify = TRUE;
+	ErrorDesc = NULL;
+	CodeEnd = pArithm->Code;
+	CodeLimit = &pArithm->Code[ARITHM_EXPR_SIZE-1];
+	if ( IsCompare )
+		CompileCompare( pArithm->Expr );
+	else
+		CompileCalc( pArithm->Expr );
+	if ( ErrorDesc )
+		pArithm->Code[0].Op = OP_TEXT;
+	else
+		CodeEnd->Op = OP_END;
+	UnderVerify = WasUnderVerify;
+	VerifyErrorDesc = WasVerifyErrorDesc;
+	ErrorDesc = NULL;
+	pArithm->CodeRevision = Revision;
+}
+
+/* to call after having written ArithmExpr[NumExpr].Expr */
+void ArithmExprChanged(int NumExpr)
+{
+	rtapi_smp_wmb();
+	ArithmExpr[NumExpr].Revision++;
+}
+
+static inline arithmtype ReadIndex(StrArithmOp * pOp)
+{
+	switch( pOp->Op )
+	{
+		case OP_BIT:
+			return *pOp->u.PtrBit;
+		case OP_WORD:
+			return *pOp->u.PtrWord;
+		case OP_FLOAT:
+			return (arithmtype)*pOp->u.PtrFloat;
+	}
+	return ReadVar( pOp->Type, pOp->Offset );
+}
+
+/* runs the code, returns the value of the compare (0 for a calc) */
+arithmtype RunArithmCode(StrArithmOp * pOp)
+{
+	arithmtype Stack[ ARITHM_EXPR_SIZE ];
+	arithmtype * Top = Stack-1;
+	int Nbr;
+	for( ; ; pOp++ )
+	{
+		switch( pOp->Op )
+		{
+			case OP_END:
+				return Top>=Stack?*Top:0;
+			case OP_CONST:
+				*++Top = pOp->u.Value;
+				break;
+			case OP_BIT:
+				*++Top = *pOp->u.PtrBit;
+				break;
+			case OP_WORD:
+				*++Top = *pOp->u.PtrWord;
+				break;
+			case OP_FLOAT:
+				*++Top = (arithmtype)*pOp->u.PtrFloat;
+				break;
+			case OP_VAR:
+				*++Top = ReadVar( pOp->Type, pOp->Offset );
+				break;
+			case OP_VAR_INDEXED:
+				*++Top = ReadVar( pOp->Type, pOp->Offset+ReadIndex( pOp+1 ) );
+				pOp++;
+				break;
+			case OP_NOT:
+				*Top = *Top?0:1;
+				break;
+			case OP_POW:
+				Top--;
+				*Top = pow_int( *Top, Top[1] );
+				break;
+			case OP_MUL:
+				Top--;
+				*Top = *Top * Top[1];
+				break;
+			/* the text evaluation traps on a division by 0, this gives 0 */
+			case OP_DIV:
+				Top--;
+				*Top = Top[1]!=0?*Top / Top[1]:0;
+				break;
+			case OP_MOD:
+				Top--;
+				*Top = Top[1]!=0?*Top % Top[1]:0;
+				break;
+			case OP_ADD:
+				Top--;
+				*Top = *Top + Top[1];
+				break;
+			case OP_SUB:
+				Top--;
+				*Top = *Top - Top[1];
+				break;
+			case OP_AND:
+				Top--;
+				*Top = *Top & Top[1];
+				break;
+			case OP_XOR:
+				Top--;
+				*Top = *Top ^ Top[1];
+				break;
+			case OP_OR:
+				Top--;
+				*Top = *Top | Top[1];
+				break;
+			case OP_ABS:
+				if ( *Top<0 )
+					*Top = *Top * -1;
+				break;
+			case OP_MINI:
+				for( Nbr=1; Nbr<pOp->u.Value; Nbr++ )
+				{
+					Top--;
+					if ( Top[1]<*Top )
+						*Top = Top[1];
+				}
+				break;
+			case OP_MAXI:
+				for( Nbr=1; Nbr<pOp->u.Value; Nbr++ )
+				{
+					Top--;
+					if ( Top[1]>*Top )
+						*Top = Top[1];
+				}
+				break;
+			case OP_AVG:
+				for( Nbr=1; Nbr<pOp->u.Value; Nbr++ )
+				{
+					Top--;
+					*Top = *Top + Top[1];
+				}
+				*Top = *Top / pOp->u.Value;
+				break;
+			case OP_COMPARE:
+				Top--;
+				*Top = ( (pOp->u.Value&1) && *Top<Top[1] )
+					|| ( (pOp->u.Value&2) && *Top==Top[1] )
+					|| ( (pOp->u.Value&4) && *Top>Top[1] );
+				break;
+			case OP_STORE_WORD:
+				*pOp->u.PtrWord = *Top--;
+				break;
+			case OP_STORE:
+				WriteVar( pOp->Type, pOp->Offset, *Top-- );
+				break;
+			case OP_STORE_INDEXED:
+				WriteVar( pOp->Type, pOp->Offset+ReadIndex( pOp+1 ), *Top-- );
+				pOp++;
+				break;
+		}
+	}
+}
+
+/* EvalCompare( ) for the refresh */
+int EvalCompiledCompare(StrArithmExpr * pArithm)
+{
+	if ( pArithm->CodeRevision!=pArithm->Revision )
+		CompileArithmExpr( pArithm, TRUE );
+	if ( pArithm->Code[0].Op==OP_TEXT )
+		return EvalCompare( pArithm->Expr );
+	return RunArithmCode( pArithm->Code );
+}
+
+/* MakeCalc( ) for the refresh */
+void MakeCompiledCalc(StrArithmExpr * pArithm)
+{
+	if ( pArithm->CodeRevision!=pArithm->Revision )
+		CompileArithmExpr( pArithm, FALSE );
+	if ( pArithm->Code[0].Op==OP_TEXT )
+		MakeCalc( pArithm->Expr, FALSE /* verify mode */ );
+	else
+		RunArithmCode( pArithm->Code );
+}
@@ -9,5 +9,8 @@ arithmtype AddSub(void);
 arithmtype Or(void);
 char * VerifySyntaxForEvalCompare(char * StringToVerify);
 char * VerifySyntaxForMakeCalc(char * StringToVerify);
+void ArithmExprChanged(int NumExpr);
+int EvalCompiledCompare(StrArithmExpr * pArithm);
+void MakeCompiledCalc(StrArithmExpr * pArithm);
 
 
@@ -68,6 +68,7 @@ static int ShmemId;
 
 
 StrRung * RungArray;
+StrRungCode * RungCodeArray;
 TYPE_FOR_BOOL_VAR * VarArray;
 int * VarWordArray;
 double * VarFloatArray;
@@ -185,6 +186,7 @@ int ClassicLadder_AllocAll()
     numWords += NBR_STEPS;
 #endif
     bytes += pSizesInfos->nbr_rungs * sizeof(StrRung);
+    bytes += pSizesInfos->nbr_rungs * sizeof(StrRungCode);
     bytes += pSizesInfos->nbr_timers * sizeof(StrTimer);
     bytes += pSizesInfos->nbr_monostables * sizeof(StrMonostable);
     bytes += pSizesInfos->nbr_counters * sizeof(StrCounter);
@@ -290,6 +292,8 @@ int ClassicLadder_AllocAll()
 	   pByte += sizeof(StrInfosGene);
     RungArray = (StrRung *) pByte;
  	   pByte += pSizesInfos->nbr_rungs * sizeof(StrRung);
+    RungCodeArray = (StrRungCode *) pByte;
+ 	   pByte += pSizesInfos->nbr_rungs * sizeof(StrRungCode);
     TimerArray = (StrTimer *) pByte;	
    	   pByte += pSizesInfos->nbr_timers * sizeof(StrTimer);
     MonostableArray = (StrMonostable *) pByte;
@@ -23,9 +23,11 @@
 #ifdef MODULE
 #include <linux/module.h>
 #include <linux/string.h>
+#include <linux/stddef.h>
 #else
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 #endif
 #ifdef __RTL__
 #include <rtlinux_signal.h>
@@ -40,6 +42,7 @@
 #include "calc_sequential.h"
 #endif
 #include "calc.h"
+#include "rtapi_atomic.h"
 
 void InitRungs()
 {
@@ -64,6 +67,7 @@ void InitRungs()
 				RungArray[NumRung].Element[x][y].DynamicOutput = 0;
 			}
 		}
+		RungChanged( &RungArray[NumRung] );
 	}
 	// the rung used in the default section created per default
 	InfosGene->FirstRung = 0;
@@ -210,7 +214,10 @@ void InitArithmExpr()
 {
     int NumExpr;
     for (NumExpr=0; NumExpr<NBR_ARITHM_EXPR; NumExpr++)
+    {
         strcpy(ArithmExpr[NumExpr].Expr,"");
+        ArithmExprChanged(NumExpr);
+    }
 }
 void InitIOConf( )
 {
@@ -625,7 +632,7 @@ char CalcTypeCompar(int x,int y,StrRung * UpdateRung)
     char State;
     char StateElement;
 
-    StateElement = EvalCompare(ArithmExpr[UpdateRung->Element[x][y].VarNum].Expr);
+    StateElement = EvalCompiledCompare(&ArithmExpr[UpdateRung->Element[x][y].VarNum]);
     UpdateRung->Element[x][y].DynamicState = StateElement;
     if (x==2)
     {
@@ -646,103 +653,318 @@ char CalcTypeOutputOperate(int x,int y,StrRung * UpdateRung)
     char State;
     State = StateOnLeft(x-2,y,UpdateRung);
     if (State)
-        MakeCalc(ArithmExpr[UpdateRung->Element[x][y].VarNum].Expr,FALSE /* verify mode */);
+        MakeCompiledCalc(&ArithmExpr[UpdateRung->Element[x][y].VarNum]);
     UpdateRung->Element[x][y].DynamicInput = State;
     UpdateRung->Element[x][y].DynamicState = State;
     return State;
 }
 
 
-int RefreshRung(StrRung * Rung, int * JumpTo)
+/* Element : a block, or an output that does not only write a var */
+/* (the elements calculated from the grid, with StateOnLeft( ) ) */
+int RefreshBlock(int x,int y,StrRung * Rung)
 {
-	int x = 0, y = 0;
 	int JumpToRung = -1;
 	int SectionToCall = -1;
+	switch(Rung->Element[x][y].Type)
+	{
+#ifdef OLD_TIMERS_MONOS_SUPPORT
+		case ELE_TIMER:
+			CalcTypeTimer(x,y,Rung);
+			break;
+		case ELE_MONOSTABLE:
+			CalcTypeMonostable(x,y,Rung);
+			break;
+#endif
+		case ELE_COUNTER:
+			CalcTypeCounter(x,y,Rung);
+			break;
+		case ELE_TIMER_IEC:
+			CalcTypeTimerIEC(x,y,Rung);
+			break;
+		case ELE_COMPAR:
+			CalcTypeCompar(x,y,Rung);
+			break;
+		case ELE_OUTPUT_JUMP:
+			JumpToRung = CalcTypeOutputJump(x,y,Rung);
+			break;
+		case ELE_OUTPUT_CALL:
+			SectionToCall = CalcTypeOutputCall(x,y,Rung);
+			if ( SectionToCall!=-1 )
+			{
+				StrSection * pSubRoutineSection = &SectionArray[ SectionToCall ];
+				if ( pSubRoutineSection->Used && pSubRoutineSection->SubRoutineNumber>=0 )
+					RefreshASection( pSubRoutineSection ); //recursive call! ;-)
+				else
+					debug_printf("Refresh rungs aborted - call to a sub-routine undefined or programmed as main !!!");
+			}
+			break;
+		case ELE_OUTPUT_OPERATE:
+			CalcTypeOutputOperate(x,y,Rung);
+			break;
+	}
+	return JumpToRung;
+}
 
-	do
+/* Compiled form of the rungs: the elements in the order they are */
+/* refreshed (column per column, from the top), each knowing which */
+/* outputs of the column on its left it is connected to. The outputs */
+/* of a column are kept in the bits of a char during the refresh, so */
+/* the state on the left of an element is one 'and' instead of */
+/* following the connections in the grid at each scan. Blocks are */
+/* still calculated by their CalcType...( ) function. */
+#define RUNG_OP_NONE 0	/* not compiled */
+#define RUNG_OP_END 1
+#define RUNG_OP_CNX_TOP 2	/* free cell with a vertical connection, for the display */
+#define RUNG_OP_INPUT 3
+#define RUNG_OP_INPUT_NOT 4
+#define RUNG_OP_RISING_INPUT 5
+#define RUNG_OP_FALLING_INPUT 6
+#define RUNG_OP_CONNECTION 7
+#define RUNG_OP_OUTPUT 8
+#define RUNG_OP_OUTPUT_NOT 9
+#define RUNG_OP_OUTPUT_SET 10
+#define RUNG_OP_OUTPUT_RESET 11
+#define RUNG_OP_BLOCK 12	/* RefreshBlock( ) */
+
+/* index in VarArray[] of a boolean var, as ReadVar( ) and WriteVar( ) */
+int BitIndexOfVar(int TypeVar,int Offset)
+{
+#ifndef MAT_CONNECTION
+	switch(TypeVar)
 	{
-		do
+		case VAR_MEM_BIT:
+			return Offset;
+		case VAR_ERROR_BIT:
+			return NBR_STEPS+NBR_BITS+NBR_PHYS_INPUTS+NBR_PHYS_OUTPUTS+Offset;
+#ifdef SEQUENTIAL_SUPPORT
+		case VAR_STEP_ACTIVITY:
+			return NBR_BITS+NBR_PHYS_INPUTS+NBR_PHYS_OUTPUTS+Offset;
+#endif
+		case VAR_PHYS_INPUT:
+			return NBR_BITS+Offset;
+		case VAR_PHYS_OUTPUT:
+			return NBR_BITS+NBR_PHYS_INPUTS+Offset;
+	}
+#endif
+	return -1;
+}
+
+/* the rows of column x-1 that StateOnLeft(x,y) looks at */
+void CompileStateOnLeft(int x,int y,StrRung * TheRung,StrRungOp * pOp)
+{
+	int PosY;
+	if (x==0)
+	{
+		pOp->LeftCol = -1;
+		pOp->LeftMask = 0;
+		return;
+	}
+	pOp->LeftCol = x-1;
+	pOp->LeftMask = 1<<y;
+	PosY = y;
+	while( PosY>0 && TheRung->Element[x][PosY].ConnectedWithTop )
+	{
+		PosY--;
+		pOp->LeftMask |= 1<<PosY;
+	}
+	PosY = y+1;
+	while( PosY<RUNG_HEIGHT && TheRung->Element[x][PosY].ConnectedWithTop )
+	{
+		pOp->LeftMask |= 1<<PosY;
+		PosY++;
+	}
+}
+
+void CompileRung(StrRung * Rung,StrRungCode * Code)
+{
+	int x,y;
+	int Revision = Rung->Revision;
+	StrRungOp * pOp = Code->Op;
+	/* read Revision before the elements, see RungChanged( ) */
+	rtapi_smp_rmb();
+	for (x=0;x<RUNG_WIDTH;x++)
+	{
+		Code->InitOut[x] = 0;
+		for (y=0;y<RUNG_HEIGHT;y++)
 		{
-			switch(Rung->Element[x][y].Type)
+			StrElement * Element = &Rung->Element[x][y];
+			if ( Element->DynamicOutput )
+				Code->InitOut[x] |= 1<<y;
+			pOp->Op = RUNG_OP_NONE;
+			switch(Element->Type)
 			{
-				/* MLD,16/5/2001,V0.2.8 , fixed for drawing */
 				case ELE_FREE:
 				case ELE_UNUSABLE:
-					if (StateOnLeft(x,y,Rung))
-						Rung->Element[x][y].DynamicInput = 1;
-					else
-						Rung->Element[x][y].DynamicInput = 0;
+					if ( Element->ConnectedWithTop )
+						pOp->Op = RUNG_OP_CNX_TOP;
 					break;
-				/* End fix */
 				case ELE_INPUT:
-					CalcTypeInput(x,y,Rung,FALSE,FALSE);
+					pOp->Op = RUNG_OP_INPUT;
 					break;
 				case ELE_INPUT_NOT:
-					CalcTypeInput(x,y,Rung,TRUE,FALSE);
+					pOp->Op = RUNG_OP_INPUT_NOT;
 					break;
 				case ELE_RISING_INPUT:
-					CalcTypeInput(x,y,Rung,FALSE,TRUE);
+					pOp->Op = RUNG_OP_RISING_INPUT;
 					break;
 				case ELE_FALLING_INPUT:
-					CalcTypeInput(x,y,Rung,TRUE,TRUE);
+					pOp->Op = RUNG_OP_FALLING_INPUT;
 					break;
 				case ELE_CONNECTION:
-					CalcTypeConnection(x,y,Rung);
-					break;
-#ifdef OLD_TIMERS_MONOS_SUPPORT
-				case ELE_TIMER:
-					CalcTypeTimer(x,y,Rung);
-					break;
-				case ELE_MONOSTABLE:
-					CalcTypeMonostable(x,y,Rung);
-					break;
-#endif
-				case ELE_COUNTER:
-					CalcTypeCounter(x,y,Rung);
-					break;
-				case ELE_TIMER_IEC:
-					CalcTypeTimerIEC(x,y,Rung);
-					break;
-				case ELE_COMPAR:
-					CalcTypeCompar(x,y,Rung);
+					pOp->Op = RUNG_OP_CONNECTION;
 					break;
 				case ELE_OUTPUT:
-					CalcTypeOutput(x,y,Rung,FALSE);
+					pOp->Op = RUNG_OP_OUTPUT;
 					break;
 				case ELE_OUTPUT_NOT:
-					CalcTypeOutput(x,y,Rung,TRUE);
+					pOp->Op = RUNG_OP_OUTPUT_NOT;
 					break;
 				case ELE_OUTPUT_SET:
-					CalcTypeOutputSetReset(x,y,Rung,FALSE);
+					pOp->Op = RUNG_OP_OUTPUT_SET;
 					break;
 				case ELE_OUTPUT_RESET:
-					CalcTypeOutputSetReset(x,y,Rung,TRUE);
+					pOp->Op = RUNG_OP_OUTPUT_RESET;
 					break;
+#ifdef OLD_TIMERS_MONOS_SUPPORT
+				case ELE_TIMER:
+				case ELE_MONOSTABLE:
+#endif
+				case ELE_COUNTER:
+				case ELE_TIMER_IEC:
+				case ELE_COMPAR:
 				case ELE_OUTPUT_JUMP:
-					JumpToRung = CalcTypeOutputJump(x,y,Rung);
-					// we will now abort the refresh of the rung immediately...
-					break;
 				case ELE_OUTPUT_CALL:
-					SectionToCall = CalcTypeOutputCall(x,y,Rung);
-					if ( SectionToCall!=-1 )
-					{
-						StrSection * pSubRoutineSection = &SectionArray[ SectionToCall ];
-						if ( pSubRoutineSection->Used && pSubRoutineSection->SubRoutineNumber>=0 )
-							RefreshASection( pSubRoutineSection ); //recursive call! ;-)
-						else
-							debug_printf("Refresh rungs aborted - call to a sub-routine undefined or programmed as main !!!");
-					}
-					break;
 				case ELE_OUTPUT_OPERATE:
-					CalcTypeOutputOperate(x,y,Rung);
+					pOp->Op = RUNG_OP_BLOCK;
 					break;
 			}
-			y++;
-		}while( y<RUNG_HEIGHT && JumpToRung==-1 );
-		y = 0;
-		x++;
+			if ( pOp->Op!=RUNG_OP_NONE )
+			{
+				pOp->X = x;
+				pOp->Y = y;
+				pOp->BitIndex = BitIndexOfVar( Element->VarType, Element->VarNum );
+				CompileStateOnLeft( x, y, Rung, pOp );
+				pOp++;
+			}
+		}
+	}
+	pOp->Op = RUNG_OP_END;
+	Code->CodeRevision = Revision;
+}
+
+/* to call after having written the elements of a rung */
+void RungChanged(StrRung * Rung)
+{
+	rtapi_smp_wmb();
+	Rung->Revision++;
+}
+
+/* end of CalcTypeInput( ), for the compiled rung */
+static inline void RefreshContact(StrElement * Element,StrRungOp * pOp,char * Out,char StateElement,char StateOnLeft)
+{
+	char State = StateElement;
+	Element->DynamicState = StateElement;
+	if ( pOp->LeftCol>=0 )
+	{
+		Element->DynamicInput = StateOnLeft;
+		State = StateElement && StateOnLeft;
+	}
+	Element->DynamicOutput = State;
+	if ( State )
+		Out[(int)pOp->X] |= 1<<pOp->Y;
+	else
+		Out[(int)pOp->X] &= ~(1<<pOp->Y);
+}
+
+int RefreshRung(StrRung * Rung, int * JumpTo)
+{
+	StrRungCode * Code = &RungCodeArray[ Rung-RungArray ];
+	StrRungOp * pOp;
+	char Out[RUNG_WIDTH];
+	int JumpToRung = -1;
+
+	if ( Code->CodeRevision!=Rung->Revision || Code->Op[0].Op==RUNG_OP_NONE )
+		CompileRung( Rung, Code );
+	memcpy( Out, Code->InitOut, RUNG_WIDTH );
+
+	for ( pOp=Code->Op; pOp->Op!=RUNG_OP_END && JumpToRung==-1; pOp++ )
+	{
+		StrElement * Element = &Rung->Element[(int)pOp->X][(int)pOp->Y];
+		char StateOnLeft = pOp->LeftCol<0 || (Out[(int)pOp->LeftCol] & pOp->LeftMask);
+		char State;
+		char StateVar;
+		switch( pOp->Op )
+		{
+			case RUNG_OP_CNX_TOP:
+				Element->DynamicInput = StateOnLeft;
+				break;
+			/* as CalcTypeInput( ) */
+			case RUNG_OP_INPUT:
+				State = pOp->BitIndex>=0?VarArray[ pOp->BitIndex ]:ReadVar( Element->VarType, Element->VarNum );
+				Element->DynamicVarBak = State;
+				RefreshContact( Element, pOp, Out, State, StateOnLeft );
+				break;
+			case RUNG_OP_INPUT_NOT:
+				State = !( pOp->BitIndex>=0?VarArray[ pOp->BitIndex ]:ReadVar( Element->VarType, Element->VarNum ) );
+				Element->DynamicVarBak = State;
+				RefreshContact( Element, pOp, Out, State, StateOnLeft );
+				break;
+			case RUNG_OP_RISING_INPUT:
+			case RUNG_OP_FALLING_INPUT:
+				State = pOp->BitIndex>=0?VarArray[ pOp->BitIndex ]:ReadVar( Element->VarType, Element->VarNum );
+				if ( pOp->Op==RUNG_OP_FALLING_INPUT )
+					State = !State;
+				StateVar = State;
+				if ( State && Element->DynamicVarBak )
+					State = 0;
+				Element->DynamicVarBak = StateVar;
+				RefreshContact( Element, pOp, Out, State, StateOnLeft );
+				break;
+			/* as CalcTypeConnection( ) */
+			case RUNG_OP_CONNECTION:
+				if ( pOp->LeftCol>=0 )
+					Element->DynamicInput = StateOnLeft;
+				Element->DynamicState = StateOnLeft;
+				Element->DynamicOutput = StateOnLeft;
+				Out[(int)pOp->X] = ( Out[(int)pOp->X] & ~(1<<pOp->Y) ) | ( StateOnLeft<<pOp->Y );
+				break;
+			/* as CalcTypeOutput( ) and CalcTypeOutputSetReset( ) */
+			case RUNG_OP_OUTPUT:
+			case RUNG_OP_OUTPUT_NOT:
+			case RUNG_OP_OUTPUT_SET:
+			case RUNG_OP_OUTPUT_RESET:
+				Element->DynamicInput = StateOnLeft;
+				Element->DynamicState = StateOnLeft;
+				State = StateOnLeft;
+				if ( pOp->Op==RUNG_OP_OUTPUT_NOT )
+					State = !State;
+				else if ( pOp->Op==RUNG_OP_OUTPUT_SET || pOp->Op==RUNG_OP_OUTPUT_RESET )
+				{
+					if ( !State )
+						break;
+					State = pOp->Op==RUNG_OP_OUTPUT_SET;
+				}
+				if ( pOp->BitIndex>=0 )
+					VarArray[ pOp->BitIndex ] = State;
+				else
+					WriteVar( Element->VarType, Element->VarNum, State );
+				break;
+			case RUNG_OP_BLOCK:
+			{
+				int y;
+				JumpToRung = RefreshBlock( pOp->X, pOp->Y, Rung );
+				/* a block writes the outputs of its rows itself */
+				Out[(int)pOp->X] = 0;
+				for (y=0;y<RUNG_HEIGHT;y++)
+				{
+					if ( Rung->Element[(int)pOp->X][y].DynamicOutput )
+						Out[(int)pOp->X] |= 1<<y;
+				}
+				break;
+			}
+		}
 	}
-	while( x<RUNG_WIDTH && JumpToRung==-1 );
 
 	*JumpTo = JumpToRung;
 	return TRUE;
@@ -825,8 +1047,9 @@ void ClassicLadder_RefreshAllSections()
 // time measurement has been moved to module_hal.c for EMC
 }
 
+/* the Revision of RungDest is kept, the caller bumps it with RungChanged( ) */
 void CopyRungToRung(StrRung * RungSrc,StrRung * RungDest)
 {
-    memcpy(RungDest,RungSrc,sizeof(StrRung));
+    memcpy(RungDest,RungSrc,offsetof(StrRung,Revision));
 }
 
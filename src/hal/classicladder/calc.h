@@ -14,3 +14,4 @@ void InitIOConf( void );
 void RefreshASection( StrSection * pSection );
 void ClassicLadder_RefreshAllSections(void);
 void CopyRungToRung(StrRung * RungSrc,StrRung * RungDest);
+void RungChanged(StrRung * Rung);
@@ -223,8 +223,31 @@ typedef struct StrRung
 	char Label[LGT_LABEL];
 	char Comment[LGT_COMMENT];
 	StrElement Element[RUNG_WIDTH][RUNG_HEIGHT];
+	/* incremented each time Element[][] is written (see RungChanged( )), */
+	/* the refresh compiles the rung again when it differs from its code. */
+	/* Must stay last: CopyRungToRung( ) copies everything before it. */
+	int Revision;
 }StrRung;
 
+/* one element of a rung, in the compiled form of the rung (see calc.c) */
+typedef struct StrRungOp
+{
+	char Op;
+	char X;
+	char Y;
+	char LeftCol;	/* column whose outputs are on the left of the element, -1 if the left rail */
+	char LeftMask;	/* and its rows connected to the element */
+	int BitIndex;	/* of the variable in VarArray[], -1 if it must use ReadVar( )/WriteVar( ) */
+}StrRungOp;
+
+typedef struct StrRungCode
+{
+	int CodeRevision;
+	/* outputs of the elements that are not calculated, one bit per row */
+	char InitOut[RUNG_WIDTH];
+	StrRungOp Op[RUNG_WIDTH*RUNG_HEIGHT+1];
+}StrRungCode;
+
 #ifdef OLD_TIMERS_MONOS_SUPPORT
 typedef struct StrTimer
 {
@@ -279,9 +302,29 @@ typedef struct StrTimerIEC
 	int ValueToReachOneBaseUnit;
 }StrTimerIEC;
 
+/* one instruction of the compiled form of an expression (see arithm_eval.c) */
+typedef struct StrArithmOp
+{
+	short Op;
+	short Type;	/* variable read with ReadVar( ) or written with WriteVar( ) */
+	int Offset;
+	union
+	{
+		int Value;
+		int * PtrWord;
+		TYPE_FOR_BOOL_VAR * PtrBit;
+		double * PtrFloat;
+	}u;
+}StrArithmOp;
+
 typedef struct StrArithmExpr
 {
 	char Expr[ARITHM_EXPR_SIZE];
+	/* incremented each time Expr is written (see ArithmExprChanged( )), */
+	/* the refresh compiles Expr again when it differs from CodeRevision */
+	int Revision;
+	int CodeRevision;
+	StrArithmOp Code[ARITHM_EXPR_SIZE];
 }StrArithmExpr;
 
 #define DEVICE_TYPE_DIRECT_ACCESS 0	/* used inb( ) and outb( ) calls */
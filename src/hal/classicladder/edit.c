@@ -552,7 +552,13 @@ void ApplyNewArithmExpr()
 {
 	int NumExpr;
 	for (NumExpr=0; NumExpr<NBR_ARITHM_EXPR; NumExpr++)
-		strcpy(ArithmExpr[NumExpr].Expr,EditArithmExpr[NumExpr].Expr);
+	{
+		if ( strcmp(ArithmExpr[NumExpr].Expr,EditArithmExpr[NumExpr].Expr) )
+		{
+			strcpy(ArithmExpr[NumExpr].Expr,EditArithmExpr[NumExpr].Expr);
+			ArithmExprChanged(NumExpr);
+		}
+	}
 }
 void CheckForFreeingArithmExpr(int PosiX,int PosiY)
 {
@@ -824,6 +830,7 @@ void DeleteCurrentRung()
 				|| (RungArray[OldCurrent].Element[x][y].Type == ELE_OUTPUT_OPERATE) )
 				{
 					strcpy(ArithmExpr[ RungArray[OldCurrent].Element[x][y].VarNum ].Expr,"");
+					ArithmExprChanged( RungArray[OldCurrent].Element[x][y].VarNum );
 				}
 			}
 		}
@@ -847,6 +854,7 @@ void ApplyRungEdited()
 	int NextNew;
 	save_label_comment_edited();
 	CopyRungToRung(&EditDatas.Rung,&RungArray[EditDatas.NumRung]);
+	RungChanged(&RungArray[EditDatas.NumRung]);
 	ApplyNewArithmExpr();
 
 	/* if we have added or inserted, we will have to */
@@ -41,6 +41,7 @@
 #include "files_sequential.h"
 #include "files.h"
 #include "vars_access.h"
+#include "arithm_eval.h"
 #include "protocol_modbus_master.h"
 #include "emc_mods.h"
 
@@ -203,6 +204,7 @@ char LoadRung(char * FileName,StrRung * BufRung)
         }
         while(LineOk);
         fclose(File);
+        RungChanged(BufRung);
         Okay = TRUE;
     }
     return (Okay);
@@ -715,10 +717,12 @@ char LoadArithmeticExpr(char * FileName)
 					{
 						NumExpr = atoi(Line);
 						strcpy(ArithmExpr[NumExpr].Expr,Line+strlen("xxxx,"));
+						ArithmExprChanged(NumExpr);
 					}
 					else
 					{
 						strcpy(ArithmExpr[NumExpr].Expr,Line);
+						ArithmExprChanged(NumExpr);
 						NumExpr++;
 					}
 				}
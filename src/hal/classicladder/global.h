@@ -8,6 +8,7 @@
 #include "protocol_modbus_master.h"
 
 extern StrRung * RungArray;
+extern StrRungCode * RungCodeArray;
 extern TYPE_FOR_BOOL_VAR * VarArray;
 extern int * VarWordArray;
 extern double * VarFloatArray;
@@ -31,6 +31,7 @@
 #include "global.h"
 #include "edit.h"
 #include "manager.h"
+#include "calc.h"
 
 void InitSections( void )
 {
@@ -168,6 +169,7 @@ int AddSection( char * NewSectionName, int TypeLanguageSection, int SubRoutineNb
 				pSection->FirstRung = NumFreeRung;
 				pSection->LastRung = NumFreeRung;
 				InitBufferRungEdited( &RungArray[ NumFreeRung ] );
+				RungChanged( &RungArray[ NumFreeRung ] );
 			}
 			else
 			{
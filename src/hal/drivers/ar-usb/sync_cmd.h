@@ -26,6 +26,17 @@
  *    SYNC_DATA          4'b1100  ... TODO:       {VAL} Send immediate data
  *                                                VAL[7:0]: one byte data
  *    SYNC_EOF           4'b1101                  End of frame                                            
+ *    SYNC_PJNT          4'b1110  {CODE}          Packed joint commands of one servo period, ends it like SYNC_EOF
+ *                                                CODE[2j+1:2j]: how the 16.16 delta of joint j is sent
+ *                                                  ZERO(00): no motion, no data word
+ *                                                  SAME(01): the delta of the previous SYNC_PJNT, no data word
+ *                                                  DIFF(10): 1 data word, signed 16-bit change to the previous delta
+ *                                                  FULL(11): 2 data words, signed 32-bit delta, low word first
+ *                                                the word holds the CODEs of J5..J0; with NUM_JOINTS > 6
+ *                                                the next word holds those of J7..J6 in [3:0]
+ *                                                then the data words, in joint order
+ *                                                The previous delta of each joint is 0 after JCMD reset,
+ *                                                and is set by every SYNC_PJNT (ZERO included).
  *    Write 2nd byte of SYNC_CMD[] will push it into SFIFO.
  *    The WB_WRITE got stalled if SFIFO is full.
  */
@@ -45,7 +56,7 @@
 #define SYNC_MACH_PARAM     0xB000
 #define SYNC_DATA           0xC000
 #define SYNC_EOF            0xD000
-// RESERVED  0xe000
+#define SYNC_PJNT           0xE000
 // RESERVED  0xf000
 
 //  timeout type
@@ -74,6 +85,13 @@
 #define SYNC_MOT_PARAM_ID_MASK          0x000F
 #define SYNC_MACH_PARAM_ADDR_MASK       0x0FFF
 #define SYNC_USB_CMD_TYPE_MASK 		0x0FFF
+// SYNC_PJNT codes
+#define PJNT_ZERO                       0x0
+#define PJNT_SAME                       0x1
+#define PJNT_DIFF                       0x2
+#define PJNT_FULL                       0x3
+#define PJNT_HEAD_JOINTS                6       // CODEs in the SYNC_PJNT word
+#define SYNC_PJNT_CODE_MASK             0x0FFF
 // SYNC VEL CMD masks
 #define VEL_MASK                        0x0FFE
 #define VEL_SYNC_MASK                   0x0001
@@ -88,6 +106,7 @@
 #define GET_MOT_PARAM_ID(t)             (((t) & SYNC_MOT_PARAM_ID_MASK))
 #define GET_MACH_PARAM_ADDR(t)          ((t) & SYNC_MACH_PARAM_ADDR_MASK)
 #define GET_USB_CMD_TYPE(t)             ((t) & SYNC_USB_CMD_TYPE_MASK)
+#define GET_PJNT_CODE(c, j)             (((c) >> (2 * (j))) & 0x3)
 
 #define PACK_SYNC_DATA(t)               ((t & 0xFF))
 #define PACK_IO_ID(i)                   (((i) & 0x3F) << 6)
@@ -97,6 +116,7 @@
 #define PACK_MOT_PARAM_ADDR(t)          ((t) << 4)
 #define PACK_MACH_PARAM_ADDR(t)         ((t) & SYNC_MACH_PARAM_ADDR_MASK)
 #define PACK_USB_CMD_TYPE(t)            ((t) & SYNC_USB_CMD_TYPE_MASK)
+#define PACK_PJNT_CODE(c, j)            ((c) << (2 * (j)))
 
 #define RISC_CMD_TYPE                   0x0004  // for SYNC_USB_CMD
 
@@ -0,0 +1,299 @@
+/********************************************************************
+ * Description:  wou_bench.c
+ *               Drives the loopback WOU FPGA emulator of wou_loop.c
+ *               the way wou_stepgen does, with the encoding, prebuffer
+ *               and mail decoding of wou_codec.c that wou_stepgen
+ *               uses, and reports the payload efficiency of the WOU
+ *               frames, the GO-BACK-N retransmits and the host time
+ *               per servo period.
+ *
+ * License: GPL Version 2
+ *
+ * Copyright (c) 2014 All rights reserved.
+ *
+ * Last change:
+ ********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include <wou.h>
+#include <wb_regs.h>
+#include <mailtag.h>
+#include "sync_cmd.h"
+#include "wou_codec.h"
+#include "wou_loop.h"
+
+#define MAX_CHAN WOU_MAX_CHAN
+#define FRACTION_BITS 16
+#define MAX_PERIODS 1000000
+#define NUM_MOT_PARAMS 20   // 6 motion and 14 PID parameters a joint
+#define DOUT_PERIODS 1000   // GPIO out 0 toggles this often
+
+static wou_param_t w_param;
+static int num_joints = 4;
+static int pack_jnt;
+static int32_t pack_prev[MAX_CHAN];
+static wou_sfifo_t sfifo;
+
+/* what wou_stepgen decodes of the mails, with the same code */
+static wou_mbox_t mbox;
+static wou_mail_t mail;
+static wou_mbox_vals_t mbox_vals;
+static uint32_t bp_tick;
+static int mails;
+static double mail_ns;
+
+static double nsnow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int cmp(const void *a, const void *b)
+{
+    double d = *(const double *) a - *(const double *) b;
+    return d < 0 ? -1 : d > 0;
+}
+
+/* the mailbox callback, as fetchmail() of wou_stepgen */
+static void fetchmail(const uint8_t *buf_head)
+{
+    double t0 = nsnow();
+
+    wou_mail_fast(buf_head, num_joints, &mail);
+    bp_tick = mail.bp_tick;
+    wou_mbox_put(&mbox, buf_head);
+    mails++;
+    mail_ns += nsnow() - t0;
+}
+
+/*
+ * the motor parameters rtapi_app_main() sends through write_mot_param():
+ * one value a wait, or all values held in sfifo, as between
+ * param_batch_begin() and param_batch_end()
+ */
+static void upload_params(int batched, double *link_us, uint64_t *spins)
+{
+    wou_loop_stats_t s0, s1;
+    int i, j;
+
+    wou_loop_stats(&s0);
+    sfifo.hold = batched;
+    for (j = 0; j < num_joints; j++) {
+        for (i = 0; i < NUM_MOT_PARAMS; i++) {
+            wou_sfifo_value(&sfifo, SYNC_MOT_PARAM | PACK_MOT_PARAM_ADDR(i)
+                            | PACK_MOT_PARAM_ID(j), 1000 * j + i);
+            wou_sfifo_wait(&sfifo);
+        }
+    }
+    while (wou_sfifo_drain(&sfifo) == -1);
+    sfifo.hold = 0;
+    // until the RISC has them all
+    while (!wou_loop_idle()) {
+        wou_flush(&w_param);
+        wou_update(&w_param);
+    }
+    wou_loop_stats(&s1);
+    *link_us = (s1.link_ns - s0.link_ns) / 1000.0;
+    *spins = s1.window_full - s0.window_full;
+}
+
+/*
+ * one servo period of commands, as update_freq() queues them: GPIO out
+ * 0 toggling now and then, and a smooth move of each joint, with joint
+ * 0 stopping every other 1500 periods
+ */
+static void send_period(int period, int64_t *rawcount)
+{
+    uint16_t data[2 * MAX_CHAN + 2], sync_cmd;
+    int32_t integer_pos_cmd, delta[MAX_CHAN];
+    int n;
+
+    if (period % DOUT_PERIODS == 0) {
+        sync_cmd = SYNC_DOUT | PACK_IO_ID(0)
+                   | PACK_DO_VAL((period / DOUT_PERIODS) & 1);
+        wou_sfifo_put(&sfifo, &sync_cmd, 1);
+    }
+    for (n = 0; n < num_joints; n++) {
+        integer_pos_cmd = (int32_t) (sin(period * 0.003 + n) *
+                                     (1000.0 + 500.0 * n) * 65536.0);
+        if (n == 0 && (period / 1500) % 2) {
+            integer_pos_cmd = 0;
+        }
+        delta[n] = integer_pos_cmd;
+        wou_jnt_words(integer_pos_cmd, data + 2 * n);
+        rawcount[n] += integer_pos_cmd;
+    }
+    if (pack_jnt) {
+        n = wou_pack_joints(num_joints, pack_prev, delta, data);
+        wou_sfifo_put(&sfifo, data, n);
+    } else {
+        data[2 * num_joints] = SYNC_EOF;
+        wou_sfifo_put(&sfifo, data, 2 * num_joints + 1);
+    }
+    if (sfifo.hold) {
+        // one more period queued; send it now if the link takes it
+        sfifo.periods += 1;
+        wou_sfifo_drain(&sfifo);
+    }
+}
+
+static double percent(uint64_t part, uint64_t whole)
+{
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+static void usage(void)
+{
+    printf("usage: wou_bench [-n periods] [-j joints] [-l latency_us] "
+           "[-w window] [-t timeout_us]\n"
+           "                 [-L loss_ppm] [-c crc_ppm] [-m mail_ticks] "
+           "[-s seed] [-p]\n"
+           "                 [-b prebuf] [-a decode_periods]\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    wou_loop_config_t cfg;
+    wou_loop_stats_t s0, s1, sb;
+    static double times[MAX_PERIODS];
+    int64_t rawcount[MAX_CHAN];
+    int periods = 20000, busy = 0, fail = 0, i, c;
+    int prebuf = 0, decode_periods = 0, decoded = 0;
+    uint32_t idle_tick, dout0;
+    double t0, sum = 0, one_us, batch_us;
+    uint64_t one_spins, batch_spins;
+
+    wou_loop_defaults(&cfg);
+    while ((c = getopt(argc, argv, "n:j:l:w:t:L:c:m:s:pb:a:")) != -1) {
+        switch (c) {
+        case 'n': periods = atoi(optarg); break;
+        case 'j': num_joints = atoi(optarg); break;
+        case 'l': cfg.latency_ns = atol(optarg) * 1000; break;
+        case 'w': cfg.window = atoi(optarg); break;
+        case 't': cfg.timeout_ns = atol(optarg) * 1000; break;
+        case 'L': cfg.loss_ppm = atoi(optarg); break;
+        case 'c': cfg.crc_ppm = atoi(optarg); break;
+        case 'm': cfg.mail_ticks = atoi(optarg); break;
+        case 's': cfg.seed = strtoul(optarg, NULL, 0); break;
+        case 'p': pack_jnt = 1; break;
+        case 'b': prebuf = atoi(optarg); break;
+        case 'a': decode_periods = atoi(optarg); break;
+        default: usage();
+        }
+    }
+    if (periods < 1 || periods > MAX_PERIODS
+        || num_joints < 1 || num_joints > MAX_CHAN
+        || prebuf < 0 || prebuf > WOU_PREBUF_MAX || decode_periods < 0) {
+        usage();
+    }
+    wou_loop_config(&cfg);
+
+    wou_init(&w_param, "wou_bench", 0, "");
+    wou_connect(&w_param);
+    sfifo.w_param = &w_param;
+    mbox.num_joints = num_joints;
+    mbox.async = (decode_periods > 0);
+    wou_set_mbox_cb(&w_param, fetchmail);
+    // NUM_JOINTS, as rtapi_app_main() of wou_stepgen sends it
+    wou_sfifo_value(&sfifo, SYNC_MACH_PARAM | PACK_MACH_PARAM_ADDR(MACHINE_CTRL),
+                    num_joints << 16);
+    wou_sfifo_wait(&sfifo);
+    upload_params(0, &one_us, &one_spins);
+    upload_params(1, &batch_us, &batch_spins);
+    memset(rawcount, 0, sizeof(rawcount));
+    wou_loop_stats(&sb);
+    sfifo.hold = (prebuf > 0);
+
+    for (i = 0; i < periods; i++) {
+        wou_loop_stats(&s0);
+        t0 = nsnow();
+        if (wou_sfifo_drain(&sfifo) == -1 && sfifo.periods >= prebuf) {
+            // usb-busy: wou_stepgen pauses motion
+            busy++;
+            wou_update(&w_param);
+        } else {
+            wou_update(&w_param);
+            wou_mbox_read(&mbox, &mbox_vals);
+            send_period(i - busy, rawcount);
+        }
+        times[i] = nsnow() - t0;
+        wou_loop_stats(&s1);
+        // the emulated FPGA is not host time
+        times[i] -= s1.fpga_ns - s0.fpga_ns;
+        sum += times[i];
+        // wou.mbox.decode, in a thread decode_periods slower
+        if (decode_periods && i % decode_periods == 0) {
+            decoded += wou_mbox_decode(&mbox);
+        }
+    }
+
+    // let the FPGA take everything, then wait for a mail sent after that
+    for (i = 0; (sfifo.len || !wou_loop_idle()) && i < MAX_PERIODS; i++) {
+        wou_sfifo_drain(&sfifo);
+        wou_update(&w_param);
+    }
+    wou_loop_stats(&s1);
+    idle_tick = (uint32_t) s1.ticks;
+    for (i = 0; (int32_t) (bp_tick - idle_tick) <= 0 && i < MAX_PERIODS; i++) {
+        wou_update(&w_param);
+    }
+    decoded += wou_mbox_decode(&mbox);
+    wou_mbox_read(&mbox, &mbox_vals);
+    wou_loop_stats(&s1);
+#define D(f) ((unsigned long long) (s1.f - sb.f))
+
+    printf("%s, %d joints, %d servo periods of %ldus, latency %ldus, "
+           "window %d, loss %dppm, crc errors %dppm, prebuf %d\n",
+           pack_jnt ? "SYNC_PJNT" : "SYNC_JNT", num_joints, periods,
+           cfg.period_ns / 1000, cfg.latency_ns / 1000,
+           cfg.window, cfg.loss_ppm, cfg.crc_ppm, prebuf);
+    printf("motor parameters: %d values, one by one %.0fus (%llu spins), "
+           "batched %.0fus (%llu spins)\n", num_joints * NUM_MOT_PARAMS,
+           one_us, (unsigned long long) one_spins,
+           batch_us, (unsigned long long) batch_spins);
+    printf("host to fpga: %llu frames, %llu bytes, %.1f%% payload\n",
+           D(tx_frames), D(tx_bytes), percent(D(tx_payload), D(tx_bytes)));
+    printf("fpga to host: %llu frames, %llu bytes, %.1f%% payload\n",
+           D(rx_frames), D(rx_bytes), percent(D(rx_payload), D(rx_bytes)));
+    printf("retransmits %llu, lost %llu, crc errors %llu, out of order %llu\n",
+           D(retransmits), D(lost), D(crc_errors), D(out_of_order));
+    printf("usb busy %d periods, sfifo stalls %llu, underruns %llu\n", busy,
+           D(sfifo_stalls), D(underruns));
+    qsort(times, periods, sizeof(double), cmp);
+    printf("host per servo period: mean %.0fns  99%% %.0fns  worst %.0fns  "
+           "(fetchmail %.0fns)\n", sum / periods,
+           times[(periods - 1) * 99 / 100], times[periods - 1],
+           mails ? mail_ns / mails : 0.0);
+    if (decode_periods) {
+        printf("mails: %d, decoded every %d periods %d, dropped %u\n",
+               mails, decode_periods, decoded, mbox.ring.dropped);
+    }
+
+    for (i = 0; i < num_joints; i++) {
+        if (mail.pulse_pos[i] != (int32_t) (rawcount[i] >> FRACTION_BITS)) {
+            printf("joint %d at %d, commanded %d\n", i, mail.pulse_pos[i],
+                   (int32_t) (rawcount[i] >> FRACTION_BITS));
+            fail++;
+        }
+    }
+    // the last toggle of GPIO out 0 went out in period sent - 1
+    dout0 = ((periods - busy - 1) / DOUT_PERIODS) & 1;
+    if (mbox_vals.dout0 != dout0 || mbox.bad_tags) {
+        printf("dout0 %u, sent %u, %u unknown mails\n", mbox_vals.dout0,
+               dout0, mbox.bad_tags);
+        fail++;
+    }
+    if (fail) {
+        printf("*fail*\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,325 @@
+/********************************************************************
+ * Description:  wou_codec.c
+ *               The host side of the WOU command stream and mailbox,
+ *               shared by wou_stepgen and wou_bench.  See wou_codec.h.
+ *
+ * License: GPL Version 2
+ *
+ * Copyright (c) 2014 All rights reserved.
+ *
+ * Last change:
+ ********************************************************************/
+#include <stdint.h>
+#include <string.h>
+
+#include "rtapi_atomic.h"	/* rtapi_smp_wmb() for the mailbox ring */
+#include <wou.h>
+#include <wb_regs.h>
+#include <mailtag.h>
+#include "sync_cmd.h"
+#include "wou_codec.h"
+
+#define FRACTION_BITS 16
+#define FRACTION_MASK 0x0000FFFF
+
+int wou_sfifo_drain(wou_sfifo_t *s)
+{
+    int i, n;
+
+    if (s->len == 0) {
+        return wou_flush(s->w_param);
+    }
+    if (wou_flush(s->w_param) == -1) {
+        return -1;
+    }
+    for (i = 0; i < s->len; i += n) {
+        n = s->len - i;
+        if (n > MAX_DSIZE / sizeof(uint16_t)) {
+            n = MAX_DSIZE / sizeof(uint16_t);
+        }
+        wou_cmd(s->w_param, WB_WR_CMD, (uint16_t) (JCMD_BASE | JCMD_SYNC_CMD),
+                n * sizeof(uint16_t), (const uint8_t *) (s->buf + i));
+    }
+    s->len = 0;
+    s->periods = 0;
+    return wou_flush(s->w_param);
+}
+
+void wou_sfifo_put(wou_sfifo_t *s, const uint16_t *words, int n)
+{
+    if (!s->hold) {
+        wou_cmd(s->w_param, WB_WR_CMD, (uint16_t) (JCMD_BASE | JCMD_SYNC_CMD),
+                n * sizeof(uint16_t), (const uint8_t *) words);
+        return;
+    }
+    if (s->len + n > WOU_SFIFO_WORDS) {
+        // a burst of parameters filled the buffer: wait for the link
+        while (wou_sfifo_drain(s) == -1);
+    }
+    memcpy(s->buf + s->len, words, n * sizeof(uint16_t));
+    s->len += n;
+}
+
+void wou_sfifo_wait(wou_sfifo_t *s)
+{
+    if (!s->hold) {
+        while (wou_flush(s->w_param) == -1);
+    }
+}
+
+void wou_sfifo_value(wou_sfifo_t *s, uint16_t sync_cmd, int32_t data)
+{
+    uint16_t words[sizeof(int32_t) + 1];
+    int j;
+
+    for (j = 0; j < sizeof(int32_t); j++) {
+        words[j] = SYNC_DATA | ((uint8_t *) &data)[j];
+    }
+    words[j] = sync_cmd;
+    wou_sfifo_put(s, words, sizeof(int32_t) + 1);
+}
+
+void wou_jnt_words(int32_t pos_cmd, uint16_t *words)
+{
+    // SYNC_JNT: opcode for SYNC_JNT command
+    // DIR_P: Direction, (positive(1), negative(0))
+    // POS_MASK: relative position mask
+    uint32_t mag = (pos_cmd >= 0) ? (uint32_t) pos_cmd : -(uint32_t) pos_cmd;
+
+    /* integer part, then fraction part (16-bit each) */
+    words[0] = SYNC_JNT | ((pos_cmd >= 0) ? DIR_P : DIR_N)
+               | (POS_MASK & (mag >> FRACTION_BITS));
+    words[1] = mag & FRACTION_MASK;
+}
+
+int wou_pack_joints(int num_joints, int32_t *prev, const int32_t *delta,
+                    uint16_t *words)
+{
+    uint32_t codes = 0, code;
+    int n, w;
+    int64_t diff;
+
+    w = (num_joints > PJNT_HEAD_JOINTS) ? 2 : 1;
+    for (n = 0; n < num_joints; n++) {
+        diff = (int64_t) delta[n] - prev[n];
+        if (delta[n] == 0) {
+            code = PJNT_ZERO;
+        } else if (diff == 0) {
+            code = PJNT_SAME;
+        } else if (diff >= -32768 && diff <= 32767) {
+            code = PJNT_DIFF;
+            words[w++] = (uint16_t) diff;
+        } else {
+            code = PJNT_FULL;
+            words[w++] = (uint32_t) delta[n] & 0xFFFF;
+            words[w++] = (uint32_t) delta[n] >> 16;
+        }
+        codes |= PACK_PJNT_CODE(code, n);
+        prev[n] = delta[n];
+    }
+    words[0] = SYNC_PJNT | (codes & SYNC_PJNT_CODE_MASK);
+    if (num_joints > PJNT_HEAD_JOINTS) {
+        words[1] = codes >> (2 * PJNT_HEAD_JOINTS);
+    }
+    return w;
+}
+
+uint16_t wou_mail_fast(const uint8_t *buf_head, int num_joints, wou_mail_t *m)
+{
+    const uint32_t *p;
+    int i;
+
+    memcpy(&m->tag, (buf_head + 2), sizeof(uint16_t));
+    p = (const uint32_t *) (buf_head + 4);     // BP_TICK
+    m->bp_tick = *p;
+
+    switch (m->tag) {
+    case MT_MOTION_STATUS:
+        for (i = 0; i < num_joints; i++) {
+            p += 1;
+            m->pulse_pos[i] = (int32_t) *p;
+            p += 1;
+            m->enc_pos[i] = (int32_t) *p;
+            p += 1;
+            m->cmd_fbs[i] = (int32_t) *p;
+            p += 1;
+            m->enc_vel_p[i] = (int32_t) *p;
+        }
+        // skip din[3], dout0, 16ch of 16-bit ADC value and MPG
+        p += 3 + 1 + 8 + 1;
+        p += 1;
+        m->machine_status = *p;
+        p += 1;     // max_tick_time
+        p += 1;
+        m->rcmd_state = *p;
+        break;
+
+    case MT_RISC_CMD:
+        p = (const uint32_t *) (buf_head + 8);
+        m->rcmd_state = *p;
+        if (*p == RCMD_UPDATE_POS_REQ) {
+            p += 1;
+            m->rcmd_seq_num = *p;
+        }
+        break;
+
+    case MT_PROBED_POS:
+        for (i = 0; i < num_joints; i++) {
+            p += 1;
+            m->probed_pos[i] = (int32_t) *p;
+        }
+        p += 1;
+        m->trigger_result = (uint8_t) *p;
+        break;
+    }
+    return m->tag;
+}
+
+int wou_mail_slow(const uint8_t *buf_head, int num_joints, wou_mbox_vals_t *v)
+{
+    int i;
+    uint16_t mail_tag;
+    const uint32_t *p;
+    const uint16_t *adc;
+
+    memcpy(&mail_tag, (buf_head + 2), sizeof(uint16_t));
+    p = (const uint32_t *) (buf_head + 4);  // BP_TICK
+
+    switch (mail_tag) {
+    case MT_MOTION_STATUS:
+        // skip the joints, decoded by wou_mail_fast()
+        p += 4 * num_joints;
+
+        // digital input
+        for (i = 0; i < 3; i++) {
+            p += 1;
+            v->din[i] = *p;
+        }
+        // digital output
+        p += 1;
+        v->dout0 = *p;
+
+        // copy 16 channel of 16-bit ADC value
+        p += 1;
+        adc = (const uint16_t *) p;
+        for (i = 0; i < 8; i++) {
+            v->adc[i * 2] = adc[i * 2 + 1];
+            v->adc[i * 2 + 1] = adc[i * 2];
+        }
+
+        // MPG
+        p += 8;     // skip 16ch of 16-bit ADC value
+        // the MPG on my hand is 1-click for a full-AB-phase-wave.
+        // therefore the mpg_count will increase by 4.
+        // divide it by 4 for smooth jogging.
+        // otherwise, there will be 4 units of motions for every MPG click.
+        v->mpg_count = ((int32_t) *p) >> 2;
+        p += 1;     // machine_status, decoded by wou_mail_fast()
+
+        p += 1;
+        v->max_tick_time = *p;
+        break;
+
+    case MT_DEBUG:
+        for (i = 0; i < 8; i++) {
+            p += 1;
+            v->debug[i] = *p;
+        }
+        break;
+
+    case MT_ERROR_CODE:
+    case MT_RISC_CMD:
+    case MT_PROBED_POS:
+        // nothing here, or decoded by wou_mail_fast()
+        break;
+
+    default:
+        return -1;
+    }
+    return 0;
+}
+
+/* publish mb->back as the newest snap buffer */
+static void wou_mbox_publish(wou_mbox_t *mb)
+{
+    unsigned int next = mb->snap.seq + 1;
+
+    mb->snap.begin = next;
+    rtapi_smp_wmb();
+    mb->snap.buf[next & 1] = mb->back;
+    rtapi_smp_wmb();
+    mb->snap.seq = next;
+}
+
+static void wou_mbox_slow(wou_mbox_t *mb, const uint8_t *buf_head)
+{
+    if (wou_mail_slow(buf_head, mb->num_joints, &mb->back) < 0) {
+        memcpy(&mb->bad_tag, (buf_head + 2), sizeof(uint16_t));
+        mb->bad_tags++;
+    }
+}
+
+void wou_mbox_put(wou_mbox_t *mb, const uint8_t *buf_head)
+{
+    unsigned int head;
+    uint16_t mail_tag;
+
+    if (!mb->async) {
+        wou_mbox_slow(mb, buf_head);
+        wou_mbox_publish(mb);
+        return;
+    }
+    memcpy(&mail_tag, (buf_head + 2), sizeof(uint16_t));
+    if (mail_tag == MT_RISC_CMD || mail_tag == MT_PROBED_POS) {
+        return;
+    }
+    head = mb->ring.head;
+    if (head - mb->ring.tail >= WOU_MBOX_RING) {
+        mb->ring.dropped++;
+        return;
+    }
+    memcpy(mb->ring.mail[head & (WOU_MBOX_RING - 1)], buf_head,
+           buf_head[0] + 1);
+    rtapi_smp_wmb();
+    mb->ring.head = head + 1;
+}
+
+int wou_mbox_decode(wou_mbox_t *mb)
+{
+    unsigned int head, tail;
+    int n;
+
+    head = mb->ring.head;
+    tail = mb->ring.tail;
+    if (head == tail) {
+        return 0;
+    }
+    rtapi_smp_rmb();
+    for (n = 0; tail != head; n++) {
+        wou_mbox_slow(mb, mb->ring.mail[tail & (WOU_MBOX_RING - 1)]);
+        tail++;
+    }
+    rtapi_smp_mb();
+    mb->ring.tail = tail;
+    wou_mbox_publish(mb);
+    return n;
+}
+
+int wou_mbox_read(wou_mbox_t *mb, wou_mbox_vals_t *v)
+{
+    unsigned int seq;
+
+    seq = mb->snap.seq;
+    if (seq == mb->read_seq) {
+        return 0;
+    }
+    rtapi_smp_rmb();
+    *v = mb->snap.buf[seq & 1];
+    rtapi_smp_rmb();
+    if (mb->snap.begin - seq >= 2) {
+        // wou_mbox_decode() rewrote the buffer meanwhile, copy it next time
+        return 0;
+    }
+    mb->read_seq = seq;
+    return 1;
+}
@@ -0,0 +1,138 @@
+/********************************************************************
+ * Description:  wou_codec.h
+ *               The host side of the WOU command stream and mailbox:
+ *               SYNC command words for the SFIFO, the prebuffer that
+ *               holds them while USB is busy, and the decoding of the
+ *               mails, with the ring and snapshot that let a slower
+ *               thread decode them.
+ *
+ *               wou_stepgen builds on these, and wou_bench drives the
+ *               same code against the loopback emulator of wou_loop.c,
+ *               so what it measures is what the driver sends.
+ *
+ * License: GPL Version 2
+ *
+ * Copyright (c) 2014 All rights reserved.
+ *
+ * Last change:
+ ********************************************************************/
+#ifndef __wou_codec_h__
+#define __wou_codec_h__
+
+#include <stdint.h>
+#include <wou.h>
+
+#define WOU_MAX_CHAN        8
+
+/**
+ * Host side prebuffer for the SFIFO command stream.
+ * With hold set, wou_sfifo_put() keeps the JCMD_SYNC_CMD words in buf
+ * instead of handing them to libwou, and wou_sfifo_drain() sends them
+ * together, packed into as few WB_WR_CMDs as MAX_DSIZE allows, once
+ * the link takes them again.  periods counts the whole servo periods
+ * the caller queued.
+ **/
+#define WOU_PREBUF_MAX      64
+#define WOU_SFIFO_WORDS     (WOU_PREBUF_MAX * 128)
+
+typedef struct {
+    wou_param_t *w_param;
+    int         hold;           // wou_sfifo_put() goes to buf
+    int         len;            // words in buf
+    int         periods;        // whole servo periods in buf
+    uint16_t    buf[WOU_SFIFO_WORDS];
+} wou_sfifo_t;
+
+/* hand the prebuffered words to libwou; returns -1 while USB is busy */
+extern int wou_sfifo_drain(wou_sfifo_t *s);
+/* queue @n SFIFO command words, in order with all the others */
+extern void wou_sfifo_put(wou_sfifo_t *s, const uint16_t *words, int n);
+/* wait until WOU accepted the queued commands, unless they are held */
+extern void wou_sfifo_wait(wou_sfifo_t *s);
+/* queue the SYNC_DATA words of @data, then @sync_cmd */
+extern void wou_sfifo_value(wou_sfifo_t *s, uint16_t sync_cmd, int32_t data);
+
+/* the SYNC_JNT word pair of a 16.16 joint command, into @words */
+extern void wou_jnt_words(int32_t pos_cmd, uint16_t *words);
+/* SYNC_PJNT record (see sync_cmd.h) of the 16.16 joint deltas of one
+   servo period, into @words; returns its length.  @prev follows the
+   previous delta the RISC keeps for each joint. */
+extern int wou_pack_joints(int num_joints, int32_t *prev,
+                           const int32_t *delta, uint16_t *words);
+
+/**
+ * Mail decoding.
+ * wou_mail_fast() takes what a servo period needs at once out of a
+ * mail: BP_TICK, the joints of MT_MOTION_STATUS with the machine
+ * status, MT_RISC_CMD and MT_PROBED_POS.  wou_mail_slow() takes the
+ * rest (GPIO inputs, DOUT, ADC, MPG, MT_DEBUG) into a wou_mbox_vals_t.
+ **/
+typedef struct {
+    uint16_t    tag;
+    uint32_t    bp_tick;
+    int32_t     pulse_pos[WOU_MAX_CHAN];
+    int32_t     enc_pos[WOU_MAX_CHAN];
+    int32_t     cmd_fbs[WOU_MAX_CHAN];
+    int32_t     enc_vel_p[WOU_MAX_CHAN];    // pulses per servo period
+    uint32_t    machine_status;
+    uint32_t    rcmd_state;
+    uint32_t    rcmd_seq_num;               // of RCMD_UPDATE_POS_REQ
+    int32_t     probed_pos[WOU_MAX_CHAN];
+    uint8_t     trigger_result;
+} wou_mail_t;
+
+typedef struct {
+    uint32_t    din[3];
+    uint32_t    dout0;
+    int32_t     adc[16];
+    int32_t     mpg_count;
+    uint32_t    max_tick_time;
+    int32_t     debug[8];
+} wou_mbox_vals_t;
+
+/* decodes the fields of @m that @buf_head carries, returns the tag */
+extern uint16_t wou_mail_fast(const uint8_t *buf_head, int num_joints,
+                              wou_mail_t *m);
+/* returns -1 for a mail tag it does not know */
+extern int wou_mail_slow(const uint8_t *buf_head, int num_joints,
+                         wou_mbox_vals_t *v);
+
+/**
+ * Mails for a slower thread.
+ * wou_mbox_put() runs after wou_mail_fast() in the mailbox callback.
+ * With async unset it decodes the mail at once.  Otherwise it copies
+ * the mail into ring, and wou_mbox_decode(), in a lower priority
+ * thread, decodes the queued mails and publishes the values through
+ * the two buffers of snap.  wou_mbox_read() copies the newest buffer,
+ * so the servo thread never waits for the decoding.
+ **/
+#define WOU_MBOX_RING       32      // mails, power of 2
+#define WOU_MBOX_MAIL       256     // PLOAD_SIZE_TX byte and up to 255 bytes
+
+typedef struct {
+    int         num_joints;
+    int         async;
+    struct {
+        volatile unsigned int head;     // written by wou_mbox_put()
+        volatile unsigned int tail;     // written by wou_mbox_decode()
+        uint32_t    dropped;            // mails with no room left
+        uint8_t     mail[WOU_MBOX_RING][WOU_MBOX_MAIL];
+    } ring;
+    struct {
+        volatile unsigned int begin;    // bumped before a buffer is written
+        volatile unsigned int seq;      // set to begin after it is written
+        wou_mbox_vals_t buf[2];         // buf[seq & 1] is the newest
+    } snap;
+    wou_mbox_vals_t back;           // decoded by wou_mail_slow()
+    unsigned int read_seq;          // snap.seq wou_mbox_read() copied
+    uint32_t    bad_tags;           // mails wou_mail_slow() did not know
+    uint16_t    bad_tag;            // the last of them
+} wou_mbox_t;
+
+extern void wou_mbox_put(wou_mbox_t *mb, const uint8_t *buf_head);
+/* returns the number of mails decoded */
+extern int wou_mbox_decode(wou_mbox_t *mb);
+/* returns 1 with the values published since the last call in @v */
+extern int wou_mbox_read(wou_mbox_t *mb, wou_mbox_vals_t *v);
+
+#endif // __wou_codec_h__
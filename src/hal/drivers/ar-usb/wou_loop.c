@@ -0,0 +1,897 @@
+/********************************************************************
+ * Description:  wou_loop.c
+ *               A loopback emulator of the WOU FPGA endpoint, in place
+ *               of libwou and the USB board.  See wou_loop.h.
+ *
+ *               Host side: wou_cmd() packs WOU packets into TYP_WOUF
+ *               frames, wou_flush() sends them with their TID while
+ *               the GO-BACK-N window has room, and sends the window
+ *               again when it is not acked within timeout_ns.
+ *               FPGA side: frames are checked for their CRC-16 and
+ *               TID, acked, and their WB writes done; SYNC_CMD writes
+ *               go to the SFIFO, which stalls the link when it is full.
+ *               Once per base period the RISC takes one SYNC_EOF frame
+ *               of SYNC commands from the SFIFO and moves the joints.
+ *               Reads (WB_RD_CMD) are not answered.
+ *
+ * License: GPL Version 2
+ *
+ * Copyright (c) 2014 All rights reserved.
+ *
+ * Last change:
+ ********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <wou.h>
+#include <wb_regs.h>
+#include <mailtag.h>
+#include "sync_cmd.h"
+#include "wou_loop.h"
+
+// WOUF_COMMAND
+#define WL_TYP_WOUF     0x00
+#define WL_RST_TID      0x01
+#define WL_MAILBOX      0x02
+#define WL_REALTIME     0x03
+
+#define WL_HEAD         4       // preamble, SOFD, PLOAD_SIZE_TX
+#define WL_CRC          2
+#define WL_PLOAD_MAX    0xFF
+#define WL_FRAME_MAX    (WL_HEAD + WL_PLOAD_MAX + WL_CRC)
+#define WL_WOU_MAX      (WL_PLOAD_MAX - 3)  // after {WOUF_COMMAND, TID, PLOAD_SIZE_RX}
+#define WL_WOU_HEAD     3       // {F, DATA_SIZE}, WB_ADDR
+
+#define WL_WIRE         1024    // frames on the wire, each way
+#define WL_PEND         256     // frames waiting for the window
+#define WL_MAILS        64      // mails waiting for wou_update()
+#define WL_JOINTS       8
+#define WL_SFIFO_MAX    4096
+
+typedef struct {
+    int64_t due;                // arrival at the far end
+    int len;                    // preamble to CRC-16
+    uint8_t buf[WL_FRAME_MAX];
+} wl_frame_t;
+
+typedef struct {
+    wl_frame_t f[WL_WIRE];
+    int head, tail;
+    int64_t free;               // busy sending until then
+} wl_wire_t;
+
+static wou_loop_config_t cfg;
+static int configured;
+
+static struct {
+    int64_t now;
+    uint32_t rnd;
+    wou_loop_stats_t st;
+    wl_wire_t h2f, f2h;
+
+    /* host */
+    uint8_t cur[WL_WOU_MAX];    // the TYP_WOUF frame being filled
+    int cur_len;
+    uint8_t rt[WL_WOU_MAX];     // the REALTIME frame being filled
+    int rt_len;
+    uint8_t pend[WL_PEND][WL_WOU_MAX];
+    int pend_len[WL_PEND];
+    int pend_head, pend_tail, pend_n;
+    wl_frame_t win[256];        // sent and not acked yet, by TID
+    uint8_t base, next;         // oldest TID not acked, next TID to send
+    int64_t timer;              // when base was sent
+    uint32_t mail[WL_MAILS][WL_FRAME_MAX / 4 + 1];
+    int mail_head, mail_n;
+    int32_t crc_count, crc_told;
+    void (*mbox_cb)(const uint8_t *);
+    void (*crc_error_cb)(int32_t);
+    void (*rt_cmd_cb)(void);
+
+    /* FPGA */
+    uint8_t expect;             // next TID to take
+    int stalled;                // h2f waits for SFIFO room
+    int64_t next_tick;
+    uint8_t wb[0x10000];
+    uint16_t sfifo[WL_SFIFO_MAX];
+    int sf_head, sf_n;
+
+    /* RISC */
+    uint32_t imm;               // SYNC_DATA immediate data
+    int jnt;                    // joint of the next SYNC_JNT
+    int frac_next;              // the next word is the fraction of jnt
+    int jnt_pos, jnt_dir;
+    int pj_state;               // in a SYNC_PJNT record, see risc_pjnt()
+    uint32_t pj_codes;
+    uint16_t pj_lo;             // low word of a PJNT_FULL delta
+    int32_t pj_prev[WL_JOINTS]; // previous SYNC_PJNT deltas
+    int running;                // a SYNC_EOF was taken
+    int joints;                 // NUM_JOINTS of MACHINE_CTRL
+    int64_t pos[WL_JOINTS];     // 16.16 pulses
+    int32_t cmd_fbs[WL_JOINTS];
+    uint32_t dout0;
+    uint32_t mach_param[MACHINE_PARAM_ITEM];
+    uint32_t mot_param[WL_JOINTS][MAX_PARAM_ITEM];
+} wl;
+
+static uint16_t crc_table[256];
+
+/* CRC-16-CCITT, from PLOAD_SIZE_TX to the end of the payload */
+static uint16_t crc16(const uint8_t *p, int n)
+{
+    uint16_t crc = 0xFFFF;
+
+    while (n-- > 0) {
+        crc = (crc << 8) ^ crc_table[(crc >> 8) ^ *p++];
+    }
+    return crc;
+}
+
+static void crc16_init(void)
+{
+    int i, b;
+    uint16_t c;
+
+    for (i = 0; i < 256; i++) {
+        c = i << 8;
+        for (b = 0; b < 8; b++) {
+            c = (c & 0x8000) ? (c << 1) ^ 0x1021 : (c << 1);
+        }
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t rnd(void)
+{
+    // xorshift32
+    wl.rnd ^= wl.rnd << 13;
+    wl.rnd ^= wl.rnd >> 17;
+    wl.rnd ^= wl.rnd << 5;
+    return wl.rnd;
+}
+
+static int chance(int ppm)
+{
+    return ppm > 0 && (rnd() % 1000000) < (uint32_t) ppm;
+}
+
+static int64_t nsnow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* frame the @size bytes put at f->buf + WL_HEAD */
+static void frame_seal(wl_frame_t *f, int size)
+{
+    uint16_t crc;
+
+    f->buf[0] = 0xAA;
+    f->buf[1] = 0xAA;
+    f->buf[2] = 0xAB;
+    f->buf[3] = size;
+    crc = crc16(f->buf + 3, size + 1);
+    f->buf[WL_HEAD + size] = crc & 0xFF;
+    f->buf[WL_HEAD + size + 1] = crc >> 8;
+    f->len = WL_HEAD + size + WL_CRC;
+}
+
+/* returns PLOAD_SIZE_TX, or 0 when the frame is to be dropped */
+static int frame_check(const wl_frame_t *f)
+{
+    int size = f->buf[3];
+    uint16_t crc;
+
+    if (f->buf[0] != 0xAA || f->buf[1] != 0xAA || f->buf[2] != 0xAB
+        || size < 2 || f->len != WL_HEAD + size + WL_CRC) {
+        return 0;
+    }
+    crc = f->buf[WL_HEAD + size] | (f->buf[WL_HEAD + size + 1] << 8);
+    if (crc != crc16(f->buf + 3, size + 1)) {
+        return 0;
+    }
+    return size;
+}
+
+static void wire_send(wl_wire_t *w, const wl_frame_t *f)
+{
+    wl_frame_t *slot;
+    int64_t start = w->free > wl.now ? w->free : wl.now;
+
+    w->free = start + f->len * cfg.byte_ns;
+    if (w == &wl.h2f) {
+        wl.st.tx_frames++;
+        wl.st.tx_bytes += f->len;
+    } else {
+        wl.st.rx_frames++;
+        wl.st.rx_bytes += f->len;
+    }
+    if (chance(cfg.loss_ppm) || (w->tail + 1) % WL_WIRE == w->head) {
+        wl.st.lost++;
+        return;
+    }
+    slot = &w->f[w->tail];
+    memcpy(slot->buf, f->buf, f->len);
+    slot->len = f->len;
+    slot->due = w->free + cfg.latency_ns;
+    if (chance(cfg.crc_ppm)) {
+        // one bit flipped after PLOAD_SIZE_TX, CRC-16 included
+        slot->buf[WL_HEAD + rnd() % (f->len - WL_HEAD)] ^= 1 << (rnd() % 8);
+    }
+    w->tail = (w->tail + 1) % WL_WIRE;
+}
+
+/************************************************************************
+ * FPGA                                                                 *
+ ************************************************************************/
+static void fpga_ack(uint8_t tid)
+{
+    wl_frame_t f;
+
+    f.buf[WL_HEAD] = WL_TYP_WOUF;
+    f.buf[WL_HEAD + 1] = tid;
+    frame_seal(&f, 2);
+    wire_send(&wl.f2h, &f);
+}
+
+/* number of SYNC commands written by the WOU packets at @p */
+static int fpga_sync_words(const uint8_t *p, int n)
+{
+    int i = 0, size, words = 0;
+
+    while (i + WL_WOU_HEAD <= n) {
+        size = (p[i] & 0x7F) ? (p[i] & 0x7F) : 128;
+        if (!(p[i] & 0x80)) {
+            i += WL_WOU_HEAD;
+            continue;
+        }
+        if ((p[i + 1] | (p[i + 2] << 8)) == (JCMD_BASE | JCMD_SYNC_CMD)) {
+            words += size / 2;
+        }
+        i += WL_WOU_HEAD + size;
+    }
+    return words;
+}
+
+static void fpga_exec(const uint8_t *p, int n)
+{
+    int i = 0, k, size, addr;
+
+    while (i + WL_WOU_HEAD <= n) {
+        size = (p[i] & 0x7F) ? (p[i] & 0x7F) : 128;
+        addr = p[i + 1] | (p[i + 2] << 8);
+        if (!(p[i] & 0x80)) {
+            // WB_RD_CMD: nothing is read back here
+            i += WL_WOU_HEAD;
+            continue;
+        }
+        i += WL_WOU_HEAD;
+        if (i + size > n) {
+            break;
+        }
+        if (addr == (JCMD_BASE | JCMD_SYNC_CMD)) {
+            // the 2nd byte of SYNC_CMD pushes it into the SFIFO
+            for (k = 0; k + 1 < size && wl.sf_n < cfg.sfifo_words; k += 2) {
+                wl.sfifo[(wl.sf_head + wl.sf_n) % WL_SFIFO_MAX] =
+                    p[i + k] | (p[i + k + 1] << 8);
+                wl.sf_n++;
+            }
+        } else {
+            for (k = 0; k < size; k++) {
+                wl.wb[(addr + k) & 0xFFFF] = p[i + k];
+            }
+        }
+        i += size;
+    }
+}
+
+/* returns 0 while the SFIFO has no room for the frame */
+static int fpga_rx(const wl_frame_t *f)
+{
+    int size = frame_check(f);
+
+    if (size == 0) {
+        wl.st.crc_errors++;
+        return 1;
+    }
+    switch (f->buf[WL_HEAD]) {
+    case WL_TYP_WOUF:
+        if (size < 3) {
+            break;
+        }
+        if (f->buf[WL_HEAD + 1] != wl.expect) {
+            // GO-BACK-N: drop it, and ack the last one taken again
+            wl.st.out_of_order++;
+            fpga_ack(wl.expect - 1);
+            break;
+        }
+        if (fpga_sync_words(f->buf + WL_HEAD + 3, size - 3)
+            > cfg.sfifo_words - wl.sf_n) {
+            return 0;
+        }
+        fpga_exec(f->buf + WL_HEAD + 3, size - 3);
+        fpga_ack(wl.expect);
+        wl.expect++;
+        break;
+    case WL_RST_TID:
+        wl.expect = 0;
+        break;
+    case WL_REALTIME:
+        fpga_exec(f->buf + WL_HEAD + 2, size - 2);
+        break;
+    }
+    return 1;
+}
+
+static void risc_move(int j, int32_t d)
+{
+    if (j < WL_JOINTS) {
+        wl.pos[j] += d;
+        // integer part, as SYNC_JNT carries it
+        wl.cmd_fbs[j] = d >= 0 ? (d >> 16) : -((-d) >> 16);
+    }
+}
+
+/* joints of the SYNC_PJNT record up to the next one with data words;
+   returns 1 when the record is done */
+static int risc_pjnt_skip(void)
+{
+    int code;
+
+    for (; wl.jnt < wl.joints; wl.jnt++) {
+        code = GET_PJNT_CODE(wl.pj_codes, wl.jnt);
+        if (code == PJNT_ZERO) {
+            wl.pj_prev[wl.jnt] = 0;
+        } else if (code != PJNT_SAME) {
+            return 0;
+        }
+        risc_move(wl.jnt, wl.pj_prev[wl.jnt]);
+    }
+    wl.pj_state = 0;
+    wl.jnt = 0;
+    return 1;
+}
+
+/*
+ * the words after a SYNC_PJNT: pj_state is 1 for the J7..J6 CODE word,
+ * 2 for a PJNT_DIFF or the low word of a PJNT_FULL, 3 for its high word
+ */
+static int risc_pjnt(uint16_t w)
+{
+    int code;
+
+    switch (wl.pj_state) {
+    case 1:
+        wl.pj_codes |= (uint32_t) w << (2 * PJNT_HEAD_JOINTS);
+        break;
+    case 2:
+        code = GET_PJNT_CODE(wl.pj_codes, wl.jnt);
+        if (code == PJNT_FULL) {
+            wl.pj_lo = w;
+            wl.pj_state = 3;
+            return 0;
+        }
+        wl.pj_prev[wl.jnt] += (int16_t) w;
+        risc_move(wl.jnt, wl.pj_prev[wl.jnt]);
+        wl.jnt++;
+        break;
+    case 3:
+        wl.pj_prev[wl.jnt] = (int32_t) (wl.pj_lo | ((uint32_t) w << 16));
+        risc_move(wl.jnt, wl.pj_prev[wl.jnt]);
+        wl.jnt++;
+        break;
+    }
+    wl.pj_state = 2;
+    return risc_pjnt_skip();
+}
+
+/* returns 1 at the end of a servo period */
+static int risc_sync(uint16_t w)
+{
+    int addr, id;
+
+    if (wl.pj_state) {
+        return risc_pjnt(w);
+    }
+
+    if (wl.frac_next) {
+        int32_t d = (wl.jnt_pos << 16) | w;
+        risc_move(wl.jnt, wl.jnt_dir ? d : -d);
+        wl.jnt++;
+        wl.frac_next = 0;
+        return 0;
+    }
+    if ((w & SFIFO_SYNC_JNT_MASK) == SYNC_JNT) {
+        // the fraction (16-bit) follows
+        wl.jnt_pos = w & POS_MASK;
+        wl.jnt_dir = w & DIR_P;
+        wl.frac_next = 1;
+        return 0;
+    }
+    switch (w & SYNC_OP_CODE_MASK) {
+    case SYNC_EOF:
+        wl.jnt = 0;
+        return 1;
+    case SYNC_PJNT:
+        wl.pj_codes = w & SYNC_PJNT_CODE_MASK;
+        wl.jnt = 0;
+        if (wl.joints > PJNT_HEAD_JOINTS) {
+            wl.pj_state = 1;
+            return 0;
+        }
+        wl.pj_state = 2;
+        return risc_pjnt_skip();
+    case SYNC_DATA:
+        wl.imm = (wl.imm >> 8) | ((uint32_t) GET_DATA_VAL(w) << 24);
+        break;
+    case SYNC_MACH_PARAM:
+        addr = GET_MACH_PARAM_ADDR(w);
+        if (addr < MACHINE_PARAM_ITEM) {
+            wl.mach_param[addr] = wl.imm;
+        }
+        if (addr == MACHINE_CTRL) {
+            wl.joints = (wl.imm & MCTRL_NUM_JOINTS_MASK) >> 16;
+            if (wl.joints > WL_JOINTS) {
+                wl.joints = WL_JOINTS;
+            }
+        }
+        break;
+    case SYNC_MOT_PARAM:
+        addr = GET_MOT_PARAM_ADDR(w);
+        id = GET_MOT_PARAM_ID(w);
+        if (id < WL_JOINTS && addr < MAX_PARAM_ITEM) {
+            wl.mot_param[id][addr] = wl.imm;
+        }
+        break;
+    case SYNC_DOUT:
+        id = GET_IO_ID(w);
+        if (id < 32) {
+            wl.dout0 = (wl.dout0 & ~(1U << id)) | (GET_DO_VAL(w) << id);
+        }
+        break;
+    default:
+        // SYNC_DIN, SYNC_VEL, ... do not wait or change anything here
+        break;
+    }
+    return 0;
+}
+
+/* MT_MOTION_STATUS, in the layout fetchmail() of wou_stepgen reads */
+static void risc_mail(void)
+{
+    wl_frame_t f;
+    uint32_t w[WL_PLOAD_MAX / 4];
+    uint32_t moving = 0;
+    int i, n = 0;
+    uint16_t tag = MT_MOTION_STATUS;
+    uint32_t tick = (uint32_t) wl.st.ticks;
+
+    for (i = 0; i < wl.joints; i++) {
+        w[n++] = (uint32_t) (wl.pos[i] >> 16);  // pulse_pos
+        w[n++] = (uint32_t) (wl.pos[i] >> 16);  // enc_pos
+        w[n++] = wl.cmd_fbs[i];                 // cmd_fbs
+        w[n++] = wl.cmd_fbs[i];                 // enc_vel_p
+        moving |= wl.cmd_fbs[i];
+    }
+    for (i = 0; i < 3; i++) {
+        w[n++] = 0;                             // din[]
+    }
+    w[n++] = wl.dout0;
+    for (i = 0; i < 8; i++) {
+        w[n++] = 0;                             // 16ch of 16-bit ADC
+    }
+    w[n++] = 0;                                 // mpg_count
+    w[n++] = moving ? (1 << MACHINE_MOVING_BIT) : 0;
+    w[n++] = 0;                                 // max_tick_time
+    w[n++] = RCMD_IDLE;                         // rcmd_state
+
+    f.buf[WL_HEAD] = WL_MAILBOX;
+    memcpy(f.buf + WL_HEAD + 1, &tag, sizeof(uint16_t));
+    memcpy(f.buf + WL_HEAD + 3, &tick, sizeof(uint32_t));
+    memcpy(f.buf + WL_HEAD + 7, w, n * sizeof(uint32_t));
+    frame_seal(&f, 7 + n * sizeof(uint32_t));
+    wl.st.rx_payload += n * sizeof(uint32_t);
+    wire_send(&wl.f2h, &f);
+}
+
+/* one base period: take SYNC commands up to the next SYNC_EOF or SYNC_PJNT */
+static void risc_tick(void)
+{
+    int eof = 0;
+    uint16_t w;
+
+    wl.st.ticks++;
+    memset(wl.cmd_fbs, 0, sizeof(wl.cmd_fbs));
+    while (wl.sf_n > 0 && !eof) {
+        w = wl.sfifo[wl.sf_head];
+        wl.sf_head = (wl.sf_head + 1) % WL_SFIFO_MAX;
+        wl.sf_n--;
+        wl.st.sfifo_words++;
+        eof = risc_sync(w);
+    }
+    if (eof) {
+        wl.running = 1;
+    } else if (wl.running) {
+        wl.st.underruns++;
+    }
+    if (wl.stalled) {
+        wl.st.sfifo_stalls++;
+        wl.stalled = 0;
+    }
+    if (wl.st.ticks % cfg.mail_ticks == 0) {
+        risc_mail();
+    }
+}
+
+/************************************************************************
+ * host                                                                 *
+ ************************************************************************/
+static void host_rx(const wl_frame_t *f)
+{
+    int size = frame_check(f);
+    uint8_t tid;
+
+    if (size == 0) {
+        wl.st.crc_errors++;
+        wl.crc_count++;
+        return;
+    }
+    switch (f->buf[WL_HEAD]) {
+    case WL_TYP_WOUF:
+        // cumulative ack
+        tid = f->buf[WL_HEAD + 1];
+        if ((uint8_t) (tid - wl.base) < (uint8_t) (wl.next - wl.base)) {
+            wl.base = tid + 1;
+            wl.timer = wl.now;
+        }
+        break;
+    case WL_MAILBOX:
+        if (wl.mail_n == WL_MAILS) {
+            wl.mail_head = (wl.mail_head + 1) % WL_MAILS;
+            wl.mail_n--;
+            wl.st.mails_dropped++;
+        }
+        // fetchmail() takes the mail from PLOAD_SIZE_TX on
+        memcpy(wl.mail[(wl.mail_head + wl.mail_n) % WL_MAILS], f->buf + 3,
+               size + 1);
+        wl.mail_n++;
+        break;
+    }
+}
+
+/* GO-BACK-N: every frame in the window again */
+static void host_resend(void)
+{
+    uint8_t tid;
+
+    for (tid = wl.base; tid != wl.next; tid++) {
+        wire_send(&wl.h2f, &wl.win[tid]);
+        wl.st.retransmits++;
+    }
+    wl.timer = wl.now;
+}
+
+/* run both ends of the link up to @to, event by event */
+static void link_run(int64_t to)
+{
+    int64_t t, t0;
+    int ev;
+
+    for (;;) {
+        t = wl.next_tick;
+        ev = 0;
+        if (wl.h2f.head != wl.h2f.tail && !wl.stalled
+            && wl.h2f.f[wl.h2f.head].due < t) {
+            t = wl.h2f.f[wl.h2f.head].due;
+            ev = 1;
+        }
+        if (wl.f2h.head != wl.f2h.tail && wl.f2h.f[wl.f2h.head].due < t) {
+            t = wl.f2h.f[wl.f2h.head].due;
+            ev = 2;
+        }
+        if (wl.base != wl.next && wl.timer + cfg.timeout_ns < t) {
+            t = wl.timer + cfg.timeout_ns;
+            ev = 3;
+        }
+        if (t > to) {
+            break;
+        }
+        if (t > wl.now) {
+            wl.now = t;
+        }
+        switch (ev) {
+        case 0:
+            t0 = nsnow();
+            risc_tick();
+            wl.next_tick += cfg.period_ns;
+            wl.st.fpga_ns += nsnow() - t0;
+            break;
+        case 1:
+            t0 = nsnow();
+            if (fpga_rx(&wl.h2f.f[wl.h2f.head])) {
+                wl.h2f.head = (wl.h2f.head + 1) % WL_WIRE;
+            } else {
+                wl.stalled = 1;
+            }
+            wl.st.fpga_ns += nsnow() - t0;
+            break;
+        case 2:
+            host_rx(&wl.f2h.f[wl.f2h.head]);
+            wl.f2h.head = (wl.f2h.head + 1) % WL_WIRE;
+            break;
+        case 3:
+            host_resend();
+            break;
+        }
+    }
+    if (to > wl.now) {
+        wl.now = to;
+    }
+}
+
+/* send what the window has room for */
+static void host_send(void)
+{
+    wl_frame_t *f;
+    int n;
+
+    while (wl.pend_n > 0 && (uint8_t) (wl.next - wl.base) < cfg.window) {
+        n = wl.pend_len[wl.pend_head];
+        f = &wl.win[wl.next];
+        f->buf[WL_HEAD] = WL_TYP_WOUF;
+        f->buf[WL_HEAD + 1] = wl.next;
+        f->buf[WL_HEAD + 2] = 2;        // PLOAD_SIZE_RX: nothing to read
+        memcpy(f->buf + WL_HEAD + 3, wl.pend[wl.pend_head], n);
+        frame_seal(f, 3 + n);
+        if (wl.base == wl.next) {
+            wl.timer = wl.now;
+        }
+        wire_send(&wl.h2f, f);
+        wl.next++;
+        wl.pend_head = (wl.pend_head + 1) % WL_PEND;
+        wl.pend_n--;
+    }
+}
+
+/* the frame being filled goes behind the others */
+static void host_close(void)
+{
+    if (wl.cur_len == 0) {
+        return;
+    }
+    while (wl.pend_n == WL_PEND) {
+        link_run(wl.now + cfg.poll_ns);
+        host_send();
+    }
+    memcpy(wl.pend[wl.pend_tail], wl.cur, wl.cur_len);
+    wl.pend_len[wl.pend_tail] = wl.cur_len;
+    wl.pend_tail = (wl.pend_tail + 1) % WL_PEND;
+    wl.pend_n++;
+    wl.cur_len = 0;
+}
+
+static int wou_pack(uint8_t *buf, const uint8_t type, const uint16_t addr,
+                    const uint8_t size, const uint8_t *data)
+{
+    int n = WL_WOU_HEAD;
+
+    buf[0] = (size & 0x7F) | ((type == WB_WR_CMD) ? 0x80 : 0);
+    buf[1] = addr & 0xFF;
+    buf[2] = addr >> 8;
+    if (type == WB_WR_CMD) {
+        memcpy(buf + WL_WOU_HEAD, data, size);
+        n += size;
+        wl.st.tx_payload += size;
+    }
+    return n;
+}
+
+/************************************************************************
+ * libwou                                                               *
+ ************************************************************************/
+static void env_long(const char *name, long *v, long scale)
+{
+    const char *s = getenv(name);
+
+    if (s && *s) {
+        *v = atol(s) * scale;
+    }
+}
+
+void wou_loop_defaults(wou_loop_config_t *c)
+{
+    long v;
+
+    c->period_ns = 655360;
+    c->latency_ns = 250000;
+    c->byte_ns = 100;
+    c->poll_ns = 10000;
+    c->timeout_ns = 2000000;
+    c->window = 32;
+    c->loss_ppm = 0;
+    c->crc_ppm = 0;
+    c->sfifo_words = 1024;
+    c->mail_ticks = 1;
+    c->seed = 1;
+
+    env_long("WOU_LOOP_PERIOD", &c->period_ns, 1);
+    env_long("WOU_LOOP_LATENCY", &c->latency_ns, 1000);
+    env_long("WOU_LOOP_TIMEOUT", &c->timeout_ns, 1000);
+    v = c->window;
+    env_long("WOU_LOOP_WINDOW", &v, 1);
+    c->window = v;
+    v = c->loss_ppm;
+    env_long("WOU_LOOP_LOSS", &v, 1);
+    c->loss_ppm = v;
+    v = c->crc_ppm;
+    env_long("WOU_LOOP_CRC", &v, 1);
+    c->crc_ppm = v;
+}
+
+void wou_loop_config(const wou_loop_config_t *c)
+{
+    cfg = *c;
+    configured = 1;
+}
+
+void wou_loop_stats(wou_loop_stats_t *stats)
+{
+    *stats = wl.st;
+    stats->link_ns = wl.now;
+}
+
+int wou_loop_idle(void)
+{
+    return wl.cur_len == 0 && wl.pend_n == 0 && wl.base == wl.next
+        && wl.h2f.head == wl.h2f.tail && wl.sf_n == 0;
+}
+
+int wou_init(wou_param_t *w_param, const char *device_type,
+             int device_id, const char *bitfile)
+{
+    if (!configured) {
+        wou_loop_defaults(&cfg);
+        configured = 1;
+    }
+    if (cfg.window < 1 || cfg.window > 127) {
+        cfg.window = 32;
+    }
+    if (cfg.sfifo_words < 1 || cfg.sfifo_words > WL_SFIFO_MAX) {
+        cfg.sfifo_words = WL_SFIFO_MAX;
+    }
+    if (cfg.mail_ticks < 1) {
+        cfg.mail_ticks = 1;
+    }
+    memset(&wl, 0, sizeof(wl));
+    wl.rnd = cfg.seed ? cfg.seed : 1;
+    wl.next_tick = cfg.period_ns;
+    crc16_init();
+    fprintf(stderr, "wou_loop: emulating %s, latency %ldus, window %d, "
+            "loss %dppm, crc errors %dppm\n", device_type ? device_type : "",
+            cfg.latency_ns / 1000, cfg.window, cfg.loss_ppm, cfg.crc_ppm);
+    return 0;
+}
+
+int wou_connect(wou_param_t *w_param)
+{
+    wl_frame_t f;
+
+    f.buf[WL_HEAD] = WL_RST_TID;
+    f.buf[WL_HEAD + 1] = 0;
+    frame_seal(&f, 2);
+    wire_send(&wl.h2f, &f);
+    wl.base = wl.next = 0;
+    return 0;
+}
+
+int wou_prog_risc(wou_param_t *w_param, const char *binfile)
+{
+    // the emulated RISC needs no program
+    return 0;
+}
+
+void wou_set_mbox_cb(wou_param_t *w_param, void (*callback)(const uint8_t *))
+{
+    wl.mbox_cb = callback;
+}
+
+void wou_set_crc_error_cb(wou_param_t *w_param, void (*callback)(int32_t))
+{
+    wl.crc_error_cb = callback;
+}
+
+void wou_set_rt_cmd_cb(wou_param_t *w_param, void (*callback)(void))
+{
+    wl.rt_cmd_cb = callback;
+}
+
+void wou_cmd(wou_param_t *w_param, const uint8_t type, const uint16_t addr,
+             const uint8_t size, const uint8_t *buf)
+{
+    if (wl.cur_len + WL_WOU_HEAD + size > WL_WOU_MAX) {
+        host_close();
+    }
+    wl.cur_len += wou_pack(wl.cur + wl.cur_len, type, addr, size, buf);
+}
+
+int wou_flush(wou_param_t *w_param)
+{
+    host_close();
+    link_run(wl.now);
+    host_send();
+    if (wl.pend_n > 0) {
+        // the window is full; the host waits a while for the acks
+        wl.st.window_full++;
+        link_run(wl.now + cfg.poll_ns);
+        return -1;
+    }
+    return 0;
+}
+
+void rt_wou_cmd(wou_param_t *w_param, const uint8_t type, const uint16_t addr,
+                const uint8_t size, const uint8_t *buf)
+{
+    if (wl.rt_len + WL_WOU_HEAD + size > WL_WOU_MAX) {
+        rt_wou_flush(w_param);
+    }
+    wl.rt_len += wou_pack(wl.rt + wl.rt_len, type, addr, size, buf);
+}
+
+int rt_wou_flush(wou_param_t *w_param)
+{
+    wl_frame_t f;
+
+    if (wl.rt_len == 0) {
+        return 0;
+    }
+    // no TID and no ack: lost REALTIME frames stay lost
+    f.buf[WL_HEAD] = WL_REALTIME;
+    f.buf[WL_HEAD + 1] = 2;             // PLOAD_SIZE_RX
+    memcpy(f.buf + WL_HEAD + 2, wl.rt, wl.rt_len);
+    frame_seal(&f, 2 + wl.rt_len);
+    wire_send(&wl.h2f, &f);
+    wl.rt_len = 0;
+    return 0;
+}
+
+void wou_update(wou_param_t *w_param)
+{
+    if (wl.rt_cmd_cb) {
+        wl.rt_cmd_cb();
+    }
+    link_run(wl.now + cfg.period_ns);
+    while (wl.mail_n > 0) {
+        if (wl.mbox_cb) {
+            wl.mbox_cb((const uint8_t *) wl.mail[wl.mail_head]);
+        }
+        wl.mail_head = (wl.mail_head + 1) % WL_MAILS;
+        wl.mail_n--;
+    }
+    if (wl.crc_error_cb && wl.crc_count != wl.crc_told) {
+        wl.crc_told = wl.crc_count;
+        wl.crc_error_cb(wl.crc_count);
+    }
+}
+
+void wou_status(wou_param_t *w_param)
+{
+    wou_loop_stats_t *s = &wl.st;
+
+    fprintf(stderr, "wou_loop: tick %llu, tx %llu frames %llu bytes, "
+            "rx %llu frames %llu bytes, retransmits %llu, lost %llu, "
+            "crc errors %llu, sfifo stalls %llu, underruns %llu\n",
+            (unsigned long long) s->ticks,
+            (unsigned long long) s->tx_frames,
+            (unsigned long long) s->tx_bytes,
+            (unsigned long long) s->rx_frames,
+            (unsigned long long) s->rx_bytes,
+            (unsigned long long) s->retransmits,
+            (unsigned long long) s->lost,
+            (unsigned long long) s->crc_errors,
+            (unsigned long long) s->sfifo_stalls,
+            (unsigned long long) s->underruns);
+}
@@ -0,0 +1,71 @@
+/********************************************************************
+ * Description:  wou_loop.h
+ *               A loopback emulator of the WOU FPGA endpoint, for
+ *               running wou_stepgen (as the wou_sim module) and
+ *               wou_bench without the USB board.
+ *
+ *               wou_loop.c implements the libwou calls used by
+ *               wou_stepgen.  The frames of WOU_PROTOCOL (preamble,
+ *               TID, GO-BACK-N ARQ, CRC-16, MAILBOX) go over an
+ *               emulated wire with configurable latency, loss and CRC
+ *               errors to an emulated FPGA, whose RISC consumes the
+ *               SFIFO once per base period and mails MT_MOTION_STATUS
+ *               back.  Time is virtual: it moves by one base period per
+ *               wou_update(), and by poll_ns per wou_flush() that finds
+ *               the window full.
+ *
+ * License: GPL Version 2
+ *
+ * Copyright (c) 2014 All rights reserved.
+ *
+ * Last change:
+ ********************************************************************/
+#ifndef __wou_loop_h__
+#define __wou_loop_h__
+
+#include <stdint.h>
+
+typedef struct {
+    long period_ns;     // FPGA base period, one per wou_update()
+    long latency_ns;    // one way, USB and FPGA turn around
+    long byte_ns;       // wire time of one byte
+    long poll_ns;       // host time spent in a wou_flush() returning -1
+    long timeout_ns;    // GO-BACK-N retransmit timeout
+    int window;         // TYP_WOUF frames in flight, 1 ~ 127
+    int loss_ppm;       // frames lost, per million, both directions
+    int crc_ppm;        // frames corrupted, per million, both directions
+    int sfifo_words;    // SFIFO depth, in SYNC commands
+    int mail_ticks;     // MT_MOTION_STATUS every so many base periods
+    uint32_t seed;      // for loss and CRC errors
+} wou_loop_config_t;
+
+typedef struct {
+    uint64_t tx_frames;     // host to FPGA, retransmits included
+    uint64_t tx_bytes;      // on the wire, preamble to CRC-16
+    uint64_t tx_payload;    // DATA bytes of WB_WR_CMD packets
+    uint64_t rx_frames;     // FPGA to host
+    uint64_t rx_bytes;
+    uint64_t rx_payload;    // MAIL_PAYLOAD bytes
+    uint64_t retransmits;   // frames sent again by GO-BACK-N
+    uint64_t lost;          // frames dropped on the wire
+    uint64_t crc_errors;    // frames dropped for their CRC-16
+    uint64_t out_of_order;  // TYP_WOUF frames the FPGA dropped for their TID
+    uint64_t window_full;   // wou_flush() calls returning -1
+    uint64_t sfifo_words;   // SYNC commands the RISC consumed
+    uint64_t sfifo_stalls;  // base periods a full SFIFO held a frame
+    uint64_t underruns;     // base periods without a whole period of SYNC commands
+    uint64_t mails_dropped; // mails not taken by wou_update() in time
+    uint64_t ticks;         // base periods, the FPGA bp_tick
+    int64_t fpga_ns;        // time spent emulating the FPGA
+    int64_t link_ns;        // virtual time of the link
+} wou_loop_stats_t;
+
+/* the defaults, overridden by WOU_LOOP_* in the environment */
+extern void wou_loop_defaults(wou_loop_config_t *cfg);
+/* use @cfg instead; call before wou_init() */
+extern void wou_loop_config(const wou_loop_config_t *cfg);
+extern void wou_loop_stats(wou_loop_stats_t *stats);
+/* nonzero when every command sent has been consumed by the RISC */
+extern int wou_loop_idle(void);
+
+#endif // __wou_loop_h__
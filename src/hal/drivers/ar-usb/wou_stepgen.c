@@ -39,6 +39,7 @@
 #include <wb_regs.h>
 #include <mailtag.h>
 #include "sync_cmd.h"
+#include "wou_codec.h"
 
 #define REQUEST_TICK_SYNC_AFTER 500 // after 500 tick count, request risc to sync tick count
 #define MAX_CHAN 8
@@ -51,12 +52,7 @@
 #define PID_LOOP 8
 #define SON_DELAY_TICK  1500
 
-// to disable DP(): #define TRACE 0
-#define TRACE 0
-#include "dptrace.h"
-#if (TRACE!=0)
-static FILE *dptrace;
-#endif
+#include "dptrace_ring.h"
 
 // to disable MAILBOX dump: #define MBOX_LOG 0
 #define MBOX_LOG 0
@@ -123,6 +119,15 @@ RTAPI_MP_INT(alarm_en, "hardware alarm dection mode");
 int servo_period_ns = -1;   // init to '-1' for testing valid parameter value
 RTAPI_MP_INT(servo_period_ns, "used for calculating new velocity command, unit: ns");
 
+int prebuf = 0;
+RTAPI_MP_INT(prebuf, "servo periods of SFIFO commands to hold on the host while USB is busy, 0 to pause motion instead");
+
+int pack_jnt = 0;
+RTAPI_MP_INT(pack_jnt, "send joint commands as SYNC_PJNT records (the RISC program must know them), 0 for SYNC_JNT words");
+
+int mbox_async = 0;
+RTAPI_MP_INT(mbox_async, "decode GPIO, ADC and debug mails in wou.mbox.decode (addf it to a slower thread), 0 to decode them in update-freq");
+
 # define GPIO_IN_NUM    80
 # define GPIO_OUT_NUM   32
 
@@ -316,6 +321,7 @@ typedef struct {
 typedef struct {
     hal_bit_t   *usb_busy;
     hal_bit_t   usb_busy_s;
+    hal_u32_t   *prebuf_periods;   /* servo periods waiting in sfifo */
     hal_bit_t   *ignore_ahc_limit;
     int32_t     prev_vel_sync;
     hal_float_t *vel_sync_scale;
@@ -422,6 +428,8 @@ static machine_control_t *machine_control;
 
 /* other globals */
 static int comp_id;		/* component ID */
+static dpt_ring_t *trace;	/* binary trace ring, see dptrace_ring.h */
+static int trace_shmem_id = -1;
 static int num_joints = 0;	/* number of step generators configured */
 static double dt;		/* update_freq period in seconds */
 static double recip_dt;		/* reciprocal of period, avoids divides */
@@ -442,6 +450,142 @@ void endian_swap(uint32_t  *x)
     *x = (*x>>24) | ((*x<<8) & 0x00FF0000) |((*x>>8) & 0x0000FF00) |(*x<<24);
 }
 
+/**
+ * Mailbox decode.
+ * fetchmail() runs in update_freq(), under wou_update().  It decodes
+ * only what the servo period needs at once (see wou_mail_fast()) into
+ * the HAL pins, and hands the mail to wou_mbox_put() for the rest.
+ * With mbox_async=1, the wou.mbox.decode function, added to a lower
+ * priority thread, decodes those; update_freq() copies the newest
+ * values to the HAL pins, so its time does not depend on the mails.
+ * With mbox_async=0, fetchmail() decodes them itself.
+ **/
+static wou_mbox_t mbox;
+static wou_mail_t mail;
+static uint32_t mbox_dropped_seen;
+static uint32_t mbox_bad_seen;
+
+#if (MBOX_LOG)
+static void mbox_log(const uint8_t *buf_head)
+{
+    wou_mbox_vals_t v;
+    const uint32_t *p;
+    stepgen_t   *stepgen;
+    char        dmsg[1024];
+    int         dsize;
+    int         i;
+
+    wou_mail_slow(buf_head, num_joints, &v);
+    dsize = sprintf (dmsg, "%10d  ", *(uint32_t *) (buf_head + 4));  // #0
+    stepgen = stepgen_array;
+    for (i=0; i<num_joints; i++) {
+        dsize += sprintf (dmsg + dsize, "%10d %10d %10d  ",
+                *(stepgen->pulse_pos),
+                *(stepgen->enc_pos),
+                *(stepgen->cmd_fbs)
+        );
+        stepgen += 1;   // point to next joint
+    }
+    dsize += sprintf (dmsg + dsize, "0x%04X 0x%04X 0x%04X", // #21 #22 #23
+            v.din[0],
+            v.din[1],
+            v.dout0);
+    dsize += sprintf (dmsg + dsize, "  %10d", v.adc[0]); // #24
+
+    // number of debug words: to match "send_joint_status() at common.c
+    // they follow BP_TICK, the joints and 17 status words
+    p = (const uint32_t *) (buf_head + 4) + 4 * num_joints + 17;
+    for (i=0; i<MBOX_DEBUG_VARS; i++) {
+        p += 1;
+        dsize += sprintf (dmsg + dsize, "%10d ", *p);
+    }
+    assert (dsize < 1023);
+    fprintf (mbox_fp, "%s\n", dmsg);
+}
+#endif
+
+/* errors of the mails decoded since the last call */
+static void mbox_report(void)
+{
+    uint32_t n;
+
+    n = mbox.bad_tags;
+    if (n != mbox_bad_seen) {
+        rtapi_print_msg(RTAPI_MSG_ERR,
+                "WOU: ERROR: unknown mail tag (%d)\n", mbox.bad_tag);
+        mbox_bad_seen = n;
+    }
+    n = mbox.ring.dropped;
+    if (n != mbox_dropped_seen) {
+        rtapi_print_msg(RTAPI_MSG_ERR,
+                "WOU: ERROR: %u mails dropped, wou.mbox.decode runs too seldom\n",
+                n - mbox_dropped_seen);
+        mbox_dropped_seen = n;
+    }
+}
+
+/* copy the newest decoded mail values to the HAL pins */
+static void mbox_apply(void)
+{
+    wou_mbox_vals_t snap, *v = &snap;
+    int i;
+
+    if (!wou_mbox_read(&mbox, v)) {
+        return;
+    }
+
+    *machine_control->dout0 = v->dout0;
+    for (i = 0; i < 16; i++) {
+        *(analog->in[i]) = v->adc[i];
+    }
+    *(machine_control->mpg_count) = v->mpg_count;
+    *(machine_control->max_tick_time) = v->max_tick_time;
+    for (i = 0; i < 8; i++) {
+        *machine_control->debug[i] = v->debug[i];
+    }
+
+    // update gpio_in[31:0]
+    // compare if there's any GPIO.DIN bit got toggled
+    if (machine_control->prev_in0 != v->din[0]) {
+        // avoid for-loop to save CPU cycles
+        machine_control->prev_in0 = v->din[0];
+        for (i = 0; i < 32; i++) {
+            *(machine_control->in[i]) = ((machine_control->prev_in0) >> i) & 0x01;
+            *(machine_control->in_n[i]) = (~(*(machine_control->in[i]))) & 0x01;
+        }
+    }
+
+    // update gpio_in[63:32]
+    // compare if there's any GPIO.DIN bit got toggled
+    if (machine_control->prev_in1 != v->din[1]) {
+        // avoid for-loop to save CPU cycles
+        machine_control->prev_in1 = v->din[1];
+        for (i = 32; i < 64; i++) {
+            *(machine_control->in[i]) = ((machine_control->prev_in1) >> (i-32)) & 0x01;
+            *(machine_control->in_n[i]) = (~(*(machine_control->in[i]))) & 0x01;
+        }
+    }
+
+    // update gpio_in[79:64]
+    // compare if there's any GPIO.DIN bit got toggled
+    if (machine_control->prev_in2 != v->din[2]) {
+        // avoid for-loop to save CPU cycles
+        machine_control->prev_in2 = v->din[2];
+        for (i = 64; i < 80; i++) {
+            *(machine_control->in[i]) = ((machine_control->prev_in2) >> (i-64)) & 0x01;
+            *(machine_control->in_n[i]) = (~(*(machine_control->in[i]))) & 0x01;
+        }
+    }
+}
+
+/* HAL function wou.mbox.decode: decode the mails fetchmail() queued */
+static void mbox_decode(void *arg, long period)
+{
+    if (wou_mbox_decode(&mbox) > 0) {
+        mbox_report();
+    }
+}
+
 /************************************************************************
  * callback functions for libwou                                        *
  ************************************************************************/
@@ -453,227 +597,116 @@ static void get_crc_error_counter(int32_t crc_error_counter)
 
 static void fetchmail(const uint8_t *buf_head)
 {
-    // char        *buf_head;
     int         i;
-    uint16_t    mail_tag;
-    uint32_t    *p, din[3]; //, dout[1];
-    uint8_t     *buf;
     stepgen_t   *stepgen;
-    uint32_t    bp_tick;    // served as previous-bp-tick
-    uint32_t    machine_status;
-    uint32_t    joints_vel;
-#if (MBOX_LOG)
-    char        dmsg[1024];
-    int         dsize;
-#elif (DEBUG_LOG)
-    char        dmsg[1024];
-    int         dsize;
-#endif
-
-    // buf_head = (char *) wou_mbox_ptr (&w_param);
-    memcpy(&mail_tag, (buf_head + 2), sizeof(uint16_t));
+    int32_t     joints_vel;
 
-    // BP_TICK
-    p = (uint32_t *) (buf_head + 4);
-    bp_tick = *p;
-    *machine_control->bp_tick = bp_tick;
+    wou_mail_fast(buf_head, num_joints, &mail);
+    *machine_control->bp_tick = mail.bp_tick;
 
-    switch(mail_tag)
+    switch(mail.tag)
     {
     case MT_MOTION_STATUS:
         /* for PLASMA with ADC_SPI */
-        //redundant: p = (uint32_t *) (buf_head + 4); // BP_TICK
         stepgen = stepgen_array;
         joints_vel = 0;
         for (i=0; i<num_joints; i++) {
-            p += 1;
-            *(stepgen->pulse_pos) = (int32_t)*p;
-            p += 1;
-            *(stepgen->enc_pos) = (int32_t)*p;
-            p += 1;
-            *(stepgen->cmd_fbs) = (int32_t)*p;
-            p += 1;
-            *(stepgen->enc_vel_p)  = (int32_t)*p; // encoder velocity in pulses per servo-period
-            joints_vel |= *(stepgen->enc_vel_p);
+            *(stepgen->pulse_pos) = mail.pulse_pos[i];
+            *(stepgen->enc_pos) = mail.enc_pos[i];
+            *(stepgen->cmd_fbs) = mail.cmd_fbs[i];
+            *(stepgen->enc_vel_p) = mail.enc_vel_p[i]; // encoder velocity in pulses per servo-period
+            joints_vel |= mail.enc_vel_p[i];
+            *stepgen->ferror_flag = mail.machine_status & (1 << i);
             stepgen += 1;   // point to next joint
         }
         *machine_control->machine_moving = (joints_vel != 0);
-
-        // digital input
-        p += 1;
-        din[0] = *p;
-        p += 1;
-        din[1] = *p;
-        p += 1;
-        din[2] = *p;
-        // digital output
-        p += 1;
-        *machine_control->dout0 = *p;
-
-        // update gpio_in[31:0]
-        // compare if there's any GPIO.DIN bit got toggled
-        if (machine_control->prev_in0 != din[0]) {
-            // avoid for-loop to save CPU cycles
-            machine_control->prev_in0 = din[0];
-            for (i = 0; i < 32; i++) {
-                *(machine_control->in[i]) = ((machine_control->prev_in0) >> i) & 0x01;
-                *(machine_control->in_n[i]) = (~(*(machine_control->in[i]))) & 0x01;
-            }
-        }
-
-        // update gpio_in[63:32]
-        // compare if there's any GPIO.DIN bit got toggled
-        if (machine_control->prev_in1 != din[1]) {
-            // avoid for-loop to save CPU cycles
-            machine_control->prev_in1 = din[1];
-            for (i = 32; i < 64; i++) {
-                *(machine_control->in[i]) = ((machine_control->prev_in1) >> (i-32)) & 0x01;
-                *(machine_control->in_n[i]) = (~(*(machine_control->in[i]))) & 0x01;
-            }
-        }
-
-        // update gpio_in[79:64]
-        // compare if there's any GPIO.DIN bit got toggled
-        if (machine_control->prev_in2 != din[2]) {
-            // avoid for-loop to save CPU cycles
-            machine_control->prev_in2 = din[2];
-            for (i = 64; i < 80; i++) {
-                *(machine_control->in[i]) = ((machine_control->prev_in2) >> (i-64)) & 0x01;
-                *(machine_control->in_n[i]) = (~(*(machine_control->in[i]))) & 0x01;
-            }
-        }
-
-        // copy 16 channel of 16-bit ADC value
-        p += 1;
-        buf = (uint8_t*)p;
-        for (i=0; i<8; i++) {
-            *(analog->in[i*2]) = *(((uint16_t*)buf)+i*2+1);
-            *(analog->in[i*2+1]) = *(((uint16_t*)buf)+i*2);
-        }
-
-        // MPG
-        p += 8; // skip 16ch of 16-bit ADC value
-        *(machine_control->mpg_count) = *p;
-        // the MPG on my hand is 1-click for a full-AB-phase-wave.
-        // therefore the mpg_count will increase by 4.
-        // divide it by 4 for smooth jogging.
-        // otherwise, there will be 4 units of motions for every MPG click.
-        *(machine_control->mpg_count) >>= 2;
-        p += 1;
-        machine_status = *p;
-        stepgen = stepgen_array;
-        for (i=0; i<num_joints; i++) {
-            *stepgen->ferror_flag = machine_status & (1 << i);
-            stepgen += 1;   // point to next joint
-        }
-        *machine_control->probe_result = (machine_status >> PROBE_RESULT_BIT) & 1;
-        *machine_control->ahc_doing = (machine_status >> AHC_DOING_BIT) & 1;
-
-        p += 1;
-        *(machine_control->max_tick_time) = *p;
-
-        p += 1;
-        *machine_control->rcmd_state = *p;
-
+        *machine_control->probe_result = (mail.machine_status >> PROBE_RESULT_BIT) & 1;
+        *machine_control->ahc_doing = (mail.machine_status >> AHC_DOING_BIT) & 1;
+        *machine_control->rcmd_state = mail.rcmd_state;
 #if (MBOX_LOG)
-        dsize = sprintf (dmsg, "%10d  ", bp_tick);  // #0
-        // fprintf (mbox_fp, "%10d  ", bp_tick);
-        stepgen = stepgen_array;
-        for (i=0; i<num_joints; i++) {
-            dsize += sprintf (dmsg + dsize, "%10d %10d %10d  ",
-                    *(stepgen->pulse_pos),
-                    *(stepgen->enc_pos),
-                    *(stepgen->joint_cmd)
-            );
-            stepgen += 1;   // point to next joint
-        }
-        dsize += sprintf (dmsg + dsize, "0x%04X 0x%04X 0x%04X", // #21 #22 #23
-                din[0],
-                din[1],
-                dout[0]);
-        dsize += sprintf (dmsg + dsize, "  %10d 0x%04X", *(analog->in[0]), ferror_flag); // #24 #25
-
-
-        // number of debug words: to match "send_joint_status() at common.c
-        for (i=0; i<MBOX_DEBUG_VARS; i++) {
-            p += 1;
-            dsize += sprintf (dmsg + dsize, "%10d ", *p);
-        }
-        assert (dsize < 1023);
-        fprintf (mbox_fp, "%s\n", dmsg);
+        mbox_log(buf_head);
 #endif
         break;
 
-    case MT_ERROR_CODE:
-        // error code
-        p = (uint32_t *) (buf_head + 4);    // prev_bp_tick - bp_offset
-        p += 1;
-        bp_tick = *p;                      
-        p += 1;
-//        printf ("MT_ERROR_CODE: code(%d) bp_tick(%d) \n", *p, bp_tick);
-        break;
-
-    case MT_DEBUG:
-        p = (uint32_t *) (buf_head + 4);
-        bp_tick = *p;
-        for (i=0; i<8; i++) {
-            p += 1;
-            *machine_control->debug[i] = *p;
-        }
-        break;
-
     case MT_RISC_CMD:
-        p = (uint32_t *) (buf_head + 8);
-        *machine_control->rcmd_state = *p;
-        if (*p == RCMD_UPDATE_POS_REQ)
+        *machine_control->rcmd_state = mail.rcmd_state;
+        if (mail.rcmd_state == RCMD_UPDATE_POS_REQ)
         {
             // SET update_pos_req here
             // will RESET it after sending a RCMD_UPDATE_POS_ACK packet
             *machine_control->update_pos_req = 1;
-            p += 1;
-            *machine_control->rcmd_seq_num_req = *p;
+            *machine_control->rcmd_seq_num_req = mail.rcmd_seq_num;
         }
-        DP("update_pos_req(%d) rcmd_seq_num_req(%d) rcmd_state(%d)\n", *machine_control->update_pos_req, *machine_control->rcmd_seq_num_req, *machine_control->rcmd_state);
+        DPT(trace, DPT_WOU_RCMD, *machine_control->rcmd_state,
+            *machine_control->update_pos_req,
+            *machine_control->rcmd_seq_num_req, 0, 0);
         break;
 
     case MT_PROBED_POS:
         stepgen = stepgen_array;
-        p = (uint32_t *) (buf_head + 4);
         for (i=0; i<num_joints; i++) {
-            p += 1;
-            *(stepgen->probed_pos) = (double) ((int32_t)*p) * (stepgen->scale_recip);
+            *(stepgen->probed_pos) = (double) mail.probed_pos[i] * (stepgen->scale_recip);
 //            printf("joint[%d] probed_pos(%f)\n", i, *(stepgen->probed_pos));
             stepgen += 1;   // point to next joint
         }
-        p += 1;
-        *machine_control->trigger_result = ((uint8_t)*p);
+        *machine_control->trigger_result = mail.trigger_result;
         break;
 
     default:
-        fprintf(stderr, "ERROR: wou_stepgen.c unknown mail tag (%d)\n", mail_tag);
         break;
     }
+
+    wou_mbox_put(&mbox, buf_head);
+    if (!mbox_async) {
+        mbox_report();
+    }
 }
 
-static void write_mot_param (uint32_t joint, uint32_t addr, int32_t data)
+/**
+ * Host side prebuffer for the SFIFO command stream (see wou_codec.h).
+ * With prebuf > 0, update_freq() does not pause motion as soon as
+ * wou_flush() returns -1 (the GO-BACK-N window to the FPGA is full):
+ * the periods that could not be sent wait in sfifo.  Motion is paused
+ * (usb-busy) only when prebuf periods are already waiting.
+ **/
+static wou_sfifo_t sfifo;
+
+/**
+ * Batched parameter upload for rtapi_app_main().  Between
+ * param_batch_begin() and param_batch_end(), write_mot_param() and
+ * write_machine_param() only queue their SYNC_DATA and SYNC_*_PARAM
+ * words in sfifo.  param_batch_end() hands them to libwou packed
+ * into MAX_DSIZE sized WB_WR_CMDs and waits once for WOU to take them
+ * all, instead of a round trip for every value.
+ **/
+static int param_values;        /* values queued since param_batch_begin() */
+static long long param_start;
+
+static void param_batch_begin(void)
 {
-    uint16_t    sync_cmd;
-    uint8_t     buf[MAX_DSIZE];
-    int         j;
+    sfifo.hold = 1;
+    param_values = 0;
+    param_start = rtapi_get_time();
+}
 
-    for(j=0; j<sizeof(int32_t); j++) {
-        sync_cmd = SYNC_DATA | ((uint8_t *)&data)[j];
-        memcpy(buf, &sync_cmd, sizeof(uint16_t));
-        wou_cmd(&w_param, WB_WR_CMD, (uint16_t) (JCMD_BASE | JCMD_SYNC_CMD),
-                sizeof(uint16_t), buf);
-    }
+static void param_batch_end(const char *what)
+{
+    while (wou_sfifo_drain(&sfifo) == -1);
+    sfifo.hold = 0;
+    rtapi_print_msg(RTAPI_MSG_INFO,
+            "WOU: %d %s uploaded in %lld us\n", param_values, what,
+            (rtapi_get_time() - param_start) / 1000);
+}
 
-    sync_cmd = SYNC_MOT_PARAM | PACK_MOT_PARAM_ADDR(addr) | PACK_MOT_PARAM_ID(joint);
-    memcpy(buf, &sync_cmd, sizeof(uint16_t));
-    wou_cmd(&w_param, WB_WR_CMD, (uint16_t) (JCMD_BASE | JCMD_SYNC_CMD),
-            sizeof(uint16_t), buf);
-    while(wou_flush(&w_param) == -1);
-    DP ("end of SYNC_MOT_PARAM_CMD\n");
+/* the previous delta the RISC keeps for each joint, for pack_jnt */
+static int32_t pack_prev[MAX_CHAN];
+
+static void write_mot_param (uint32_t joint, uint32_t addr, int32_t data)
+{
+    wou_sfifo_value(&sfifo, SYNC_MOT_PARAM | PACK_MOT_PARAM_ADDR(addr)
+                    | PACK_MOT_PARAM_ID(joint), data);
+    param_values++;
+    wou_sfifo_wait(&sfifo);
 
     return;
 }
@@ -688,37 +721,23 @@ static void send_sync_cmd (uint16_t sync_cmd, uint32_t *data, uint32_t size)
     {
         for(j=0; j<sizeof(int32_t); j++) {
             buf = SYNC_DATA | ((uint8_t *)data)[j];
-            wou_cmd(&w_param, WB_WR_CMD, (uint16_t) (JCMD_BASE | JCMD_SYNC_CMD), sizeof(uint16_t), (const uint8_t *)&buf);
+            wou_sfifo_put(&sfifo, &buf, 1);
         }
         data++;
     }
 
-    wou_cmd(&w_param, WB_WR_CMD, (uint16_t) (JCMD_BASE | JCMD_SYNC_CMD), sizeof(uint16_t), (const uint8_t *)&sync_cmd);
-    while(wou_flush(&w_param) == -1);   // wait until all those WB_WR_CMDs are accepted by WOU
-    DP ("end of send_sync_cmd\n");
+    wou_sfifo_put(&sfifo, &sync_cmd, 1);
+    wou_sfifo_wait(&sfifo);   // wait until all those WB_WR_CMDs are accepted by WOU
 
     return;
 }
 
 static void write_machine_param (uint32_t addr, int32_t data)
 {
-    uint16_t    sync_cmd;
-    uint8_t     buf[MAX_DSIZE];
-    int         j;
+    wou_sfifo_value(&sfifo, SYNC_MACH_PARAM | PACK_MACH_PARAM_ADDR(addr), data);
+    param_values++;
 
-    for(j=0; j<sizeof(int32_t); j++) {
-        sync_cmd = SYNC_DATA | ((uint8_t *)&data)[j];
-        memcpy(buf, &sync_cmd, sizeof(uint16_t));
-        wou_cmd(&w_param, WB_WR_CMD, (uint16_t) (JCMD_BASE | JCMD_SYNC_CMD),
-                sizeof(uint16_t), buf);
-    }
-    sync_cmd = SYNC_MACH_PARAM | PACK_MACH_PARAM_ADDR(addr);
-    memcpy(buf, &sync_cmd, sizeof(uint16_t));
-    wou_cmd(&w_param, WB_WR_CMD, (uint16_t) (JCMD_BASE | JCMD_SYNC_CMD),
-            sizeof(uint16_t), buf);
-
-    while(wou_flush(&w_param) == -1);
-    DP ("end of write_machine_param(%u)\n", addr);     // addr(32): MACHINE_CTRL ... updated when accel_state changes
+    wou_sfifo_wait(&sfifo);
     return;
 }
 
@@ -752,17 +771,13 @@ int rtapi_app_main(void)
     } else {
         // initialize FPGA with bitfile(bits)
         wou_init(&w_param, board, wou_id, bits);
+        sfifo.w_param = &w_param;
         if (wou_connect(&w_param) == -1) {
             rtapi_print_msg(RTAPI_MSG_ERR, "WOU: ERROR: Connection failed\n");
             return -1;
         }
     }
 
-#if (TRACE!=0)
-    // initialize file handle for logging wou steps
-    dptrace = fopen("wou_stepgen.log", "w");
-#endif
-
     /* test for risc image file string: bins */
     if ((bins == 0) || (bins[0] == '\0')) {
         rtapi_print_msg(RTAPI_MSG_ERR,
@@ -792,6 +807,8 @@ int rtapi_app_main(void)
         debug_fp = fopen ("./debug.log", "w");
 #endif
         // set mailbox callback function
+        mbox.num_joints = num_joints;
+        mbox.async = mbox_async;
         wou_set_mbox_cb (&w_param, fetchmail);
 
         // set crc counter callback function
@@ -915,6 +932,9 @@ int rtapi_app_main(void)
             (uint16_t) (SSIF_BASE | SSIF_ENC_POL),
             (uint8_t) 1, data);
 
+    // machine parameters go out together, see param_batch_begin()
+    param_batch_begin();
+
     // "set LSP_ID/LSN_ID for up to 8 channels"
     for (n = 0; n < MAX_CHAN && (lsp_id[n][0] != ' ') ; n++) {
         pos_scale = atof(pos_scale_str[n]);
@@ -926,8 +946,6 @@ int rtapi_app_main(void)
             immediate_data = (n << 16) | (lsn << 8) | (lsp);
         }
         write_machine_param(JOINT_LSP_LSN, immediate_data);
-        while(wou_flush(&w_param) == -1);
-
     }
 
     // "set ALR_ID for up to 8 channels"
@@ -941,21 +959,17 @@ int rtapi_app_main(void)
         }
     }
     write_machine_param(ALR_EN_BITS, immediate_data);
-    while(wou_flush(&w_param) == -1);
 
     // configure alarm output (for E-Stop)
     write_machine_param(ALR_OUTPUT, (uint32_t) strtoul(alr_output, NULL, 16));
     fprintf(stderr, "ALR_OUTPUT(%08X)",(uint32_t) strtoul(alr_output, NULL, 16));
-    while(wou_flush(&w_param) == -1);
 
     // config auto height control behavior
     immediate_data = atoi(ahc_ch_str);
     write_machine_param(AHC_ANALOG_CH, immediate_data);
-    while(wou_flush(&w_param) == -1);
     immediate_data = atoi(ahc_joint_str);
     pos_scale = atof(pos_scale_str[immediate_data]);
     write_machine_param(AHC_JNT, immediate_data);
-    while(wou_flush(&w_param) == -1);
 
     if (strcmp(ahc_polarity, "POSITIVE") == 0) {
         if (pos_scale >=0) {
@@ -980,7 +994,6 @@ int rtapi_app_main(void)
         fprintf(stderr, "wou_stepgen.c: non-supported ahc polarity config\n");
         assert(0);
     }
-    while(wou_flush(&w_param) == -1);
 
 
     // config debug pattern
@@ -999,7 +1012,7 @@ int rtapi_app_main(void)
         fprintf(stderr, "wou_stepgen.c: unknow test pattern type (%s)\n", pattern_type_str);
         assert(0);
     }
-    while(wou_flush(&w_param) == -1);
+    param_batch_end("machine parameters");
 
     // Update num_joints while checking pulse_type[]
     assert (num_joints <= 6);  // support up to 6 joints for USB/7i43
@@ -1015,28 +1028,6 @@ int rtapi_app_main(void)
     wou_cmd(&w_param, WB_WR_CMD, SSIF_BASE | SSIF_RST_POS, 1, data);
     while(wou_flush(&w_param) == -1);
 
-#if (TRACE!=0)
-// initialize file handle for logging wou steps
-//     dptrace = fopen("wou_stepgen.log", "w");
-    /* prepare header for gnuplot */
-//    DPS("#%10s  %15s%15s%15s%15s  %15s%15s%15s%15s  %15s%15s%15s%15s  %15s%15s%15s%15s\n",
-//            "dt",
-//            "int_pcmd[0]", "prev_pcmd[0]", "pos_fb[0]", "risc_pos_cmd[0]",
-//            "int_pcmd[1]", "prev_pcmd[1]", "pos_fb[1]", "risc_pos_cmd[1]",
-//            "int_pcmd[2]", "prev_pcmd[2]", "pos_fb[2]", "risc_pos_cmd[2]",
-//            "int_pcmd[3]", "prev_pcmd[3]", "pos_fb[3]", "risc_pos_cmd[3]"
-//    );
-
-    DPS("#%10s", "dt");
-    for (n = 0; n < num_joints; n++)
-    {
-        DPS("      int_pcmd[%d]", n);
-        DPS("     prev_pcmd[%d]", n);
-        DPS("        pos_fb[%d]", n);
-        DPS("  risc_pos_cmd[%d]", n);
-    }
-    DPS("\n");
-#endif
 
     // issue a WOU_WRITE to clear SSIF_RST_POS register
     data[0] = 0x00;
@@ -1054,6 +1045,12 @@ int rtapi_app_main(void)
         recip_dt = 1.0 / dt;
     }
 
+    if (prebuf < 0 || prebuf > WOU_PREBUF_MAX) {
+        rtapi_print_msg(RTAPI_MSG_ERR,
+                "WOU: ERROR: prebuf(%d) must be 0 to %d\n", prebuf, WOU_PREBUF_MAX);
+        return -1;
+    }
+
     // MACHINE_CTRL,   // [31:24]  RESERVED
     //                 // [23:16]  NUM_JOINTS
     //                 // [15: 8]  WORLD(1)/JOINT(0) mode
@@ -1084,6 +1081,13 @@ int rtapi_app_main(void)
         return -1;
     }
 
+    /* tracing is optional, the driver runs without its ring */
+    trace_shmem_id = dpt_open(&trace, DPT_RING_WOU, comp_id);
+    if (trace_shmem_id < 0) {
+        rtapi_print_msg(RTAPI_MSG_WARN,
+                "STEPGEN: no trace ring, dpt_open() returned %d\n", trace_shmem_id);
+    }
+
     /* allocate shared memory for counter data */
     stepgen_array = hal_malloc(num_joints * sizeof(stepgen_t));
     if (stepgen_array == 0) {
@@ -1093,7 +1097,8 @@ int rtapi_app_main(void)
         return -1;
     }
 
-    /* configure motion parameters */
+    /* configure motion parameters, all in one batch with the PID ones */
+    param_batch_begin();
     for(n=0; n<num_joints; n++) {
         /* compute fraction bits */
         // compute proper fraction bit for command
@@ -1112,14 +1117,12 @@ int rtapi_app_main(void)
         assert (enc_scale > 0);
         immediate_data = (uint32_t)(enc_scale * FIXED_POINT_SCALE);
         write_mot_param (n, (ENC_SCALE), immediate_data);
-        while(wou_flush(&w_param) == -1);
 
         /* unit_pulse_scale per servo_period */
         immediate_data = (uint32_t)(FIXED_POINT_SCALE * pos_scale * dt);
         rtapi_print_msg(RTAPI_MSG_DBG, "j[%d] scale(0x%08X)\n", n, immediate_data);
         assert(immediate_data != 0);
         write_mot_param (n, (SCALE), immediate_data);
-        while(wou_flush(&w_param) == -1);
         pos_scale = fabs(pos_scale);    // absolute pos_scale for MAX_VEL/ACCEL calculation
 
         /* config MAX velocity */
@@ -1130,7 +1133,6 @@ int rtapi_app_main(void)
                 n, immediate_data, max_vel, pos_scale, dt, FIXED_POINT_SCALE);
         assert(immediate_data>0);
         write_mot_param (n, (MAX_VELOCITY), immediate_data);
-        while(wou_flush(&w_param) == -1);
         stepgen_array[n].pulse_maxv = immediate_data;
 
         /* config acceleration */
@@ -1141,7 +1143,6 @@ int rtapi_app_main(void)
                 n, immediate_data, max_accel, pos_scale, dt, FIXED_POINT_SCALE);
         assert(immediate_data > 0);
         write_mot_param (n, (MAX_ACCEL), immediate_data);
-        while(wou_flush(&w_param) == -1);
         stepgen_array[n].pulse_maxa = immediate_data;
 
 //        /* config acceleration recip */
@@ -1164,7 +1165,6 @@ int rtapi_app_main(void)
                 n, immediate_data, FIXED_POINT_SCALE, max_jerk, pos_scale, dt);
         assert(immediate_data != 0);
         write_mot_param (n, (MAX_JERK), immediate_data);
-        while(wou_flush(&w_param) == -1);
         stepgen_array[n].pulse_maxj = immediate_data;
 
         /* config max following error */
@@ -1173,7 +1173,6 @@ int rtapi_app_main(void)
         immediate_data = (uint32_t)(ceil(max_following_error * pos_scale));
         rtapi_print_msg(RTAPI_MSG_DBG, "max ferror(%d)\n", immediate_data);
         write_mot_param (n, (MAXFOLLWING_ERR), immediate_data);
-        while(wou_flush(&w_param) == -1);
     }
 
     // config PID parameter
@@ -1196,7 +1195,6 @@ int rtapi_app_main(void)
                 immediate_data = (int32_t) (value);
                 // P_GAIN: the mot_param index for P_GAIN value
                 write_mot_param (n, (P_GAIN + i), immediate_data);
-                while(wou_flush(&w_param) == -1);
                 rtapi_print_msg(RTAPI_MSG_INFO, "pid(%d) = %s (%d)\n",i, pid_str[n][i], immediate_data);
             }
 
@@ -1207,6 +1205,7 @@ int rtapi_app_main(void)
 //            rtapi_print_msg(RTAPI_MSG_INFO, "\n");
         }
     }
+    param_batch_end("motor parameters");
     analog = hal_malloc(sizeof(analog_t));
     if (analog == 0) {
         rtapi_print_msg(RTAPI_MSG_ERR,
@@ -1265,10 +1264,23 @@ int rtapi_app_main(void)
         hal_exit(comp_id);
         return -1;
     }
+    if (mbox_async) {
+        retval = hal_export_funct("wou.mbox.decode", mbox_decode,
+                NULL, 0, 0, comp_id);
+        if (retval != 0) {
+            rtapi_print_msg(RTAPI_MSG_ERR,
+                    "STEPGEN: ERROR: mbox decode funct export failed\n");
+            hal_exit(comp_id);
+            return -1;
+        }
+    }
     rtapi_print_msg(RTAPI_MSG_INFO,
             "STEPGEN: installed %d step pulse generators\n",
             num_joints);
 
+    /* from now on, update_freq() may hold SFIFO commands on the host */
+    sfifo.hold = (prebuf > 0);
+
     /*   restore saved message level*/
     rtapi_set_msg_level(msg);
 
@@ -1278,9 +1290,10 @@ int rtapi_app_main(void)
 
 void rtapi_app_exit(void)
 {
-#if (TRACE!=0)
-    fclose(dptrace);
-#endif
+    if (trace_shmem_id >= 0) {
+        trace = 0;
+        rtapi_shmem_delete(trace_shmem_id, comp_id);
+    }
     hal_exit(comp_id);
 }
 
@@ -1324,13 +1337,11 @@ static void update_freq(void *arg, long period)
 
     uint16_t sync_cmd;
     int32_t wou_pos_cmd, integer_pos_cmd;
+    int32_t jnt_delta[MAX_CHAN];    // 16.16 pulses of this period, for pack_jnt
     uint8_t data[MAX_DSIZE];    // data[]: for wou_cmd()
     uint32_t sync_out_data;
     uint32_t tmp;
     int32_t immediate_data = 0;
-#if (TRACE!=0)
-    static uint32_t _dt = 0;
-#endif
 
     /* FIXME - while this code works just fine, there are a bunch of
        internal variables, many of which hold intermediate results that
@@ -1344,7 +1355,8 @@ static void update_freq(void *arg, long period)
     int msg;
 
     // TODO: confirm trajecotry planning thread is always ahead of wou
-    if (wou_flush(&w_param) == -1) {
+    // with prebuf, keep going while fewer than prebuf periods wait for USB
+    if (wou_sfifo_drain(&sfifo) == -1 && sfifo.periods >= prebuf) {
         // struct timespec time;
 
         // raise flag to pause trajectory planning
@@ -1388,6 +1400,7 @@ static void update_freq(void *arg, long period)
 
     // wou_status (&w_param); // print usb bandwidth utilization
     wou_update(&w_param);   // link to wou_recv()
+    mbox_apply();
 
     /* begin: sending debug pattern */
     if (test_pattern_type != NO_TEST) {
@@ -1453,11 +1466,10 @@ static void update_freq(void *arg, long period)
         uint32_t dbuf[2];
         dbuf[0] = RCMD_UPDATE_POS_ACK;
         dbuf[1] = *machine_control->rcmd_seq_num_req;
-        DP("update_pos_ack");
         send_sync_cmd ((SYNC_USB_CMD | RISC_CMD_TYPE), dbuf, 2);
         // Reset update_pos_req after sending a RCMD_UPDATE_POS_ACK packet
         *machine_control->update_pos_req = 0;
-        DP("update_pos_ack(%d) rcmd_seq_num_ack(%d)\n", *machine_control->update_pos_ack, dbuf[1]);
+        DPT(trace, DPT_WOU_POS_ACK, dbuf[1], 0, 0, 0, 0);
     }
 
     /* begin: handle AHC state, AHC level */
@@ -1498,14 +1510,13 @@ static void update_freq(void *arg, long period)
     if (*(machine_control->sync_in_trigger) != 0) {
         assert(*(machine_control->sync_in_index) >= 0);
         assert(*(machine_control->sync_in_index) < GPIO_IN_NUM);
-        DP("wou_stepgen.c: risc singal wait trigged(input(%d) type (%d))\n",
-                (uint32_t)*machine_control->sync_in_index,
-                (uint32_t)*(machine_control->wait_type));
+        DPT(trace, DPT_WOU_SYNC_IN, *machine_control->sync_in_index,
+            *machine_control->wait_type, 0, 0, 0);
         // begin: trigger sync in and wait timeout
         sync_cmd = SYNC_DIN |
                    PACK_IO_ID((uint32_t)*(machine_control->sync_in_index)) |
                    PACK_DI_TYPE((uint32_t)*(machine_control->wait_type));
-        wou_cmd(&w_param, WB_WR_CMD, (JCMD_BASE | JCMD_SYNC_CMD), sizeof(uint16_t), (uint8_t *) &sync_cmd);
+        wou_sfifo_put(&sfifo, &sync_cmd, 1);
         // end: trigger sync in and wait timeout
         *(machine_control->sync_in_trigger) = 0;
     }
@@ -1521,8 +1532,7 @@ static void update_freq(void *arg, long period)
 //                fprintf(stderr, "wou_stepgen.c: gpio_%02d => (%d)\n", i,
 //                        *(machine_control->out[i]));
                 sync_cmd = SYNC_DOUT | PACK_IO_ID(i) | PACK_DO_VAL(*(machine_control->out[i]));
-                memcpy(data, &sync_cmd, sizeof(uint16_t));
-                wou_cmd(&w_param, WB_WR_CMD, (JCMD_BASE | JCMD_SYNC_CMD),sizeof(uint16_t), data);
+                wou_sfifo_put(&sfifo, &sync_cmd, 1);
             }
         }
         sync_out_data |= ((*(machine_control->out[i])) << i);
@@ -1533,13 +1543,6 @@ static void update_freq(void *arg, long period)
     /* point at stepgen data */
     stepgen = arg;
 
-#if (TRACE!=0)
-    _dt++;
-    if (*stepgen->enable) {
-        DPS("%11u", _dt);	// %11u: '#' + %10s
-    }
-#endif
-
     // in[0] == 1 (ESTOP released)
     // in[0] == 0 (ESTOP pressed)
     if (*(machine_control->in[0]) == 0) {
@@ -1567,8 +1570,8 @@ static void update_freq(void *arg, long period)
                                       / stepgen_array[(*machine_control->spindle_joint_id)].pos_scale);
             write_mot_param (n, (SSYNC_SCALE), immediate_data); // format: 16.16
             stepgen->prev_uu_per_rev = *stepgen->uu_per_rev;
-            DP("j[%d].SSYNC_SCALE: 0x%08X\n", n, immediate_data);
-            DP("spindle_joint_id(%d) uu_per_rev(%f) prev_uu_per_rev(%f)\n", *machine_control->spindle_joint_id, *stepgen->uu_per_rev, stepgen->prev_uu_per_rev);
+            DPT(trace, DPT_WOU_SSYNC_SCALE, n, immediate_data,
+                *stepgen->uu_per_rev, *machine_control->spindle_joint_id, 0);
         }
 
         if (*stepgen->bypass_lsp != stepgen->prev_bypass_lsp)
@@ -1590,7 +1593,7 @@ static void update_freq(void *arg, long period)
                 immediate_data = (n << 16) | (lsn << 8) | (lsp);
             }
             write_machine_param(JOINT_LSP_LSN, immediate_data);
-            while(wou_flush(&w_param) == -1);
+            wou_sfifo_wait(&sfifo);
             stepgen->prev_bypass_lsp = *stepgen->bypass_lsp;
         }
 
@@ -1613,7 +1616,7 @@ static void update_freq(void *arg, long period)
                 immediate_data = (n << 16) | (lsn << 8) | (lsp);
             }
             write_machine_param(JOINT_LSP_LSN, immediate_data);
-            while(wou_flush(&w_param) == -1);
+            wou_sfifo_wait(&sfifo);
             stepgen->prev_bypass_lsn = *stepgen->bypass_lsn;
         }
 
@@ -1647,7 +1650,9 @@ static void update_freq(void *arg, long period)
             /* in HAL, 若任何一軸的 *stepgen->enable 訊號忘了接，就會造成這個 assertion */
             assert (i == n); // confirm the JCMD_SYNC_CMD is packed with all joints
             i += 1;
-            wou_flush(&w_param);
+            if (!sfifo.hold) {
+                wou_flush(&w_param);
+            }
             wou_pos_cmd = 0;
             sync_cmd = SYNC_JNT | DIR_P | (POS_MASK & wou_pos_cmd);
 
@@ -1657,12 +1662,7 @@ static void update_freq(void *arg, long period)
 
             memcpy(data + (2*n+1) * sizeof(uint16_t), &sync_cmd,
                     sizeof(uint16_t));
-            if (n == (num_joints - 1)) {
-                // send to WOU when all axes commands are generated
-                wou_cmd(&w_param,
-                        WB_WR_CMD,
-                        (JCMD_BASE | JCMD_SYNC_CMD), 4 * num_joints, data);
-            }
+            jnt_delta[n] = 0;
 
             // maxvel must be >= 0.0, and may not be faster than 1 step per (steplen+stepspace) seconds
             {
@@ -1722,7 +1722,8 @@ static void update_freq(void *arg, long period)
             assert(*stepgen->risc_probe_pin < 64);
             assert(dbuf[2] != 0);
             stepgen->risc_probing = 1;
-            DP ("j[%d]: do risc-probing type(%d) pin(%d)\n", n, *stepgen->risc_probe_type, *stepgen->risc_probe_pin);
+            DPT(trace, DPT_WOU_PROBE, n, *stepgen->risc_probe_type,
+                *stepgen->risc_probe_pin, 0, 0);
         }
 
 //        if((*machine_control->trigger_enable != machine_control->prev_trigger_enable) &&
@@ -1762,9 +1763,8 @@ static void update_freq(void *arg, long period)
             {
                 (stepgen->prev_pos_cmd) = (*stepgen->pos_cmd);
                 stepgen->rawcount = stepgen->prev_pos_cmd * FIXED_POINT_SCALE * stepgen->pos_scale;
-                DP ("update_pos_ack(%d)\n", *machine_control->update_pos_ack);
-                DP ("j[%d], pos_cmd(%f) prev_pos_cmd(%f)\n",
-                        n, (*stepgen->pos_cmd), (stepgen->prev_pos_cmd));
+                DPT(trace, DPT_WOU_POS_UPDATE, n, *stepgen->pos_cmd,
+                    stepgen->rawcount, 0, 0);
             }
             *stepgen->vel_cmd = ((*stepgen->pos_cmd) - (stepgen->prev_pos_cmd));
 
@@ -1814,7 +1814,7 @@ static void update_freq(void *arg, long period)
             /* extract integer part of command */
             wou_pos_cmd = abs(integer_pos_cmd) >> FRACTION_BITS;
 
-            if(wou_pos_cmd >= 8192) {
+            if(!pack_jnt && wou_pos_cmd >= 8192) {
                 fprintf(stderr,"j(%d) pos_cmd(%f) prev_pos_cmd(%f) vel_cmd(%f)\n",
                         n ,
                         (*stepgen->pos_cmd), 
@@ -1824,57 +1824,39 @@ static void update_freq(void *arg, long period)
                 assert(0);
             }
 
-            // SYNC_JNT: opcode for SYNC_JNT command
-            // DIR_P: Direction, (positive(1), negative(0))
-            // POS_MASK: relative position mask
-
             // TODO: pack sync_cmd into single-32-bit-word for each joint
 
-            /* packing integer part of position command (16-bit) */
-            if (integer_pos_cmd >= 0) {
-                sync_cmd = SYNC_JNT | DIR_P | (POS_MASK & wou_pos_cmd);
-            } else {
-                sync_cmd = SYNC_JNT | DIR_N | (POS_MASK & wou_pos_cmd);
-            }
-            memcpy(data + (2 * n * sizeof(uint16_t)), &sync_cmd, sizeof(uint16_t));
-
-            /* packing fraction part (16-bit) */
-            wou_pos_cmd = (abs(integer_pos_cmd)) & FRACTION_MASK;
-            sync_cmd = (uint16_t) wou_pos_cmd;
-            memcpy(data + (2*n+1) * sizeof(uint16_t), &sync_cmd, sizeof(uint16_t));
+            /* packing integer and fraction part of position command */
+            wou_jnt_words(integer_pos_cmd, (uint16_t *) data + 2 * n);
 
+            jnt_delta[n] = integer_pos_cmd;
             stepgen->rawcount += (int64_t) integer_pos_cmd; // precision: 64.16
             stepgen->prev_pos_cmd = (((double)stepgen->rawcount * stepgen->scale_recip)/(FIXED_POINT_SCALE));
             stepgen->prev_vel_cmd = *stepgen->vel_cmd;
         }
 
-        if (n == (num_joints - 1)) {
-            // send to WOU when all axes commands are generated
-            wou_cmd(&w_param,
-                    WB_WR_CMD,
-                    (JCMD_BASE | JCMD_SYNC_CMD), 4 * num_joints, data);
-        }
-
-        DPS("       0x%08X%15.7f%15.7f%15.7f",
-                integer_pos_cmd,
-                (stepgen->prev_pos_cmd),
-                *stepgen->pos_fb,
-                *stepgen->risc_pos_cmd);
+        DPT(trace, DPT_WOU_JOINT, n, integer_pos_cmd, stepgen->prev_pos_cmd,
+            *stepgen->pos_fb, *stepgen->risc_pos_cmd);
 
         /* move on to next channel */
         stepgen++;
     }
 
-    sync_cmd = SYNC_EOF;
-    memcpy(data, &sync_cmd, sizeof(uint16_t));
-    wou_cmd(&w_param, WB_WR_CMD, (uint16_t) (JCMD_BASE | JCMD_SYNC_CMD), sizeof(uint16_t), data);
-
-#if (TRACE!=0)
-    stepgen = arg;
-    if (*(stepgen->enable)) {
-        DPS("\n");
+    // send to WOU when all axes commands are generated
+    if (pack_jnt) {
+        n = wou_pack_joints(num_joints, pack_prev, jnt_delta, (uint16_t *) data);
+        wou_sfifo_put(&sfifo, (uint16_t *) data, n);
+    } else {
+        wou_sfifo_put(&sfifo, (uint16_t *) data, 2 * num_joints);
+        sync_cmd = SYNC_EOF;
+        wou_sfifo_put(&sfifo, &sync_cmd, 1);
     }
-#endif
+    if (sfifo.hold) {
+        // one more period queued; send it now if the link takes it
+        sfifo.periods += 1;
+        wou_sfifo_drain(&sfifo);
+    }
+    *(machine_control->prebuf_periods) = sfifo.periods;
 
     /* restore saved message level */
     rtapi_set_msg_level(msg);
@@ -2135,6 +2117,13 @@ static int export_machine_control(machine_control_t * machine_control)
         return retval;
     }
 
+    retval = hal_pin_u32_newf(HAL_OUT, &(machine_control->prebuf_periods), comp_id,
+            "wou.prebuf-periods");
+    if (retval != 0) {
+        return retval;
+    }
+    *(machine_control->prebuf_periods) = 0;
+
     retval = hal_pin_bit_newf(HAL_OUT, &(machine_control->vel_sync), comp_id,
             "wou.motion.vel-sync");
     if (retval != 0) {
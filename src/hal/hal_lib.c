@@ -149,12 +149,33 @@ static void free_funct_entry_struct(hal_funct_entry_t * funct_entry);
 static void free_thread_struct(hal_thread_t * thread);
 #endif /* RTAPI */
 
+/** The name_hash_xxx() functions maintain the name hash described in
+    hal_priv.h.  'name_hash_add()' enters a pin, signal or parameter under
+    its name (and its original name, if it is aliased), 'name_hash_del()'
+    removes it again, and 'name_hash_find()' looks a name up.  'kind' is
+    one of HAL_HASH_PIN, HAL_HASH_SIG or HAL_HASH_PARAM.  Like the alloc
+    and free functions, they assume the caller has the hal_data mutex.
+*/
+static void name_hash_add(int kind, void *obj);
+static void name_hash_del(int kind, void *obj);
+static void *name_hash_find(int kind, const char *name);
+
 #ifdef RTAPI
 /** 'thread_task()' is a function that is invoked as a realtime task.
     It implements a thread, by running down the thread's function list
     and calling each function in turn.
 */
 static void thread_task(void *arg);
+
+/** 'thread_stats_start()' is called by 'thread_task()' at the start of
+    each run while the thread keeps stats.  It clears the stats when
+    they were just turned on, counts the start jitter, and returns the
+    width of a run time bucket in CPU clocks, or 0 while the period in
+    clocks is not known yet.  'stat_add()' counts one run time.
+*/
+static long int thread_stats_start(hal_thread_t * thread,
+    long long int now);
+static void stat_add(hal_stat_t * stat, long int value, long int width);
 #endif /* RTAPI */
 
 /***********************************************************************
@@ -662,6 +683,13 @@ int hal_pin_new(const char *name, hal_type_t type, hal_pin_dir_t dir,
 	    "HAL: ERROR: pin_new called after hal_ready\n");
 	return -EINVAL;
     }
+    /* the name must not be taken by another pin, or by an alias */
+    if (halpr_find_pin_by_name(name) != 0) {
+	rtapi_mutex_give(&(hal_data->mutex));
+	rtapi_print_msg(RTAPI_MSG_ERR,
+	    "HAL: ERROR: duplicate variable '%s'\n", name);
+	return -EINVAL;
+    }
     /* allocate a new variable structure */
     new = alloc_pin_struct();
     if (new == 0) {
@@ -689,6 +717,7 @@ int hal_pin_new(const char *name, hal_type_t type, hal_pin_dir_t dir,
 	    /* reached end of list, insert here */
 	    new->next_ptr = next;
 	    *prev = SHMOFF(new);
+	    name_hash_add(HAL_HASH_PIN, new);
 	    rtapi_mutex_give(&(hal_data->mutex));
 	    return 0;
 	}
@@ -698,6 +727,7 @@ int hal_pin_new(const char *name, hal_type_t type, hal_pin_dir_t dir,
 	    /* found the right place for it, insert here */
 	    new->next_ptr = next;
 	    *prev = SHMOFF(new);
+	    name_hash_add(HAL_HASH_PIN, new);
 	    rtapi_mutex_give(&(hal_data->mutex));
 	    return 0;
 	}
@@ -792,6 +822,8 @@ int hal_pin_alias(const char *pin_name, const char *alias)
 	prev = &(pin->next_ptr);
 	next = *prev;
     }
+    /* take it out of the hash under its current name(s) */
+    name_hash_del(HAL_HASH_PIN, pin);
     if ( alias != NULL ) {
 	/* adding a new alias */
 	if ( pin->oldname == 0 ) {
@@ -820,6 +852,7 @@ int hal_pin_alias(const char *pin_name, const char *alias)
 	    /* reached end of list, insert here */
 	    pin->next_ptr = next;
 	    *prev = SHMOFF(pin);
+	    name_hash_add(HAL_HASH_PIN, pin);
 	    rtapi_mutex_give(&(hal_data->mutex));
 	    return 0;
 	}
@@ -829,6 +862,7 @@ int hal_pin_alias(const char *pin_name, const char *alias)
 	    /* found the right place for it, insert here */
 	    pin->next_ptr = next;
 	    *prev = SHMOFF(pin);
+	    name_hash_add(HAL_HASH_PIN, pin);
 	    rtapi_mutex_give(&(hal_data->mutex));
 	    return 0;
 	}
@@ -938,6 +972,7 @@ int hal_signal_new(const char *name, hal_type_t type)
 	    /* reached end of list, insert here */
 	    new->next_ptr = next;
 	    *prev = SHMOFF(new);
+	    name_hash_add(HAL_HASH_SIG, new);
 	    rtapi_mutex_give(&(hal_data->mutex));
 	    return 0;
 	}
@@ -947,6 +982,7 @@ int hal_signal_new(const char *name, hal_type_t type)
 	    /* found the right place for it, insert here */
 	    new->next_ptr = next;
 	    *prev = SHMOFF(new);
+	    name_hash_add(HAL_HASH_SIG, new);
 	    rtapi_mutex_give(&(hal_data->mutex));
 	    return 0;
 	}
@@ -1305,6 +1341,13 @@ int hal_param_new(const char *name, hal_type_t type, hal_param_dir_t dir, void *
 	    "HAL: ERROR: param_new called after hal_ready\n");
 	return -EINVAL;
     }
+    /* the name must not be taken by another param, or by an alias */
+    if (halpr_find_param_by_name(name) != 0) {
+	rtapi_mutex_give(&(hal_data->mutex));
+	rtapi_print_msg(RTAPI_MSG_ERR,
+	    "HAL: ERROR: duplicate parameter '%s'\n", name);
+	return -EINVAL;
+    }
     /* allocate a new parameter structure */
     new = alloc_param_struct();
     if (new == 0) {
@@ -1328,6 +1371,7 @@ int hal_param_new(const char *name, hal_type_t type, hal_param_dir_t dir, void *
 	    /* reached end of list, insert here */
 	    new->next_ptr = next;
 	    *prev = SHMOFF(new);
+	    name_hash_add(HAL_HASH_PARAM, new);
 	    rtapi_mutex_give(&(hal_data->mutex));
 	    return 0;
 	}
@@ -1337,6 +1381,7 @@ int hal_param_new(const char *name, hal_type_t type, hal_param_dir_t dir, void *
 	    /* found the right place for it, insert here */
 	    new->next_ptr = next;
 	    *prev = SHMOFF(new);
+	    name_hash_add(HAL_HASH_PARAM, new);
 	    rtapi_mutex_give(&(hal_data->mutex));
 	    return 0;
 	}
@@ -1529,6 +1574,8 @@ int hal_param_alias(const char *param_name, const char *alias)
 	prev = &(param->next_ptr);
 	next = *prev;
     }
+    /* take it out of the hash under its current name(s) */
+    name_hash_del(HAL_HASH_PARAM, param);
     if ( alias != NULL ) {
 	/* adding a new alias */
 	if ( param->oldname == 0 ) {
@@ -1557,6 +1604,7 @@ int hal_param_alias(const char *param_name, const char *alias)
 	    /* reached end of list, insert here */
 	    param->next_ptr = next;
 	    *prev = SHMOFF(param);
+	    name_hash_add(HAL_HASH_PARAM, param);
 	    rtapi_mutex_give(&(hal_data->mutex));
 	    return 0;
 	}
@@ -1566,6 +1614,7 @@ int hal_param_alias(const char *param_name, const char *alias)
 	    /* found the right place for it, insert here */
 	    param->next_ptr = next;
 	    *prev = SHMOFF(param);
+	    name_hash_add(HAL_HASH_PARAM, param);
 	    rtapi_mutex_give(&(hal_data->mutex));
 	    return 0;
 	}
@@ -2271,78 +2320,17 @@ hal_comp_t *halpr_find_comp_by_name(const char *name)
 
 hal_pin_t *halpr_find_pin_by_name(const char *name)
 {
-    int next;
-    hal_pin_t *pin;
-    hal_oldname_t *oldname;
-
-    /* search pin list for 'name' */
-    next = hal_data->pin_list_ptr;
-    while (next != 0) {
-	pin = SHMPTR(next);
-	if (strcmp(pin->name, name) == 0) {
-	    /* found a match */
-	    return pin;
-	}
-	if (pin->oldname != 0 ) {
-	    oldname = SHMPTR(pin->oldname);
-	    if (strcmp(oldname->name, name) == 0) {
-		/* found a match */
-		return pin;
-	    }
-	}
-	/* didn't find it yet, look at next one */
-	next = pin->next_ptr;
-    }
-    /* if loop terminates, we reached end of list with no match */
-    return 0;
+    return name_hash_find(HAL_HASH_PIN, name);
 }
 
 hal_sig_t *halpr_find_sig_by_name(const char *name)
 {
-    int next;
-    hal_sig_t *sig;
-
-    /* search signal list for 'name' */
-    next = hal_data->sig_list_ptr;
-    while (next != 0) {
-	sig = SHMPTR(next);
-	if (strcmp(sig->name, name) == 0) {
-	    /* found a match */
-	    return sig;
-	}
-	/* didn't find it yet, look at next one */
-	next = sig->next_ptr;
-    }
-    /* if loop terminates, we reached end of list with no match */
-    return 0;
+    return name_hash_find(HAL_HASH_SIG, name);
 }
 
 hal_param_t *halpr_find_param_by_name(const char *name)
 {
-    int next;
-    hal_param_t *param;
-    hal_oldname_t *oldname;
-
-    /* search parameter list for 'name' */
-    next = hal_data->param_list_ptr;
-    while (next != 0) {
-	param = SHMPTR(next);
-	if (strcmp(param->name, name) == 0) {
-	    /* found a match */
-	    return param;
-	}
-	if (param->oldname != 0 ) {
-	    oldname = SHMPTR(param->oldname);
-	    if (strcmp(oldname->name, name) == 0) {
-		/* found a match */
-		return param;
-	    }
-	}
-	/* didn't find it yet, look at next one */
-	next = param->next_ptr;
-    }
-    /* if loop terminates, we reached end of list with no match */
-    return 0;
+    return name_hash_find(HAL_HASH_PARAM, name);
 }
 
 hal_thread_t *halpr_find_thread_by_name(const char *name)
@@ -2519,6 +2507,30 @@ hal_pin_t *halpr_find_pin_by_sig(hal_sig_t * sig, hal_pin_t * start)
     return 0;
 }
 
+int halpr_stat_percentile(hal_stat_t * stat, int permille)
+{
+    hal_u32_t target, count;
+    int n;
+
+    if (stat->runs == 0) {
+	return -1;
+    }
+    /* runs * permille / 1000, without overflowing 32 bits */
+    target = (stat->runs / 1000) * permille
+	+ ((stat->runs % 1000) * permille + 999) / 1000;
+    if (target == 0) {
+	target = 1;
+    }
+    count = 0;
+    for (n = 0; n < HAL_STAT_BUCKETS - 1; n++) {
+	count += stat->bucket[n];
+	if (count >= target) {
+	    break;
+	}
+    }
+    return n;
+}
+
 /***********************************************************************
 *                     LOCAL FUNCTION CODE                              *
 ************************************************************************/
@@ -2655,6 +2667,96 @@ void rtapi_app_exit(void)
 	"HAL_LIB: kernel lib removed successfully\n");
 }
 
+static void stat_clear(hal_stat_t * stat)
+{
+    int n;
+
+    stat->runs = 0;
+    stat->overruns = 0;
+    for (n = 0; n < HAL_STAT_BUCKETS; n++) {
+	stat->bucket[n] = 0;
+    }
+}
+
+static void stat_add(hal_stat_t * stat, long int value, long int width)
+{
+    long int n;
+
+    n = value / width;
+    if (n >= HAL_STAT_BUCKETS) {
+	n = HAL_STAT_BUCKETS - 1;
+	stat->overruns++;
+    } else if (n < 0) {
+	n = 0;
+    }
+    stat->bucket[n]++;
+    stat->runs++;
+}
+
+static long int thread_stats_start(hal_thread_t * thread, long long int now)
+{
+    hal_funct_entry_t *funct_root, *funct_entry;
+    hal_funct_t *funct;
+    long long int now_ns, diff;
+    long int interval, jitter;
+    int n;
+
+    now_ns = rtapi_get_time();
+    if (!thread->stats_on) {
+	/* stats were just turned on, start from scratch */
+	stat_clear(&(thread->run_stats));
+	stat_clear(&(thread->jitter_stats));
+	thread->jitter_max = 0;
+	thread->period_clocks = 0;
+	thread->last_clocks = 0;
+	funct_root = (hal_funct_entry_t *) & (thread->funct_list);
+	funct_entry = SHMPTR(funct_root->links.next);
+	while (funct_entry != funct_root) {
+	    funct = SHMPTR(funct_entry->funct_ptr);
+	    stat_clear(&(funct->stats));
+	    funct_entry = SHMPTR(funct_entry->links.next);
+	}
+	thread->stats_on = 1;
+    }
+    if (thread->last_clocks != 0) {
+	/* start jitter, in nsec; clamp so it fits a long on 32 bits */
+	diff = now_ns - thread->last_start - thread->period;
+	if (diff < 0) {
+	    diff = -diff;
+	}
+	if (diff > 0x3FFFFFFF) {
+	    diff = 0x3FFFFFFF;
+	}
+	jitter = (long int) diff;
+	if (jitter > thread->jitter_max) {
+	    thread->jitter_max = jitter;
+	}
+	n = 0;
+	while ((jitter >> (n + 1)) != 0 && n < HAL_STAT_BUCKETS - 1) {
+	    n++;
+	}
+	thread->jitter_stats.bucket[n]++;
+	thread->jitter_stats.runs++;
+	if (jitter >= thread->period) {
+	    thread->jitter_stats.overruns++;
+	}
+	/* track the period in CPU clocks, ignoring late starts */
+	diff = now - thread->last_clocks;
+	if (diff > 0 && diff < 0x3FFFFFFF) {
+	    interval = (long int) diff;
+	    if (thread->period_clocks == 0) {
+		thread->period_clocks = interval;
+	    } else if (interval < 2 * thread->period_clocks) {
+		thread->period_clocks +=
+		    (interval - thread->period_clocks) / 16;
+	    }
+	}
+    }
+    thread->last_start = now_ns;
+    thread->last_clocks = now;
+    return thread->period_clocks / HAL_STAT_BUCKETS;
+}
+
 /* this is the task function that implements threads in realtime */
 
 static void thread_task(void *arg)
@@ -2664,6 +2766,7 @@ static void thread_task(void *arg)
     hal_funct_entry_t *funct_root, *funct_entry;
     long long int start_time, end_time;
     long long int thread_start_time;
+    long int width;
 
     thread = arg;
     while (1) {
@@ -2675,6 +2778,13 @@ static void thread_task(void *arg)
 	    start_time = rtapi_get_clocks();
 	    end_time = start_time;
 	    thread_start_time = start_time;
+	    /* execution statistics, if turned on */
+	    width = 0;
+	    if (thread->stats) {
+		width = thread_stats_start(thread, start_time);
+	    } else {
+		thread->stats_on = 0;
+	    }
 	    /* run thru function list */
 	    while (funct_entry != funct_root) {
 		/* call the function */
@@ -2688,6 +2798,9 @@ static void thread_task(void *arg)
 		if (funct->runtime > funct->maxtime) {
 		    funct->maxtime = funct->runtime;
 		}
+		if (width > 0) {
+		    stat_add(&(funct->stats), funct->runtime, width);
+		}
 		/* point to next next entry in list */
 		funct_entry = SHMPTR(funct_entry->links.next);
 		/* prepare to measure time for next funct */
@@ -2698,6 +2811,12 @@ static void thread_task(void *arg)
 	    if (thread->runtime > thread->maxtime) {
 		thread->maxtime = thread->runtime;
 	    }
+	    if (width > 0) {
+		stat_add(&(thread->run_stats), thread->runtime, width);
+	    }
+	} else {
+	    /* don't count the time stopped as jitter */
+	    thread->last_clocks = 0;
 	}
 	/* wait until next period */
 	rtapi_wait();
@@ -2750,6 +2869,9 @@ static int init_hal_data(void)
     hal_data->shmem_bot = sizeof(hal_data_t);
     hal_data->shmem_top = HAL_SIZE;
     hal_data->lock = HAL_LOCK_NONE;
+    memset(hal_data->name_hash, 0, sizeof(hal_data->name_hash));
+    hal_data->name_hash_used = 0;
+    hal_data->name_hash_missing = 0;
     /* done, release mutex */
     rtapi_mutex_give(&(hal_data->mutex));
     return 0;
@@ -2865,6 +2987,7 @@ static hal_pin_t *alloc_pin_struct(void)
 	p->dir = 0;
 	p->signal = 0;
 	memset(&p->dummysig, 0, sizeof(hal_data_u));
+	p->oldname = 0;
 	p->name[0] = '\0';
     }
     return p;
@@ -2919,6 +3042,7 @@ static hal_param_t *alloc_param_struct(void)
 	p->data_ptr = 0;
 	p->owner_ptr = 0;
 	p->type = 0;
+	p->oldname = 0;
 	p->name[0] = '\0';
     }
     return p;
@@ -2972,6 +3096,7 @@ static hal_funct_t *alloc_funct_struct(void)
 	p->users = 0;
 	p->arg = 0;
 	p->funct = 0;
+	stat_clear(&(p->stats));
 	p->name[0] = '\0';
     }
     return p;
@@ -3028,6 +3153,14 @@ static hal_thread_t *alloc_thread_struct(void)
 	p->period = 0;
 	p->priority = 0;
 	p->task_id = 0;
+	p->stats = 0;
+	p->stats_on = 0;
+	p->last_start = 0;
+	p->last_clocks = 0;
+	p->period_clocks = 0;
+	p->jitter_max = 0;
+	stat_clear(&(p->run_stats));
+	stat_clear(&(p->jitter_stats));
 	list_init_entry(&(p->funct_list));
 	p->name[0] = '\0';
     }
@@ -3142,8 +3275,10 @@ static void free_pin_struct(hal_pin_t * pin)
 {
 
     unlink_pin(pin);
+    name_hash_del(HAL_HASH_PIN, pin);
     /* clear contents of struct */
     if ( pin->oldname != 0 ) free_oldname_struct(SHMPTR(pin->oldname));
+    pin->oldname = 0;
     pin->data_ptr_addr = 0;
     pin->owner_ptr = 0;
     pin->type = 0;
@@ -3168,6 +3303,7 @@ static void free_sig_struct(hal_sig_t * sig)
 	/* check for another pin linked to the signal */
 	pin = halpr_find_pin_by_sig(sig, pin);
     }
+    name_hash_del(HAL_HASH_SIG, sig);
     /* clear contents of struct */
     sig->data_ptr = 0;
     sig->type = 0;
@@ -3182,8 +3318,10 @@ static void free_sig_struct(hal_sig_t * sig)
 
 static void free_param_struct(hal_param_t * p)
 {
+    name_hash_del(HAL_HASH_PARAM, p);
     /* clear contents of struct */
     if ( p->oldname != 0 ) free_oldname_struct(SHMPTR(p->oldname));
+    p->oldname = 0;
     p->data_ptr = 0;
     p->owner_ptr = 0;
     p->type = 0;
@@ -3202,6 +3340,219 @@ static void free_oldname_struct(hal_oldname_t * oldname)
     hal_data->oldname_free_ptr = SHMOFF(oldname);
 }
 
+static unsigned int name_hash_slot(const char *name)
+{
+    unsigned int hash = 2166136261U;
+
+    /* FNV-1a */
+    while (*name != '\0') {
+	hash = (hash ^ (unsigned char) *name++) * 16777619U;
+    }
+    return hash % HAL_HASH_SIZE;
+}
+
+/* get the name(s) of the object in hash slot 'entry' */
+static void name_hash_names(int entry, char **name, char **oldname)
+{
+    void *obj;
+    int old;
+
+    obj = SHMPTR(entry & ~3);
+    switch (entry & 3) {
+    case HAL_HASH_PIN:
+	*name = ((hal_pin_t *) obj)->name;
+	old = ((hal_pin_t *) obj)->oldname;
+	break;
+    case HAL_HASH_SIG:
+	*name = ((hal_sig_t *) obj)->name;
+	old = 0;
+	break;
+    default:
+	*name = ((hal_param_t *) obj)->name;
+	old = ((hal_param_t *) obj)->oldname;
+	break;
+    }
+    if (old != 0) {
+	*oldname = ((hal_oldname_t *) SHMPTR(old))->name;
+    } else {
+	*oldname = 0;
+    }
+}
+
+/* put 'entry' in the chain for 'name', unless it is already in it */
+static void name_hash_insert(int entry, const char *name)
+{
+    unsigned int slot, n;
+    int *free_slot;
+
+    free_slot = 0;
+    slot = name_hash_slot(name);
+    for (n = 0; n < HAL_HASH_SIZE; n++) {
+	if (hal_data->name_hash[slot] == entry) {
+	    return;
+	}
+	if (hal_data->name_hash[slot] == HAL_HASH_DELETED && free_slot == 0) {
+	    /* re-use it, but keep looking for 'entry' */
+	    free_slot = &(hal_data->name_hash[slot]);
+	}
+	if (hal_data->name_hash[slot] == 0) {
+	    /* end of the chain */
+	    if (free_slot == 0) {
+		free_slot = &(hal_data->name_hash[slot]);
+		hal_data->name_hash_used++;
+	    }
+	    break;
+	}
+	slot = (slot + 1) % HAL_HASH_SIZE;
+    }
+    if (free_slot == 0) {
+	/* lookups walk the lists until the next rebuild gets it in */
+	rtapi_print_msg(RTAPI_MSG_DBG,
+	    "HAL: name hash full, can't enter '%s'\n", name);
+	hal_data->name_hash_missing = 1;
+	return;
+    }
+    *free_slot = entry;
+}
+
+static void name_hash_remove(int entry, const char *name)
+{
+    unsigned int slot, n;
+
+    slot = name_hash_slot(name);
+    for (n = 0; n < HAL_HASH_SIZE; n++) {
+	if (hal_data->name_hash[slot] == 0) {
+	    /* not in the hash */
+	    return;
+	}
+	if (hal_data->name_hash[slot] == entry) {
+	    /* mark it deleted, so the rest of the chain can still be found */
+	    hal_data->name_hash[slot] = HAL_HASH_DELETED;
+	    return;
+	}
+	slot = (slot + 1) % HAL_HASH_SIZE;
+    }
+}
+
+static void name_hash_enter(int kind, void *obj)
+{
+    int entry;
+    char *name, *oldname;
+
+    entry = SHMOFF(obj) | kind;
+    name_hash_names(entry, &name, &oldname);
+    name_hash_insert(entry, name);
+    if (oldname != 0) {
+	name_hash_insert(entry, oldname);
+    }
+}
+
+static void name_hash_add(int kind, void *obj)
+{
+    int next;
+    hal_pin_t *pin;
+    hal_sig_t *sig;
+    hal_param_t *param;
+
+    if (hal_data->name_hash_used >= HAL_HASH_SIZE / 4 * 3 ||
+	hal_data->name_hash_missing) {
+	/* chains are getting long, mostly with deleted slots after
+	   components were unloaded; build the hash again from the lists */
+	memset(hal_data->name_hash, 0, sizeof(hal_data->name_hash));
+	hal_data->name_hash_used = 0;
+	hal_data->name_hash_missing = 0;
+	for (next = hal_data->pin_list_ptr; next != 0; next = pin->next_ptr) {
+	    pin = SHMPTR(next);
+	    name_hash_enter(HAL_HASH_PIN, pin);
+	}
+	for (next = hal_data->sig_list_ptr; next != 0; next = sig->next_ptr) {
+	    sig = SHMPTR(next);
+	    name_hash_enter(HAL_HASH_SIG, sig);
+	}
+	for (next = hal_data->param_list_ptr; next != 0;
+	    next = param->next_ptr) {
+	    param = SHMPTR(next);
+	    name_hash_enter(HAL_HASH_PARAM, param);
+	}
+    }
+    name_hash_enter(kind, obj);
+}
+
+static void name_hash_del(int kind, void *obj)
+{
+    int entry;
+    char *name, *oldname;
+
+    entry = SHMOFF(obj) | kind;
+    name_hash_names(entry, &name, &oldname);
+    name_hash_remove(entry, name);
+    if (oldname != 0) {
+	name_hash_remove(entry, oldname);
+    }
+}
+
+/* look 'name' up the slow way, in the list for 'kind' */
+static void *name_hash_walk(int kind, const char *name)
+{
+    int next;
+    char *objname, *oldname;
+
+    if (kind == HAL_HASH_PIN) {
+	next = hal_data->pin_list_ptr;
+    } else if (kind == HAL_HASH_SIG) {
+	next = hal_data->sig_list_ptr;
+    } else {
+	next = hal_data->param_list_ptr;
+    }
+    while (next != 0) {
+	name_hash_names(next | kind, &objname, &oldname);
+	if (strcmp(objname, name) == 0 ||
+	    (oldname != 0 && strcmp(oldname, name) == 0)) {
+	    /* found a match */
+	    return SHMPTR(next);
+	}
+	/* didn't find it yet, look at next one */
+	if (kind == HAL_HASH_PIN) {
+	    next = ((hal_pin_t *) SHMPTR(next))->next_ptr;
+	} else if (kind == HAL_HASH_SIG) {
+	    next = ((hal_sig_t *) SHMPTR(next))->next_ptr;
+	} else {
+	    next = ((hal_param_t *) SHMPTR(next))->next_ptr;
+	}
+    }
+    return 0;
+}
+
+static void *name_hash_find(int kind, const char *name)
+{
+    unsigned int slot, n;
+    int entry;
+    char *objname, *oldname;
+
+    slot = name_hash_slot(name);
+    for (n = 0; n < HAL_HASH_SIZE; n++) {
+	entry = hal_data->name_hash[slot];
+	if (entry == 0) {
+	    /* end of the chain */
+	    break;
+	}
+	if (entry != HAL_HASH_DELETED && (entry & 3) == kind) {
+	    name_hash_names(entry, &objname, &oldname);
+	    if (strcmp(objname, name) == 0 ||
+		(oldname != 0 && strcmp(oldname, name) == 0)) {
+		/* found a match */
+		return SHMPTR(entry & ~3);
+	    }
+	}
+	slot = (slot + 1) % HAL_HASH_SIZE;
+    }
+    if (hal_data->name_hash_missing) {
+	/* not found, but it may be one of the names left out */
+	return name_hash_walk(kind, name);
+    }
+    return 0;
+}
+
 #ifdef RTAPI
 static void free_funct_struct(hal_funct_t * funct)
 {
@@ -3414,5 +3765,6 @@ EXPORT_SYMBOL(halpr_find_param_by_owner);
 EXPORT_SYMBOL(halpr_find_funct_by_owner);
 
 EXPORT_SYMBOL(halpr_find_pin_by_sig);
+EXPORT_SYMBOL(halpr_stat_percentile);
 
 #endif /* rtapi */
@@ -151,6 +151,26 @@ typedef struct {
     char name[HAL_NAME_LEN + 1];	/* the original name */
 } hal_oldname_t;
 
+/** HAL name hash.
+    Pins, signals and parameters are also entered in an open addressed
+    hash table, keyed on their name and, if they have been aliased, on
+    their original name, so the halpr_find_xxx_by_name() functions don't
+    have to walk the lists.  A slot holds the offset of the struct with
+    the kind of object in the two low bits (the structs are 4 byte
+    aligned), zero if the slot was never used, or HAL_HASH_DELETED.
+    Each name entered takes at least 56 bytes of shmem (a signal, or an
+    aliased pin or param and its oldname struct for its two names), so
+    with a slot per 32 bytes of HAL_SIZE live names stay under 3/5 of
+    the table, below the 3/4 that makes name_hash_add() rebuild it,
+    whatever HAL_SIZE is.
+*/
+#define HAL_SIZE		300000	/* size of HAL shmem, 1/8 is the table */
+#define HAL_HASH_SIZE		(HAL_SIZE / 32)	/* number of slots */
+#define HAL_HASH_DELETED	(-1)
+#define HAL_HASH_PIN		1
+#define HAL_HASH_SIG		2
+#define HAL_HASH_PARAM		3
+
 /* Master HAL data structure
    There is a single instance of this structure in the machine.
    It resides at the base of the HAL shared memory block, where it
@@ -190,6 +210,9 @@ typedef struct {
     int exact_base_period;      /* if set, pretend that rtapi satisfied our
 				   period request exactly */
     unsigned char lock;         /* hal locking, can be one of the HAL_LOCK_* types */
+    int name_hash_used;		/* slots in use or deleted */
+    int name_hash_missing;	/* non-zero if a name could not be entered */
+    int name_hash[HAL_HASH_SIZE];	/* pins, signals and params by name */
 } hal_data_t;
 
 /** HAL 'component' data structure.
@@ -267,6 +290,27 @@ typedef struct {
     that identify the functions connected to that thread.
 */
 
+/** HAL execution statistics.
+    While a thread's 'stats' flag is set (halcmd 'stats on'), the thread
+    keeps histograms of the run times of the thread and of each function
+    it calls, and of how far each start was from one period after the
+    previous one (the start jitter).  Run times are binned by the share
+    of the period they took: bucket i counts the runs that took
+    i/HAL_STAT_BUCKETS to (i+1)/HAL_STAT_BUCKETS of a period, and the
+    last bucket also gets the overruns.  Jitter is binned by powers of
+    two: bucket i counts the starts that were 2^i to 2^(i+1) nsec off
+    (bucket 0 also counts the exact ones), and an overrun is a start
+    that was off by a whole period.  Turning the stats on clears the
+    counts.
+*/
+#define HAL_STAT_BUCKETS 32
+
+typedef struct {
+    hal_u32_t runs;		/* number of runs counted */
+    hal_u32_t overruns;		/* runs that took a period or more */
+    hal_u32_t bucket[HAL_STAT_BUCKETS];	/* histogram */
+} hal_stat_t;
+
 typedef struct {
     int next_ptr;		/* next function in linked list */
     int uses_fp;		/* floating point flag */
@@ -277,6 +321,7 @@ typedef struct {
     void (*funct) (void *, long);	/* ptr to function code */
     hal_s32_t runtime;		/* duration of last run, in nsec */
     hal_s32_t maxtime;		/* duration of longest run, in nsec */
+    hal_stat_t stats;		/* run times, if the thread keeps stats */
     char name[HAL_NAME_LEN + 1];	/* function name */
 } hal_funct_t;
 
@@ -297,6 +342,14 @@ typedef struct {
     int task_id;		/* ID of the task that runs this thread */
     hal_s32_t runtime;		/* duration of last run, in nsec */
     hal_s32_t maxtime;		/* duration of longest run, in nsec */
+    int stats;			/* keep execution statistics */
+    int stats_on;		/* stats were on during the last run */
+    long long int last_start;	/* start of the last run, in nsec */
+    long long int last_clocks;	/* same, in CPU clocks */
+    long int period_clocks;	/* measured period, in CPU clocks */
+    hal_s32_t jitter_max;	/* worst start jitter, in nsec */
+    hal_stat_t run_stats;	/* run times of the thread */
+    hal_stat_t jitter_stats;	/* start jitter */
     hal_list_t funct_list;	/* list of functions to run */
     char name[HAL_NAME_LEN + 1];	/* thread name */
 } hal_thread_t;
@@ -324,8 +377,7 @@ typedef struct {
 */
 
 #define HAL_KEY   0x48414C32	/* key used to open HAL shared memory */
-#define HAL_VER   0x0000000C	/* version code */
-#define HAL_SIZE  262000
+#define HAL_VER   0x0000000E	/* version code */
 
 /* These pointers are set by hal_init() to point to the shmem block
    and to the master data structure. All access should use these
@@ -421,5 +473,11 @@ extern hal_funct_t *halpr_find_funct_by_owner(hal_comp_t * owner,
 */
 extern hal_pin_t *halpr_find_pin_by_sig(hal_sig_t * sig, hal_pin_t * start);
 
+/** 'stat_percentile()' returns the bucket of 'stat' that holds the
+    run at 'permille' thousandths of the counted runs, or -1 if none
+    were counted.  halcmd and halmodule use it to report percentiles.
+*/
+extern int halpr_stat_percentile(hal_stat_t * stat, int permille);
+
 RTAPI_END_DECLS
 #endif /* HAL_PRIV_H */
@@ -740,6 +740,92 @@ PyObject *component_is_ready(PyObject *self, PyObject *args) {
     return PyBool_FromLong(halpr_find_comp_by_name(name)->ready != NULL);
 }
 
+/* builds a dict from 'stat'; run time buckets are 'period' / 32 nsec
+   wide, jitter buckets ('log2' set) are powers of two */
+static PyObject *stat_to_dict(hal_stat_t *stat, long period, int log2) {
+    static const int permille[] = { 500, 900, 990, 999 };
+    PyObject *buckets = PyList_New(HAL_STAT_BUCKETS);
+    PyObject *percentiles = PyDict_New();
+    if(!buckets || !percentiles) {
+        Py_XDECREF(buckets);
+        Py_XDECREF(percentiles);
+        return NULL;
+    }
+    for(int i=0; i<HAL_STAT_BUCKETS; i++)
+        PyList_SET_ITEM(buckets, i, PyLong_FromUnsignedLong(stat->bucket[i]));
+    for(int i=0; i<4; i++) {
+        int n = halpr_stat_percentile(stat, permille[i]);
+        if(n < 0 || (!log2 && !period)) continue;
+        long long edge;
+        if(!log2) edge = (long long)period * (n + 1) / HAL_STAT_BUCKETS;
+        else edge = 1LL << (n + 1);
+        PyObject *k = PyInt_FromLong(permille[i]);
+        PyObject *v = PyLong_FromLongLong(edge);
+        PyDict_SetItem(percentiles, k, v);
+        Py_XDECREF(k);
+        Py_XDECREF(v);
+    }
+    return Py_BuildValue("{s:k,s:k,s:N,s:N}",
+            "runs", (unsigned long)stat->runs,
+            "overruns", (unsigned long)stat->overruns,
+            "buckets", buckets, "percentiles", percentiles);
+}
+
+PyObject *get_stats(PyObject *self, PyObject *args) {
+    char *name;
+    hal_thread_t *thread, thread_copy;
+    hal_funct_t *funct;
+    hal_stat_t funct_stats;
+    long period = 0;
+
+    if(!PyArg_ParseTuple(args, "s", &name)) return NULL;
+    if(!SHMPTR(0)) {
+	PyErr_Format(PyExc_RuntimeError,
+		"Cannot call before creating component");
+	return NULL;
+    }
+
+    // copy the counts out, so the mutex isn't held while building objects
+    rtapi_mutex_get(&(hal_data->mutex));
+    thread = halpr_find_thread_by_name(name);
+    if(thread) {
+        thread_copy = *thread;
+        rtapi_mutex_give(&(hal_data->mutex));
+        return Py_BuildValue("{s:l,s:N,s:l,s:N,s:N}",
+                "period", thread_copy.period,
+                "stats", PyBool_FromLong(thread_copy.stats),
+                "jitter_max", (long)thread_copy.jitter_max,
+                "run", stat_to_dict(&thread_copy.run_stats,
+                    thread_copy.period, 0),
+                "jitter", stat_to_dict(&thread_copy.jitter_stats, 0, 1));
+    }
+    funct = halpr_find_funct_by_name(name);
+    if(!funct) {
+        rtapi_mutex_give(&(hal_data->mutex));
+	PyErr_Format(PyExc_NameError,
+                "Thread or function `%s' does not exist", name);
+	return NULL;
+    }
+    funct_stats = funct->stats;
+    // the run time buckets depend on the period of the calling thread
+    int next = hal_data->thread_list_ptr;
+    while(next && !period) {
+        thread = (hal_thread_t*)SHMPTR(next);
+        hal_list_t *root = &(thread->funct_list);
+        for(hal_list_t *l = list_next(root); l != root; l = list_next(l)) {
+            if(SHMPTR(((hal_funct_entry_t*)l)->funct_ptr) == funct) {
+                period = thread->period;
+                break;
+            }
+        }
+        next = thread->next_ptr;
+    }
+    rtapi_mutex_give(&(hal_data->mutex));
+    // a function in no thread has no bucket width, so no percentiles
+    return Py_BuildValue("{s:l,s:N}", "period", period,
+            "run", stat_to_dict(&funct_stats, period, 0));
+}
+
 PyObject *new_sig(PyObject *self, PyObject *args) {
     char *name;
     int type,retval;
@@ -1057,6 +1143,8 @@ PyMethodDef module_methods[] = {
 	"Set the RTAPI message level"},
     {"get_msg_level", get_msg_level, METH_NOARGS,
 	"Get the RTAPI message level"},
+    {"get_stats", get_stats, METH_VARARGS,
+	"Return the execution statistics of a thread or function as a dict"},
     {"new_sig", new_sig, METH_VARARGS,
 	"create a signal"},
     {"connect", connect, METH_VARARGS,
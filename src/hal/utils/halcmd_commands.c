@@ -67,6 +67,7 @@ static void print_script_sig_info(int type, char **patterns);
 static void print_param_info(int type, char **patterns);
 static void print_funct_info(char **patterns);
 static void print_thread_info(char **patterns);
+static void print_stats_info(char **patterns);
 static void print_comp_names(char **patterns);
 static void print_pin_names(char **patterns);
 static void print_sig_names(char **patterns);
@@ -299,6 +300,38 @@ int do_stop_cmd(void) {
     return retval;
 }
 
+int do_stats_cmd(char *onoff, char **patterns) {
+    int next, on, count;
+    hal_thread_t *tptr;
+
+    if (strcmp(onoff, "on") == 0) {
+	on = 1;
+    } else if (strcmp(onoff, "off") == 0) {
+	on = 0;
+    } else {
+	halcmd_error("'stats' requires 'on' or 'off', not '%s'\n", onoff);
+	return -EINVAL;
+    }
+    count = 0;
+    rtapi_mutex_get(&(hal_data->mutex));
+    next = hal_data->thread_list_ptr;
+    while (next != 0) {
+	tptr = SHMPTR(next);
+	if ( match(patterns, tptr->name) ) {
+	    tptr->stats = on;
+	    count++;
+	}
+	next = tptr->next_ptr;
+    }
+    rtapi_mutex_give(&(hal_data->mutex));
+    if (count == 0) {
+	halcmd_error("no matching threads\n");
+	return -EINVAL;
+    }
+    halcmd_info("Statistics turned %s for %d thread(s)\n", onoff, count);
+    return 0;
+}
+
 int do_addf_cmd(char *func, char *thread, char **opt) {
     char *position_str = opt ? opt[0] : NULL;
     int position = -1;
@@ -979,6 +1012,8 @@ int do_show_cmd(char *type, char **patterns)
 	print_funct_info(patterns);
     } else if (strcmp(type, "thread") == 0) {
 	print_thread_info(patterns);
+    } else if (strcmp(type, "stats") == 0) {
+	print_stats_info(patterns);
     } else if (strcmp(type, "alias") == 0) {
 	print_pin_aliases(patterns);
 	print_param_aliases(patterns);
@@ -1897,6 +1932,81 @@ static void print_thread_info(char **patterns)
     halcmd_output("\n");
 }
 
+/* prints the runs, overruns and percentiles of 'stat'; 'period' is
+   the thread period for run times, or 0 for start jitter, whose
+   buckets are powers of two
+*/
+static void print_stat(const char *name, const char *kind,
+    hal_stat_t * stat, long period)
+{
+    static const int permille[] = { 500, 900, 990, 999 };
+    long edge[4];
+    int i, n;
+
+    for (i = 0; i < 4; i++) {
+	n = halpr_stat_percentile(stat, permille[i]);
+	if (n < 0) {
+	    edge[i] = 0;
+	} else if (period != 0) {
+	    /* upper edge of the bucket, in nsec */
+	    edge[i] = (long) (((long long) period * (n + 1)) / HAL_STAT_BUCKETS);
+	} else {
+	    edge[i] = (n < 30) ? (1L << (n + 1)) : 0x7FFFFFFFL;
+	}
+    }
+    if (scriptmode == 0) {
+	halcmd_output(" %-32s %-6s %10lu %8lu %9ld %9ld %9ld %9ld\n",
+	    name, kind, (unsigned long)stat->runs,
+	    (unsigned long)stat->overruns, edge[0], edge[1], edge[2], edge[3]);
+    } else {
+	halcmd_output("%s %s %lu %lu %ld %ld %ld %ld\n",
+	    name, kind, (unsigned long)stat->runs,
+	    (unsigned long)stat->overruns, edge[0], edge[1], edge[2], edge[3]);
+    }
+}
+
+static void print_stats_info(char **patterns)
+{
+    int next_thread;
+    hal_thread_t *tptr;
+    hal_list_t *list_root, *list_entry;
+    hal_funct_entry_t *fentry;
+    hal_funct_t *funct;
+
+    if (scriptmode == 0) {
+	halcmd_output("Execution Statistics (percentiles are upper bounds, in nsec):\n");
+	halcmd_output(" %-32s %-6s %10s %8s %9s %9s %9s %9s\n",
+	    "Name", "Kind", "Runs", "Overruns", "50%", "90%", "99%", "99.9%");
+    }
+    rtapi_mutex_get(&(hal_data->mutex));
+    next_thread = hal_data->thread_list_ptr;
+    while (next_thread != 0) {
+	tptr = SHMPTR(next_thread);
+	if ( match(patterns, tptr->name) ) {
+	    if (scriptmode == 0 && !tptr->stats) {
+		halcmd_output(" %-32s (stats off)\n", tptr->name);
+	    }
+	    print_stat(tptr->name, "run", &(tptr->run_stats), tptr->period);
+	    print_stat(tptr->name, "jitter", &(tptr->jitter_stats), 0);
+	    if (scriptmode == 0) {
+		halcmd_output(" %-32s %-6s %10s %8s %9ld\n", "", "max", "", "",
+		    (long)tptr->jitter_max);
+	    }
+	    list_root = &(tptr->funct_list);
+	    list_entry = list_next(list_root);
+	    while (list_entry != list_root) {
+		fentry = (hal_funct_entry_t *) list_entry;
+		funct = SHMPTR(fentry->funct_ptr);
+		print_stat(funct->name, "funct", &(funct->stats), tptr->period);
+		list_entry = list_next(list_entry);
+	    }
+	}
+	next_thread = tptr->next_ptr;
+    }
+    rtapi_mutex_give(&(hal_data->mutex));
+    halcmd_output("\n");
+}
+
 static void print_comp_names(char **patterns)
 {
     int next;
@@ -2743,10 +2853,12 @@ int do_help_cmd(char *command)
 	printf("show [type] [pattern]\n");
 	printf("  Prints info about HAL items of the specified type.\n");
 	printf("  'type' is 'comp', 'pin', 'sig', 'param', 'funct',\n");
-	printf("  'thread', or 'all'.  If 'type' is omitted, it assumes\n");
-	printf("  'all' with no pattern.  If 'pattern' is specified\n");
+	printf("  'thread', 'stats', or 'all'.  If 'type' is omitted, it\n");
+	printf("  assumes 'all' with no pattern.  If 'pattern' is specified\n");
 	printf("  it prints only those items whose names match the\n");
-	printf("  pattern, which may be a 'shell glob'.\n");
+	printf("  pattern, which may be a 'shell glob'.  'stats' prints\n");
+	printf("  the execution statistics of threads and their functions\n");
+	printf("  (see 'help stats').\n");
     } else if (strcmp(command, "list") == 0) {
 	printf("list type [pattern]\n");
 	printf("  Prints the names of HAL items of the specified type.\n");
@@ -2780,6 +2892,14 @@ int do_help_cmd(char *command)
     } else if (strcmp(command, "stop") == 0) {
 	printf("stop\n");
 	printf("  Stops all realtime threads.\n");
+    } else if (strcmp(command, "stats") == 0) {
+	printf("stats on|off [pattern]\n");
+	printf("  Turns execution statistics on or off for the threads whose\n");
+	printf("  names match 'pattern', or for all threads.  While they are\n");
+	printf("  on, a thread keeps histograms of its run time, of the run\n");
+	printf("  time of each of its functions, and of its start jitter.\n");
+	printf("  Turning them on clears the counts.  Use 'show stats' to\n");
+	printf("  print them.\n");
     } else if (strcmp(command, "quit") == 0) {
 	printf("quit\n");
 	printf("  Stop processing input and terminate halcmd (when\n");
@@ -2832,6 +2952,7 @@ static void print_help_commands(void)
     printf("  status              Display status information\n");
     printf("  save                Print config as commands\n");
     printf("  start, stop         Start/stop realtime threads\n");
+    printf("  stats               Turn thread execution statistics on/off\n");
     printf("  alias, unalias      Add or remove pin or parameter name aliases\n");
     printf("  quit, exit          Exit from halcmd\n");
 }
@@ -66,6 +66,7 @@ extern int do_gets_cmd(char *name);
 extern int do_ptype_cmd(char *name);
 extern int do_stype_cmd(char *name);
 extern int do_show_cmd(char *type, char **patterns);
+extern int do_stats_cmd(char *onoff, char **patterns);
 extern int do_list_cmd(char *type, char **patterns);
 extern int do_source_cmd(char *type);
 extern int do_status_cmd(char *type);
@@ -50,7 +50,7 @@ static const char *command_table[] = {
     "linkps", "linksp", "linkpp", "unlinkp",
     "net", "newsig", "delsig", "getp", "gets", "setp", "sets", "ptype", "stype",
     "addf", "delf", "show", "list", "status", "save", "source",
-    "start", "stop", "quit", "exit", "help", "alias", "unalias", 
+    "start", "stop", "stats", "quit", "exit", "help", "alias", "unalias", 
     NULL,
 };
 
@@ -65,7 +65,12 @@ static const char *alias_table[] = {
 };
 
 static const char *show_table[] = {
-    "all", "alias", "comp", "pin", "sig", "param", "funct", "thread",
+    "all", "alias", "comp", "pin", "sig", "param", "funct", "thread", "stats",
+    NULL,
+};
+
+static const char *stats_table[] = {
+    "on", "off",
     NULL,
 };
 
@@ -685,8 +690,14 @@ char **halcmd_completer(const char *text, int start, int end, hal_completer_func
                 result = func(text, funct_generator);
             } else if (startswith(n, "thread")) {
                 result = func(text, thread_generator);
+            } else if (startswith(n, "stats")) {
+                result = func(text, thread_generator);
             }
         }
+    } else if(startswith(buffer, "stats ") && argno == 1) {
+        result = completion_matches_table(text, stats_table, func);
+    } else if(startswith(buffer, "stats ") && argno == 2) {
+        result = func(text, thread_generator);
     } else if(startswith(buffer, "save ") && argno == 1) {
         result = completion_matches_table(text, save_table, func);
     } else if(startswith(buffer, "status ") && argno == 1) {
@@ -18,7 +18,12 @@
 #include <string.h>             /* strstr() */
 #include <ctype.h>              /* isspace() */
 #include <fcntl.h>
+#include <sys/stat.h>           /* fstat() */
 
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
 
 #include "config.h"
 #include "inifile.hh"
@@ -36,18 +41,56 @@ static bool check_line_endings(const char *s) {
                 warned = true;
                 continue;
             }
-            fprintf(stderr, "inifile: error: File contains ambiguous carriage returns\n");
             return true;
         }
     }
     return false;
 }
 
+
+/* The file is read once, on the first Find() after it is opened, and the
+   lookups go through this index instead of rereading it.  Lines are cut the
+   way fgets(line, LINELEN + 1) cut them, so line numbers and over-long lines
+   come out as before.  The last file indexed is kept, so that iniFind() and
+   friends, which make an IniFile per lookup, only read it once too. */
+struct IniFile::Index {
+    struct Line {
+        unsigned int            lineNo;
+        const char              *text;          /* first non-white char */
+        const char              *value;         /* after the '=', or NULL */
+    };
+
+    int                         refs;
+    dev_t                       dev;
+    ino_t                       ino;
+    off_t                       size;
+    time_t                      mtime;
+    long                        mtimeNsec;
+
+    char                        *buf;
+    std::vector<Line>           lines;          /* blank lines left out */
+    std::vector<int>            headers;        /* lines starting with '[' */
+    std::map<std::string, int>  sections;       /* "[name]" -> first header */
+    std::map<std::string, std::vector<int> > tags;
+    unsigned int                lastLineNo;
+    unsigned int                badLineNo;      /* first ambiguous CR, or 0 */
+
+    static Index                *last;
+
+    Index() : refs(1), buf(NULL), lastLineNo(0), badLineNo(0) {}
+    ~Index() { delete[] buf; }
+    void                        Release(void){ if(--refs == 0) delete this; }
+};
+
+IniFile::Index                  *IniFile::Index::last = NULL;
+
+
 IniFile::IniFile(int _errMask, FILE *_fp)
 {
     fp = _fp;
     errMask = _errMask;
     owned = false;
+    index = NULL;
 
     if(fp != NULL)
         LockFile();
@@ -97,6 +140,11 @@ IniFile::Close()
         fp = NULL;
     }
 
+    if(index != NULL){
+        index->Release();
+        index = NULL;
+    }
+
     return(rVal == 0);
 }
 
@@ -263,6 +311,114 @@ IniFile::Find(double *result, StrDoublePair *pPair,
 }
 
 
+/*! Reads the open file into an index, or takes the one of the last file
+   read if it is the same file and has not changed since. */
+void
+IniFile::LoadIndex(void)
+{
+    struct stat                 st;
+    bool                        cacheable;
+    Index                       *idx;
+    size_t                      size, n, len;
+    char                        *data, *out, *line, *nonWhite;
+    int                         newLinePos;
+
+    cacheable = fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode);
+    idx = Index::last;
+    if(cacheable && idx != NULL && idx->dev == st.st_dev
+       && idx->ino == st.st_ino && idx->size == st.st_size
+       && idx->mtime == st.st_mtime && idx->mtimeNsec == st.st_mtim.tv_nsec){
+        idx->refs++;
+        index = idx;
+        return;
+    }
+
+    /* slurp it */
+    size = cacheable && st.st_size > 0 ? st.st_size : BUFSIZ;
+    data = (char *)malloc(size);
+    n = 0;
+    rewind(fp);
+    while(data != NULL && (len = fread(data + n, 1, size - n, fp)) > 0){
+        n += len;
+        if(n == size)
+            data = (char *)realloc(data, size *= 2);
+    }
+
+    idx = new Index;
+    if(cacheable){
+        idx->dev = st.st_dev;
+        idx->ino = st.st_ino;
+        idx->size = st.st_size;
+        idx->mtime = st.st_mtime;
+        idx->mtimeNsec = st.st_mtim.tv_nsec;
+    }
+
+    /* each line gets its own terminator, so at worst twice the size */
+    out = idx->buf = new char[2 * n + 1];
+    for(size_t pos = 0; data != NULL && pos < n; pos += len){
+        for(len = 0; len < LINELEN && pos + len < n; )
+            if(data[pos + len++] == '\n')
+                break;
+
+        line = out;
+        memcpy(line, data + pos, len);
+        line[len] = 0;
+        out += len + 1;
+
+        if(check_line_endings(line) && idx->badLineNo == 0)
+            idx->badLineNo = idx->lastLineNo + 1;
+        idx->lastLineNo++;
+
+        newLinePos = strlen(line) - 1;
+        if(newLinePos >= 0 && line[newLinePos] == '\n')
+            line[newLinePos] = 0;
+
+        if(NULL == (nonWhite = SkipWhite(line)))
+            continue;
+
+        Index::Line l = { idx->lastLineNo, nonWhite, NULL };
+        int i = idx->lines.size();
+
+        if(nonWhite[0] == '['){
+            const char *close = strchr(nonWhite, ']');
+
+            idx->headers.push_back(i);
+            if(close != NULL)
+                idx->sections.insert(std::make_pair(
+                    std::string(nonWhite, close + 1 - nonWhite), i));
+        }
+
+        /* a tag is whatever comes before whitespace or '=' */
+        size_t tagLen = strcspn(nonWhite, " \r\t\n=");
+        if(nonWhite[tagLen] != 0){
+            char *valueString, *endValueString;
+
+            idx->tags[std::string(nonWhite, tagLen)].push_back(i);
+            if(NULL != (valueString = AfterEqual(nonWhite + tagLen))){
+                /* Eliminate white space at the end of a line also. */
+                endValueString = valueString + strlen(valueString) - 1;
+                while (*endValueString == ' ' || *endValueString == '\t'
+                       || *endValueString == '\r') {
+                    *endValueString = 0;
+                    endValueString--;
+                }
+            }
+            l.value = valueString;
+        }
+        idx->lines.push_back(l);
+    }
+    free(data);
+
+    if(cacheable){
+        if(Index::last != NULL)
+            Index::last->Release();
+        Index::last = idx;
+        idx->refs++;
+    }
+    index = idx;
+}
+
+
 /*! Finds the nth tag in section.
 
    @param tag Entry in the ini file to find.
@@ -275,16 +431,14 @@ IniFile::Find(double *result, StrDoublePair *pPair,
 const char *
 IniFile::Find(const char *_tag, const char *_section, int _num, int *lineno)
 {
-    // WTF, return a pointer to the middle of a local buffer?
     // FIX: this is totally non-reentrant.
     static char                 line[LINELEN + 2] = "";        /* 1 for newline, 1 for NULL */
     char                        bracketSection[LINELEN + 2] = "";
-    char                        *nonWhite;
-    int                         newLinePos;                /* position of newline to strip */
-    int                         len;
-    char                        tagEnd;
-    char                        *valueString;
-    char                        *endValueString;
+    const Index::Line           *found = NULL;
+    ErrorCode                   errCode = ERR_NONE;
+    int                         first, stop, i;
+    unsigned int                stopLineNo;
+    size_t                      len;
 
     // For exceptions.
     lineNo = 0;
@@ -296,132 +450,102 @@ IniFile::Find(const char *_tag, const char *_section, int _num, int *lineno)
     if(!CheckIfOpen())
         return(NULL);
 
-    /* start from beginning */
-    rewind(fp);
+    if(index == NULL)
+        LoadIndex();
 
-    /* check for section first-- if it's non-NULL, then position file at
-       line after [section] */
-    if(section != NULL){
-        sprintf(bracketSection, "[%s]", section);
+    const std::vector<Index::Line> &lines = index->lines;
 
-        /* find [section], and position fp just after it */
-        while (!feof(fp)) {
-
-            if (NULL == fgets(line, LINELEN + 1, fp)) {
-                /* got to end of file without finding it */
-                ThrowException(ERR_SECTION_NOT_FOUND);
-                return(NULL);
+    /* search the whole file, or from the line after [section] up to the
+       next section */
+    first = 0;
+    stop = lines.size();
+    stopLineNo = index->lastLineNo;
+    if(section != NULL){
+        snprintf(bracketSection, sizeof(bracketSection), "[%s]", section);
+        len = strlen(bracketSection);
+
+        i = -1;
+        if(strchr(section, ']') == NULL){
+            std::map<std::string, int>::const_iterator s =
+                index->sections.find(bracketSection);
+            if(s != index->sections.end())
+                i = s->second;
+        } else {
+            for(size_t h = 0; h < index->headers.size(); h++){
+                if(strncmp(bracketSection, lines[index->headers[h]].text,
+                           len) == 0){
+                    i = index->headers[h];
+                    break;
+                }
             }
+        }
 
-            if(check_line_endings(line)) {
-                ThrowException(ERR_CONVERSION);
-                return(NULL);
+        if(i < 0){
+            errCode = ERR_SECTION_NOT_FOUND;
+        } else {
+            std::vector<int>::const_iterator h = std::upper_bound(
+                index->headers.begin(), index->headers.end(), i);
+            first = i + 1;
+            if(h != index->headers.end()){
+                stop = *h;
+                stopLineNo = lines[stop].lineNo;
             }
+        }
+    }
 
-            /* got a line */
-            lineNo++;
-
-            /* strip off newline */
-            newLinePos = strlen(line) - 1;        /* newline is on back from 0 */
-            if (newLinePos < 0) {
-                newLinePos = 0;
-            }
-            if (line[newLinePos] == '\n') {
-                line[newLinePos] = 0;        /* make the newline 0 */
-            }
+    if(errCode == ERR_NONE){
+        int skip = _num > 1 ? _num - 1 : 0;
 
-            if (NULL == (nonWhite = SkipWhite(line))) {
-                /* blank line-- skip */
-                continue;
+        len = strlen(tag);
+        if(strcspn(tag, " \r\t\n=") == len){
+            std::map<std::string, std::vector<int> >::const_iterator t =
+                index->tags.find(tag);
+            if(t != index->tags.end()){
+                std::vector<int>::const_iterator m = std::lower_bound(
+                    t->second.begin(), t->second.end(), first);
+                if(t->second.end() - m > skip && m[skip] < stop)
+                    found = &lines[m[skip]];
             }
+        } else {
+            /* a tag with blanks in it can only be matched the long way */
+            for(i = first; i < stop; i++){
+                const char *nonWhite = lines[i].text;
+                char tagEnd;
 
-            /* not a blank line, and nonwhite is first char */
-            if (strncmp(bracketSection, nonWhite, strlen(bracketSection)) != 0){
-                /* not on this line */
-                continue;
+                if(strncmp(tag, nonWhite, len) != 0)
+                    continue;
+                tagEnd = nonWhite[len];
+                if ((tagEnd == ' ' || tagEnd == '\r' || tagEnd == '\t'
+                     || tagEnd == '\n' || tagEnd == '=') && skip-- == 0) {
+                    found = &lines[i];
+                    break;
+                }
             }
-
-            /* it matches-- fp is now set up for search on tag */
-            break;
         }
+        if(found != NULL)
+            stopLineNo = found->lineNo;
     }
 
-    while (!feof(fp)) {
-        /* check for end of file */
-        if (NULL == fgets(line, LINELEN + 1, (FILE *) fp)) {
-            /* got to end of file without finding it */
-            ThrowException(ERR_TAG_NOT_FOUND);
-            return(NULL);
-        }
-
-        if(check_line_endings(line)) {
-            ThrowException(ERR_CONVERSION);
-            return(NULL);
-        }
-
-        /* got a line */
-        lineNo++;
-
-        /* strip off newline */
-        newLinePos = strlen(line) - 1;        /* newline is on back from 0 */
-        if (newLinePos < 0) {
-            newLinePos = 0;
-        }
-        if (line[newLinePos] == '\n') {
-            line[newLinePos] = 0;        /* make the newline 0 */
-        }
-
-        /* skip leading whitespace */
-        if (NULL == (nonWhite = SkipWhite(line))) {
-            /* blank line-- skip */
-            continue;
-        }
-
-        /* check for '[' char-- if so, it's a section tag, and we're out
-           of our section */
-        if (NULL != section && nonWhite[0] == '[') {
-            ThrowException(ERR_TAG_NOT_FOUND);
-            return(NULL);
-        }
-
-        len = strlen(tag);
-        if (strncmp(tag, nonWhite, len) != 0) {
-            /* not on this line */
-            continue;
-        }
+    /* a bad line only matters if reading line by line would have got to it */
+    if(index->badLineNo != 0 && index->badLineNo <= stopLineNo){
+        fprintf(stderr, "inifile: error: File contains ambiguous carriage returns\n");
+        lineNo = index->badLineNo - 1;
+        ThrowException(ERR_CONVERSION);
+        return(NULL);
+    }
 
-        /* it matches the first part of the string-- if whitespace or = is
-           next char then call it a match */
-        tagEnd = nonWhite[len];
-        if (tagEnd == ' ' || tagEnd == '\r' || tagEnd == '\t'
-            || tagEnd == '\n' || tagEnd == '=') {
-            /* it matches-- return string after =, or NULL */
-            if (--_num > 0) {
-                /* Not looking for this one, so skip it... */
-                continue;
-            }
-            nonWhite += len;
-            valueString = AfterEqual(nonWhite);
-            /* Eliminate white space at the end of a line also. */
-            if (NULL == valueString) {
-                ThrowException(ERR_TAG_NOT_FOUND);
-                return(NULL);
-            }
-            endValueString = valueString + strlen(valueString) - 1;
-            while (*endValueString == ' ' || *endValueString == '\t'
-                   || *endValueString == '\r') {
-                *endValueString = 0;
-                endValueString--;
-            }
-	    if (lineno)
-		*lineno = lineNo;
-            return(valueString);
-        }
-        /* else continue */
+    lineNo = stopLineNo;
+    if(errCode == ERR_NONE && (found == NULL || found->value == NULL))
+        errCode = ERR_TAG_NOT_FOUND;
+    if(errCode != ERR_NONE){
+        ThrowException(errCode);
+        return(NULL);
     }
 
-    ThrowException(ERR_TAG_NOT_FOUND);
-    return(NULL);
+    strcpy(line, found->value);
+    if (lineno)
+        *lineno = lineNo;
+    return(line);
 }
 
 const char *
@@ -111,11 +111,19 @@ private:
     const char *                section;
     int                         num;
 
+    struct Index;
+    Index                       *index;
+
     bool                        CheckIfOpen(void);
+    void                        LoadIndex(void);
     bool                        LockFile(void);
     void                        ThrowException(ErrorCode);
     char                        *AfterEqual(const char *string);
     char                        *SkipWhite(const char *string);
+
+                                // The index is shared, not copied.
+                                IniFile(const IniFile &);
+    IniFile                     &operator=(const IniFile &);
 };
 #endif
 
@@ -352,6 +352,20 @@ RTAPI_BEGIN_DECLS
 */
     extern long long int rtapi_get_clocks(void);
 
+#if defined(SIM) && defined(RTAPI)
+/** 'rtapi_set_clock_hold' installs a function that the simulator's
+    virtual clock (SIM_RTAPI_CLOCK=virtual) calls before each tick.
+    While it returns non-zero, the clock stops and the user space
+    programs get the CPU, for at most SIM_RTAPI_HOLD_MS milliseconds;
+    after that, the same non-zero value no longer holds it.  A module
+    returns a value that changes whenever user space makes progress.
+    Calling it with NULL removes the function.  Call from init/cleanup
+    code only.
+*/
+    typedef long (*rtapi_clock_hold_t)(void);
+    extern void rtapi_set_clock_hold(rtapi_clock_hold_t hold);
+#endif
+
 
 /***********************************************************************
 *                     TASK RELATED FUNCTIONS                           *
@@ -0,0 +1,20 @@
+#ifndef RTAPI_ATOMIC_H
+#define RTAPI_ATOMIC_H
+
+/* memory barriers for lock-free structures shared between realtime
+   code and user space, e.g. single producer/single consumer rings:
+   the producer fills an entry, rtapi_smp_wmb(), then advances its index;
+   the consumer reads the index, rtapi_smp_rmb(), then reads the entry */
+
+#ifdef __KERNEL__
+#include <asm/system.h>
+#define rtapi_smp_mb() smp_mb()
+#define rtapi_smp_rmb() smp_rmb()
+#define rtapi_smp_wmb() smp_wmb()
+#else
+#define rtapi_smp_mb() __sync_synchronize()
+#define rtapi_smp_rmb() __sync_synchronize()
+#define rtapi_smp_wmb() __sync_synchronize()
+#endif
+
+#endif
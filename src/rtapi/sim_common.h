@@ -192,15 +192,26 @@ int rtapi_get_msg_level() {
 
 long long rtapi_get_time(void) {
     struct timeval tv;
+#ifdef SIM_VIRTUAL_CLOCK
+    /* see sim_rtapi.c */
+    if(virtual_clock) return virtual_time;
+#endif
     gettimeofday(&tv, 0);
     return tv.tv_sec * 1000 * 1000 * 1000 + tv.tv_usec * 1000;
 }
 
 #ifdef MSR_H_USABLE
 #include <asm/msr.h>
-#elif defined(__i386__) || defined(__x86_64__)
+#elif defined(__i386__)
 #define rdtscll(val) \
          __asm__ __volatile__("rdtsc" : "=A" (val))
+#elif defined(__x86_64__)
+/* "=A" is rax or rdx here, not edx:eax, so put the halves together */
+#define rdtscll(val) do { \
+         unsigned int __a, __d; \
+         __asm__ __volatile__("rdtsc" : "=a" (__a), "=d" (__d)); \
+         (val) = ((unsigned long long) __d << 32) | __a; \
+     } while (0)
 #else
 #warning No implementation of rtapi_get_clocks available
 #define rdtscll(val) (val)=0
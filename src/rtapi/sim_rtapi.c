@@ -11,10 +11,14 @@
 * Last change: 
 ********************************************************************/
 
+#define _GNU_SOURCE		/* CPU_SET(), pthread_setaffinity_np() */
 #include <stdio.h>		/* vprintf() */
 #include <stdlib.h>		/* malloc(), sizeof() */
+#include <limits.h>		/* PTHREAD_STACK_MIN */
 #include <stdarg.h>		/* va_* */
 #include <pth.h>		/* pth_uctx_* */
+#include <pthread.h>		/* pthread_* */
+#include <sched.h>		/* sched_*, cpu_set_t */
 #include <unistd.h>		/* usleep() */
 #include <sys/ipc.h>		/* IPC_* */
 #include <sys/shm.h>		/* shmget() */
@@ -41,12 +45,96 @@ struct rtapi_task {
   int ratio;
   void *arg;
   void (*taskcode) (void*);	/* pointer to task function */
+  pthread_t thread;		/* POSIX thread, when not cooperative */
+  int started;			/* the POSIX thread exists */
+  volatile int stop;		/* ask the POSIX thread to exit */
+  long long deadline;		/* its next wakeup, in monotonic nsec */
 };
 
 static struct timeval schedule;
 static int base_periods;
 static pth_uctx_t main_ctx, this_ctx;
 
+/* Tasks run either as pth user contexts, which sim_rtapi_run_threads()
+   switches to in turn from the main thread (the default), or, with
+   SIM_RTAPI_THREADS=posix in the environment, as POSIX threads that
+   sleep until absolute deadlines and run in parallel on the CPUs that
+   rtapi_app may use.  The latter need root for realtime priority. */
+static int posix_threads = -1;
+static long long posix_epoch;
+static __thread struct rtapi_task *this_task;
+
+/* With SIM_RTAPI_CLOCK=virtual, rtapi_get_time() returns a virtual
+   time that advances by exactly one base period per tick, and the
+   ticks run back to back instead of waiting for the wall clock, so a program runs through motion as fast as the CPU allows.
+   SIM_RTAPI_SPEEDUP=n limits that to n times real time, for when the
+   user space side (task, the interpreter) must keep up.  Between ticks
+   rtapi_app still answers halcmd, and the tasks run in the same order
+   every tick, so runs are repeatable.  The virtual clock needs the
+   cooperative tasks.  rtapi_get_clocks() keeps reading the CPU clock,
+   so the HAL thread and function times stay real.
+
+   A module may install a clock hold (motion does, while its queue runs
+   short): as long as it returns non-zero, no tick runs and user space
+   gets the CPU, but for at most SIM_RTAPI_HOLD_MS (default 100) ms per
+   value it returns, so a user space program that waits for motion
+   cannot stop the clock for good.  sim_common.h reads these: */
+#define SIM_VIRTUAL_CLOCK
+static int virtual_clock;
+static long long virtual_time;
+static int virtual_speedup;
+static long long virtual_start, virtual_real_start;
+static rtapi_clock_hold_t clock_hold;
+static long long hold_max = 100000000LL;
+static long long hold_since;
+static long hold_expired;
+
+static long long monotonic_ns(void);
+
+static void check_clock_mode(void)
+{
+  static int checked = 0;
+  const char *mode = getenv("SIM_RTAPI_CLOCK");
+  const char *speedup = getenv("SIM_RTAPI_SPEEDUP");
+  const char *hold = getenv("SIM_RTAPI_HOLD_MS");
+
+  if(checked) return;
+  checked = 1;
+  virtual_clock = (mode && strcmp(mode, "virtual") == 0);
+  virtual_speedup = speedup ? atoi(speedup) : 0;
+  if(virtual_speedup < 0) virtual_speedup = 0;
+  if(hold && atoi(hold) >= 0) hold_max = atoi(hold) * 1000000LL;
+}
+
+void rtapi_set_clock_hold(rtapi_clock_hold_t hold)
+{
+  clock_hold = hold;
+  hold_since = 0;
+  hold_expired = 0;
+}
+
+static int use_posix_threads(void)
+{
+  if(posix_threads < 0) {
+    const char *mode = getenv("SIM_RTAPI_THREADS");
+    check_clock_mode();
+    posix_threads = (mode && strcmp(mode, "posix") == 0);
+    if(posix_threads && virtual_clock) {
+      rtapi_print_msg(RTAPI_MSG_ERR,
+	      "virtual clock: ignoring SIM_RTAPI_THREADS=posix\n");
+      posix_threads = 0;
+    }
+  }
+  return posix_threads;
+}
+
+static long long monotonic_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 #define MODULE_MAGIC  30812
 #define TASK_MAGIC    21979	/* random numbers used as signatures */
 #define SHMEM_MAGIC   25453
@@ -104,6 +192,16 @@ int rtapi_clock_set_period(unsigned long int nsecs)
   }
   period = nsecs;
   gettimeofday(&schedule, NULL);
+  posix_epoch = monotonic_ns();
+  check_clock_mode();
+  if(virtual_clock) {
+    /* start from the wall clock, so absolute times still look sane */
+    virtual_time = schedule.tv_sec * 1000000000LL + schedule.tv_usec * 1000LL;
+    virtual_start = virtual_time;
+    virtual_real_start = posix_epoch;
+    rtapi_print_msg(RTAPI_MSG_INFO, "virtual clock, speedup %d\n",
+	    virtual_speedup);
+  }
   return period;
 }
 
@@ -140,6 +238,8 @@ int rtapi_task_new(void (*taskcode) (void*), void *arg,
   task->stacksize = stacksize;
   task->taskcode = taskcode;
   task->prio = prio;
+  task->started = 0;
+  task->stop = 0;
 
   /* and return handle to the caller */
 
@@ -147,6 +247,17 @@ int rtapi_task_new(void (*taskcode) (void*), void *arg,
 }
 
 
+static void posix_task_stop(struct rtapi_task *task)
+{
+  if(!task->started) return;
+  /* the thread exits the next time it calls rtapi_wait() */
+  task->stop = 1;
+  if(!pthread_equal(task->thread, pthread_self()))
+    pthread_join(task->thread, NULL);
+  task->started = 0;
+}
+
+
 int rtapi_task_delete(int id) {
   struct rtapi_task *task;
 
@@ -157,7 +268,10 @@ int rtapi_task_delete(int id) {
   if (task->magic != TASK_MAGIC)
     return -EINVAL;
 
-  pth_uctx_destroy(task->ctx);
+  if(use_posix_threads())
+    posix_task_stop(task);
+  else
+    pth_uctx_destroy(task->ctx);
   
   task->magic = 0;
   return 0;
@@ -182,6 +296,58 @@ static void wrapper(void *arg)
 }
 
 
+/* Pin the calling task to one CPU, round robin by task number.  When
+   rtapi_app may use more than two CPUs, the first is left to its main
+   thread and to the user space programs. */
+static void posix_task_pin(struct rtapi_task *task)
+{
+  cpu_set_t allowed, cpus;
+  int n, cpu, count, first;
+
+  if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+  count = CPU_COUNT(&allowed);
+  if(count < 2) return;
+  first = (count > 2) ? 1 : 0;
+  n = first + (task - task_array) % (count - first);
+  for(cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if(CPU_ISSET(cpu, &allowed) && n-- == 0) break;
+  }
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  if(pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0)
+    rtapi_print_msg(RTAPI_MSG_INFO, "task %d on cpu %d\n",
+	    (int)(task - task_array), cpu);
+}
+
+static void *posix_wrapper(void *arg)
+{
+  struct rtapi_task *task;
+  struct sched_param param;
+  long long now;
+
+  task = (struct rtapi_task*)arg;
+  this_task = task;
+  posix_task_pin(task);
+  param.sched_priority = sched_get_priority_max(SCHED_FIFO) - task->prio;
+  if(pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+    rtapi_print_msg(RTAPI_MSG_INFO,
+	    "task %d runs without realtime priority\n",
+	    (int)(task - task_array));
+
+  /* start in step with the other tasks, at a multiple of the period
+     since the clock was set */
+  now = monotonic_ns();
+  task->deadline = posix_epoch
+      + (now - posix_epoch) / task->period * task->period;
+  rtapi_wait();
+
+  (task->taskcode) (task->arg);
+
+  rtapi_print("ERROR: reached end of wrapper for task %d\n", (int)(task - task_array));
+  return NULL;
+}
+
+
 int rtapi_task_start(int task_id, unsigned long int period_nsec)
 {
   struct rtapi_task *task;
@@ -199,6 +365,20 @@ int rtapi_task_start(int task_id, unsigned long int period_nsec)
   task->period = period_nsec;
   task->ratio = period_nsec / period;
 
+  if(use_posix_threads()) {
+    pthread_attr_t attr;
+    if(task->stacksize < PTHREAD_STACK_MIN) task->stacksize = PTHREAD_STACK_MIN;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, task->stacksize);
+    task->stop = 0;
+    retval = pthread_create(&task->thread, &attr, posix_wrapper, (void*)task);
+    pthread_attr_destroy(&attr);
+    if (retval != 0)
+      return -retval;
+    task->started = 1;
+    return 0;
+  }
+
   /* create the thread - use the wrapper function, pass it a pointer
      to the task structure so it can call the actual task function */
   retval = pth_uctx_create(&task->ctx);
@@ -224,7 +404,10 @@ int rtapi_task_stop(int task_id)
   if (task->magic != TASK_MAGIC)
     return -EINVAL;
 
-  pth_uctx_destroy(task->ctx);
+  if(use_posix_threads())
+    posix_task_stop(task);
+  else
+    pth_uctx_destroy(task->ctx);
 
   return 0;
 }
@@ -275,8 +458,32 @@ int rtapi_task_set_period(int task_id,
   return 0;
 }
 
+static void posix_wait(struct rtapi_task *task)
+{
+  struct timespec ts;
+  long long now;
+
+  if(task->stop) pthread_exit(NULL);
+  task->deadline += task->period;
+  now = monotonic_ns();
+  if(now - task->deadline > 10000000000LL) {
+    // Stopped in the debugger or similar; don't play catch-up
+    rtapi_print_msg(RTAPI_MSG_DBG, "Long pause, resetting schedule\n");
+    task->deadline = now;
+  }
+  ts.tv_sec = task->deadline / 1000000000LL;
+  ts.tv_nsec = task->deadline % 1000000000LL;
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    ;
+  if(task->stop) pthread_exit(NULL);
+}
+
 int rtapi_wait(void)
 {
+  if(this_task) {
+    posix_wait(this_task);
+    return 0;
+  }
   pth_uctx_switch(this_ctx, main_ctx);
   return 0;
 }
@@ -298,10 +505,70 @@ long int simple_strtol(const char *nptr, char **endptr, int base) {
 
 #define MIN_RUNS 13
 
+/* While the clock hold asks for it, don't tick: give the CPU to user
+   space in short naps, still answering halcmd.  Returns like select() */
+static int virtual_hold(int fd) {
+    struct timeval interval;
+    long hold;
+    fd_set fds;
+    int result;
+
+    while(clock_hold && (hold = clock_hold()) != 0 && hold != hold_expired) {
+	if(hold_since == 0) {
+	    hold_since = monotonic_ns();
+	} else if(monotonic_ns() - hold_since > hold_max) {
+	    hold_expired = hold;
+	    break;
+	}
+	interval.tv_sec = 0;
+	interval.tv_usec = 200;
+	FD_ZERO(&fds);
+	FD_SET(fd, &fds);
+	result = select(fd+1, &fds, NULL, NULL, &interval);
+	if(result) return result;
+    }
+    hold_since = 0;
+    return 0;
+}
+
+/* In virtual time, ticks run back to back unless the clock is held;
+   every MIN_RUNS ticks, look for a command and, if there is a speedup
+   limit, wait for the wall clock to catch up with it */
+static int virtual_sleep(int fd) {
+    struct timeval interval;
+    long long ahead;
+    fd_set fds;
+    int result;
+
+    result = virtual_hold(fd);
+    if(result) return result;
+    if(base_periods % MIN_RUNS) return 0;
+    interval.tv_sec = 0;
+    interval.tv_usec = 0;
+    if(virtual_speedup > 0) {
+	ahead = (virtual_time - virtual_start) / virtual_speedup
+	    - (monotonic_ns() - virtual_real_start);
+	if(ahead > 1000) {
+	    interval.tv_sec = ahead / 1000000000LL;
+	    interval.tv_usec = (ahead % 1000000000LL) / 1000;
+	}
+    } else {
+	/* let the user space programs in, on a busy or single CPU */
+	sched_yield();
+    }
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+
+    return select(fd+1, &fds, NULL, NULL, &interval);
+}
+
 static int maybe_sleep(int fd) {
     struct timeval now;
     struct timeval interval;
 
+    if(period != 0 && virtual_clock) {
+	return virtual_sleep(fd);
+    }
     if(period == 0) {
 	fd_set fds;
 	FD_ZERO(&fds);
@@ -351,6 +618,14 @@ static int maybe_sleep(int fd) {
 
 int sim_rtapi_run_threads(int fd) {
     static int first_time = 1;
+    if(use_posix_threads()) {
+	/* the tasks run on their own, just wait for a command */
+	fd_set fds;
+	FD_ZERO(&fds);
+	FD_SET(fd, &fds);
+
+	return select(fd+1, &fds, NULL, NULL, NULL);
+    }
     if(first_time) {
 	int result = pth_uctx_create(&main_ctx);
 	if(result == FALSE) _exit(1);
@@ -365,6 +640,7 @@ int sim_rtapi_run_threads(int fd) {
 	if(period) {
 	    int t;
 	    base_periods++;
+	    virtual_time += period;
 	    for(t=0; t<MAX_TASKS; t++) {
 		struct rtapi_task *task = &task_array[t];
 		if(task->magic == TASK_MAGIC && task->ctx && 
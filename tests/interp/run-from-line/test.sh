@@ -0,0 +1,11 @@
+#!/bin/bash
+rm -rf checkpoints empty
+mkdir empty
+# checkpoints taken with the old tool table
+rs274 -i checkpoint.ini -t old.tbl -g test.ngc > /dev/null || exit 1
+test -n "$(ls checkpoints)" || exit 1
+rs274 -i checkpoint.ini -t test.tbl -r 18 -g test.ngc | awk '{$1=""; print}' > restored
+rs274 -i empty.ini -t test.tbl -r 18 -g test.ngc | awk '{$1=""; print}' > reread
+diff -u reread restored >&2 || exit 1
+cat restored
+rm -rf checkpoints empty restored reread
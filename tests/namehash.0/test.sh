@@ -0,0 +1,60 @@
+#!/bin/sh
+# The name hash is rebuilt when 3/4 of its slots are used or deleted;
+# creating and deleting a signal 14000 times gets it there at least once.
+DIR=`mktemp -d /tmp/namehash.XXXXXX`
+trap "rm -rf $DIR" 0 1 2 3 15
+
+cat > $DIR/test.hal <<'HAL'
+loadrt and2 count=2
+loadrt near count=1
+newsig keep-bit bit
+newsig keep-float float
+alias pin and2.0.in0 gate-a
+alias param near.0.scale near-scale
+setp gate-a TRUE
+setp near-scale 2.5
+net keep-bit and2.0.in1
+sets keep-bit TRUE
+net keep-float near.0.in1
+sets keep-float -1.25
+HAL
+
+awk 'BEGIN { for (i = 0; i < 14000; i++)
+    printf "newsig churn%d float\ndelsig churn%d\n", i, i }' >> $DIR/test.hal
+
+cat >> $DIR/test.hal <<'HAL'
+getp gate-a
+getp and2.0.in0
+getp near-scale
+getp near.0.scale
+gets keep-bit
+getp and2.0.in1
+getp near.0.in1
+
+unalias pin and2.0.in0
+alias pin and2.1.in0 gate-a
+getp gate-a
+getp and2.0.in0
+
+unload near
+loadrt near count=1
+alias param near.0.difference near-scale
+setp near-scale 0.5
+getp near.0.difference
+getp near.0.scale
+gets keep-float
+delsig keep-float
+newsig keep-float s32
+sets keep-float -7
+gets keep-float
+
+unload and2
+loadrt and2 count=1
+alias pin and2.0.in0 gate-a
+setp gate-a TRUE
+getp and2.0.in0
+getp and2.0.in1
+gets keep-bit
+HAL
+
+halrun -f $DIR/test.hal
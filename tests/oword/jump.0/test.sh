@@ -0,0 +1,5 @@
+#!/bin/bash
+for f in jump.ngc nojump.ngc; do
+    rs274 -i test.ini -g $f | awk '{$1=""; print}'
+    test ${PIPESTATUS[0]} = 0 || exit 1
+done
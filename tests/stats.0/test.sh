@@ -0,0 +1,27 @@
+#!/bin/sh
+realtime start
+halcmd -f <<'HAL'
+setexact_for_test_suite_only
+loadrt threads name1=fast period1=100000 name2=slow period2=1000000
+loadrt threadtest count=1
+addf threadtest.0.increment fast
+addf threadtest.0.reset slow
+stats on
+start
+loadusr -w sleep 1
+stop
+HAL
+halcmd -s show stats
+python <<'PY'
+import hal
+h = hal.component("statstest")
+for name in ("fast", "slow", "threadtest.0.increment", "threadtest.0.reset"):
+    s = hal.get_stats(name)
+    for kind in ("run", "jitter"):
+        if kind not in s: continue
+        k = s[kind]
+        print "get_stats", name, kind, k["runs"], sum(k["buckets"]), \
+            len(k["percentiles"])
+h.exit()
+PY
+realtime stop
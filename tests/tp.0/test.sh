@@ -0,0 +1,2 @@
+#!/bin/sh
+tp_bench